@@ -126,6 +126,12 @@ public:
         }
     }
 
+    void shrink(size_t size)
+    {
+        ASSERT(size <= m_size);
+        m_size = size;
+    }
+
     void fill(bool value)
     {
         __builtin_memset(m_data, value ? 0xff : 0x00, size_in_bytes());
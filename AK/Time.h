@@ -50,7 +50,19 @@ inline void timeval_add(const TimevalType& a, const TimevalType& b, TimevalType&
     }
 }
 
+template<typename TimespecType>
+inline void timespec_sub(const TimespecType& a, const TimespecType& b, TimespecType& result)
+{
+    result.tv_sec = a.tv_sec - b.tv_sec;
+    result.tv_nsec = a.tv_nsec - b.tv_nsec;
+    if (result.tv_nsec < 0) {
+        --result.tv_sec;
+        result.tv_nsec += 1000000000;
+    }
+}
+
 }
 
+using AK::timespec_sub;
 using AK::timeval_add;
 using AK::timeval_sub;
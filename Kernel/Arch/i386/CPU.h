@@ -193,6 +193,8 @@ public:
         UserSupervisor = 1 << 2,
         WriteThrough = 1 << 3,
         CacheDisabled = 1 << 4,
+        Accessed = 1 << 5,
+        Dirty = 1 << 6,
         Global = 1 << 8,
         NoExecute = 0x8000000000000000ULL,
     };
@@ -215,6 +217,12 @@ public:
     bool is_global() const { return raw() & Global; }
     void set_global(bool b) { set_bit(Global, b); }
 
+    bool is_accessed() const { return raw() & Accessed; }
+    void set_accessed(bool b) { set_bit(Accessed, b); }
+
+    bool is_dirty() const { return raw() & Dirty; }
+    void set_dirty(bool b) { set_bit(Dirty, b); }
+
     bool is_execute_disabled() const { return raw() & NoExecute; }
     void set_execute_disabled(bool b) { set_bit(NoExecute, b); }
 
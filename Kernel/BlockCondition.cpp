@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Kernel/Arch/i386/CPU.h>
+#include <Kernel/BlockCondition.h>
+#include <Kernel/Scheduler.h>
+#include <Kernel/Thread.h>
+
+namespace Kernel {
+
+BlockCondition::~BlockCondition()
+{
+    // Blockers keep whatever they're registered with alive until they're done blocking.
+    ASSERT(m_threads.is_empty());
+}
+
+void BlockCondition::add_blocked_thread(Thread& thread)
+{
+    InterruptDisabler disabler;
+    ASSERT(!m_threads.contains_slow(&thread));
+    m_threads.append(&thread);
+}
+
+void BlockCondition::remove_blocked_thread(Thread& thread)
+{
+    InterruptDisabler disabler;
+    for (size_t i = 0; i < m_threads.size(); ++i) {
+        if (m_threads[i] == &thread) {
+            m_threads.remove(i);
+            return;
+        }
+    }
+    ASSERT_NOT_REACHED();
+}
+
+void BlockCondition::unblock()
+{
+    InterruptDisabler disabler;
+    if (m_threads.is_empty())
+        return;
+    bool did_unblock = false;
+    // NOTE: Unblocking a thread doesn't remove it from the list, that happens once its blocker goes away.
+    for (auto* thread : m_threads)
+        did_unblock |= Scheduler::evaluate_blocked_thread(*thread);
+    if (did_unblock)
+        Scheduler::stop_idling();
+}
+
+}
@@ -24,7 +24,14 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/ByteBuffer.h>
 #include <Kernel/Devices/BlockDevice.h>
+#include <Kernel/Thread.h>
+#include <Kernel/VM/MemoryManager.h>
+#include <Kernel/WaitQueue.h>
+#include <LibBareMetal/StdLib.h>
+
+//#define BLOCK_DEVICE_DEBUG
 
 namespace Kernel {
 
@@ -62,4 +69,178 @@ bool BlockDevice::write_raw(u32 offset, unsigned length, const u8* in)
     return write_blocks(first_block, end_block - first_block, in);
 }
 
+void BlockDevice::enqueue_request(BlockDeviceRequest& request, BlockDeviceRequest* before)
+{
+    if (before)
+        m_pending_requests.insert_before(*before, request);
+    else
+        m_pending_requests.append(request);
+}
+
+void BlockDevice::submit_request(BlockDeviceRequest& request)
+{
+    ASSERT(request.block_count());
+    ASSERT(request.block_count() <= max_blocks_per_transfer());
+    ASSERT(!is_user_address(VirtualAddress(request.buffer())));
+
+    if (!uses_request_queue()) {
+        bool success;
+        if (request.type() == BlockDeviceRequest::Type::Read)
+            success = read_blocks(request.block_index(), request.block_count(), request.buffer());
+        else
+            success = write_blocks(request.block_index(), request.block_count(), request.buffer());
+        request.complete(success);
+        return;
+    }
+
+    InterruptDisabler disabler;
+
+    // Keep the pending queue sorted by block index.
+    BlockDeviceRequest* successor = nullptr;
+    for (auto& pending_request : m_pending_requests) {
+        if (pending_request.block_index() > request.block_index()) {
+            successor = &pending_request;
+            break;
+        }
+    }
+    enqueue_request(request, successor);
+
+    start_next_request();
+}
+
+void BlockDevice::start_next_request()
+{
+    InterruptDisabler disabler;
+    if (!m_active_requests.is_empty() || m_pending_requests.is_empty())
+        return;
+
+    // C-LOOK: sweep upwards from the current head position, then wrap around to the lowest request.
+    auto it = m_pending_requests.begin();
+    while (it != m_pending_requests.end() && it->block_index() < m_head_position)
+        ++it;
+    if (it == m_pending_requests.end())
+        it = m_pending_requests.begin();
+
+    // Merge the following requests of the same type, as long as they are contiguous on disk.
+    auto type = it->type();
+    u32 block_index = it->block_index();
+    u32 block_count = 0;
+    while (it != m_pending_requests.end()) {
+        auto& request = *it;
+        if (request.type() != type || request.block_index() != block_index + block_count || block_count + request.block_count() > max_blocks_per_transfer())
+            break;
+        ++it;
+        m_active_requests.append(request);
+        block_count += request.block_count();
+    }
+
+#ifdef BLOCK_DEVICE_DEBUG
+    dbg() << class_name() << ": Starting " << (type == BlockDeviceRequest::Type::Read ? "read" : "write") << " of " << block_count << " block(s) @ " << block_index;
+#endif
+
+    if (!start_transfer(type, block_index, block_count, m_active_requests)) {
+        // The hardware is busy, so put the batch back where it came from and try again later.
+        auto* successor = it != m_pending_requests.end() ? &*it : nullptr;
+        while (auto* request = m_active_requests.take_first())
+            enqueue_request(*request, successor);
+        return;
+    }
+
+    m_head_position = block_index + block_count;
+}
+
+void BlockDevice::complete_transfer(bool success)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(!m_active_requests.is_empty());
+    while (auto* request = m_active_requests.take_first())
+        request->complete(success);
+    start_next_request();
+}
+
+bool BlockDevice::submit_request_and_wait(BlockDeviceRequest::Type type, u32 block_index, u32 block_count, u8* buffer)
+{
+    // The completion may run in IRQ context with some other process' address space active,
+    // so userspace buffers have to be bounced through kernel memory.
+    bool is_user_buffer = is_user_address(VirtualAddress(buffer));
+
+    while (block_count) {
+        u32 chunk_block_count = min(block_count, max_blocks_per_transfer());
+        size_t chunk_size = chunk_block_count * block_size();
+
+        ByteBuffer bounce_buffer;
+        u8* chunk_buffer = buffer;
+        if (is_user_buffer) {
+            bounce_buffer = ByteBuffer::create_uninitialized(chunk_size);
+            chunk_buffer = bounce_buffer.data();
+            if (type == BlockDeviceRequest::Type::Write)
+                memcpy(chunk_buffer, buffer, chunk_size);
+        }
+
+        WaitQueue wait_queue;
+        bool done = false;
+        bool success = false;
+        BlockDeviceRequest request(type, block_index, chunk_block_count, chunk_buffer, [&](bool request_success) {
+            success = request_success;
+            done = true;
+            wait_queue.wake_all();
+        });
+
+        {
+            InterruptDisabler disabler;
+            submit_request(request);
+            while (!done)
+                Thread::current->wait_on(wait_queue);
+        }
+
+        if (!success)
+            return false;
+
+        if (is_user_buffer && type == BlockDeviceRequest::Type::Read)
+            memcpy(buffer, chunk_buffer, chunk_size);
+
+        block_index += chunk_block_count;
+        block_count -= chunk_block_count;
+        buffer += chunk_size;
+    }
+    return true;
+}
+
+BlockDeviceRequestBatch::~BlockDeviceRequestBatch()
+{
+    // The requests and their completions refer to us, so they can't outlive the batch.
+    wait();
+}
+
+void BlockDeviceRequestBatch::submit(BlockDeviceRequest::Type type, u32 block_index, u32 block_count, u8* buffer)
+{
+    while (block_count) {
+        u32 chunk_block_count = min(block_count, m_device.max_blocks_per_transfer());
+        {
+            InterruptDisabler disabler;
+            ++m_pending_count;
+        }
+        m_requests.append(make<BlockDeviceRequest>(type, block_index, chunk_block_count, buffer, [this](bool success) {
+            InterruptDisabler disabler;
+            if (!success)
+                m_success = false;
+            if (!--m_pending_count)
+                m_wait_queue.wake_all();
+        }));
+        m_device.submit_request(m_requests.last());
+
+        block_index += chunk_block_count;
+        block_count -= chunk_block_count;
+        buffer += chunk_block_count * m_device.block_size();
+    }
+}
+
+bool BlockDeviceRequestBatch::wait()
+{
+    InterruptDisabler disabler;
+    while (m_pending_count)
+        Thread::current->wait_on(m_wait_queue);
+    return m_success;
+}
+
 }
@@ -26,12 +26,62 @@
 
 #pragma once
 
+#include <AK/Function.h>
+#include <AK/IntrusiveList.h>
+#include <AK/NonnullOwnPtrVector.h>
 #include <Kernel/Devices/Device.h>
+#include <Kernel/WaitQueue.h>
 
 namespace Kernel {
 
+class BlockDeviceRequest {
+    AK_MAKE_NONCOPYABLE(BlockDeviceRequest);
+    AK_MAKE_NONMOVABLE(BlockDeviceRequest);
+
+public:
+    enum class Type {
+        Read,
+        Write,
+    };
+
+    BlockDeviceRequest(Type type, u32 block_index, u32 block_count, u8* buffer, Function<void(bool success)> completion)
+        : m_type(type)
+        , m_block_index(block_index)
+        , m_block_count(block_count)
+        , m_buffer(buffer)
+        , m_completion(move(completion))
+    {
+    }
+
+    Type type() const { return m_type; }
+    u32 block_index() const { return m_block_index; }
+    u32 block_count() const { return m_block_count; }
+    u32 end_block_index() const { return m_block_index + m_block_count; }
+    u8* buffer() const { return m_buffer; }
+
+    // For devices that pass requests on to another device, e.g. partitions.
+    void offset_block_index(u32 offset) { m_block_index += offset; }
+
+    void complete(bool success)
+    {
+        if (m_completion)
+            m_completion(success);
+    }
+
+    IntrusiveListNode m_list_node;
+
+private:
+    Type m_type { Type::Read };
+    u32 m_block_index { 0 };
+    u32 m_block_count { 0 };
+    u8* m_buffer { nullptr };
+    Function<void(bool success)> m_completion;
+};
+
 class BlockDevice : public Device {
 public:
+    typedef IntrusiveList<BlockDeviceRequest, &BlockDeviceRequest::m_list_node> RequestList;
+
     virtual ~BlockDevice() override;
 
     size_t block_size() const { return m_block_size; }
@@ -45,7 +95,30 @@ public:
     virtual bool read_blocks(unsigned index, u16 count, u8*) = 0;
     virtual bool write_blocks(unsigned index, u16 count, const u8*) = 0;
 
+    // Queue up a request for the device without waiting for it. Adjacent requests are merged
+    // and dispatched in elevator order. The completion callback may be invoked from IRQ context,
+    // so the request (and its buffer, which must be kernel memory) has to stay alive until then.
+    // Devices without a request queue carry the request out synchronously.
+    virtual void submit_request(BlockDeviceRequest&);
+    virtual u32 max_blocks_per_transfer() const { return PAGE_SIZE / m_block_size; }
+
+    // Start the next transfer if the device is idle. Drivers call this when hardware that
+    // was busy with something else (e.g. the other drive on a channel) becomes available.
+    void start_next_request();
+
 protected:
+    bool submit_request_and_wait(BlockDeviceRequest::Type, u32 block_index, u32 block_count, u8* buffer);
+
+    // Drivers that use the request queue return true here and implement start_transfer(). It's
+    // called with interrupts disabled and a batch of physically adjacent requests of the same type.
+    // Return false if the hardware can't take the transfer right now, and call start_next_request()
+    // once it can.
+    virtual bool uses_request_queue() const { return false; }
+    virtual bool start_transfer(BlockDeviceRequest::Type, u32, u32, RequestList&) { ASSERT_NOT_REACHED(); }
+
+    // Called by drivers (typically from the IRQ handler) when the transfer started last finished.
+    void complete_transfer(bool success);
+
     BlockDevice(unsigned major, unsigned minor, size_t block_size = PAGE_SIZE)
         : Device(major, minor)
         , m_block_size(block_size)
@@ -55,7 +128,40 @@ protected:
 private:
     virtual bool is_block_device() const final { return true; }
 
+    void enqueue_request(BlockDeviceRequest&, BlockDeviceRequest* before);
+
     size_t m_block_size { 0 };
+
+    RequestList m_pending_requests;
+    RequestList m_active_requests;
+    u32 m_head_position { 0 };
+};
+
+// Submits any number of transfers to a device without waiting in between, so they can all be
+// merged and ordered by the request queue, and then waits for all of them at once.
+class BlockDeviceRequestBatch {
+    AK_MAKE_NONCOPYABLE(BlockDeviceRequestBatch);
+    AK_MAKE_NONMOVABLE(BlockDeviceRequestBatch);
+
+public:
+    explicit BlockDeviceRequestBatch(BlockDevice& device)
+        : m_device(device)
+    {
+    }
+    ~BlockDeviceRequestBatch();
+
+    // The buffer must be kernel memory, and stay alive until wait() returns.
+    void submit(BlockDeviceRequest::Type, u32 block_index, u32 block_count, u8* buffer);
+
+    // Returns false if any of the requests failed.
+    bool wait();
+
+private:
+    BlockDevice& m_device;
+    NonnullOwnPtrVector<BlockDeviceRequest> m_requests;
+    WaitQueue m_wait_queue;
+    size_t m_pending_count { 0 };
+    bool m_success { true };
 };
 
 }
@@ -65,6 +65,21 @@ bool DiskPartition::write_blocks(unsigned index, u16 count, const u8* data)
     return m_device->write_blocks(m_block_offset + index, count, data);
 }
 
+void DiskPartition::submit_request(BlockDeviceRequest& request)
+{
+#ifdef OFFD_DEBUG
+    klog() << "DiskPartition::submit_request " << request.block_index() << " (really: " << (m_block_offset + request.block_index()) << ") count=" << request.block_count();
+#endif
+
+    request.offset_block_index(m_block_offset);
+    m_device->submit_request(request);
+}
+
+u32 DiskPartition::max_blocks_per_transfer() const
+{
+    return m_device->max_blocks_per_transfer();
+}
+
 const char* DiskPartition::class_name() const
 {
     return "DiskPartition";
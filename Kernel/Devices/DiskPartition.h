@@ -38,6 +38,8 @@ public:
 
     virtual bool read_blocks(unsigned index, u16 count, u8*) override;
     virtual bool write_blocks(unsigned index, u16 count, const u8*) override;
+    virtual void submit_request(BlockDeviceRequest&) override;
+    virtual u32 max_blocks_per_transfer() const override;
 
     // ^BlockDevice
     virtual ssize_t read(FileDescription&, u8*, ssize_t) override { return 0; }
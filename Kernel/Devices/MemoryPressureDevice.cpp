@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/StringView.h>
+#include <Kernel/Devices/MemoryPressureDevice.h>
+#include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/VM/MemoryManager.h>
+
+namespace Kernel {
+
+static MemoryPressureDevice* s_the;
+
+MemoryPressureDevice& MemoryPressureDevice::the()
+{
+    ASSERT(s_the);
+    return *s_the;
+}
+
+MemoryPressureDevice::MemoryPressureDevice()
+    : CharacterDevice(1, 12)
+{
+    s_the = this;
+}
+
+MemoryPressureDevice::~MemoryPressureDevice()
+{
+}
+
+KResultOr<NonnullRefPtr<FileDescription>> MemoryPressureDevice::open(int options)
+{
+    auto description = FileDescription::create(MemoryPressureObserver::create());
+    description->set_rw_mode(options);
+    description->set_file_flags(options);
+    return description;
+}
+
+void MemoryPressureDevice::register_observer(Badge<MemoryPressureObserver>, MemoryPressureObserver& observer)
+{
+    InterruptDisabler disabler;
+    m_observers.set(&observer);
+}
+
+void MemoryPressureDevice::unregister_observer(Badge<MemoryPressureObserver>, MemoryPressureObserver& observer)
+{
+    InterruptDisabler disabler;
+    m_observers.remove(&observer);
+}
+
+void MemoryPressureDevice::notify_observers()
+{
+    InterruptDisabler disabler;
+    for (auto* observer : m_observers)
+        observer->evaluate_block_conditions();
+}
+
+NonnullRefPtr<MemoryPressureObserver> MemoryPressureObserver::create()
+{
+    return adopt(*new MemoryPressureObserver);
+}
+
+MemoryPressureObserver::MemoryPressureObserver()
+{
+    MemoryPressureDevice::the().register_observer({}, *this);
+}
+
+MemoryPressureObserver::~MemoryPressureObserver()
+{
+    MemoryPressureDevice::the().unregister_observer({}, *this);
+}
+
+bool MemoryPressureObserver::can_read(const FileDescription&) const
+{
+    return m_last_seen_event != MM.memory_pressure_event_count();
+}
+
+ssize_t MemoryPressureObserver::read(FileDescription&, u8* buffer, ssize_t size)
+{
+    StringView level;
+    {
+        InterruptDisabler disabler;
+        switch (MM.reported_memory_pressure()) {
+        case MemoryManager::MemoryPressure::None:
+            level = "none\n";
+            break;
+        case MemoryManager::MemoryPressure::Low:
+            level = "low\n";
+            break;
+        case MemoryManager::MemoryPressure::Critical:
+            level = "critical\n";
+            break;
+        }
+        m_last_seen_event = MM.memory_pressure_event_count();
+    }
+    ssize_t nread = min(size, (ssize_t)level.length());
+    memcpy(buffer, level.characters_without_null_termination(), nread);
+    return nread;
+}
+
+}
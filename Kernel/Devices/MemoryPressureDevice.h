@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/HashTable.h>
+#include <Kernel/Devices/CharacterDevice.h>
+
+namespace Kernel {
+
+class MemoryPressureObserver;
+
+// Opening /dev/mempressure vends a new MemoryPressureObserver, so that every subscriber
+// keeps track of which memory pressure changes it has already seen.
+class MemoryPressureDevice final : public CharacterDevice {
+    AK_MAKE_ETERNAL
+public:
+    MemoryPressureDevice();
+    virtual ~MemoryPressureDevice() override;
+
+    static MemoryPressureDevice& the();
+
+    void notify_observers();
+
+    void register_observer(Badge<MemoryPressureObserver>, MemoryPressureObserver&);
+    void unregister_observer(Badge<MemoryPressureObserver>, MemoryPressureObserver&);
+
+    // ^CharacterDevice
+    virtual KResultOr<NonnullRefPtr<FileDescription>> open(int options) override;
+    virtual ssize_t read(FileDescription&, u8*, ssize_t) override { return 0; }
+    virtual ssize_t write(FileDescription&, const u8*, ssize_t) override { return -EINVAL; }
+    virtual bool can_read(const FileDescription&) const override { return true; }
+    virtual bool can_write(const FileDescription&) const override { return false; }
+
+private:
+    // ^CharacterDevice
+    virtual const char* class_name() const override { return "MemoryPressureDevice"; }
+
+    HashTable<MemoryPressureObserver*> m_observers;
+};
+
+// Becomes readable whenever the memory pressure has changed since it was last read.
+// Reading yields the current level as a line of text: "none", "low" or "critical".
+class MemoryPressureObserver final : public File {
+public:
+    static NonnullRefPtr<MemoryPressureObserver> create();
+    virtual ~MemoryPressureObserver() override;
+
+private:
+    MemoryPressureObserver();
+
+    // ^File
+    virtual ssize_t read(FileDescription&, u8*, ssize_t) override;
+    virtual ssize_t write(FileDescription&, const u8*, ssize_t) override { return -EINVAL; }
+    virtual bool can_read(const FileDescription&) const override;
+    virtual bool can_write(const FileDescription&) const override { return false; }
+    virtual String absolute_path(const FileDescription&) const override { return "mempressure"; }
+    virtual const char* class_name() const override { return "MemoryPressureObserver"; }
+
+    u32 m_last_seen_event { 0 };
+};
+
+}
@@ -165,8 +165,8 @@ void PATAChannel::initialize(bool force_pio)
     // Let's try to set up DMA transfers.
     PCI::enable_bus_mastering(pci_address());
     PCI::enable_interrupt_line(pci_address());
-    prdt().end_of_table = 0x8000;
-    m_dma_buffer_page = MM.allocate_supervisor_physical_page();
+    for (size_t i = 0; i < max_dma_transfer_size / PAGE_SIZE; ++i)
+        m_dma_buffer_pages.append(MM.allocate_supervisor_physical_page());
     klog() << "PATAChannel: Bus master IDE: " << m_bus_master_base;
 }
 
@@ -194,6 +194,10 @@ void PATAChannel::handle_irq(const RegisterState&)
 #ifdef PATA_DEBUG
     klog() << "PATAChannel: interrupt: DRQ=" << ((status & ATA_SR_DRQ) != 0) << " BSY=" << ((status & ATA_SR_BSY) != 0) << " DRDY=" << ((status & ATA_SR_DRDY) != 0);
 #endif
+    if (m_active_device) {
+        complete_dma_transfer();
+        return;
+    }
     m_irq_queue.wake_all();
 }
 
@@ -262,39 +266,89 @@ void PATAChannel::detect_disks()
     }
 }
 
-bool PATAChannel::ata_read_sectors_with_dma(u32 lba, u16 count, u8* outbuf, bool slave_request)
+void PATAChannel::copy_to_dma_buffer(size_t dma_offset, const u8* data, size_t size)
 {
-    LOCKER(s_lock());
+    while (size) {
+        size_t offset_in_page = dma_offset % PAGE_SIZE;
+        size_t chunk_size = min(size, PAGE_SIZE - offset_in_page);
+        memcpy(m_dma_buffer_pages[dma_offset / PAGE_SIZE]->paddr().offset(0xc0000000 + offset_in_page).as_ptr(), data, chunk_size);
+        data += chunk_size;
+        dma_offset += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+void PATAChannel::copy_from_dma_buffer(size_t dma_offset, u8* data, size_t size)
+{
+    while (size) {
+        size_t offset_in_page = dma_offset % PAGE_SIZE;
+        size_t chunk_size = min(size, PAGE_SIZE - offset_in_page);
+        memcpy(data, m_dma_buffer_pages[dma_offset / PAGE_SIZE]->paddr().offset(0xc0000000 + offset_in_page).as_ptr(), chunk_size);
+        data += chunk_size;
+        dma_offset += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+bool PATAChannel::start_dma_transfer(PATADiskDevice& device, BlockDeviceRequest::Type type, u32 lba, u16 count, BlockDevice::RequestList& requests)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    if (m_active_device)
+        return false;
+
+    bool is_read = type == BlockDeviceRequest::Type::Read;
 #ifdef PATA_DEBUG
-    dbg() << "PATAChannel::ata_read_sectors_with_dma (" << lba << " x" << count << ") -> " << outbuf;
+    dbg() << "PATAChannel::start_dma_transfer " << (is_read ? "read" : "write") << " (" << lba << " x" << count << ")";
 #endif
 
-    prdt().offset = m_dma_buffer_page->paddr();
-    prdt().size = 512 * count;
+    size_t transfer_size = 512 * count;
+    ASSERT(transfer_size <= max_dma_transfer_size);
+
+    if (!is_read) {
+        size_t offset = 0;
+        for (auto& request : requests) {
+            size_t request_size = request.block_count() * 512;
+            ASSERT(offset + request_size <= transfer_size);
+            copy_to_dma_buffer(offset, request.buffer(), request_size);
+            offset += request_size;
+        }
+    }
+
+    // One physical region descriptor per DMA buffer page.
+    size_t prd_count = ceil_div(transfer_size, (size_t)PAGE_SIZE);
+    for (size_t i = 0; i < prd_count; ++i) {
+        auto& prd = prdt()[i];
+        prd.offset = m_dma_buffer_pages[i]->paddr();
+        prd.size = min(transfer_size - i * PAGE_SIZE, (size_t)PAGE_SIZE);
+        prd.end_of_table = (i == prd_count - 1) ? 0x8000 : 0;
+    }
 
-    ASSERT(prdt().size <= PAGE_SIZE);
+    m_active_device = &device;
+    m_active_requests = &requests;
+    m_active_transfer_type = type;
+    m_active_transfer_size = transfer_size;
 
     // Stop bus master
     m_bus_master_base.out<u8>(0);
 
     // Write the PRDT location
-    m_bus_master_base.offset(4).out(m_prdt_page->paddr().get());
+    m_bus_master_base.offset(4).out<u32>(m_prdt_page->paddr().get());
 
     // Turn on "Interrupt" and "Error" flag. The error flag should be cleared by hardware.
     m_bus_master_base.offset(2).out<u8>(m_bus_master_base.offset(2).in<u8>() | 0x6);
 
     // Set transfer direction
-    m_bus_master_base.out<u8>(0x8);
+    m_bus_master_base.out<u8>(is_read ? 0x8 : 0x0);
 
     while (m_io_base.offset(ATA_REG_STATUS).in<u8>() & ATA_SR_BSY)
         ;
 
     u8 devsel = 0xe0;
-    if (slave_request)
+    if (device.is_slave())
         devsel |= 0x10;
 
     m_control_base.offset(ATA_CTL_CONTROL).out<u8>(0);
-    m_io_base.offset(ATA_REG_HDDEVSEL).out<u8>(devsel | (static_cast<u8>(slave_request) << 4));
+    m_io_base.offset(ATA_REG_HDDEVSEL).out<u8>(devsel);
     io_delay();
 
     m_io_base.offset(ATA_REG_FEATURES).out<u8>(0);
@@ -315,91 +369,50 @@ bool PATAChannel::ata_read_sectors_with_dma(u32 lba, u16 count, u8* outbuf, bool
             break;
     }
 
-    m_io_base.offset(ATA_REG_COMMAND).out<u8>(ATA_CMD_READ_DMA_EXT);
+    m_io_base.offset(ATA_REG_COMMAND).out<u8>(is_read ? ATA_CMD_READ_DMA_EXT : ATA_CMD_WRITE_DMA_EXT);
     io_delay();
 
-    prepare_for_irq();
+    enable_irq();
     // Start bus master
-    m_bus_master_base.out<u8>(0x9);
-
-    wait_for_irq();
-
-    if (m_device_error)
-        return false;
-
-    memcpy(outbuf, m_dma_buffer_page->paddr().offset(0xc0000000).as_ptr(), 512 * count);
-
-    // I read somewhere that this may trigger a cache flush so let's do it.
-    m_bus_master_base.offset(2).out<u8>(m_bus_master_base.offset(2).in<u8>() | 0x6);
+    m_bus_master_base.out<u8>(is_read ? 0x9 : 0x1);
     return true;
 }
 
-bool PATAChannel::ata_write_sectors_with_dma(u32 lba, u16 count, const u8* inbuf, bool slave_request)
+void PATAChannel::complete_dma_transfer()
 {
-    LOCKER(s_lock());
-#ifdef PATA_DEBUG
-    dbg() << "PATAChannel::ata_write_sectors_with_dma (" << lba << " x" << count << ") <- " << inbuf;
-#endif
-
-    prdt().offset = m_dma_buffer_page->paddr();
-    prdt().size = 512 * count;
-
-    memcpy(m_dma_buffer_page->paddr().offset(0xc0000000).as_ptr(), inbuf, 512 * count);
-
-    ASSERT(prdt().size <= PAGE_SIZE);
+    ASSERT(m_active_device);
+    auto& device = *m_active_device;
 
     // Stop bus master
     m_bus_master_base.out<u8>(0);
-
-    // Write the PRDT location
-    m_bus_master_base.offset(4).out<u32>(m_prdt_page->paddr().get());
-
-    // Turn on "Interrupt" and "Error" flag. The error flag should be cleared by hardware.
-    m_bus_master_base.offset(2).out<u8>(m_bus_master_base.offset(2).in<u8>() | 0x6);
-
-    while (m_io_base.offset(ATA_REG_STATUS).in<u8>() & ATA_SR_BSY)
-        ;
-
-    u8 devsel = 0xe0;
-    if (slave_request)
-        devsel |= 0x10;
-
-    m_control_base.offset(ATA_CTL_CONTROL).out<u8>(0);
-    m_io_base.offset(ATA_REG_HDDEVSEL).out<u8>(devsel | (static_cast<u8>(slave_request) << 4));
-    io_delay();
-
-    m_io_base.offset(ATA_REG_FEATURES).out<u8>(0);
-
-    m_io_base.offset(ATA_REG_SECCOUNT0).out<u8>(0);
-    m_io_base.offset(ATA_REG_LBA0).out<u8>(0);
-    m_io_base.offset(ATA_REG_LBA1).out<u8>(0);
-    m_io_base.offset(ATA_REG_LBA2).out<u8>(0);
-
-    m_io_base.offset(ATA_REG_SECCOUNT0).out<u8>(count);
-    m_io_base.offset(ATA_REG_LBA0).out<u8>((lba & 0x000000ff) >> 0);
-    m_io_base.offset(ATA_REG_LBA1).out<u8>((lba & 0x0000ff00) >> 8);
-    m_io_base.offset(ATA_REG_LBA2).out<u8>((lba & 0x00ff0000) >> 16);
-
-    for (;;) {
-        auto status = m_io_base.offset(ATA_REG_STATUS).in<u8>();
-        if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRDY))
-            break;
+    bool success = !m_device_error;
+
+    auto& requests = *m_active_requests;
+    if (success && m_active_transfer_type == BlockDeviceRequest::Type::Read) {
+        size_t offset = 0;
+        for (auto& request : requests) {
+            size_t request_size = request.block_count() * 512;
+            copy_from_dma_buffer(offset, request.buffer(), request_size);
+            offset += request_size;
+        }
+        ASSERT(offset == m_active_transfer_size);
     }
 
-    m_io_base.offset(ATA_REG_COMMAND).out<u8>(ATA_CMD_WRITE_DMA_EXT);
-    io_delay();
-
-    prepare_for_irq();
-    // Start bus master
-    m_bus_master_base.out<u8>(0x1);
-    wait_for_irq();
-
-    if (m_device_error)
-        return false;
-
     // I read somewhere that this may trigger a cache flush so let's do it.
     m_bus_master_base.offset(2).out<u8>(m_bus_master_base.offset(2).in<u8>() | 0x6);
-    return true;
+
+    m_active_device = nullptr;
+    m_active_requests = nullptr;
+    disable_irq();
+    device.complete_transfer(success);
+
+    // Give the other drive on this channel a chance if we're idle now.
+    if (!m_active_device) {
+        if (m_master)
+            m_master->start_next_request();
+        if (!m_active_device && m_slave)
+            m_slave->start_next_request();
+    }
 }
 
 bool PATAChannel::ata_read_sectors(u32 start_sector, u16 count, u8* outbuf, bool slave_request)
@@ -38,6 +38,8 @@
 
 #include <AK/OwnPtr.h>
 #include <AK/RefPtr.h>
+#include <AK/Vector.h>
+#include <Kernel/Devices/BlockDevice.h>
 #include <Kernel/Lock.h>
 #include <Kernel/PCI/Access.h>
 #include <Kernel/PCI/Device.h>
@@ -82,8 +84,10 @@ private:
     void detect_disks();
 
     void wait_for_irq();
-    bool ata_read_sectors_with_dma(u32, u16, u8*, bool);
-    bool ata_write_sectors_with_dma(u32, u16, const u8*, bool);
+    bool start_dma_transfer(PATADiskDevice&, BlockDeviceRequest::Type, u32 lba, u16 count, BlockDevice::RequestList&);
+    void complete_dma_transfer();
+    void copy_to_dma_buffer(size_t dma_offset, const u8*, size_t);
+    void copy_from_dma_buffer(size_t dma_offset, u8*, size_t);
     bool ata_read_sectors(u32, u16, u8*, bool);
     bool ata_write_sectors(u32, u16, const u8*, bool);
 
@@ -97,9 +101,19 @@ private:
 
     WaitQueue m_irq_queue;
 
-    PhysicalRegionDescriptor& prdt() { return *reinterpret_cast<PhysicalRegionDescriptor*>(m_prdt_page->paddr().offset(0xc0000000).as_ptr()); }
+    // Transfers are scattered over several physical pages, one PRD entry per page.
+    static const size_t max_dma_transfer_size = 64 * KB;
+
+    PhysicalRegionDescriptor* prdt() { return reinterpret_cast<PhysicalRegionDescriptor*>(m_prdt_page->paddr().offset(0xc0000000).as_ptr()); }
     RefPtr<PhysicalPage> m_prdt_page;
-    RefPtr<PhysicalPage> m_dma_buffer_page;
+    Vector<RefPtr<PhysicalPage>> m_dma_buffer_pages;
+
+    // The DMA transfer currently in flight, if any. A channel can only run one command at a time.
+    PATADiskDevice* m_active_device { nullptr };
+    BlockDevice::RequestList* m_active_requests { nullptr };
+    BlockDeviceRequest::Type m_active_transfer_type { BlockDeviceRequest::Type::Read };
+    size_t m_active_transfer_size { 0 };
+
     IOAddress m_bus_master_base;
     Lockable<bool> m_dma_enabled;
 
@@ -86,12 +86,9 @@ ssize_t PATADiskDevice::read(FileDescription& fd, u8* outbuf, ssize_t len)
     u16 whole_blocks = len / block_size();
     ssize_t remaining = len % block_size();
 
-    unsigned blocks_per_page = PAGE_SIZE / block_size();
-
-    // PATAChannel will chuck a wobbly if we try to read more than PAGE_SIZE
-    // at a time, because it uses a single page for its DMA buffer.
-    if (whole_blocks >= blocks_per_page) {
-        whole_blocks = blocks_per_page;
+    // Don't ask for more than PATAChannel can move in a single DMA transfer.
+    if (whole_blocks >= max_blocks_per_transfer()) {
+        whole_blocks = max_blocks_per_transfer();
         remaining = 0;
     }
 
@@ -127,12 +124,9 @@ ssize_t PATADiskDevice::write(FileDescription& fd, const u8* inbuf, ssize_t len)
     u16 whole_blocks = len / block_size();
     ssize_t remaining = len % block_size();
 
-    unsigned blocks_per_page = PAGE_SIZE / block_size();
-
-    // PATAChannel will chuck a wobbly if we try to write more than PAGE_SIZE
-    // at a time, because it uses a single page for its DMA buffer.
-    if (whole_blocks >= blocks_per_page) {
-        whole_blocks = blocks_per_page;
+    // Don't ask for more than PATAChannel can move in a single DMA transfer.
+    if (whole_blocks >= max_blocks_per_transfer()) {
+        whole_blocks = max_blocks_per_transfer();
         remaining = 0;
     }
 
@@ -169,7 +163,7 @@ bool PATADiskDevice::can_write(const FileDescription& fd) const
 
 bool PATADiskDevice::read_sectors_with_dma(u32 lba, u16 count, u8* outbuf)
 {
-    return m_channel.ata_read_sectors_with_dma(lba, count, outbuf, is_slave());
+    return submit_request_and_wait(BlockDeviceRequest::Type::Read, lba, count, outbuf);
 }
 
 bool PATADiskDevice::read_sectors(u32 start_sector, u16 count, u8* outbuf)
@@ -179,7 +173,7 @@ bool PATADiskDevice::read_sectors(u32 start_sector, u16 count, u8* outbuf)
 
 bool PATADiskDevice::write_sectors_with_dma(u32 lba, u16 count, const u8* inbuf)
 {
-    return m_channel.ata_write_sectors_with_dma(lba, count, inbuf, is_slave());
+    return submit_request_and_wait(BlockDeviceRequest::Type::Write, lba, count, const_cast<u8*>(inbuf));
 }
 
 bool PATADiskDevice::write_sectors(u32 start_sector, u16 count, const u8* inbuf)
@@ -187,6 +181,21 @@ bool PATADiskDevice::write_sectors(u32 start_sector, u16 count, const u8* inbuf)
     return m_channel.ata_write_sectors(start_sector, count, inbuf, is_slave());
 }
 
+bool PATADiskDevice::uses_request_queue() const
+{
+    return !m_channel.m_bus_master_base.is_null() && m_channel.m_dma_enabled.resource();
+}
+
+bool PATADiskDevice::start_transfer(BlockDeviceRequest::Type type, u32 block_index, u32 block_count, RequestList& requests)
+{
+    return m_channel.start_dma_transfer(*this, type, block_index, block_count, requests);
+}
+
+u32 PATADiskDevice::max_blocks_per_transfer() const
+{
+    return PATAChannel::max_dma_transfer_size / block_size();
+}
+
 bool PATADiskDevice::is_slave() const
 {
     return m_drive_type == DriveType::Slave;
@@ -39,6 +39,7 @@ namespace Kernel {
 class PATAChannel;
 
 class PATADiskDevice final : public BlockDevice {
+    friend class PATAChannel;
     AK_MAKE_ETERNAL
 public:
     // Type of drive this IDEDiskDevice is on the ATA channel.
@@ -73,6 +74,11 @@ private:
     // ^DiskDevice
     virtual const char* class_name() const override;
 
+    // ^BlockDevice
+    virtual bool uses_request_queue() const override;
+    virtual bool start_transfer(BlockDeviceRequest::Type, u32 block_index, u32 block_count, RequestList&) override;
+    virtual u32 max_blocks_per_transfer() const override;
+
     bool wait_for_irq();
     bool read_sectors_with_dma(u32 lba, u16 count, u8*);
     bool write_sectors_with_dma(u32 lba, u16 count, const u8*);
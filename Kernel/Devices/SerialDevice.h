@@ -44,6 +44,8 @@ public:
     virtual ssize_t read(FileDescription&, u8*, ssize_t) override;
     virtual bool can_write(const FileDescription&) const override;
     virtual ssize_t write(FileDescription&, const u8*, ssize_t) override;
+    // We don't take serial interrupts, so the line status has to be polled.
+    virtual bool should_poll_for_readiness() const override { return true; }
 
     enum InterruptEnable {
         LowPowerMode = 0x01 << 5,
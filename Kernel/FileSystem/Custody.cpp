@@ -24,14 +24,60 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/HashMap.h>
 #include <AK/StringBuilder.h>
 #include <AK/StringView.h>
 #include <AK/Vector.h>
+#include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/FileSystem/Custody.h>
 #include <Kernel/FileSystem/Inode.h>
 
 namespace Kernel {
 
+struct LiveCustodyKey {
+    const Custody* parent { nullptr };
+    String name;
+
+    bool operator==(const LiveCustodyKey& other) const { return parent == other.parent && name == other.name; }
+};
+
+static unsigned live_custody_hash(const Custody* parent, const StringView& name)
+{
+    return pair_int_hash(ptr_hash(parent), name.hash());
+}
+
+struct LiveCustodyKeyTraits : public GenericTraits<LiveCustodyKey> {
+    static unsigned hash(const LiveCustodyKey& key) { return live_custody_hash(key.parent, key.name); }
+};
+
+// Every custody that has a parent, so path resolution can reuse existing custody chains instead of building new ones.
+static HashMap<LiveCustodyKey, Custody*, LiveCustodyKeyTraits>& live_custodies()
+{
+    static HashMap<LiveCustodyKey, Custody*, LiveCustodyKeyTraits>* map;
+    if (!map)
+        map = new HashMap<LiveCustodyKey, Custody*, LiveCustodyKeyTraits>;
+    return *map;
+}
+
+NonnullRefPtr<Custody> Custody::create(Custody* parent, const StringView& name, Inode& inode, int mount_flags)
+{
+    if (!parent)
+        return adopt(*new Custody(nullptr, name, inode, mount_flags));
+
+    InterruptDisabler disabler;
+    auto it = live_custodies().find(live_custody_hash(parent, name), [&](auto& entry) { return entry.key.parent == parent && entry.key.name == name; });
+    if (it != live_custodies().end()) {
+        auto& custody = *(*it).value;
+        // A custody that has already dropped its last reference is on its way out, and can't be handed out again.
+        if (custody.ref_count() && &custody.inode() == &inode && custody.mount_flags() == mount_flags)
+            return custody;
+    }
+
+    auto custody = adopt(*new Custody(parent, name, inode, mount_flags));
+    live_custodies().set({ parent, custody->name() }, custody.ptr());
+    return custody;
+}
+
 Custody::Custody(Custody* parent, const StringView& name, Inode& inode, int mount_flags)
     : m_parent(parent)
     , m_name(name)
@@ -42,6 +88,13 @@ Custody::Custody(Custody* parent, const StringView& name, Inode& inode, int moun
 
 Custody::~Custody()
 {
+    if (!m_parent)
+        return;
+    InterruptDisabler disabler;
+    auto it = live_custodies().find(live_custody_hash(m_parent.ptr(), m_name), [&](auto& entry) { return entry.key.parent == m_parent.ptr() && entry.key.name == m_name; });
+    // Someone may have replaced us with a custody for a different inode (e.g. after a rename), so only remove our own entry.
+    if (it != live_custodies().end() && (*it).value == this)
+        live_custodies().remove(it);
 }
 
 String Custody::absolute_path() const
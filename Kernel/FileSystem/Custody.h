@@ -30,19 +30,15 @@
 #include <AK/RefPtr.h>
 #include <AK/String.h>
 #include <Kernel/Forward.h>
-#include <Kernel/Heap/SlabAllocator.h>
 
 namespace Kernel {
 
 // FIXME: Custody needs some locking.
 
 class Custody : public RefCounted<Custody> {
-    MAKE_SLAB_ALLOCATED(Custody)
 public:
-    static NonnullRefPtr<Custody> create(Custody* parent, const StringView& name, Inode& inode, int mount_flags)
-    {
-        return adopt(*new Custody(parent, name, inode, mount_flags));
-    }
+    // Returns the existing custody for this name in the parent if it's still alive and refers to the same inode.
+    static NonnullRefPtr<Custody> create(Custody* parent, const StringView& name, Inode& inode, int mount_flags);
 
     ~Custody();
 
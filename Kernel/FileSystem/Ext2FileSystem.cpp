@@ -27,11 +27,14 @@
 #include <AK/Bitmap.h>
 #include <AK/BufferStream.h>
 #include <AK/HashMap.h>
+#include <AK/HashTable.h>
+#include <AK/QuickSort.h>
 #include <AK/StdLibExtras.h>
 #include <AK/StringView.h>
 #include <Kernel/Devices/BlockDevice.h>
 #include <Kernel/FileSystem/Ext2FileSystem.h>
 #include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/FileSystem/NameCache.h>
 #include <Kernel/FileSystem/ext2_fs.h>
 #include <Kernel/Process.h>
 #include <Kernel/UnixTypes.h>
@@ -64,13 +67,95 @@ static u8 to_ext2_file_type(mode_t mode)
     return EXT2_FT_UNKNOWN;
 }
 
-NonnullRefPtr<Ext2FS> Ext2FS::create(FileDescription& file_description)
+static u16 directory_record_free_space(const ext2_dir_entry_2& entry)
 {
-    return adopt(*new Ext2FS(file_description));
+    if (!entry.inode)
+        return entry.rec_len;
+    return entry.rec_len - EXT2_DIR_REC_LEN(entry.name_len);
 }
 
-Ext2FS::Ext2FS(FileDescription& file_description)
-    : FileBackedFS(file_description)
+template<typename Callback>
+static void for_each_entry_in_directory_block(u8* block, size_t block_size, Callback callback)
+{
+    size_t offset = 0;
+    while (offset < block_size) {
+        auto& entry = *reinterpret_cast<ext2_dir_entry_2*>(block + offset);
+        if (!entry.rec_len)
+            break;
+        if (callback(entry) == IterationDecision::Break)
+            break;
+        offset += entry.rec_len;
+    }
+}
+
+static u16 largest_free_record_in_directory_block(u8* block, size_t block_size)
+{
+    u16 largest_free_record = 0;
+    for_each_entry_in_directory_block(block, block_size, [&](auto& entry) {
+        largest_free_record = max(largest_free_record, directory_record_free_space(entry));
+        return IterationDecision::Continue;
+    });
+    return largest_free_record;
+}
+
+static void write_directory_entry(ext2_dir_entry_2& entry, u16 record_length, InodeIdentifier inode, const StringView& name, u8 file_type)
+{
+    entry.inode = inode.index();
+    entry.rec_len = record_length;
+    entry.name_len = name.length();
+    entry.file_type = file_type;
+    memcpy(entry.name, name.characters_without_null_termination(), name.length());
+}
+
+static bool insert_directory_entry_into_block(u8* block, size_t block_size, InodeIdentifier inode, const StringView& name, u8 file_type)
+{
+    u16 needed_record_length = EXT2_DIR_REC_LEN(name.length());
+    bool inserted = false;
+    for_each_entry_in_directory_block(block, block_size, [&](auto& entry) {
+        if (directory_record_free_space(entry) < needed_record_length)
+            return IterationDecision::Continue;
+        if (!entry.inode) {
+            write_directory_entry(entry, entry.rec_len, inode, name, file_type);
+        } else {
+            // Split the slack off the end of this record.
+            u16 used_record_length = EXT2_DIR_REC_LEN(entry.name_len);
+            auto& new_entry = *reinterpret_cast<ext2_dir_entry_2*>((u8*)&entry + used_record_length);
+            write_directory_entry(new_entry, entry.rec_len - used_record_length, inode, name, file_type);
+            entry.rec_len = used_record_length;
+        }
+        inserted = true;
+        return IterationDecision::Break;
+    });
+    return inserted;
+}
+
+static bool remove_directory_entry_from_block(u8* block, size_t block_size, const StringView& name)
+{
+    ext2_dir_entry_2* previous_entry = nullptr;
+    bool removed = false;
+    for_each_entry_in_directory_block(block, block_size, [&](auto& entry) {
+        if (!entry.inode || name != StringView(entry.name, entry.name_len)) {
+            previous_entry = &entry;
+            return IterationDecision::Continue;
+        }
+        // Fold the record into its predecessor, or mark it unused if it's the first one in the block.
+        if (previous_entry)
+            previous_entry->rec_len += entry.rec_len;
+        else
+            entry.inode = 0;
+        removed = true;
+        return IterationDecision::Break;
+    });
+    return removed;
+}
+
+NonnullRefPtr<Ext2FS> Ext2FS::create(FileDescription& file_description, size_t disk_cache_size)
+{
+    return adopt(*new Ext2FS(file_description, disk_cache_size));
+}
+
+Ext2FS::Ext2FS(FileDescription& file_description, size_t disk_cache_size)
+    : FileBackedFS(file_description, disk_cache_size)
 {
 }
 
@@ -130,6 +215,8 @@ bool Ext2FS::initialize()
         return false;
     }
 
+    m_free_extent_summaries.resize(m_block_group_count);
+
     unsigned blocks_to_read = ceil_div(m_block_group_count * (unsigned)sizeof(ext2_group_desc), block_size());
     BlockIndex first_block_of_bgdt = block_size() == 1024 ? 2 : 1;
     m_cached_group_descriptor_table = KBuffer::create_with_size(block_size() * blocks_to_read, Region::Access::Read | Region::Access::Write, "Ext2FS: Block group descriptors");
@@ -155,9 +242,8 @@ InodeIdentifier Ext2FS::root_inode() const
     return { fsid(), EXT2_ROOT_INO };
 }
 
-bool Ext2FS::read_block_containing_inode(unsigned inode, unsigned& block_index, unsigned& offset, u8* buffer) const
+bool Ext2FS::find_block_containing_inode(unsigned inode, unsigned& block_index, unsigned& offset) const
 {
-    LOCKER(m_lock);
     auto& super_block = this->super_block();
 
     if (inode != EXT2_ROOT_INO && inode < EXT2_FIRST_INO(&super_block))
@@ -171,7 +257,14 @@ bool Ext2FS::read_block_containing_inode(unsigned inode, unsigned& block_index,
     offset = ((inode - 1) % inodes_per_group()) * inode_size();
     block_index = bgd.bg_inode_table + (offset >> EXT2_BLOCK_SIZE_BITS(&super_block));
     offset &= block_size() - 1;
+    return true;
+}
 
+bool Ext2FS::read_block_containing_inode(unsigned inode, unsigned& block_index, unsigned& offset, u8* buffer) const
+{
+    LOCKER(m_lock);
+    if (!find_block_containing_inode(inode, block_index, offset))
+        return false;
     return read_block(block_index, buffer);
 }
 
@@ -214,183 +307,160 @@ Ext2FS::BlockListShape Ext2FS::compute_block_list_shape(unsigned blocks)
     return {};
 }
 
-bool Ext2FS::write_block_list_for_inode(InodeIndex inode_index, ext2_inode& e2inode, const Vector<BlockIndex>& blocks)
+bool Ext2FS::resize_block_list_for_inode(InodeIndex inode_index, ext2_inode& e2inode, unsigned old_block_count, unsigned new_block_count, const Vector<BlockIndex>& appended_blocks)
 {
     LOCKER(m_lock);
 
-    // NOTE: There is a mismatch between i_blocks and blocks.size() since i_blocks includes meta blocks and blocks.size() does not.
-    auto old_block_count = ceil_div(e2inode.i_size, block_size());
+    bool growing = new_block_count > old_block_count;
+    ASSERT(appended_blocks.size() == (growing ? new_block_count - old_block_count : 0));
 
+    const unsigned entries_per_block = EXT2_ADDR_PER_BLOCK(&super_block());
     auto old_shape = compute_block_list_shape(old_block_count);
-    auto new_shape = compute_block_list_shape(blocks.size());
+    auto new_shape = compute_block_list_shape(new_block_count);
 
     Vector<BlockIndex> new_meta_blocks;
-    if (new_shape.meta_blocks > old_shape.meta_blocks) {
+    if (new_shape.meta_blocks > old_shape.meta_blocks)
         new_meta_blocks = allocate_blocks(group_index_from_inode(inode_index), new_shape.meta_blocks - old_shape.meta_blocks);
-    }
 
-    e2inode.i_blocks = (blocks.size() + new_shape.meta_blocks) * (block_size() / 512);
+    // Only the pointer blocks covering the logical range between the old and the new block count are touched.
+    // We walk that range in order, so it's enough to keep one indirect and one doubly indirect block in memory.
+    struct PointerBlock {
+        BlockIndex block_index { 0 };
+        ByteBuffer contents;
+        bool dirty { false };
+    };
+    PointerBlock ind_block { 0, ByteBuffer::create_uninitialized(block_size()), false };
+    PointerBlock dind_block { 0, ByteBuffer::create_uninitialized(block_size()), false };
+
+    auto flush_pointer_block = [&](PointerBlock& pointer_block) {
+        if (!pointer_block.dirty)
+            return;
+        bool success = write_block(pointer_block.block_index, pointer_block.contents.data());
+        ASSERT(success);
+        pointer_block.dirty = false;
+    };
+
+    auto load_pointer_block = [&](PointerBlock& pointer_block, BlockIndex block_index, bool is_new) {
+        if (pointer_block.block_index != block_index) {
+            flush_pointer_block(pointer_block);
+            pointer_block.block_index = block_index;
+            if (is_new) {
+                memset(pointer_block.contents.data(), 0, block_size());
+                pointer_block.dirty = true;
+            } else {
+                read_block(block_index, pointer_block.contents.data());
+            }
+        }
+        return reinterpret_cast<BlockIndex*>(pointer_block.contents.data());
+    };
 
     bool inode_dirty = false;
 
-    unsigned output_block_index = 0;
-    unsigned remaining_blocks = blocks.size();
-    for (unsigned i = 0; i < new_shape.direct_blocks; ++i) {
-        if (e2inode.i_block[i] != blocks[output_block_index])
+    unsigned first_logical_index = min(old_block_count, new_block_count);
+    unsigned end_logical_index = max(old_block_count, new_block_count);
+    for (unsigned bi = first_logical_index; bi < end_logical_index; ++bi) {
+        BlockIndex block_index = growing ? appended_blocks[bi - old_block_count] : 0;
+
+        if (bi < EXT2_NDIR_BLOCKS) {
+            e2inode.i_block[bi] = block_index;
             inode_dirty = true;
-        e2inode.i_block[i] = blocks[output_block_index];
-        ++output_block_index;
-        --remaining_blocks;
-    }
-    if (inode_dirty) {
+            continue;
+        }
+
+        unsigned index = bi - EXT2_NDIR_BLOCKS;
+        BlockIndex* pointers = nullptr;
+        if (index < entries_per_block) {
+            bool is_new = !e2inode.i_block[EXT2_IND_BLOCK];
+            if (is_new) {
 #ifdef EXT2_DEBUG
-        dbg() << "Ext2FS: Writing " << min((size_t)EXT2_NDIR_BLOCKS, blocks.size()) << " direct block(s) to i_block array of inode " << inode_index;
-        for (size_t i = 0; i < min((size_t)EXT2_NDIR_BLOCKS, blocks.size()); ++i)
-            dbg() << "   + " << blocks[i];
+                dbg() << "Ext2FS: Adding the indirect block to i_block array of inode " << inode_index;
 #endif
-        write_ext2_inode(inode_index, e2inode);
-        inode_dirty = false;
-    }
-
-    if (!remaining_blocks)
-        return true;
-
-    const unsigned entries_per_block = EXT2_ADDR_PER_BLOCK(&super_block());
+                e2inode.i_block[EXT2_IND_BLOCK] = new_meta_blocks.take_last();
+                inode_dirty = true;
+            }
+            pointers = load_pointer_block(ind_block, e2inode.i_block[EXT2_IND_BLOCK], is_new);
+        } else {
+            index -= entries_per_block;
+            ASSERT(index < entries_per_block * entries_per_block);
 
-    bool ind_block_new = !e2inode.i_block[EXT2_IND_BLOCK];
-    if (ind_block_new) {
-        BlockIndex new_indirect_block = new_meta_blocks.take_last();
-        if (e2inode.i_block[EXT2_IND_BLOCK] != new_indirect_block)
-            inode_dirty = true;
-        e2inode.i_block[EXT2_IND_BLOCK] = new_indirect_block;
-        if (inode_dirty) {
+            bool dind_is_new = !e2inode.i_block[EXT2_DIND_BLOCK];
+            if (dind_is_new) {
 #ifdef EXT2_DEBUG
-            dbg() << "Ext2FS: Adding the indirect block to i_block array of inode " << inode_index;
+                dbg() << "Ext2FS: Adding the doubly-indirect block to i_block array of inode " << inode_index;
 #endif
-            write_ext2_inode(inode_index, e2inode);
-            inode_dirty = false;
+                e2inode.i_block[EXT2_DIND_BLOCK] = new_meta_blocks.take_last();
+                inode_dirty = true;
+            }
+            auto* dind_pointers = load_pointer_block(dind_block, e2inode.i_block[EXT2_DIND_BLOCK], dind_is_new);
+
+            auto& indirect_block_index = dind_pointers[index / entries_per_block];
+            bool is_new = !indirect_block_index;
+            if (is_new) {
+                indirect_block_index = new_meta_blocks.take_last();
+                dind_block.dirty = true;
+            }
+            pointers = load_pointer_block(ind_block, indirect_block_index, is_new);
+            index %= entries_per_block;
         }
-    }
 
-    if (old_shape.indirect_blocks == new_shape.indirect_blocks) {
-        // No need to update the singly indirect block array.
-        remaining_blocks -= new_shape.indirect_blocks;
-        output_block_index += new_shape.indirect_blocks;
-    } else {
-        auto block_contents = ByteBuffer::create_uninitialized(block_size());
-        BufferStream stream(block_contents);
-        ASSERT(new_shape.indirect_blocks <= entries_per_block);
-        for (unsigned i = 0; i < new_shape.indirect_blocks; ++i) {
-            stream << blocks[output_block_index++];
-            --remaining_blocks;
+        if (pointers[index] != block_index) {
+            pointers[index] = block_index;
+            ind_block.dirty = true;
         }
-        stream.fill_to_end(0);
-        bool success = write_block(e2inode.i_block[EXT2_IND_BLOCK], block_contents.data());
-        ASSERT(success);
     }
 
-    if (!remaining_blocks)
-        return true;
-
-    bool dind_block_dirty = false;
+    ASSERT(new_meta_blocks.is_empty());
+
+    // When shrinking, give back the pointer blocks that don't point to anything anymore.
+    Vector<BlockIndex> freed_meta_blocks;
+    auto free_meta_block = [&](BlockIndex block_index) {
+        if (!block_index)
+            return;
+        if (ind_block.block_index == block_index)
+            ind_block.dirty = false;
+        if (dind_block.block_index == block_index)
+            dind_block.dirty = false;
+        freed_meta_blocks.append(block_index);
+    };
 
-    bool dind_block_new = !e2inode.i_block[EXT2_DIND_BLOCK];
-    if (dind_block_new) {
-        BlockIndex new_dindirect_block = new_meta_blocks.take_last();
-        if (e2inode.i_block[EXT2_DIND_BLOCK] != new_dindirect_block)
+    if (!growing && old_shape.doubly_indirect_blocks) {
+        unsigned old_indirect_block_count = ceil_div(old_shape.doubly_indirect_blocks, entries_per_block);
+        unsigned new_indirect_block_count = ceil_div(new_shape.doubly_indirect_blocks, entries_per_block);
+        auto* dind_pointers = load_pointer_block(dind_block, e2inode.i_block[EXT2_DIND_BLOCK], false);
+        for (unsigned i = new_indirect_block_count; i < old_indirect_block_count; ++i) {
+            free_meta_block(dind_pointers[i]);
+            dind_pointers[i] = 0;
+            dind_block.dirty = true;
+        }
+        if (!new_shape.doubly_indirect_blocks) {
+            free_meta_block(e2inode.i_block[EXT2_DIND_BLOCK]);
+            e2inode.i_block[EXT2_DIND_BLOCK] = 0;
             inode_dirty = true;
-        e2inode.i_block[EXT2_DIND_BLOCK] = new_dindirect_block;
-        if (inode_dirty) {
-#ifdef EXT2_DEBUG
-            dbg() << "Ext2FS: Adding the doubly-indirect block to i_block array of inode " << inode_index;
-#endif
-            write_ext2_inode(inode_index, e2inode);
-            inode_dirty = false;
         }
     }
 
-    if (old_shape.doubly_indirect_blocks == new_shape.doubly_indirect_blocks) {
-        // No need to update the doubly indirect block data.
-        remaining_blocks -= new_shape.doubly_indirect_blocks;
-        output_block_index += new_shape.doubly_indirect_blocks;
-    } else {
-        unsigned indirect_block_count = new_shape.doubly_indirect_blocks / entries_per_block;
-        if ((new_shape.doubly_indirect_blocks % entries_per_block) != 0)
-            indirect_block_count++;
-
-        auto dind_block_contents = ByteBuffer::create_uninitialized(block_size());
-        read_block(e2inode.i_block[EXT2_DIND_BLOCK], dind_block_contents.data());
-        if (dind_block_new) {
-            memset(dind_block_contents.data(), 0, dind_block_contents.size());
-            dind_block_dirty = true;
-        }
-        auto* dind_block_as_pointers = (unsigned*)dind_block_contents.data();
-
-        ASSERT(indirect_block_count <= entries_per_block);
-        for (unsigned i = 0; i < indirect_block_count; ++i) {
-            bool ind_block_dirty = false;
-
-            BlockIndex indirect_block_index = dind_block_as_pointers[i];
-
-            bool ind_block_new = !indirect_block_index;
-            if (ind_block_new) {
-                indirect_block_index = new_meta_blocks.take_last();
-                dind_block_as_pointers[i] = indirect_block_index;
-                dind_block_dirty = true;
-            }
+    if (!growing && old_shape.indirect_blocks && !new_shape.indirect_blocks) {
+        free_meta_block(e2inode.i_block[EXT2_IND_BLOCK]);
+        e2inode.i_block[EXT2_IND_BLOCK] = 0;
+        inode_dirty = true;
+    }
 
-            auto ind_block_contents = ByteBuffer::create_uninitialized(block_size());
-            read_block(indirect_block_index, ind_block_contents.data());
-            if (ind_block_new) {
-                memset(ind_block_contents.data(), 0, dind_block_contents.size());
-                ind_block_dirty = true;
-            }
-            auto* ind_block_as_pointers = (unsigned*)ind_block_contents.data();
-
-            unsigned entries_to_write = new_shape.doubly_indirect_blocks - (i * entries_per_block);
-            if (entries_to_write > entries_per_block)
-                entries_to_write = entries_per_block;
-
-            ASSERT(entries_to_write <= entries_per_block);
-            for (unsigned j = 0; j < entries_to_write; ++j) {
-                BlockIndex output_block = blocks[output_block_index++];
-                if (ind_block_as_pointers[j] != output_block) {
-                    ind_block_as_pointers[j] = output_block;
-                    ind_block_dirty = true;
-                }
-                --remaining_blocks;
-            }
-            for (unsigned j = entries_to_write; j < entries_per_block; ++j) {
-                if (ind_block_as_pointers[j] != 0) {
-                    ind_block_as_pointers[j] = 0;
-                    ind_block_dirty = true;
-                }
-            }
+    flush_pointer_block(ind_block);
+    flush_pointer_block(dind_block);
 
-            if (ind_block_dirty) {
-                bool success = write_block(indirect_block_index, ind_block_contents.data());
-                ASSERT(success);
-            }
-        }
-        for (unsigned i = indirect_block_count; i < entries_per_block; ++i) {
-            if (dind_block_as_pointers[i] != 0) {
-                dind_block_as_pointers[i] = 0;
-                dind_block_dirty = true;
-            }
-        }
+    for (auto block_index : freed_meta_blocks)
+        set_block_allocation_state(block_index, false);
 
-        if (dind_block_dirty) {
-            bool success = write_block(e2inode.i_block[EXT2_DIND_BLOCK], dind_block_contents.data());
-            ASSERT(success);
-        }
+    // NOTE: There is a mismatch between i_blocks and the block count since i_blocks includes meta blocks and the block count does not.
+    unsigned new_i_blocks = (new_block_count + new_shape.meta_blocks) * (block_size() / 512);
+    if (e2inode.i_blocks != new_i_blocks) {
+        e2inode.i_blocks = new_i_blocks;
+        inode_dirty = true;
     }
 
-    if (!remaining_blocks)
-        return true;
-
-    // FIXME: Implement!
-    dbg() << "we don't know how to write tind ext2fs blocks yet!";
-    ASSERT_NOT_REACHED();
+    if (inode_dirty)
+        write_ext2_inode(inode_index, e2inode);
+    return true;
 }
 
 Vector<Ext2FS::BlockIndex> Ext2FS::block_list_for_inode(const ext2_inode& e2inode, bool include_block_list_blocks) const
@@ -524,7 +594,7 @@ void Ext2FS::flush_block_group_descriptor_table()
     write_blocks(first_block_of_bgdt, blocks_to_write, (const u8*)block_group_descriptors());
 }
 
-void Ext2FS::flush_writes()
+void Ext2FS::flush_filesystem_metadata()
 {
     LOCKER(m_lock);
     if (m_super_block_dirty) {
@@ -544,9 +614,26 @@ void Ext2FS::flush_writes()
 #endif
         }
     }
+}
 
+void Ext2FS::flush_writes()
+{
+    LOCKER(m_lock);
+    flush_filesystem_metadata();
     FileBackedFS::flush_writes();
+    uncache_unused_inodes();
+}
 
+void Ext2FS::write_back_expired_writes()
+{
+    LOCKER(m_lock);
+    flush_filesystem_metadata();
+    FileBackedFS::write_back_expired_writes();
+    uncache_unused_inodes();
+}
+
+void Ext2FS::uncache_unused_inodes()
+{
     // Uncache Inodes that are only kept alive by the index-to-inode lookup cache.
     // We don't uncache Inodes that are being watched by at least one InodeWatcher.
 
@@ -565,6 +652,92 @@ void Ext2FS::flush_writes()
         uncache_inode(index);
 }
 
+KResult Ext2FS::fsync_inode(Ext2FSInode& inode, bool data_only)
+{
+    LOCKER(m_lock);
+
+    // fdatasync() may skip the inode itself, unless the size or the block list changed since it was last written out.
+    bool include_metadata = !data_only || inode.m_allocation_dirty;
+
+    HashTable<BlockIndex> metadata_blocks;
+    if (include_metadata) {
+        if (inode.is_metadata_dirty())
+            inode.flush_metadata();
+        flush_filesystem_metadata();
+
+        BlockIndex inode_block_index;
+        unsigned offset;
+        if (find_block_containing_inode(inode.index(), inode_block_index, offset))
+            metadata_blocks.set(inode_block_index);
+
+        unsigned first_block_of_bgdt = block_size() == 1024 ? 2 : 1;
+        unsigned bgdt_block_count = ceil_div(m_block_group_count * (unsigned)sizeof(ext2_group_desc), block_size());
+        for (unsigned i = 0; i < bgdt_block_count; ++i)
+            metadata_blocks.set(first_block_of_bgdt + i);
+        for (auto& cached_bitmap : m_cached_bitmaps)
+            metadata_blocks.set(cached_bitmap->bitmap_block_index);
+
+        auto& e2inode = inode.m_raw_inode;
+        if (!is_symlink(e2inode.i_mode) || e2inode.i_blocks) {
+            auto for_each_pointer_in_block = [&](BlockIndex block_index, auto callback) {
+                auto block = ByteBuffer::create_uninitialized(block_size());
+                read_block(block_index, block.data());
+                auto* pointers = reinterpret_cast<const BlockIndex*>(block.data());
+                for (unsigned i = 0; i < EXT2_ADDR_PER_BLOCK(&super_block()) && pointers[i]; ++i)
+                    callback(pointers[i]);
+            };
+            if (e2inode.i_block[EXT2_IND_BLOCK])
+                metadata_blocks.set(e2inode.i_block[EXT2_IND_BLOCK]);
+            if (e2inode.i_block[EXT2_DIND_BLOCK]) {
+                metadata_blocks.set(e2inode.i_block[EXT2_DIND_BLOCK]);
+                for_each_pointer_in_block(e2inode.i_block[EXT2_DIND_BLOCK], [&](BlockIndex ind_block_index) {
+                    metadata_blocks.set(ind_block_index);
+                });
+            }
+            if (e2inode.i_block[EXT2_TIND_BLOCK]) {
+                metadata_blocks.set(e2inode.i_block[EXT2_TIND_BLOCK]);
+                for_each_pointer_in_block(e2inode.i_block[EXT2_TIND_BLOCK], [&](BlockIndex dind_block_index) {
+                    metadata_blocks.set(dind_block_index);
+                    for_each_pointer_in_block(dind_block_index, [&](BlockIndex ind_block_index) {
+                        metadata_blocks.set(ind_block_index);
+                    });
+                });
+            }
+        }
+    }
+
+    // The extents are ordered by logical index, so make a copy ordered by block index for quick lookups.
+    inode.ensure_block_extents();
+    Vector<Ext2FSInode::BlockExtent> extents;
+    for (auto& extent : inode.m_block_extents) {
+        if (extent.block_index)
+            extents.append(extent);
+    }
+    quick_sort(extents.begin(), extents.end(), [](auto& a, auto& b) { return a.block_index < b.block_index; });
+
+    write_back_blocks_if([&](unsigned block_index) {
+        if (metadata_blocks.contains(block_index))
+            return true;
+        size_t low = 0;
+        size_t high = extents.size();
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            auto& extent = extents[middle];
+            if (block_index < extent.block_index)
+                high = middle;
+            else if (block_index >= extent.block_index + extent.length)
+                low = middle + 1;
+            else
+                return true;
+        }
+        return false;
+    });
+
+    if (include_metadata)
+        inode.m_allocation_dirty = false;
+    return KSuccess;
+}
+
 Ext2FSInode::Ext2FSInode(Ext2FS& fs, unsigned index)
     : Inode(fs, index)
 {
@@ -572,13 +745,14 @@ Ext2FSInode::Ext2FSInode(Ext2FS& fs, unsigned index)
 
 Ext2FSInode::~Ext2FSInode()
 {
+    discard_preallocation();
     if (m_raw_inode.i_links_count == 0)
         fs().free_inode(*this);
 }
 
 InodeMetadata Ext2FSInode::metadata() const
 {
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     InodeMetadata metadata;
     metadata.inode = identifier();
     metadata.size = m_raw_inode.i_size;
@@ -610,13 +784,6 @@ void Ext2FSInode::flush_metadata()
     dbg() << "Ext2FS: flush_metadata for inode " << identifier();
 #endif
     fs().write_ext2_inode(index(), m_raw_inode);
-    if (is_directory()) {
-        // Unless we're about to go away permanently, invalidate the lookup cache.
-        if (m_raw_inode.i_links_count != 0) {
-            // FIXME: This invalidation is way too hardcore. It's sad to throw away the whole cache.
-            m_lookup_cache.clear();
-        }
-    }
     set_metadata_dirty(false);
 }
 
@@ -648,10 +815,70 @@ RefPtr<Inode> Ext2FS::get_inode(InodeIdentifier inode) const
     return new_inode;
 }
 
+void Ext2FSInode::append_to_block_extents(unsigned block_index) const
+{
+    if (!m_block_extents.is_empty()) {
+        auto& last = m_block_extents.last();
+        bool is_contiguous = block_index ? (last.block_index && last.block_index + last.length == block_index) : !last.block_index;
+        if (is_contiguous) {
+            ++last.length;
+            return;
+        }
+    }
+    m_block_extents.append({ (unsigned)block_count(), block_index, 1 });
+}
+
+void Ext2FSInode::set_block_extents(const Vector<unsigned>& block_list)
+{
+    m_block_extents.clear();
+    for (auto block_index : block_list)
+        append_to_block_extents(block_index);
+    m_block_extents_loaded = true;
+}
+
+void Ext2FSInode::ensure_block_extents() const
+{
+    if (m_block_extents_loaded)
+        return;
+    // Loading the extents modifies the inode, so this has to happen before
+    // readers take the inode lock shared.
+    LOCKER(m_lock);
+    if (m_block_extents_loaded)
+        return;
+    const_cast<Ext2FSInode&>(*this).set_block_extents(fs().block_list_for_inode(m_raw_inode));
+}
+
+unsigned Ext2FSInode::block_index_for(size_t logical_index, size_t& contiguous_block_count) const
+{
+    ASSERT(m_block_extents_loaded);
+    ASSERT(logical_index < block_count());
+
+    size_t low = 0;
+    size_t high = m_block_extents.size();
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (m_block_extents[middle].logical_index <= logical_index)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    auto& extent = m_block_extents[low];
+    size_t offset_into_extent = logical_index - extent.logical_index;
+    contiguous_block_count = extent.length - offset_into_extent;
+    if (!extent.block_index)
+        return 0;
+    return extent.block_index + offset_into_extent;
+}
+
 ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, u8* buffer, FileDescription* description) const
 {
-    Locker inode_locker(m_lock);
     ASSERT(offset >= 0);
+    if (!is_symlink() || size() >= max_inline_symlink_length)
+        ensure_block_extents();
+
+    // Readers only share the inode; the FS lock is taken per block by the disk cache.
+    Locker inode_locker(m_lock, Lock::Mode::Shared);
     if (m_raw_inode.i_size == 0)
         return 0;
 
@@ -664,12 +891,8 @@ ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, u8* buffer, FileDes
         return nread;
     }
 
-    Locker fs_locker(fs().m_lock);
-
-    if (m_block_list.is_empty())
-        m_block_list = fs().block_list_for_inode(m_raw_inode);
-
-    if (m_block_list.is_empty()) {
+    ASSERT(m_block_extents_loaded);
+    if (!block_count()) {
         klog() << "ext2fs: read_bytes: empty block list for inode " << index();
         return -EIO;
     }
@@ -678,8 +901,8 @@ ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, u8* buffer, FileDes
 
     size_t first_block_logical_index = offset / block_size;
     size_t last_block_logical_index = (offset + count) / block_size;
-    if (last_block_logical_index >= m_block_list.size())
-        last_block_logical_index = m_block_list.size() - 1;
+    if (last_block_logical_index >= block_count())
+        last_block_logical_index = block_count() - 1;
 
     int offset_into_first_block = offset % block_size;
 
@@ -692,29 +915,100 @@ ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, u8* buffer, FileDes
 #endif
 
     u8 block[max_block_size];
+    auto cache_policy = Kernel::is_regular_file(m_raw_inode.i_mode) ? Ext2FS::CachePolicy::PassThrough : Ext2FS::CachePolicy::KeepCached;
 
-    for (size_t bi = first_block_logical_index; remaining_count && bi <= last_block_logical_index; ++bi) {
-        auto block_index = m_block_list[bi];
+    // Whole blocks that are physically contiguous on disk are read straight into the caller's buffer, and all
+    // the extents are handed to the disk together once we know them, so page-ins and readahead wait only once.
+    Vector<Ext2FS::BlockRun> runs;
+
+    size_t bi = first_block_logical_index;
+    while (remaining_count && bi <= last_block_logical_index) {
+        size_t contiguous_block_count = 0;
+        auto block_index = block_index_for(bi, contiguous_block_count);
         ASSERT(block_index);
-        bool success = fs().read_block(block_index, block, description);
+
+        size_t offset_into_block = (bi == first_block_logical_index) ? offset_into_first_block : 0;
+
+        if (!offset_into_block && remaining_count >= (size_t)block_size) {
+            size_t run_length = min(contiguous_block_count, min(remaining_count / block_size, last_block_logical_index - bi + 1));
+            runs.append({ block_index, (unsigned)run_length, out });
+            size_t num_bytes_read = run_length * block_size;
+            remaining_count -= num_bytes_read;
+            nread += num_bytes_read;
+            out += num_bytes_read;
+            bi += run_length;
+            continue;
+        }
+
+        bool success = fs().read_block(block_index, block, description, cache_policy);
         if (!success) {
             klog() << "ext2fs: read_bytes: read_block(" << block_index << ") failed (lbi: " << bi << ")";
             return -EIO;
         }
 
-        size_t offset_into_block = (bi == first_block_logical_index) ? offset_into_first_block : 0;
         size_t num_bytes_to_copy = min(block_size - offset_into_block, remaining_count);
         memcpy(out, block + offset_into_block, num_bytes_to_copy);
         remaining_count -= num_bytes_to_copy;
         nread += num_bytes_to_copy;
         out += num_bytes_to_copy;
+        ++bi;
+    }
+
+    if (!runs.is_empty() && !fs().read_block_runs(runs, description, cache_policy)) {
+        klog() << "ext2fs: read_bytes: read_block_runs(" << runs.first().index << " x" << runs.first().count << ", +" << (runs.size() - 1) << " more) failed";
+        return -EIO;
     }
 
     return nread;
 }
 
+Vector<unsigned> Ext2FSInode::allocate_blocks_for_growth(size_t count)
+{
+    ASSERT(fs().m_lock.is_locked());
+    Vector<unsigned> blocks;
+    blocks.ensure_capacity(count);
+
+    // Blocks preallocated by an earlier append directly follow the current last block, so hand those out first.
+    size_t preallocated_count = min(count, m_preallocated_block_count);
+    for (size_t i = 0; i < preallocated_count; ++i)
+        blocks.unchecked_append(m_preallocated_block_index + i);
+    m_preallocated_block_index += preallocated_count;
+    m_preallocated_block_count -= preallocated_count;
+
+    if (blocks.size() < count) {
+        unsigned goal = 0;
+        if (!blocks.is_empty())
+            goal = blocks.last() + 1;
+        else if (!m_block_extents.is_empty() && m_block_extents.last().block_index)
+            goal = m_block_extents.last().block_index + m_block_extents.last().length;
+        blocks.append(fs().allocate_blocks(fs().group_index_from_inode(index()), count - blocks.size(), goal));
+    }
+
+#ifdef EXT2_PREALLOCATE
+    // Reserve the blocks following the new tail, so that the next append lands right behind this one.
+    if (!m_preallocated_block_count && !is_symlink()) {
+        m_preallocated_block_index = blocks.last() + 1;
+        m_preallocated_block_count = fs().allocate_blocks_at(m_preallocated_block_index, EXT2_DEFAULT_PREALLOC_BLOCKS);
+    }
+#endif
+
+    return blocks;
+}
+
+void Ext2FSInode::discard_preallocation()
+{
+    if (!m_preallocated_block_count)
+        return;
+#ifdef EXT2_DEBUG
+    dbg() << "Ext2FS: Discarding " << m_preallocated_block_count << " preallocated block(s) at " << m_preallocated_block_index << " for inode " << identifier();
+#endif
+    fs().set_block_range_allocation_state(m_preallocated_block_index, m_preallocated_block_count, false);
+    m_preallocated_block_count = 0;
+}
+
 KResult Ext2FSInode::resize(u64 new_size)
 {
+    LOCKER(fs().m_lock);
     u64 old_size = size();
     if (old_size == new_size)
         return KSuccess;
@@ -730,46 +1024,66 @@ KResult Ext2FSInode::resize(u64 new_size)
 
     if (blocks_needed_after > blocks_needed_before) {
         u32 additional_blocks_needed = blocks_needed_after - blocks_needed_before;
-        if (additional_blocks_needed > fs().super_block().s_free_blocks_count)
+        if (additional_blocks_needed > fs().super_block().s_free_blocks_count + m_preallocated_block_count)
             return KResult(-ENOSPC);
     }
 
-    auto block_list = fs().block_list_for_inode(m_raw_inode);
-    if (blocks_needed_after > blocks_needed_before) {
-        auto new_blocks = fs().allocate_blocks(fs().group_index_from_inode(index()), blocks_needed_after - blocks_needed_before);
-        block_list.append(move(new_blocks));
-    } else if (blocks_needed_after < blocks_needed_before) {
+    ensure_block_extents();
+    size_t old_block_count = block_count();
+
+    Vector<Ext2FS::BlockIndex> new_blocks;
+    if (blocks_needed_after > old_block_count) {
+        new_blocks = allocate_blocks_for_growth(blocks_needed_after - old_block_count);
+        for (auto block_index : new_blocks)
+            append_to_block_extents(block_index);
+    } else if (blocks_needed_after < old_block_count) {
 #ifdef EXT2_DEBUG
-        dbg() << "Ext2FS: Shrinking inode " << identifier() << ". Old block list is " << block_list.size() << " entries:";
-        for (auto block_index : block_list) {
-            dbg() << "    # " << block_index;
-        }
+        dbg() << "Ext2FS: Shrinking inode " << identifier() << " from " << old_block_count << " to " << blocks_needed_after << " blocks";
 #endif
-        while (block_list.size() != blocks_needed_after) {
-            auto block_index = block_list.take_last();
-            if (block_index)
-                fs().set_block_allocation_state(block_index, false);
+        discard_preallocation();
+        while (block_count() != blocks_needed_after) {
+            auto& extent = m_block_extents.last();
+            size_t blocks_to_drop = min((size_t)extent.length, block_count() - blocks_needed_after);
+            if (extent.block_index)
+                fs().set_block_range_allocation_state(extent.block_index + extent.length - blocks_to_drop, blocks_to_drop, false);
+            extent.length -= blocks_to_drop;
+            if (!extent.length)
+                m_block_extents.take_last();
         }
     }
 
-    bool success = fs().write_block_list_for_inode(index(), m_raw_inode, block_list);
+    bool success = fs().resize_block_list_for_inode(index(), m_raw_inode, old_block_count, blocks_needed_after, new_blocks);
     if (!success)
         return KResult(-EIO);
 
     m_raw_inode.i_size = new_size;
+    m_allocation_dirty = true;
     set_metadata_dirty(true);
-
-    m_block_list = move(block_list);
     return KSuccess;
 }
 
 ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, FileDescription* description)
+{
+    ssize_t nwritten;
+    {
+        Locker inode_locker(m_lock);
+        Locker fs_locker(fs().m_lock);
+        nwritten = write_bytes_impl(offset, count, data, description);
+    }
+
+    // Writing back on behalf of a throttled writer can take a while, so don't keep the
+    // inode and the file system locked for everyone else meanwhile.
+    if (nwritten > 0)
+        fs().throttle_writer_if_needed();
+    return nwritten;
+}
+
+ssize_t Ext2FSInode::write_bytes_impl(off_t offset, ssize_t count, const u8* data, FileDescription* description)
 {
     ASSERT(offset >= 0);
     ASSERT(count >= 0);
-
-    Locker inode_locker(m_lock);
-    Locker fs_locker(fs().m_lock);
+    ASSERT(m_lock.is_locked());
+    ASSERT(fs().m_lock.is_locked());
 
     auto result = prepare_to_write_data();
     if (result.is_error())
@@ -797,18 +1111,17 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, Fi
     if (resize_result.is_error())
         return resize_result;
 
-    if (m_block_list.is_empty())
-        m_block_list = fs().block_list_for_inode(m_raw_inode);
+    ensure_block_extents();
 
-    if (m_block_list.is_empty()) {
+    if (!block_count()) {
         dbg() << "Ext2FSInode::write_bytes(): empty block list for inode " << index();
         return -EIO;
     }
 
     size_t first_block_logical_index = offset / block_size;
     size_t last_block_logical_index = (offset + count) / block_size;
-    if (last_block_logical_index >= m_block_list.size())
-        last_block_logical_index = m_block_list.size() - 1;
+    if (last_block_logical_index >= block_count())
+        last_block_logical_index = block_count() - 1;
 
     size_t offset_into_first_block = offset % block_size;
 
@@ -823,16 +1136,19 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, Fi
 #endif
 
     auto buffer_block = ByteBuffer::create_uninitialized(block_size);
+    auto cache_policy = Kernel::is_regular_file(m_raw_inode.i_mode) ? Ext2FS::CachePolicy::PassThrough : Ext2FS::CachePolicy::KeepCached;
     for (size_t bi = first_block_logical_index; remaining_count && bi <= last_block_logical_index; ++bi) {
         size_t offset_into_block = (bi == first_block_logical_index) ? offset_into_first_block : 0;
         size_t num_bytes_to_copy = min(block_size - offset_into_block, remaining_count);
+        size_t contiguous_block_count = 0;
+        auto block_index = block_index_for(bi, contiguous_block_count);
 
         ByteBuffer block;
         if (offset_into_block != 0 || num_bytes_to_copy != block_size) {
             block = ByteBuffer::create_uninitialized(block_size);
-            bool success = fs().read_block(m_block_list[bi], block.data(), description);
+            bool success = fs().read_block(block_index, block.data(), description, cache_policy);
             if (!success) {
-                dbg() << "Ext2FS: In write_bytes, read_block(" << m_block_list[bi] << ") failed (bi: " << bi << ")";
+                dbg() << "Ext2FS: In write_bytes, read_block(" << block_index << ") failed (bi: " << bi << ")";
                 return -EIO;
             }
         } else
@@ -848,11 +1164,11 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, Fi
             memset(block.data() + padding_start, 0, padding_bytes);
         }
 #ifdef EXT2_DEBUG
-        dbg() << "Ext2FS: Writing block " << m_block_list[bi] << " (offset_into_block: " << offset_into_block << ")";
+        dbg() << "Ext2FS: Writing block " << block_index << " (offset_into_block: " << offset_into_block << ")";
 #endif
-        bool success = fs().write_block(m_block_list[bi], block.data(), description);
+        bool success = fs().write_block(block_index, block.data(), description, cache_policy);
         if (!success) {
-            dbg() << "Ext2FS: write_block(" << m_block_list[bi] << ") failed (bi: " << bi << ")";
+            dbg() << "Ext2FS: write_block(" << block_index << ") failed (bi: " << bi << ")";
             ASSERT_NOT_REACHED();
             return -EIO;
         }
@@ -862,7 +1178,7 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, Fi
     }
 
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: After write, i_size=" << m_raw_inode.i_size << ", i_blocks=" << m_raw_inode.i_blocks << " (" << m_block_list.size() << " blocks in list)";
+    dbg() << "Ext2FS: After write, i_size=" << m_raw_inode.i_size << ", i_blocks=" << m_raw_inode.i_blocks << " (" << block_count() << " blocks in " << m_block_extents.size() << " extents)";
 #endif
 
     if (old_size != new_size)
@@ -873,8 +1189,9 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const u8* data, Fi
 
 bool Ext2FSInode::traverse_as_directory(Function<bool(const FS::DirectoryEntry&)> callback) const
 {
-    LOCKER(m_lock);
     ASSERT(is_directory());
+    ensure_block_extents();
+    Locker locker(m_lock, Lock::Mode::Shared);
 
 #ifdef EXT2_DEBUG
     dbg() << "Ext2FS: Traversing as directory: " << identifier();
@@ -948,6 +1265,9 @@ bool Ext2FSInode::write_directory(const Vector<FS::DirectoryEntry>& entries)
     ssize_t nwritten = write_bytes(0, directory_data.size(), directory_data.data(), nullptr);
     if (nwritten < 0)
         return false;
+    m_lookup_cache.clear();
+    m_directory_block_free_space.clear();
+    m_lookup_cache_populated = false;
     set_metadata_dirty(true);
     return static_cast<size_t>(nwritten) == directory_data.size();
 }
@@ -964,17 +1284,8 @@ KResult Ext2FSInode::add_child(InodeIdentifier child_id, const StringView& name,
     dbg() << "Ext2FSInode::add_child(): Adding inode " << child_id.index() << " with name '" << name << "' and mode " << mode << " to directory " << index();
 #endif
 
-    Vector<FS::DirectoryEntry> entries;
-    bool name_already_exists = false;
-    traverse_as_directory([&](auto& entry) {
-        if (name == entry.name) {
-            name_already_exists = true;
-            return false;
-        }
-        entries.append(entry);
-        return true;
-    });
-    if (name_already_exists) {
+    populate_lookup_cache();
+    if (m_lookup_cache.contains(name)) {
         dbg() << "Ext2FSInode::add_child(): Name '" << name << "' already exists in inode " << index();
         return KResult(-EEXIST);
     }
@@ -986,10 +1297,32 @@ KResult Ext2FSInode::add_child(InodeIdentifier child_id, const StringView& name,
             return result;
     }
 
-    entries.empend(name.characters_without_null_termination(), name.length(), child_id, to_ext2_file_type(mode));
-    bool success = write_directory(entries);
-    if (success)
-        m_lookup_cache.set(name, child_id.index());
+    const size_t block_size = fs().block_size();
+    u16 needed_record_length = EXT2_DIR_REC_LEN(name.length());
+    auto block = ByteBuffer::create_uninitialized(block_size);
+
+    // Put the entry into the first block with enough room for it, or start a new block if they're all full.
+    auto block_with_room = m_directory_block_free_space.find_first_block_with_room(needed_record_length);
+    size_t bi = block_with_room.has_value() ? block_with_room.value() : m_directory_block_free_space.block_count();
+
+    if (block_with_room.has_value()) {
+        if (read_bytes(bi * block_size, block_size, block.data(), nullptr) != (ssize_t)block_size)
+            return KResult(-EIO);
+        bool inserted = insert_directory_entry_into_block(block.data(), block_size, child_id, name, to_ext2_file_type(mode));
+        ASSERT(inserted);
+    } else {
+        memset(block.data(), 0, block_size);
+        write_directory_entry(*reinterpret_cast<ext2_dir_entry_2*>(block.data()), block_size, child_id, name, to_ext2_file_type(mode));
+        m_directory_block_free_space.append(0);
+    }
+
+    if (write_bytes(bi * block_size, block_size, block.data(), nullptr) != (ssize_t)block_size)
+        return KResult(-EIO);
+
+    m_directory_block_free_space.set(bi, largest_free_record_in_directory_block(block.data(), block_size));
+    m_lookup_cache.set(name, { child_id.index(), (unsigned)bi });
+    NameCache::the().invalidate(identifier(), name);
+    did_modify_directory();
     return KSuccess;
 }
 
@@ -1001,37 +1334,48 @@ KResult Ext2FSInode::remove_child(const StringView& name)
 #endif
     ASSERT(is_directory());
 
+    populate_lookup_cache();
     auto it = m_lookup_cache.find(name);
     if (it == m_lookup_cache.end())
         return KResult(-ENOENT);
-    auto child_inode_index = (*it).value;
+    auto child_inode_index = (*it).value.inode_index;
+    size_t bi = (*it).value.block_index;
 
     InodeIdentifier child_id { fsid(), child_inode_index };
 
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FSInode::remove_child(): Removing '" << name << "' in directory " << index();
+    dbg() << "Ext2FSInode::remove_child(): Removing '" << name << "' from block " << bi << " of directory " << index();
 #endif
 
-    Vector<FS::DirectoryEntry> entries;
-    traverse_as_directory([&](auto& entry) {
-        if (name != entry.name)
-            entries.append(entry);
-        return true;
-    });
+    const size_t block_size = fs().block_size();
+    auto block = ByteBuffer::create_uninitialized(block_size);
+    if (read_bytes(bi * block_size, block_size, block.data(), nullptr) != (ssize_t)block_size)
+        return KResult(-EIO);
+
+    bool removed = remove_directory_entry_from_block(block.data(), block_size, name);
+    ASSERT(removed);
 
-    bool success = write_directory(entries);
-    if (!success) {
-        // FIXME: Plumb error from write_directory().
+    if (write_bytes(bi * block_size, block_size, block.data(), nullptr) != (ssize_t)block_size)
         return KResult(-EIO);
-    }
+
+    m_directory_block_free_space.set(bi, largest_free_record_in_directory_block(block.data(), block_size));
+    did_modify_directory();
 
     m_lookup_cache.remove(name);
+    NameCache::the().invalidate(identifier(), name);
 
     auto child_inode = fs().get_inode(child_id);
     child_inode->decrement_link_count();
     return KSuccess;
 }
 
+void Ext2FSInode::did_modify_directory()
+{
+    // We don't maintain the hashed index, so make sure nobody trusts a stale one.
+    m_raw_inode.i_flags &= ~EXT2_INDEX_FL;
+    set_metadata_dirty(true);
+}
+
 unsigned Ext2FS::inodes_per_block() const
 {
     return EXT2_INODES_PER_BLOCK(&super_block());
@@ -1065,65 +1409,123 @@ bool Ext2FS::write_ext2_inode(unsigned inode, const ext2_inode& e2inode)
     return success;
 }
 
-Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_index, size_t count)
+Ext2FS::BlockGroupFreeExtentSummary& Ext2FS::free_extent_summary(GroupIndex group_index)
+{
+    ASSERT(group_index >= 1 && group_index <= m_block_group_count);
+    auto& summary = m_free_extent_summaries[group_index - 1];
+    if (!summary.needs_rescan)
+        return summary;
+
+    auto& cached_bitmap = get_bitmap_block(group_descriptor(group_index).bg_block_bitmap);
+    unsigned blocks_in_group = min(blocks_per_group(), super_block().s_blocks_count);
+    auto block_bitmap = cached_bitmap.bitmap(blocks_in_group);
+
+    size_t largest_free_run = 0;
+    block_bitmap.find_longest_range_of_unset_bits(blocks_in_group, largest_free_run);
+    summary.largest_free_run = largest_free_run;
+    summary.first_free_bit = block_bitmap.find_first_unset().value_or(blocks_in_group);
+    summary.needs_rescan = false;
+#ifdef EXT2_DEBUG
+    dbg() << "Ext2FS: group " << group_index << " largest free run: " << summary.largest_free_run << ", first free bit: " << summary.first_free_bit;
+#endif
+    return summary;
+}
+
+Ext2FS::GroupIndex Ext2FS::find_group_for_block_allocation(GroupIndex preferred_group_index, size_t count)
+{
+    // Take the first group (starting at the preferred one) that can fit the whole allocation in one run.
+    // If there is none, go with the group that has the longest run.
+    GroupIndex best_group_index = 0;
+    unsigned best_free_run = 0;
+    for (unsigned i = 0; i < m_block_group_count; ++i) {
+        GroupIndex group_index = ((preferred_group_index - 1 + i) % m_block_group_count) + 1;
+        if (!group_descriptor(group_index).bg_free_blocks_count)
+            continue;
+        auto& summary = free_extent_summary(group_index);
+        if (summary.largest_free_run >= count)
+            return group_index;
+        if (summary.largest_free_run > best_free_run) {
+            best_group_index = group_index;
+            best_free_run = summary.largest_free_run;
+        }
+    }
+    return best_group_index;
+}
+
+size_t Ext2FS::allocate_blocks_at(BlockIndex first_block, size_t max_count)
+{
+    LOCKER(m_lock);
+    if (!first_block || first_block >= super_block().s_blocks_count)
+        return 0;
+
+    GroupIndex group_index = group_index_from_block_index(first_block);
+    auto& cached_bitmap = get_bitmap_block(group_descriptor(group_index).bg_block_bitmap);
+    unsigned blocks_in_group = min(blocks_per_group(), super_block().s_blocks_count);
+    auto block_bitmap = cached_bitmap.bitmap(blocks_in_group);
+
+    BlockIndex first_block_in_group = (group_index - 1) * blocks_per_group() + first_block_index();
+    unsigned bit_index = first_block - first_block_in_group;
+
+    size_t count = 0;
+    while (count < max_count && bit_index + count < blocks_in_group && !block_bitmap.get(bit_index + count))
+        ++count;
+
+    if (count)
+        set_block_range_allocation_state(first_block, count, true);
+    return count;
+}
+
+Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_index, size_t count, BlockIndex goal)
 {
     LOCKER(m_lock);
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: allocate_blocks(preferred group: " << preferred_group_index << ", count: " << count << ")";
+    dbg() << "Ext2FS: allocate_blocks(preferred group: " << preferred_group_index << ", count: " << count << ", goal: " << goal << ")";
 #endif
     if (count == 0)
         return {};
 
     Vector<BlockIndex> blocks;
-#ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: allocate_blocks:";
-#endif
     blocks.ensure_capacity(count);
 
-    GroupIndex group_index = preferred_group_index;
-
-    if (!group_descriptor(preferred_group_index).bg_free_blocks_count) {
-        group_index = 1;
+    // Continuing right where the caller left off keeps files contiguous on disk.
+    if (goal) {
+        size_t allocated_count = allocate_blocks_at(goal, count);
+        for (size_t i = 0; i < allocated_count; ++i)
+            blocks.unchecked_append(goal + i);
+        preferred_group_index = group_index_from_block_index(goal);
     }
 
     while (blocks.size() < count) {
-
-        bool found_a_group = false;
-        if (group_descriptor(group_index).bg_free_blocks_count) {
-            found_a_group = true;
-        } else {
-            if (group_index == preferred_group_index)
-                group_index = 1;
-            for (; group_index < m_block_group_count; ++group_index) {
-                if (group_descriptor(group_index).bg_free_blocks_count) {
-                    found_a_group = true;
-                    break;
-                }
-            }
+        size_t remaining_count = count - blocks.size();
+        GroupIndex group_index = find_group_for_block_allocation(preferred_group_index, remaining_count);
+        ASSERT(group_index);
+
+        auto& summary = free_extent_summary(group_index);
+        auto& cached_bitmap = get_bitmap_block(group_descriptor(group_index).bg_block_bitmap);
+        unsigned blocks_in_group = min(blocks_per_group(), super_block().s_blocks_count);
+        auto block_bitmap = cached_bitmap.bitmap(blocks_in_group);
+
+        size_t first_bit = summary.first_free_bit;
+        auto run_length = block_bitmap.find_next_range_of_unset_bits(first_bit, remaining_count, remaining_count);
+        if (!run_length.has_value()) {
+            // The summary was too optimistic. Settle for the longest run we can get, which also tells us what the summary should say.
+            size_t longest_run_length = 0;
+            auto longest_run_start = block_bitmap.find_longest_range_of_unset_bits(remaining_count, longest_run_length);
+            ASSERT(longest_run_start.has_value());
+            summary.largest_free_run = longest_run_length;
+            first_bit = longest_run_start.value();
+            run_length = longest_run_length;
         }
 
-        ASSERT(found_a_group);
-        auto& bgd = group_descriptor(group_index);
-        auto& cached_bitmap = get_bitmap_block(bgd.bg_block_bitmap);
-
-        int blocks_in_group = min(blocks_per_group(), super_block().s_blocks_count);
-        auto block_bitmap = Bitmap::wrap(cached_bitmap.buffer.data(), blocks_in_group);
-
         BlockIndex first_block_in_group = (group_index - 1) * blocks_per_group() + first_block_index();
-        size_t free_region_size = 0;
-        auto first_unset_bit_index = block_bitmap.find_longest_range_of_unset_bits(count - blocks.size(), free_region_size);
-        ASSERT(first_unset_bit_index.has_value());
+        BlockIndex first_block = first_block_in_group + first_bit;
 #ifdef EXT2_DEBUG
-        dbg() << "Ext2FS: allocating free region of size: " << free_region_size << "[" << group_index << "]";
+        dbg() << "Ext2FS: allocating free region of size: " << run_length.value() << " at " << first_block << " [" << group_index << "]";
 #endif
-        for (size_t i = 0; i < free_region_size; ++i) {
-            BlockIndex block_index = (first_unset_bit_index.value() + i) + first_block_in_group;
-            set_block_allocation_state(block_index, true);
-            blocks.unchecked_append(block_index);
-#ifdef EXT2_DEBUG
-            dbg() << "  allocated > " << block_index;
-#endif
-        }
+        set_block_range_allocation_state(first_block, run_length.value(), true);
+        for (size_t i = 0; i < run_length.value(); ++i)
+            blocks.unchecked_append(first_block + i);
+        preferred_group_index = group_index;
     }
 
     ASSERT(blocks.size() == count);
@@ -1295,53 +1697,69 @@ Ext2FS::CachedBitmap& Ext2FS::get_bitmap_block(BlockIndex bitmap_block_index)
 
 bool Ext2FS::set_block_allocation_state(BlockIndex block_index, bool new_state)
 {
-    ASSERT(block_index != 0);
+    return set_block_range_allocation_state(block_index, 1, new_state);
+}
+
+bool Ext2FS::set_block_range_allocation_state(BlockIndex first_block, size_t count, bool new_state)
+{
+    ASSERT(first_block != 0);
     LOCKER(m_lock);
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: set_block_allocation_state(block=" << block_index << ", state=" << String::format("%u", new_state) << ")";
+    dbg() << "Ext2FS: set_block_range_allocation_state(first_block=" << first_block << ", count=" << count << ", state=" << String::format("%u", new_state) << ")";
 #endif
 
-    GroupIndex group_index = group_index_from_block_index(block_index);
-    auto& bgd = group_descriptor(group_index);
-    BlockIndex index_in_group = (block_index - first_block_index()) - ((group_index - 1) * blocks_per_group());
-    unsigned bit_index = index_in_group % blocks_per_group();
-
-    auto& cached_bitmap = get_bitmap_block(bgd.bg_block_bitmap);
-
-    bool current_state = cached_bitmap.bitmap(blocks_per_group()).get(bit_index);
-#ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: block " << block_index << " state: " << String::format("%u", current_state) << " -> " << String::format("%u", new_state) << " (in bitmap block " << bgd.bg_block_bitmap << ")";
-#endif
+    while (count) {
+        GroupIndex group_index = group_index_from_block_index(first_block);
+        auto& bgd = group_descriptor(group_index);
+        BlockIndex index_in_group = (first_block - first_block_index()) - ((group_index - 1) * blocks_per_group());
+        unsigned bit_index = index_in_group % blocks_per_group();
+        size_t count_in_group = min(count, (size_t)(blocks_per_group() - bit_index));
 
-    if (current_state == new_state) {
-        ASSERT_NOT_REACHED();
-        return true;
-    }
+        auto& cached_bitmap = get_bitmap_block(bgd.bg_block_bitmap);
+        auto block_bitmap = cached_bitmap.bitmap(blocks_per_group());
 
-    cached_bitmap.bitmap(blocks_per_group()).set(bit_index, new_state);
-    cached_bitmap.dirty = true;
+        for (size_t i = 0; i < count_in_group; ++i) {
+            if (block_bitmap.get(bit_index + i) == new_state) {
+                dbg() << "Ext2FS: block " << (first_block + i) << " is already " << (new_state ? "allocated" : "free");
+                ASSERT_NOT_REACHED();
+            }
+        }
 
-    // Update superblock
+        block_bitmap.set_range(bit_index, count_in_group, new_state);
+        cached_bitmap.dirty = true;
+
+        // Update superblock
+        if (new_state)
+            m_super_block.s_free_blocks_count -= count_in_group;
+        else
+            m_super_block.s_free_blocks_count += count_in_group;
+        m_super_block_dirty = true;
+
+        // Update BGD
+        auto& mutable_bgd = const_cast<ext2_group_desc&>(bgd);
+        if (new_state)
+            mutable_bgd.bg_free_blocks_count -= count_in_group;
+        else
+            mutable_bgd.bg_free_blocks_count += count_in_group;
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: superblock free block count " << m_super_block.s_free_blocks_count << " -> " << (m_super_block.s_free_blocks_count - 1);
+        dbg() << "Ext2FS: group " << group_index << " free block count is now " << bgd.bg_free_blocks_count;
 #endif
-    if (new_state)
-        --m_super_block.s_free_blocks_count;
-    else
-        ++m_super_block.s_free_blocks_count;
-    m_super_block_dirty = true;
+        m_block_group_descriptors_dirty = true;
 
-    // Update BGD
-    auto& mutable_bgd = const_cast<ext2_group_desc&>(bgd);
-    if (new_state)
-        --mutable_bgd.bg_free_blocks_count;
-    else
-        ++mutable_bgd.bg_free_blocks_count;
-#ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: group " << group_index << " free block count " << bgd.bg_free_blocks_count << " -> " << (bgd.bg_free_blocks_count - 1);
-#endif
+        // Allocating only ever shortens free runs, so the summary stays a valid upper bound.
+        // Freeing may join runs together though, so we have to look again.
+        auto& summary = m_free_extent_summaries[group_index - 1];
+        if (new_state) {
+            if (bit_index <= summary.first_free_bit && bit_index + count_in_group > summary.first_free_bit)
+                summary.first_free_bit = bit_index + count_in_group;
+        } else {
+            summary.first_free_bit = min(summary.first_free_bit, bit_index);
+            summary.needs_rescan = true;
+        }
 
-    m_block_group_descriptors_dirty = true;
+        first_block += count_in_group;
+        count -= count_in_group;
+    }
     return true;
 }
 
@@ -1454,7 +1872,7 @@ KResultOr<NonnullRefPtr<Inode>> Ext2FS::create_inode(InodeIdentifier parent_id,
     else if (is_block_device(mode))
         e2inode.i_block[1] = dev;
 
-    success = write_block_list_for_inode(inode_id, e2inode, blocks);
+    success = resize_block_list_for_inode(inode_id, e2inode, 0, blocks.size(), blocks);
     ASSERT(success);
 
 #ifdef EXT2_DEBUG
@@ -1469,35 +1887,113 @@ KResultOr<NonnullRefPtr<Inode>> Ext2FS::create_inode(InodeIdentifier parent_id,
 
     auto inode = get_inode({ fsid(), inode_id });
     // If we've already computed a block list, no sense in throwing it away.
-    static_cast<Ext2FSInode&>(*inode).m_block_list = move(blocks);
+    static_cast<Ext2FSInode&>(*inode).set_block_extents(blocks);
     return inode.release_nonnull();
 }
 
+void Ext2FSInode::DirectoryFreeSpaceIndex::build(const Vector<u16>& free_space_per_block)
+{
+    m_block_count = free_space_per_block.size();
+    m_leaf_count = 1;
+    while (m_leaf_count < m_block_count)
+        m_leaf_count *= 2;
+    m_tree.clear();
+    m_tree.resize(2 * m_leaf_count);
+    for (size_t i = 0; i < m_tree.size(); ++i)
+        m_tree[i] = 0;
+    for (size_t i = 0; i < m_block_count; ++i)
+        m_tree[m_leaf_count + i] = free_space_per_block[i];
+    for (size_t node = m_leaf_count - 1; node > 0; --node)
+        m_tree[node] = max(m_tree[2 * node], m_tree[2 * node + 1]);
+}
+
+void Ext2FSInode::DirectoryFreeSpaceIndex::clear()
+{
+    m_block_count = 0;
+    m_leaf_count = 0;
+    m_tree.clear();
+}
+
+void Ext2FSInode::DirectoryFreeSpaceIndex::append(u16 free_space)
+{
+    if (m_block_count == m_leaf_count) {
+        // Out of leaves, so rebuild with twice as many.
+        Vector<u16> free_space_per_block;
+        free_space_per_block.ensure_capacity(m_block_count + 1);
+        for (size_t i = 0; i < m_block_count; ++i)
+            free_space_per_block.unchecked_append(m_tree[m_leaf_count + i]);
+        free_space_per_block.unchecked_append(free_space);
+        build(free_space_per_block);
+        return;
+    }
+    ++m_block_count;
+    set(m_block_count - 1, free_space);
+}
+
+void Ext2FSInode::DirectoryFreeSpaceIndex::set(size_t block_index, u16 free_space)
+{
+    ASSERT(block_index < m_block_count);
+    size_t node = m_leaf_count + block_index;
+    m_tree[node] = free_space;
+    update_parents(node);
+}
+
+void Ext2FSInode::DirectoryFreeSpaceIndex::update_parents(size_t node)
+{
+    for (node /= 2; node > 0; node /= 2)
+        m_tree[node] = max(m_tree[2 * node], m_tree[2 * node + 1]);
+}
+
+Optional<size_t> Ext2FSInode::DirectoryFreeSpaceIndex::find_first_block_with_room(u16 record_length) const
+{
+    ASSERT(record_length);
+    if (!m_block_count || m_tree[1] < record_length)
+        return {};
+    // Unused leaves are 0, so this never ends up past the last block.
+    size_t node = 1;
+    while (node < m_leaf_count)
+        node = m_tree[2 * node] >= record_length ? 2 * node : 2 * node + 1;
+    return node - m_leaf_count;
+}
+
 void Ext2FSInode::populate_lookup_cache() const
 {
     LOCKER(m_lock);
-    if (!m_lookup_cache.is_empty())
+    if (m_lookup_cache_populated)
         return;
-    HashMap<String, unsigned> children;
+    ASSERT(is_directory());
 
-    traverse_as_directory([&children](auto& entry) {
-        children.set(String(entry.name, entry.name_length), entry.inode.index());
-        return true;
-    });
+    HashMap<String, LookupCacheEntry> children;
+    Vector<u16> block_free_space;
+
+    const size_t block_size = fs().block_size();
+    auto buffer = read_entire();
+    size_t block_count = buffer.size() / block_size;
+    block_free_space.ensure_capacity(block_count);
+
+    for (size_t bi = 0; bi < block_count; ++bi) {
+        u8* block = buffer.data() + bi * block_size;
+        for_each_entry_in_directory_block(block, block_size, [&](auto& entry) {
+            if (entry.inode)
+                children.set(String(entry.name, entry.name_len), { entry.inode, (unsigned)bi });
+            return IterationDecision::Continue;
+        });
+        block_free_space.unchecked_append(largest_free_record_in_directory_block(block, block_size));
+    }
 
-    if (!m_lookup_cache.is_empty())
-        return;
     m_lookup_cache = move(children);
+    m_directory_block_free_space.build(block_free_space);
+    m_lookup_cache_populated = true;
 }
 
 RefPtr<Inode> Ext2FSInode::lookup(StringView name)
 {
     ASSERT(is_directory());
     populate_lookup_cache();
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     auto it = m_lookup_cache.find(name.hash(), [&](auto& entry) { return entry.key == name; });
     if (it != m_lookup_cache.end())
-        return fs().get_inode({ fsid(), (*it).value });
+        return fs().get_inode({ fsid(), (*it).value.inode_index });
     return {};
 }
 
@@ -1570,8 +2066,8 @@ void Ext2FS::uncache_inode(InodeIndex index)
 size_t Ext2FSInode::directory_entry_count() const
 {
     ASSERT(is_directory());
-    LOCKER(m_lock);
     populate_lookup_cache();
+    Locker locker(m_lock, Lock::Mode::Shared);
     return m_lookup_cache.size();
 }
 
@@ -1596,6 +2092,12 @@ KResult Ext2FSInode::chown(uid_t uid, gid_t gid)
     return KSuccess;
 }
 
+KResult Ext2FSInode::fsync(bool data_only)
+{
+    LOCKER(m_lock);
+    return fs().fsync_inode(*this, data_only);
+}
+
 KResult Ext2FSInode::truncate(u64 size)
 {
     LOCKER(m_lock);
@@ -1610,25 +2112,25 @@ KResult Ext2FSInode::truncate(u64 size)
 
 unsigned Ext2FS::total_block_count() const
 {
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     return super_block().s_blocks_count;
 }
 
 unsigned Ext2FS::free_block_count() const
 {
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     return super_block().s_free_blocks_count;
 }
 
 unsigned Ext2FS::total_inode_count() const
 {
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     return super_block().s_inodes_count;
 }
 
 unsigned Ext2FS::free_inode_count() const
 {
-    LOCKER(m_lock);
+    Locker locker(m_lock, Lock::Mode::Shared);
     return super_block().s_free_inodes_count;
 }
 
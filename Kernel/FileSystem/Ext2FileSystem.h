@@ -28,6 +28,7 @@
 
 #include <AK/Bitmap.h>
 #include <AK/HashMap.h>
+#include <AK/Optional.h>
 #include <Kernel/FileSystem/FileBackedFileSystem.h>
 #include <Kernel/FileSystem/Inode.h>
 #include <Kernel/FileSystem/ext2_fs.h>
@@ -74,17 +75,73 @@ private:
     virtual KResult chmod(mode_t) override;
     virtual KResult chown(uid_t, gid_t) override;
     virtual KResult truncate(u64) override;
+    virtual KResult fsync(bool data_only) override;
 
+    ssize_t write_bytes_impl(off_t, ssize_t, const u8* data, FileDescription*);
     bool write_directory(const Vector<FS::DirectoryEntry>&);
     void populate_lookup_cache() const;
+    void did_modify_directory();
     KResult resize(u64);
+    Vector<unsigned> allocate_blocks_for_growth(size_t count);
+    void discard_preallocation();
+
+    // A run of logically consecutive blocks that are also consecutive on disk. Holes have a block index of 0.
+    struct BlockExtent {
+        unsigned logical_index { 0 };
+        unsigned block_index { 0 };
+        unsigned length { 0 };
+        unsigned end_logical_index() const { return logical_index + length; }
+    };
+
+    void ensure_block_extents() const;
+    void set_block_extents(const Vector<unsigned>&);
+    void append_to_block_extents(unsigned block_index) const;
+    size_t block_count() const { return m_block_extents.is_empty() ? 0 : m_block_extents.last().end_logical_index(); }
+    unsigned block_index_for(size_t logical_index, size_t& contiguous_block_count) const;
 
     Ext2FS& fs();
     const Ext2FS& fs() const;
     Ext2FSInode(Ext2FS&, unsigned index);
 
-    mutable Vector<unsigned> m_block_list;
-    mutable HashMap<String, unsigned> m_lookup_cache;
+    mutable Vector<BlockExtent> m_block_extents;
+    mutable bool m_block_extents_loaded { false };
+
+    // Blocks reserved in the bitmap right after the last block of the file. They're handed out first when
+    // the file grows, and given back when the inode is truncated or leaves the inode cache.
+    unsigned m_preallocated_block_index { 0 };
+    size_t m_preallocated_block_count { 0 };
+
+    // Whether the size or the block list changed since the last fsync().
+    bool m_allocation_dirty { false };
+    struct LookupCacheEntry {
+        unsigned inode_index { 0 };
+        unsigned block_index { 0 };
+    };
+
+    // Maps each name to its inode and the directory block holding its entry. Kept in sync by add_child() and remove_child().
+    mutable HashMap<String, LookupCacheEntry> m_lookup_cache;
+    // The largest record that would fit into each directory block, kept as a max-tree over the blocks
+    // so add_child() finds the first block with room in O(log n) instead of looking at every block.
+    class DirectoryFreeSpaceIndex {
+    public:
+        void build(const Vector<u16>& free_space_per_block);
+        void clear();
+        void append(u16 free_space);
+        void set(size_t block_index, u16 free_space);
+        size_t block_count() const { return m_block_count; }
+        Optional<size_t> find_first_block_with_room(u16 record_length) const;
+
+    private:
+        void update_parents(size_t node);
+
+        size_t m_block_count { 0 };
+        size_t m_leaf_count { 0 };
+        // Node 1 is the root, the children of node n are 2n and 2n + 1, and the leaves start at m_leaf_count.
+        Vector<u16> m_tree;
+    };
+
+    mutable DirectoryFreeSpaceIndex m_directory_block_free_space;
+    mutable bool m_lookup_cache_populated { false };
     ext2_inode m_raw_inode;
 };
 
@@ -92,7 +149,7 @@ class Ext2FS final : public FileBackedFS {
     friend class Ext2FSInode;
 
 public:
-    static NonnullRefPtr<Ext2FS> create(FileDescription&);
+    static NonnullRefPtr<Ext2FS> create(FileDescription&, size_t disk_cache_size = 0);
 
     virtual ~Ext2FS() override;
     virtual bool initialize() override;
@@ -105,12 +162,13 @@ public:
     virtual KResult prepare_to_unmount() const override;
 
     virtual bool supports_watchers() const override { return true; }
+    virtual bool supports_name_cache() const override { return true; }
 
 private:
     typedef unsigned BlockIndex;
     typedef unsigned GroupIndex;
     typedef unsigned InodeIndex;
-    explicit Ext2FS(FileDescription&);
+    Ext2FS(FileDescription&, size_t disk_cache_size);
 
     const ext2_super_block& super_block() const { return m_super_block; }
     const ext2_group_desc& group_descriptor(GroupIndex) const;
@@ -123,6 +181,7 @@ private:
     unsigned inode_size() const;
 
     bool write_ext2_inode(InodeIndex, const ext2_inode&);
+    bool find_block_containing_inode(InodeIndex inode, BlockIndex& block_index, unsigned& offset) const;
     bool read_block_containing_inode(InodeIndex inode, BlockIndex& block_index, unsigned& offset, u8* buffer) const;
 
     bool flush_super_block();
@@ -133,20 +192,26 @@ private:
     virtual KResult create_directory(InodeIdentifier parent_inode, const String& name, mode_t, uid_t, gid_t) override;
     virtual RefPtr<Inode> get_inode(InodeIdentifier) const override;
     virtual void flush_writes() override;
+    virtual void write_back_expired_writes() override;
+    void flush_filesystem_metadata();
+    void uncache_unused_inodes();
+    KResult fsync_inode(Ext2FSInode&, bool data_only);
 
     BlockIndex first_block_index() const;
     InodeIndex find_a_free_inode(GroupIndex preferred_group, off_t expected_size);
-    Vector<BlockIndex> allocate_blocks(GroupIndex preferred_group_index, size_t count);
+    Vector<BlockIndex> allocate_blocks(GroupIndex preferred_group_index, size_t count, BlockIndex goal = 0);
+    size_t allocate_blocks_at(BlockIndex first_block, size_t max_count);
     GroupIndex group_index_from_inode(InodeIndex) const;
     GroupIndex group_index_from_block_index(BlockIndex) const;
 
     Vector<BlockIndex> block_list_for_inode_impl(const ext2_inode&, bool include_block_list_blocks = false) const;
     Vector<BlockIndex> block_list_for_inode(const ext2_inode&, bool include_block_list_blocks = false) const;
-    bool write_block_list_for_inode(InodeIndex, ext2_inode&, const Vector<BlockIndex>&);
+    bool resize_block_list_for_inode(InodeIndex, ext2_inode&, unsigned old_block_count, unsigned new_block_count, const Vector<BlockIndex>& appended_blocks);
 
     bool get_inode_allocation_state(InodeIndex) const;
     bool set_inode_allocation_state(InodeIndex, bool);
     bool set_block_allocation_state(BlockIndex, bool);
+    bool set_block_range_allocation_state(BlockIndex first_block, size_t count, bool);
 
     void uncache_inode(InodeIndex);
     void free_inode(Ext2FSInode&);
@@ -186,6 +251,18 @@ private:
     CachedBitmap& get_bitmap_block(BlockIndex);
 
     Vector<OwnPtr<CachedBitmap>> m_cached_bitmaps;
+
+    // Rough picture of each block group's free space, so allocations don't have to scan bitmaps one block at a time.
+    struct BlockGroupFreeExtentSummary {
+        unsigned largest_free_run { 0 }; // Never less than the longest run of free blocks in the group.
+        unsigned first_free_bit { 0 };   // There are no free blocks in the group before this one.
+        bool needs_rescan { true };
+    };
+
+    BlockGroupFreeExtentSummary& free_extent_summary(GroupIndex);
+    GroupIndex find_group_for_block_allocation(GroupIndex preferred_group_index, size_t count);
+
+    Vector<BlockGroupFreeExtentSummary> m_free_extent_summaries;
 };
 
 inline Ext2FS& Ext2FSInode::fs()
@@ -87,6 +87,7 @@ void FIFO::attach(Direction direction)
         klog() << "open writer (" << m_writers << ")";
 #endif
     }
+    evaluate_block_conditions();
 }
 
 void FIFO::detach(Direction direction)
@@ -104,6 +105,7 @@ void FIFO::detach(Direction direction)
         ASSERT(m_writers);
         --m_writers;
     }
+    evaluate_block_conditions();
 }
 
 bool FIFO::can_read(const FileDescription&) const
@@ -127,6 +129,8 @@ ssize_t FIFO::read(FileDescription&, u8* buffer, ssize_t size)
 #ifdef FIFO_DEBUG
     dbg() << "   -> read (" << String::format("%c", buffer[0]) << ") " << nread;
 #endif
+    if (nread > 0)
+        evaluate_block_conditions();
     return nread;
 }
 
@@ -139,7 +143,10 @@ ssize_t FIFO::write(FileDescription&, const u8* buffer, ssize_t size)
 #ifdef FIFO_DEBUG
     dbg() << "fifo: write(" << (const void*)buffer << ", " << size << ")";
 #endif
-    return m_buffer.write(buffer, size);
+    ssize_t nwritten = m_buffer.write(buffer, size);
+    if (nwritten > 0)
+        evaluate_block_conditions();
+    return nwritten;
 }
 
 String FIFO::absolute_path(const FileDescription&) const
@@ -30,6 +30,7 @@
 #include <AK/RefCounted.h>
 #include <AK/String.h>
 #include <AK/Types.h>
+#include <Kernel/BlockCondition.h>
 #include <Kernel/Forward.h>
 #include <Kernel/KResult.h>
 #include <Kernel/UnixTypes.h>
@@ -74,6 +75,13 @@ public:
     virtual bool can_read(const FileDescription&) const = 0;
     virtual bool can_write(const FileDescription&) const = 0;
 
+    // Threads blocked on this file are woken up through its block condition, so anything that may
+    // change the answer of can_read()/can_write() has to call evaluate_block_conditions().
+    // Files that can't tell when that happens (e.g. because it's up to the hardware) get polled instead.
+    BlockCondition& block_condition() const { return m_block_condition; }
+    void evaluate_block_conditions() const { m_block_condition.unblock(); }
+    virtual bool should_poll_for_readiness() const { return false; }
+
     virtual ssize_t read(FileDescription&, u8*, ssize_t) = 0;
     virtual ssize_t write(FileDescription&, const u8*, ssize_t) = 0;
     virtual int ioctl(FileDescription&, unsigned request, unsigned arg);
@@ -82,6 +90,7 @@ public:
     virtual String absolute_path(const FileDescription&) const = 0;
 
     virtual KResult truncate(u64) { return KResult(-EINVAL); }
+    virtual KResult fsync(bool) { return KResult(-EINVAL); }
     virtual KResult chown(uid_t, gid_t) { return KResult(-EBADF); }
     virtual KResult chmod(mode_t) { return KResult(-EBADF); }
 
@@ -100,6 +109,9 @@ public:
 
 protected:
     File();
+
+private:
+    mutable BlockCondition m_block_condition;
 };
 
 }
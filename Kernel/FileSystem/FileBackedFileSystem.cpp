@@ -24,107 +24,199 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/HashMap.h>
+#include <AK/IntrusiveList.h>
+#include <AK/QuickSort.h>
 #include <AK/StringView.h>
 #include <Kernel/Arch/i386/CPU.h>
+#include <Kernel/CommandLine.h>
 #include <Kernel/Devices/BlockDevice.h>
 #include <Kernel/FileSystem/FileBackedFileSystem.h>
 #include <Kernel/FileSystem/FileDescription.h>
 #include <Kernel/KBuffer.h>
 #include <Kernel/Process.h>
+#include <Kernel/Scheduler.h>
+#include <Kernel/Time/TimeManagement.h>
 
 //#define FBFS_DEBUG
 
 namespace Kernel {
 
 struct CacheEntry {
-    time_t timestamp { 0 };
+    IntrusiveListNode list_node;
     u32 block_index { 0 };
     u8* data { nullptr };
+    u64 dirtied_at { 0 };
     bool has_data { false };
-    bool is_dirty { false };
+    bool drop_after_write_back { false };
 };
 
+// Background writeback kicks in once this share of the cache is dirty, or once a block has been dirty for too long.
+static const size_t dirty_background_percentage = 10;
+static const u64 dirty_expire_seconds = 5;
+// Past this share of dirty blocks, writers have to write back old blocks themselves before dirtying more.
+static const size_t dirty_throttle_percentage = 20;
+// Most data we hand to the disk at once when writing back, before waiting for it.
+static const size_t max_writeback_size = 1 * MB;
+
 class DiskCache {
 public:
-    explicit DiskCache(FileBackedFS& fs)
+    explicit DiskCache(FileBackedFS& fs, size_t entry_count)
         : m_fs(fs)
+        , m_entry_count(entry_count)
         , m_cached_block_data(KBuffer::create_with_size(m_entry_count * m_fs.block_size()))
         , m_entries(KBuffer::create_with_size(m_entry_count * sizeof(CacheEntry)))
     {
         for (size_t i = 0; i < m_entry_count; ++i) {
-            entries()[i].data = m_cached_block_data.data() + i * m_fs.block_size();
+            auto* entry = new (&entries()[i]) CacheEntry;
+            entry->data = m_cached_block_data.data() + i * m_fs.block_size();
+            m_clean_list.append(*entry);
         }
     }
 
-    ~DiskCache() {}
+    ~DiskCache()
+    {
+        m_clean_list.clear();
+        m_dirty_list.clear();
+    }
 
-    bool is_dirty() const { return m_dirty; }
-    void set_dirty(bool b) { m_dirty = b; }
+    bool is_dirty() const { return m_dirty_count; }
+    size_t dirty_count() const { return m_dirty_count; }
 
-    CacheEntry& get(u32 block_index) const
+    size_t entry_count() const { return m_entry_count; }
+    u64 written_back_count() const { return m_written_back_count; }
+    u64 hit_count() const { return m_hit_count; }
+    u64 miss_count() const { return m_miss_count; }
+    u64 eviction_count() const { return m_eviction_count; }
+
+    CacheEntry* find(u32 block_index)
     {
-        auto now = kgettimeofday().tv_sec;
+        auto it = m_hash.find(block_index);
+        if (it == m_hash.end())
+            return nullptr;
+        return it->value;
+    }
 
-        CacheEntry* oldest_clean_entry = nullptr;
-        for (size_t i = 0; i < m_entry_count; ++i) {
-            auto& entry = const_cast<CacheEntry&>(entries()[i]);
-            if (entry.block_index == block_index) {
-                entry.timestamp = now;
-                return entry;
-            }
-            if (!entry.is_dirty) {
-                if (!oldest_clean_entry)
-                    oldest_clean_entry = &entry;
-                else if (entry.timestamp < oldest_clean_entry->timestamp)
-                    oldest_clean_entry = &entry;
-            }
-        }
-        if (!oldest_clean_entry) {
-            // Not a single clean entry! Flush writes and try again.
-            // NOTE: We want to make sure we only call FileBackedFS flush here,
-            //       not some FileBackedFS subclass flush!
-            m_fs.flush_writes_impl();
-            return get(block_index);
+    bool has_data_for(u32 block_index)
+    {
+        auto* entry = find(block_index);
+        return entry && entry->has_data;
+    }
+
+    // Returns nullptr if every entry is dirty. Writing back means disk I/O, which we can't do with
+    // the cache lock held, so that's up to the caller.
+    CacheEntry* get(u32 block_index)
+    {
+        if (auto* entry = find(block_index)) {
+            ++m_hit_count;
+            // Dirty entries stay in write order until they're flushed.
+            if (!is_entry_dirty(*entry))
+                m_clean_list.prepend(*entry);
+            return entry;
         }
 
-        // Replace the oldest clean entry.
-        auto& new_entry = *oldest_clean_entry;
-        new_entry.timestamp = now;
+        ++m_miss_count;
+
+        if (m_clean_list.is_empty())
+            return nullptr;
+
+        // Replace the least recently used clean entry.
+        auto& new_entry = *m_clean_list.last();
+        auto it = m_hash.find(new_entry.block_index);
+        if (it != m_hash.end() && it->value == &new_entry) {
+            m_hash.remove(it);
+            ++m_eviction_count;
+        }
         new_entry.block_index = block_index;
         new_entry.has_data = false;
-        new_entry.is_dirty = false;
-        return new_entry;
+        new_entry.drop_after_write_back = false;
+        m_clean_list.prepend(new_entry);
+        m_hash.set(block_index, &new_entry);
+        return &new_entry;
     }
 
-    const CacheEntry* entries() const { return (const CacheEntry*)m_entries.data(); }
-    CacheEntry* entries() { return (CacheEntry*)m_entries.data(); }
+    bool is_entry_dirty(const CacheEntry& entry) const { return m_dirty_list.contains(entry); }
+
+    void mark_dirty(CacheEntry& entry)
+    {
+        // The dirty list is kept in the order blocks were first dirtied, so the oldest ones are always at the front.
+        if (is_entry_dirty(entry))
+            return;
+        entry.dirtied_at = g_uptime;
+        m_dirty_list.append(entry);
+        ++m_dirty_count;
+    }
+
+    void mark_clean(CacheEntry& entry)
+    {
+        if (is_entry_dirty(entry))
+            --m_dirty_count;
+        if (!entry.drop_after_write_back) {
+            m_clean_list.prepend(entry);
+            return;
+        }
+        // Nobody is going to read this block from us, so make it the first one to be reused.
+        auto it = m_hash.find(entry.block_index);
+        if (it != m_hash.end() && it->value == &entry)
+            m_hash.remove(it);
+        entry.has_data = false;
+        entry.drop_after_write_back = false;
+        m_clean_list.append(entry);
+    }
+
+    void did_write_back(size_t count) { m_written_back_count += count; }
 
     template<typename Callback>
-    void for_each_entry(Callback callback)
+    void for_each_dirty_entry(Callback callback)
     {
-        for (size_t i = 0; i < m_entry_count; ++i)
-            callback(entries()[i]);
+        for (auto& entry : m_dirty_list) {
+            if (callback(entry) == IterationDecision::Break)
+                break;
+        }
     }
 
 private:
+    const CacheEntry* entries() const { return (const CacheEntry*)m_entries.data(); }
+    CacheEntry* entries() { return (CacheEntry*)m_entries.data(); }
+
+    typedef IntrusiveList<CacheEntry, &CacheEntry::list_node> EntryList;
+
     FileBackedFS& m_fs;
-    size_t m_entry_count { 10000 };
+    size_t m_entry_count { 0 };
     KBuffer m_cached_block_data;
     KBuffer m_entries;
-    bool m_dirty { false };
+    HashMap<u32, CacheEntry*> m_hash;
+    EntryList m_clean_list;
+    EntryList m_dirty_list;
+    u64 m_hit_count { 0 };
+    u64 m_miss_count { 0 };
+    u64 m_eviction_count { 0 };
+    u64 m_written_back_count { 0 };
+    size_t m_dirty_count { 0 };
 };
 
-FileBackedFS::FileBackedFS(FileDescription& file_description)
+FileBackedFS::FileBackedFS(FileDescription& file_description, size_t cache_entry_count)
     : m_file_description(file_description)
 {
     ASSERT(m_file_description->file().is_seekable());
+
+    if (cache_entry_count)
+        m_cache_entry_count = cache_entry_count;
+    else if (auto cache_size = kernel_command_line().lookup("disk_cache_size"); cache_size.has_value()) {
+        bool ok;
+        unsigned entry_count = cache_size.value().to_uint(ok);
+        if (ok && entry_count)
+            m_cache_entry_count = entry_count;
+        else
+            klog() << "FileBackedFS: Ignoring invalid disk_cache_size '" << cache_size.value() << "'";
+    }
 }
 
 FileBackedFS::~FileBackedFS()
 {
 }
 
-bool FileBackedFS::write_block(unsigned index, const u8* data, FileDescription* description)
+bool FileBackedFS::write_block(unsigned index, const u8* data, FileDescription* description, CachePolicy cache_policy)
 {
     ASSERT(m_logical_block_size);
 #ifdef FBFS_DEBUG
@@ -134,23 +226,42 @@ bool FileBackedFS::write_block(unsigned index, const u8* data, FileDescription*
     bool allow_cache = !description || !description->is_direct();
 
     if (!allow_cache) {
+        LOCKER(m_lock);
         flush_specific_block_if_needed(index);
-        u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size());
-        m_file_description->seek(base_offset, SEEK_SET);
-        auto nwritten = m_file_description->write(data, block_size());
-        ASSERT(nwritten == block_size());
-        return true;
+        return write_to_disk(index, 1, data);
     }
 
-    auto& entry = cache().get(index);
-    memcpy(entry.data, data, block_size());
-    entry.is_dirty = true;
-    entry.has_data = true;
-
-    cache().set_dirty(true);
+    size_t dirty_count = 0;
+    for (;;) {
+        {
+            LOCKER(m_cache_lock);
+            if (auto* entry = cache().get(index)) {
+                memcpy(entry->data, data, block_size());
+                entry->has_data = true;
+                entry->drop_after_write_back = cache_policy == CachePolicy::PassThrough;
+                cache().mark_dirty(*entry);
+                break;
+            }
+            dirty_count = cache().dirty_count();
+        }
+        // Not a single clean entry! Write back the oldest dirty blocks and try again.
+        write_back_oldest_blocks(max(dirty_count - dirty_background_threshold(), (size_t)1), 0);
+    }
     return true;
 }
 
+void FileBackedFS::throttle_writer_if_needed()
+{
+    // Make heavy writers pay for their own writeback, instead of leaving everyone else without clean blocks.
+    size_t dirty_count = 0;
+    {
+        LOCKER(m_cache_lock);
+        dirty_count = cache().dirty_count();
+    }
+    if (dirty_count > dirty_throttle_threshold())
+        write_back_oldest_blocks(dirty_count - dirty_background_threshold(), 0);
+}
+
 bool FileBackedFS::raw_read(unsigned index, u8* buffer)
 {
     u32 base_offset = static_cast<u32>(index) * static_cast<u32>(m_logical_block_size);
@@ -187,96 +298,303 @@ bool FileBackedFS::raw_write_blocks(unsigned index, size_t count, const u8* buff
     return true;
 }
 
-bool FileBackedFS::write_blocks(unsigned index, unsigned count, const u8* data, FileDescription* description)
+bool FileBackedFS::write_blocks(unsigned index, unsigned count, const u8* data, FileDescription* description, CachePolicy cache_policy)
 {
     ASSERT(m_logical_block_size);
 #ifdef FBFS_DEBUG
     klog() << "FileBackedFileSystem::write_blocks " << index << " x" << count;
 #endif
     for (unsigned i = 0; i < count; ++i)
-        write_block(index + i, data + i * block_size(), description);
+        write_block(index + i, data + i * block_size(), description, cache_policy);
     return true;
 }
 
-bool FileBackedFS::read_block(unsigned index, u8* buffer, FileDescription* description) const
+bool FileBackedFS::read_block(unsigned index, u8* buffer, FileDescription* description, CachePolicy cache_policy) const
+{
+    return read_blocks(index, 1, buffer, description, cache_policy);
+}
+
+bool FileBackedFS::read_blocks(unsigned index, unsigned count, u8* buffer, FileDescription* description, CachePolicy cache_policy) const
+{
+    if (!count)
+        return false;
+    Vector<BlockRun> runs;
+    runs.append({ index, count, buffer });
+    return read_block_runs(runs, description, cache_policy);
+}
+
+bool FileBackedFS::read_block_runs(const Vector<BlockRun>& runs, FileDescription* description, CachePolicy cache_policy) const
 {
     ASSERT(m_logical_block_size);
 #ifdef FBFS_DEBUG
-    klog() << "FileBackedFileSystem::read_block " << index;
+    klog() << "FileBackedFileSystem::read_block_runs " << runs.first().index << " x" << runs.first().count << " (+" << (runs.size() - 1) << " more)";
 #endif
 
+    auto& self = const_cast<FileBackedFS&>(*this);
     bool allow_cache = !description || !description->is_direct();
 
     if (!allow_cache) {
-        const_cast<FileBackedFS*>(this)->flush_specific_block_if_needed(index);
-        u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size());
-        const_cast<FileDescription&>(*m_file_description).seek(base_offset, SEEK_SET);
-        auto nread = const_cast<FileDescription&>(*m_file_description).read(buffer, block_size());
-        ASSERT(nread == block_size());
+        LOCKER(m_lock);
+        for (auto& run : runs) {
+            for (unsigned i = 0; i < run.count; ++i)
+                self.flush_specific_block_if_needed(run.index + i);
+        }
+        return self.transfer_runs(BlockDeviceRequest::Type::Read, runs);
+    }
+
+    // Blocks already in the cache are copied out of it, and the runs of uncached blocks that are left
+    // go to the disk together. Cache hits only take the cache lock, so readers don't queue up behind
+    // someone else's disk I/O.
+    Vector<BlockRun> miss_runs;
+    {
+        LOCKER(m_cache_lock);
+        for (auto& run : runs) {
+            unsigned i = 0;
+            while (i < run.count) {
+                if (cache().has_data_for(run.index + i)) {
+                    memcpy(run.buffer + i * block_size(), cache().get(run.index + i)->data, block_size());
+                    ++i;
+                    continue;
+                }
+                unsigned run_length = 1;
+                while (i + run_length < run.count && !cache().has_data_for(run.index + i + run_length))
+                    ++run_length;
+                miss_runs.append({ run.index + i, run_length, run.buffer + i * block_size() });
+                i += run_length;
+            }
+        }
+    }
+    if (miss_runs.is_empty())
+        return true;
+
+    // Writeback holds the FS lock until the blocks it cleaned are on the disk, so we can't read a
+    // block from the disk that is newer in the cache and put the stale copy back into it.
+    Locker locker(m_lock);
+    if (!self.transfer_runs(BlockDeviceRequest::Type::Read, miss_runs))
+        return false;
+
+    Locker cache_locker(m_cache_lock);
+    for (auto& run : miss_runs) {
+        for (unsigned i = 0; i < run.count; ++i) {
+            u8* data = run.buffer + i * block_size();
+            auto* entry = cache_policy == CachePolicy::KeepCached ? cache().get(run.index + i) : cache().find(run.index + i);
+            if (!entry)
+                continue;
+            if (entry->has_data) {
+                // Someone wrote the block while we were reading it, the cache has the newer data.
+                memcpy(data, entry->data, block_size());
+                continue;
+            }
+            if (cache_policy == CachePolicy::KeepCached) {
+                memcpy(entry->data, data, block_size());
+                entry->has_data = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool FileBackedFS::transfer_runs(BlockDeviceRequest::Type type, const Vector<BlockRun>& runs)
+{
+    ASSERT(m_lock.is_locked());
+
+    // Block devices get all the runs at once, so the request queue can merge and sort them, and
+    // we only wait for the disk once. Anything else (e.g. an image file) is read and written in turn.
+    if (file().is_block_device() && block_size() % static_cast<BlockDevice&>(file()).block_size() == 0) {
+        auto& device = static_cast<BlockDevice&>(file());
+        u32 blocks_per_block = block_size() / device.block_size();
+
+        // The completions may run in IRQ context with some other process' address space active,
+        // so userspace buffers have to be bounced through kernel memory.
+        Vector<ByteBuffer> bounce_buffers;
+        bounce_buffers.ensure_capacity(runs.size());
+        for (auto& run : runs) {
+            if (!is_user_address(VirtualAddress(run.buffer))) {
+                bounce_buffers.unchecked_append({});
+                continue;
+            }
+            auto bounce_buffer = ByteBuffer::create_uninitialized(run.count * block_size());
+            if (type == BlockDeviceRequest::Type::Write)
+                memcpy(bounce_buffer.data(), run.buffer, bounce_buffer.size());
+            bounce_buffers.unchecked_append(move(bounce_buffer));
+        }
+
+        BlockDeviceRequestBatch batch(device);
+        for (size_t i = 0; i < runs.size(); ++i) {
+            u8* buffer = bounce_buffers[i].is_null() ? runs[i].buffer : bounce_buffers[i].data();
+            batch.submit(type, runs[i].index * blocks_per_block, runs[i].count * blocks_per_block, buffer);
+        }
+        if (!batch.wait())
+            return false;
+
+        if (type == BlockDeviceRequest::Type::Read) {
+            for (size_t i = 0; i < runs.size(); ++i) {
+                if (!bounce_buffers[i].is_null())
+                    memcpy(runs[i].buffer, bounce_buffers[i].data(), bounce_buffers[i].size());
+            }
+        }
         return true;
     }
 
-    auto& entry = cache().get(index);
-    if (!entry.has_data) {
-        u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size());
-        const_cast<FileDescription&>(*m_file_description).seek(base_offset, SEEK_SET);
-        auto nread = const_cast<FileDescription&>(*m_file_description).read(entry.data, block_size());
-        entry.has_data = true;
-        ASSERT(nread == block_size());
+    for (auto& run : runs) {
+        bool success = type == BlockDeviceRequest::Type::Read ? read_from_disk(run.index, run.count, run.buffer) : write_to_disk(run.index, run.count, run.buffer);
+        if (!success)
+            return false;
     }
-    memcpy(buffer, entry.data, block_size());
     return true;
 }
 
-bool FileBackedFS::read_blocks(unsigned index, unsigned count, u8* buffer, FileDescription* description) const
+bool FileBackedFS::read_from_disk(unsigned index, unsigned count, u8* buffer)
 {
-    ASSERT(m_logical_block_size);
-    if (!count)
-        return false;
-    if (count == 1)
-        return read_block(index, buffer, description);
-    u8* out = buffer;
+    u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size());
+    m_file_description->seek(base_offset, SEEK_SET);
 
-    for (unsigned i = 0; i < count; ++i) {
-        if (!read_block(index + i, out, description))
+    // The underlying device may hand us less than we asked for (e.g. PATA
+    // is limited to one page per request), so keep going until we're done.
+    size_t remaining = count * block_size();
+    while (remaining) {
+        auto nread = m_file_description->read(buffer, remaining);
+        if (nread <= 0)
             return false;
-        out += block_size();
+        buffer += nread;
+        remaining -= nread;
     }
+    return true;
+}
 
+bool FileBackedFS::write_to_disk(unsigned index, unsigned count, const u8* buffer)
+{
+    u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size());
+    m_file_description->seek(base_offset, SEEK_SET);
+
+    size_t remaining = count * block_size();
+    while (remaining) {
+        auto nwritten = m_file_description->write(buffer, remaining);
+        if (nwritten <= 0)
+            return false;
+        buffer += nwritten;
+        remaining -= nwritten;
+    }
     return true;
 }
 
 void FileBackedFS::flush_specific_block_if_needed(unsigned index)
 {
-    LOCKER(m_lock);
-    if (!cache().is_dirty())
+    ASSERT(m_lock.is_locked());
+    auto buffer = ByteBuffer::create_uninitialized(block_size());
+    {
+        LOCKER(m_cache_lock);
+        if (!cache().is_dirty())
+            return;
+        auto* entry = cache().find(index);
+        if (!entry || !cache().is_entry_dirty(*entry))
+            return;
+        memcpy(buffer.data(), entry->data, block_size());
+        cache().mark_clean(*entry);
+        cache().did_write_back(1);
+    }
+    write_to_disk(index, 1, buffer.data());
+}
+
+void FileBackedFS::write_back_entries(Vector<CacheEntry*>& entries)
+{
+    // Dirty entries are only cleaned with the FS lock held, so they can't be evicted from under us.
+    ASSERT(m_lock.is_locked());
+    if (entries.is_empty())
         return;
-    cache().for_each_entry([&](CacheEntry& entry) {
-        if (entry.is_dirty && entry.block_index == index) {
-            u32 base_offset = static_cast<u32>(entry.block_index) * static_cast<u32>(block_size());
-            m_file_description->seek(base_offset, SEEK_SET);
-            m_file_description->write(entry.data, block_size());
-            entry.is_dirty = false;
+
+    // Sort by block index, so that adjacent blocks go out to the disk in a single request.
+    quick_sort(entries.begin(), entries.end(), [](auto* a, auto* b) { return a->block_index < b->block_index; });
+
+    size_t max_batch_length = max(max_writeback_size / block_size(), (size_t)1);
+    auto buffer = ByteBuffer::create_uninitialized(min(entries.size(), max_batch_length) * block_size());
+
+    Vector<BlockRun> runs;
+    size_t i = 0;
+    while (i < entries.size()) {
+        size_t batch_length = 0;
+        {
+            // Blocks are marked clean once we have a copy, so writes that come in while we're
+            // writing this one out dirty them again instead of getting lost.
+            LOCKER(m_cache_lock);
+            while (i < entries.size() && batch_length < max_batch_length) {
+                auto& entry = *entries[i++];
+                u8* data = buffer.data() + batch_length++ * block_size();
+                if (runs.is_empty() || runs.last().index + runs.last().count != entry.block_index)
+                    runs.append({ entry.block_index, 0, data });
+                ++runs.last().count;
+                memcpy(data, entry.data, block_size());
+                cache().mark_clean(entry);
+            }
         }
-    });
+#ifdef FBFS_DEBUG
+        klog() << "FileBackedFileSystem: Writing back " << batch_length << " blocks in " << runs.size() << " runs";
+#endif
+        transfer_runs(BlockDeviceRequest::Type::Write, runs);
+        runs.clear();
+    }
+
+    LOCKER(m_cache_lock);
+    cache().did_write_back(entries.size());
 }
 
-void FileBackedFS::flush_writes_impl()
+void FileBackedFS::write_back_oldest_blocks(size_t minimum_count, u64 dirtied_before)
+{
+    LOCKER(m_lock);
+    Vector<CacheEntry*> entries;
+    {
+        LOCKER(m_cache_lock);
+        cache().for_each_dirty_entry([&](CacheEntry& entry) {
+            if (entries.size() >= minimum_count && entry.dirtied_at >= dirtied_before)
+                return IterationDecision::Break;
+            entries.append(&entry);
+            return IterationDecision::Continue;
+        });
+    }
+    write_back_entries(entries);
+}
+
+void FileBackedFS::write_back_blocks_if(Function<bool(unsigned block_index)> filter)
 {
     LOCKER(m_lock);
-    if (!cache().is_dirty())
+    Vector<CacheEntry*> entries;
+    {
+        LOCKER(m_cache_lock);
+        cache().for_each_dirty_entry([&](CacheEntry& entry) {
+            if (filter(entry.block_index))
+                entries.append(&entry);
+            return IterationDecision::Continue;
+        });
+    }
+    write_back_entries(entries);
+}
+
+void FileBackedFS::write_back_expired_writes()
+{
+    size_t dirty_count = 0;
+    {
+        LOCKER(m_cache_lock);
+        dirty_count = cache().dirty_count();
+    }
+    if (!dirty_count)
         return;
-    u32 count = 0;
-    cache().for_each_entry([&](CacheEntry& entry) {
-        if (!entry.is_dirty)
-            return;
-        u32 base_offset = static_cast<u32>(entry.block_index) * static_cast<u32>(block_size());
-        m_file_description->seek(base_offset, SEEK_SET);
-        m_file_description->write(entry.data, block_size());
-        ++count;
-        entry.is_dirty = false;
-    });
-    cache().set_dirty(false);
+    size_t background_threshold = dirty_background_threshold();
+    u64 expire_ticks = dirty_expire_seconds * TimeManagement::the().ticks_per_second();
+    u64 dirtied_before = g_uptime > expire_ticks ? g_uptime - expire_ticks : 0;
+    write_back_oldest_blocks(dirty_count > background_threshold ? dirty_count - background_threshold : 0, dirtied_before);
+}
+
+void FileBackedFS::flush_writes_impl()
+{
+    size_t count = 0;
+    {
+        LOCKER(m_cache_lock);
+        count = cache().dirty_count();
+    }
+    if (!count)
+        return;
+    write_back_oldest_blocks(count, 0);
     dbg() << class_name() << ": Flushed " << count << " blocks to disk";
 }
 
@@ -285,11 +603,37 @@ void FileBackedFS::flush_writes()
     flush_writes_impl();
 }
 
+size_t FileBackedFS::dirty_background_threshold() const
+{
+    return m_cache_entry_count * dirty_background_percentage / 100;
+}
+
+size_t FileBackedFS::dirty_throttle_threshold() const
+{
+    return m_cache_entry_count * dirty_throttle_percentage / 100;
+}
+
 DiskCache& FileBackedFS::cache() const
 {
+    ASSERT(m_cache_lock.is_locked());
     if (!m_cache)
-        m_cache = make<DiskCache>(const_cast<FileBackedFS&>(*this));
+        m_cache = make<DiskCache>(const_cast<FileBackedFS&>(*this), m_cache_entry_count);
     return *m_cache;
 }
 
+FileBackedFS::CacheStatistics FileBackedFS::cache_statistics() const
+{
+    CacheStatistics statistics;
+    statistics.entry_count = m_cache_entry_count;
+    LOCKER(m_cache_lock);
+    if (m_cache) {
+        statistics.hit_count = m_cache->hit_count();
+        statistics.miss_count = m_cache->miss_count();
+        statistics.eviction_count = m_cache->eviction_count();
+        statistics.dirty_count = m_cache->dirty_count();
+        statistics.written_back_count = m_cache->written_back_count();
+    }
+    return statistics;
+}
+
 }
@@ -26,12 +26,16 @@
 
 #pragma once
 
+#include <AK/Function.h>
+#include <Kernel/Devices/BlockDevice.h>
 #include <Kernel/FileSystem/FileDescription.h>
 #include <Kernel/FileSystem/FileSystem.h>
 #include <Kernel/Forward.h>
 
 namespace Kernel {
 
+struct CacheEntry;
+
 class FileBackedFS : public FS {
 public:
     virtual ~FileBackedFS() override;
@@ -44,16 +48,44 @@ public:
     const FileDescription& file_description() const { return *m_file_description; }
 
     virtual void flush_writes() override;
+    virtual void write_back_expired_writes() override;
 
     void flush_writes_impl();
 
     size_t logical_block_size() const { return m_logical_block_size; };
 
-protected:
-    explicit FileBackedFS(FileDescription&);
+    struct CacheStatistics {
+        size_t entry_count { 0 };
+        u64 hit_count { 0 };
+        u64 miss_count { 0 };
+        u64 eviction_count { 0 };
+        size_t dirty_count { 0 };
+        u64 written_back_count { 0 };
+    };
+    CacheStatistics cache_statistics() const;
 
-    bool read_block(unsigned index, u8* buffer, FileDescription* = nullptr) const;
-    bool read_blocks(unsigned index, unsigned count, u8* buffer, FileDescription* = nullptr) const;
+protected:
+    // The cache holds cache_entry_count blocks, or disk_cache_size from the kernel command line if it's 0.
+    FileBackedFS(FileDescription&, size_t cache_entry_count);
+
+    // The contents of regular files are cached in their InodeVMObject's pages already. Their blocks only
+    // pass through the disk cache on the way to the disk, and reading them doesn't put them in it.
+    enum class CachePolicy {
+        KeepCached,
+        PassThrough,
+    };
+
+    bool read_block(unsigned index, u8* buffer, FileDescription* = nullptr, CachePolicy = CachePolicy::KeepCached) const;
+    bool read_blocks(unsigned index, unsigned count, u8* buffer, FileDescription* = nullptr, CachePolicy = CachePolicy::KeepCached) const;
+
+    // A run of adjacent blocks, and where they go in memory.
+    struct BlockRun {
+        unsigned index;
+        unsigned count;
+        u8* buffer;
+    };
+    // Reads all the runs, sending the uncached blocks of all of them to the disk before waiting for any.
+    bool read_block_runs(const Vector<BlockRun>&, FileDescription* = nullptr, CachePolicy = CachePolicy::KeepCached) const;
 
     bool raw_read(unsigned index, u8* buffer);
     bool raw_write(unsigned index, const u8* buffer);
@@ -61,16 +93,42 @@ protected:
     bool raw_read_blocks(unsigned index, size_t count, u8* buffer);
     bool raw_write_blocks(unsigned index, size_t count, const u8* buffer);
 
-    bool write_block(unsigned index, const u8*, FileDescription* = nullptr);
-    bool write_blocks(unsigned index, unsigned count, const u8*, FileDescription* = nullptr);
+    bool write_block(unsigned index, const u8*, FileDescription* = nullptr, CachePolicy = CachePolicy::KeepCached);
+    bool write_blocks(unsigned index, unsigned count, const u8*, FileDescription* = nullptr, CachePolicy = CachePolicy::KeepCached);
+
+    // Past the throttle threshold, writers have to write back old blocks themselves. File systems call
+    // this after a write, once they've dropped their own locks.
+    void throttle_writer_if_needed();
+
+    // Write back the dirty blocks for which the filter returns true, e.g. the ones belonging to a single inode.
+    void write_back_blocks_if(Function<bool(unsigned block_index)> filter);
 
     size_t m_logical_block_size { 512 };
 
 private:
+    // Must be called with m_cache_lock held.
     DiskCache& cache() const;
+    size_t dirty_background_threshold() const;
+    size_t dirty_throttle_threshold() const;
+
+    bool read_from_disk(unsigned index, unsigned count, u8* buffer);
+    bool write_to_disk(unsigned index, unsigned count, const u8* buffer);
+    // Must be called with the FS lock held.
+    bool transfer_runs(BlockDeviceRequest::Type, const Vector<BlockRun>&);
     void flush_specific_block_if_needed(unsigned index);
 
+    // Writes back at least minimum_count of the oldest dirty blocks, plus any that were dirtied before the given time.
+    // Takes the FS lock, so it must not be called with m_cache_lock held.
+    void write_back_oldest_blocks(size_t minimum_count, u64 dirtied_before);
+    void write_back_entries(Vector<CacheEntry*>&);
+
     NonnullRefPtr<FileDescription> m_file_description;
+    size_t m_cache_entry_count { 10000 };
+
+    // Protects the cache index and lists. The FS lock is only held around disk I/O, and is always taken
+    // before this one.
+    // FIXME: Split the cache into shards by block index, each with its own lock, once we run on more than one CPU.
+    mutable Lock m_cache_lock { "DiskCache" };
     mutable OwnPtr<DiskCache> m_cache;
 };
 
@@ -287,6 +287,12 @@ KResult FileDescription::truncate(u64 length)
     return m_file->truncate(length);
 }
 
+KResult FileDescription::fsync(bool data_only)
+{
+    LOCKER(m_lock);
+    return m_file->fsync(data_only);
+}
+
 bool FileDescription::is_fifo() const
 {
     return m_file->is_fifo();
@@ -47,7 +47,6 @@ class Socket;
 class TTY;
 
 class FileDescription : public RefCounted<FileDescription> {
-    MAKE_SLAB_ALLOCATED(FileDescription)
 public:
     static NonnullRefPtr<FileDescription> create(Custody&);
     static NonnullRefPtr<FileDescription> create(File&);
@@ -133,6 +132,7 @@ public:
     void set_original_inode(Badge<VFS>, NonnullRefPtr<Inode>&& inode) { m_inode = move(inode); }
 
     KResult truncate(u64);
+    KResult fsync(bool data_only);
 
     off_t offset() const { return m_current_offset; }
 
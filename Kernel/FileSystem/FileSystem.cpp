@@ -100,6 +100,21 @@ void FS::sync()
         fs.flush_writes();
 }
 
+void FS::write_back()
+{
+    Inode::sync();
+
+    NonnullRefPtrVector<FS, 32> fses;
+    {
+        InterruptDisabler disabler;
+        for (auto& it : all_fses())
+            fses.append(*it.value);
+    }
+
+    for (auto& fs : fses)
+        fs.write_back_expired_writes();
+}
+
 void FS::lock_all()
 {
     for (auto& it : all_fses()) {
@@ -52,12 +52,15 @@ public:
     unsigned fsid() const { return m_fsid; }
     static FS* from_fsid(u32);
     static void sync();
+    static void write_back();
     static void lock_all();
 
     virtual bool initialize() = 0;
     virtual const char* class_name() const = 0;
     virtual InodeIdentifier root_inode() const = 0;
     virtual bool supports_watchers() const { return false; }
+    // Filesystems whose directories only ever change through Inode::add_child() and Inode::remove_child().
+    virtual bool supports_name_cache() const { return false; }
 
     bool is_readonly() const { return m_readonly; }
 
@@ -85,6 +88,9 @@ public:
 
     virtual void flush_writes() {}
 
+    // Called periodically in the background. Filesystems with a write cache only need to push out what has been dirty for a while.
+    virtual void write_back_expired_writes() { flush_writes(); }
+
     int block_size() const { return m_block_size; }
 
     virtual bool is_file_backed() const { return false; }
@@ -119,6 +119,9 @@ Inode::Inode(FS& fs, unsigned index)
 Inode::~Inode()
 {
     all_inodes().remove(this);
+
+    for (auto& watcher : m_watchers)
+        watcher->notify_inode_destroyed({});
 }
 
 void Inode::will_be_destroyed()
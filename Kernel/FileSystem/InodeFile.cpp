@@ -30,7 +30,9 @@
 #include <Kernel/FileSystem/InodeFile.h>
 #include <Kernel/FileSystem/VirtualFileSystem.h>
 #include <Kernel/Process.h>
+#include <Kernel/VM/MemoryManager.h>
 #include <Kernel/VM/PrivateInodeVMObject.h>
+#include <Kernel/VM/Region.h>
 #include <Kernel/VM/SharedInodeVMObject.h>
 
 namespace Kernel {
@@ -44,9 +46,29 @@ InodeFile::~InodeFile()
 {
 }
 
+SharedInodeVMObject* InodeFile::page_cache_vmobject(const FileDescription& description)
+{
+    if (description.is_direct() || !m_inode->fs().is_file_backed())
+        return nullptr;
+
+    auto metadata = m_inode->metadata();
+    if (!metadata.is_regular_file() || metadata.size <= 0)
+        return nullptr;
+
+    // read() copies out of the same physical pages that mmap() hands out. The inode only keeps
+    // a weak pointer to its shared VMObject, so hold on to it to keep the pages cached.
+    if (!m_page_cache_vmobject)
+        m_page_cache_vmobject = SharedInodeVMObject::create_with_inode(*m_inode);
+    return m_page_cache_vmobject.ptr();
+}
+
 ssize_t InodeFile::read(FileDescription& description, u8* buffer, ssize_t count)
 {
-    ssize_t nread = m_inode->read_bytes(description.offset(), count, buffer, &description);
+    ssize_t nread;
+    if (auto* vmobject = page_cache_vmobject(description))
+        nread = vmobject->read_bytes(description.offset(), count, buffer);
+    else
+        nread = m_inode->read_bytes(description.offset(), count, buffer, &description);
     if (nread > 0)
         Thread::current->did_file_read(nread);
     return nread;
@@ -97,6 +119,11 @@ KResult InodeFile::truncate(u64 size)
     return KSuccess;
 }
 
+KResult InodeFile::fsync(bool data_only)
+{
+    return m_inode->fsync(data_only);
+}
+
 KResult InodeFile::chown(uid_t uid, gid_t gid)
 {
     return VFS::the().chown(*m_inode, uid, gid);
@@ -54,6 +54,7 @@ public:
     virtual String absolute_path(const FileDescription&) const override;
 
     virtual KResult truncate(u64) override;
+    virtual KResult fsync(bool data_only) override;
     virtual KResult chown(uid_t, gid_t) override;
     virtual KResult chmod(mode_t) override;
 
@@ -64,7 +65,11 @@ public:
 
 private:
     explicit InodeFile(NonnullRefPtr<Inode>&&);
+
+    SharedInodeVMObject* page_cache_vmobject(const FileDescription&);
+
     NonnullRefPtr<Inode> m_inode;
+    RefPtr<SharedInodeVMObject> m_page_cache_vmobject;
 };
 
 }
@@ -86,6 +86,15 @@ String InodeWatcher::absolute_path(const FileDescription&) const
 void InodeWatcher::notify_inode_event(Badge<Inode>, Event::Type event_type)
 {
     m_queue.enqueue({ event_type });
+    evaluate_block_conditions();
+}
+
+void InodeWatcher::notify_inode_destroyed(Badge<Inode>)
+{
+    // Our WeakPtr would only go null after the Inode destructor has run, so let go of it now
+    // and wake up any readers waiting to find out that the inode is gone.
+    m_inode.clear();
+    evaluate_block_conditions();
 }
 
 }
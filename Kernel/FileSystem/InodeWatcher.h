@@ -57,6 +57,7 @@ public:
     virtual const char* class_name() const override { return "InodeWatcher"; };
 
     void notify_inode_event(Badge<Inode>, Event::Type);
+    void notify_inode_destroyed(Badge<Inode>);
 
 private:
     explicit InodeWatcher(Inode&);
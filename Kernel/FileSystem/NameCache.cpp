@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/StringView.h>
+#include <Kernel/FileSystem/Inode.h>
+#include <Kernel/FileSystem/NameCache.h>
+
+//#define NAME_CACHE_DEBUG
+
+namespace Kernel {
+
+static const size_t name_cache_entry_count = 2048;
+
+static NameCache* s_the;
+
+NameCache& NameCache::the()
+{
+    if (!s_the)
+        s_the = new NameCache;
+    return *s_the;
+}
+
+NameCache::NameCache()
+    : m_entry_count(name_cache_entry_count)
+{
+    m_entries = new Entry[m_entry_count];
+    for (size_t i = 0; i < m_entry_count; ++i)
+        m_lru_list.append(m_entries[i]);
+}
+
+NameCache::Entry* NameCache::find(InodeIdentifier parent, const StringView& name)
+{
+    ASSERT(m_lock.is_locked());
+    auto it = m_map.find(hash(parent, name), [&](auto& entry) { return entry.key.parent == parent && entry.key.name == name; });
+    if (it == m_map.end())
+        return nullptr;
+    return (*it).value;
+}
+
+void NameCache::add(InodeIdentifier parent, const StringView& name, InodeIdentifier child)
+{
+    ASSERT(m_lock.is_locked());
+    if (auto* entry = find(parent, name)) {
+        entry->child = child;
+        m_lru_list.prepend(*entry);
+        return;
+    }
+
+    // Unused entries are kept at the back of the list, so this is either a free entry or the least recently used one.
+    auto& entry = *m_lru_list.last();
+    if (entry.in_use)
+        m_map.remove(entry.key);
+
+    entry.key = { parent, name };
+    entry.child = child;
+    entry.in_use = true;
+    m_map.set(entry.key, &entry);
+    m_lru_list.prepend(entry);
+}
+
+void NameCache::remove(Entry& entry)
+{
+    ASSERT(m_lock.is_locked());
+    ASSERT(entry.in_use);
+    m_map.remove(entry.key);
+    entry.key = {};
+    entry.child = {};
+    entry.in_use = false;
+    m_lru_list.append(entry);
+}
+
+RefPtr<Inode> NameCache::lookup(Inode& parent, const StringView& name)
+{
+    if (!parent.fs().supports_name_cache())
+        return parent.lookup(name);
+
+    auto parent_id = parent.identifier();
+    InodeIdentifier cached_child;
+    u32 generation;
+    {
+        // NOTE: We don't call into the filesystem while holding our lock, since it may be holding its own locks when it calls invalidate().
+        LOCKER(m_lock);
+        if (auto* entry = find(parent_id, name)) {
+            m_lru_list.prepend(*entry);
+            if (entry->is_negative()) {
+                ++m_negative_hit_count;
+                return nullptr;
+            }
+            ++m_hit_count;
+            cached_child = entry->child;
+        } else {
+            ++m_miss_count;
+        }
+        generation = m_generation;
+    }
+
+    if (cached_child.is_valid()) {
+        // The filesystem may have gone away since we cached this, in which case we just fall back to a regular lookup.
+        if (auto* fs = cached_child.fs()) {
+            if (auto child = fs->get_inode(cached_child))
+                return child;
+        }
+    }
+
+    auto child = parent.lookup(name);
+
+    LOCKER(m_lock);
+    if (generation != m_generation) {
+#ifdef NAME_CACHE_DEBUG
+        dbg() << "NameCache: Not caching '" << name << "' in " << parent_id << ", raced with an invalidation";
+#endif
+        return child;
+    }
+    add(parent_id, name, child ? child->identifier() : InodeIdentifier());
+    return child;
+}
+
+void NameCache::invalidate(InodeIdentifier parent, const StringView& name)
+{
+    LOCKER(m_lock);
+    ++m_generation;
+    if (auto* entry = find(parent, name)) {
+        ++m_invalidation_count;
+        remove(*entry);
+    }
+}
+
+NameCache::Statistics NameCache::statistics() const
+{
+    Statistics statistics;
+    statistics.entry_count = m_map.size();
+    statistics.hit_count = m_hit_count;
+    statistics.negative_hit_count = m_negative_hit_count;
+    statistics.miss_count = m_miss_count;
+    statistics.invalidation_count = m_invalidation_count;
+    return statistics;
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/HashMap.h>
+#include <AK/IntrusiveList.h>
+#include <AK/RefPtr.h>
+#include <AK/String.h>
+#include <AK/StringView.h>
+#include <Kernel/FileSystem/FileSystem.h>
+#include <Kernel/Lock.h>
+
+namespace Kernel {
+
+class Inode;
+
+// Caches the result of looking up a name in a directory, keyed by (directory inode, name).
+// Names that don't exist are cached too, so repeated failed lookups (e.g. searching $PATH)
+// don't have to scan the directory every time.
+// Only filesystems where every change to a directory goes through Inode::add_child() and
+// Inode::remove_child() can use this, since those are what invalidate the entries.
+class NameCache {
+public:
+    static NameCache& the();
+
+    RefPtr<Inode> lookup(Inode& parent, const StringView& name);
+    void invalidate(InodeIdentifier parent, const StringView& name);
+
+    struct Statistics {
+        size_t entry_count { 0 };
+        u64 hit_count { 0 };
+        u64 negative_hit_count { 0 };
+        u64 miss_count { 0 };
+        u64 invalidation_count { 0 };
+    };
+    Statistics statistics() const;
+
+private:
+    NameCache();
+
+    struct Key {
+        InodeIdentifier parent;
+        String name;
+
+        bool operator==(const Key& other) const { return parent == other.parent && name == other.name; }
+    };
+
+    struct Entry {
+        IntrusiveListNode list_node;
+        Key key;
+        InodeIdentifier child;
+        bool in_use { false };
+
+        bool is_negative() const { return !child.is_valid(); }
+    };
+
+    static unsigned hash(InodeIdentifier parent, const StringView& name) { return pair_int_hash(Traits<InodeIdentifier>::hash(parent), name.hash()); }
+
+    struct KeyTraits : public GenericTraits<Key> {
+        static unsigned hash(const Key& key) { return NameCache::hash(key.parent, key.name); }
+    };
+
+    Entry* find(InodeIdentifier parent, const StringView& name);
+    void add(InodeIdentifier parent, const StringView& name, InodeIdentifier child);
+    void remove(Entry&);
+
+    mutable Lock m_lock { "NameCache" };
+    size_t m_entry_count { 0 };
+    Entry* m_entries { nullptr };
+    HashMap<Key, Entry*, KeyTraits> m_map;
+    IntrusiveList<Entry, &Entry::list_node> m_lru_list;
+
+    // Bumped on every invalidation, so a lookup that raced with a directory change doesn't cache a stale result.
+    u32 m_generation { 0 };
+
+    u64 m_hit_count { 0 };
+    u64 m_negative_hit_count { 0 };
+    u64 m_miss_count { 0 };
+    u64 m_invalidation_count { 0 };
+};
+
+}
@@ -38,7 +38,9 @@
 #include <Kernel/FileSystem/Custody.h>
 #include <Kernel/FileSystem/FileBackedFileSystem.h>
 #include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/FileSystem/NameCache.h>
 #include <Kernel/FileSystem/VirtualFileSystem.h>
+#include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/Heap/kmalloc.h>
 #include <Kernel/Interrupts/GenericInterruptHandler.h>
 #include <Kernel/Interrupts/InterruptManagement.h>
@@ -52,6 +54,7 @@
 #include <Kernel/PCI/Access.h>
 #include <Kernel/Profiling.h>
 #include <Kernel/TTY/TTY.h>
+#include <Kernel/Time/TimeManagement.h>
 #include <Kernel/VM/MemoryManager.h>
 #include <Kernel/VM/PurgeableVMObject.h>
 #include <LibBareMetal/Output/Console.h>
@@ -90,6 +93,7 @@ enum ProcFileType {
     FI_Root_cmdline,
     FI_Root_modules,
     FI_Root_profile,
+    FI_Root_locks,
     FI_Root_self, // symlink
     FI_Root_sys,  // directory
     FI_Root_net,  // directory
@@ -394,10 +398,28 @@ Optional<KBuffer> procfs$devices(InodeIdentifier)
     return builder.build();
 }
 
+Optional<KBuffer> procfs$locks(InodeIdentifier)
+{
+    KBufferBuilder builder;
+    JsonArraySerializer array { builder };
+    for (auto& statistics : Lock::contention_statistics()) {
+        auto obj = array.add_object();
+        obj.add("name", statistics.name ? statistics.name : "(unnamed)");
+        obj.add("contended", statistics.contended_count);
+        obj.add("contended_shared", statistics.shared_contended_count);
+        obj.add("total_wait_usec", statistics.total_wait_usec);
+        obj.add("max_wait_usec", statistics.max_wait_usec);
+        obj.add("last_holder_pid", statistics.last_holder_pid);
+        obj.add("last_holder_tid", statistics.last_holder_tid);
+    }
+    array.finish();
+    return builder.build();
+}
+
 Optional<KBuffer> procfs$uptime(InodeIdentifier)
 {
     KBufferBuilder builder;
-    builder.appendf("%u\n", (u32)(g_uptime / 1000));
+    builder.appendf("%u\n", (u32)TimeManagement::the().seconds_since_boot());
     return builder.build();
 }
 
@@ -518,6 +540,15 @@ Optional<KBuffer> procfs$net_tcp(InodeIdentifier)
         obj.add("bytes_in", socket.bytes_in());
         obj.add("packets_out", socket.packets_out());
         obj.add("bytes_out", socket.bytes_out());
+        obj.add("send_mss", socket.send_mss());
+        obj.add("congestion_window", socket.congestion_window());
+        obj.add("slow_start_threshold", socket.slow_start_threshold());
+        obj.add("smoothed_rtt", socket.smoothed_rtt());
+        obj.add("retransmission_timeout", socket.retransmission_timeout());
+        obj.add("sack_permitted", socket.sack_permitted());
+        obj.add("out_of_order_segments", socket.out_of_order_segments());
+        obj.add("retransmitted_segments", socket.retransmitted_segments());
+        obj.add("duplicate_acks", socket.duplicate_acks());
     });
     array.finish();
     return builder.build();
@@ -747,10 +778,19 @@ Optional<KBuffer> procfs$df(InodeIdentifier)
         fs_object.add("readonly", fs.is_readonly());
         fs_object.add("mount_flags", mount.flags());
 
-        if (fs.is_file_backed())
-            fs_object.add("source", static_cast<const FileBackedFS&>(fs).file_description().absolute_path());
-        else
+        if (fs.is_file_backed()) {
+            auto& file_backed_fs = static_cast<const FileBackedFS&>(fs);
+            fs_object.add("source", file_backed_fs.file_description().absolute_path());
+            auto cache_statistics = file_backed_fs.cache_statistics();
+            fs_object.add("cache_size", cache_statistics.entry_count);
+            fs_object.add("cache_hits", cache_statistics.hit_count);
+            fs_object.add("cache_misses", cache_statistics.miss_count);
+            fs_object.add("cache_evictions", cache_statistics.eviction_count);
+            fs_object.add("cache_dirty_blocks", cache_statistics.dirty_count);
+            fs_object.add("cache_written_back_blocks", cache_statistics.written_back_count);
+        } else {
             fs_object.add("source", fs.class_name());
+        }
     });
     array.finish();
     return builder.build();
@@ -829,15 +869,36 @@ Optional<KBuffer> procfs$memstat(InodeIdentifier)
     json.add("kmalloc_eternal_allocated", (u32)kmalloc_sum_eternal);
     json.add("user_physical_allocated", MM.user_physical_pages_used());
     json.add("user_physical_available", MM.user_physical_pages() - MM.user_physical_pages_used());
+    json.add("user_physical_zeroed", MM.zeroed_user_physical_pages());
     json.add("super_physical_allocated", MM.super_physical_pages_used());
     json.add("super_physical_available", MM.super_physical_pages() - MM.super_physical_pages_used());
     json.add("kmalloc_call_count", g_kmalloc_call_count);
     json.add("kfree_call_count", g_kfree_call_count);
-    slab_alloc_stats([&json](size_t slab_size, size_t num_allocated, size_t num_free) {
-        auto prefix = String::format("slab_%zu", slab_size);
-        json.add(String::format("%s_num_allocated", prefix.characters()), (u32)num_allocated);
-        json.add(String::format("%s_num_free", prefix.characters()), (u32)num_free);
+    size_t dirty_block_count = 0;
+    u64 written_back_block_count = 0;
+    VFS::the().for_each_mount([&](auto& mount) {
+        auto& fs = mount.guest_fs();
+        if (!fs.is_file_backed())
+            return;
+        auto statistics = static_cast<const FileBackedFS&>(fs).cache_statistics();
+        dirty_block_count += statistics.dirty_count;
+        written_back_block_count += statistics.written_back_count;
+    });
+    json.add("disk_cache_dirty_blocks", (u32)dirty_block_count);
+    json.add("disk_cache_written_back_blocks", written_back_block_count);
+    auto name_cache_statistics = NameCache::the().statistics();
+    json.add("name_cache_entries", (u32)name_cache_statistics.entry_count);
+    json.add("name_cache_hits", name_cache_statistics.hit_count);
+    json.add("name_cache_negative_hits", name_cache_statistics.negative_hit_count);
+    json.add("name_cache_misses", name_cache_statistics.miss_count);
+    json.add("name_cache_invalidations", name_cache_statistics.invalidation_count);
+    slab_alloc_stats([&json](auto& statistics) {
+        auto prefix = String::format("slab_%zu", statistics.object_size);
+        json.add(String::format("%s_num_allocated", prefix.characters()), (u32)statistics.num_allocated);
+        json.add(String::format("%s_num_free", prefix.characters()), (u32)statistics.num_free);
+        json.add(String::format("%s_num_pages", prefix.characters()), (u32)statistics.num_pages);
     });
+    json.add("slab_expanded_pages", (u32)slab_expanded_page_count());
     json.finish();
     return builder.build();
 }
@@ -893,6 +954,7 @@ Optional<KBuffer> procfs$all(InodeIdentifier)
         process_object.add("amount_purgeable_volatile", (u32)process.amount_purgeable_volatile());
         process_object.add("amount_purgeable_nonvolatile", (u32)process.amount_purgeable_nonvolatile());
         process_object.add("icon_id", process.icon_id());
+        process_object.add("inode_faults", process.inode_faults());
         auto thread_array = process_object.add_array("threads");
         process.for_each_thread([&](const Thread& thread) {
             auto thread_object = thread_array.add_object();
@@ -1635,6 +1697,7 @@ ProcFS::ProcFS()
     m_entries[FI_Root_cmdline] = { "cmdline", FI_Root_cmdline, true, procfs$cmdline };
     m_entries[FI_Root_modules] = { "modules", FI_Root_modules, true, procfs$modules };
     m_entries[FI_Root_profile] = { "profile", FI_Root_profile, false, procfs$profile };
+    m_entries[FI_Root_locks] = { "locks", FI_Root_locks, false, procfs$locks };
     m_entries[FI_Root_sys] = { "sys", FI_Root_sys, true };
     m_entries[FI_Root_net] = { "net", FI_Root_net, false };
 
@@ -24,6 +24,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <Kernel/FileSystem/NameCache.h>
 #include <Kernel/FileSystem/TmpFS.h>
 #include <Kernel/Process.h>
 #include <Kernel/Thread.h>
@@ -311,6 +312,7 @@ KResult TmpFSInode::add_child(InodeIdentifier child_id, const StringView& name,
     auto child = static_ptr_cast<TmpFSInode>(child_tmp.release_nonnull());
 
     m_children.set(owned_name, { entry, move(child) });
+    NameCache::the().invalidate(identifier(), name);
     set_metadata_dirty(true);
     set_metadata_dirty(false);
     return KSuccess;
@@ -328,6 +330,7 @@ KResult TmpFSInode::remove_child(const StringView& name)
     if (it == m_children.end())
         return KResult(-ENOENT);
     m_children.remove(it);
+    NameCache::the().invalidate(identifier(), name);
     set_metadata_dirty(true);
     set_metadata_dirty(false);
     return KSuccess;
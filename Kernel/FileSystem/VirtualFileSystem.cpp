@@ -31,6 +31,7 @@
 #include <Kernel/FileSystem/FileBackedFileSystem.h>
 #include <Kernel/FileSystem/FileDescription.h>
 #include <Kernel/FileSystem/FileSystem.h>
+#include <Kernel/FileSystem/NameCache.h>
 #include <Kernel/FileSystem/VirtualFileSystem.h>
 #include <Kernel/KSyms.h>
 #include <Kernel/Process.h>
@@ -698,6 +699,11 @@ void VFS::sync()
     FS::sync();
 }
 
+void VFS::write_back()
+{
+    FS::write_back();
+}
+
 Custody& VFS::root_custody()
 {
     if (!m_root_custody)
@@ -820,7 +826,7 @@ KResultOr<NonnullRefPtr<Custody>> VFS::resolve_path_without_veil(StringView path
         }
 
         // Okay, let's look up this part.
-        auto child_inode = parent.inode().lookup(part);
+        auto child_inode = NameCache::the().lookup(parent.inode(), part);
         if (!child_inode) {
             if (out_parent) {
                 // ENOENT with a non-null parent custody signals to caller that
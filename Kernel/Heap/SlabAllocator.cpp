@@ -25,138 +25,290 @@
  */
 
 #include <AK/Assertions.h>
+#include <AK/Bitmap.h>
 #include <AK/Memory.h>
+#include <AK/StringView.h>
+#include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/Heap/kmalloc.h>
-#include <Kernel/VM/Region.h>
+#include <Kernel/VM/MemoryManager.h>
 
 #define SANITIZE_SLABS
 
 namespace Kernel {
 
-template<size_t templated_slab_size>
-class SlabAllocator {
-public:
-    SlabAllocator() {}
-
-    void init(size_t size)
-    {
-        m_base = kmalloc_eternal(size);
-        m_end = (u8*)m_base + size;
-        FreeSlab* slabs = (FreeSlab*)m_base;
-        size_t slab_count = size / templated_slab_size;
-        for (size_t i = 1; i < slab_count; ++i) {
-            slabs[i].next = &slabs[i - 1];
-        }
-        slabs[0].next = nullptr;
-        m_freelist = &slabs[slab_count - 1];
-        m_num_allocated = 0;
-        m_num_free = slab_count;
+// Every slab is a single page that starts with a SlabPage header and is followed by objects of one size class.
+// Slab pages come out of the kmalloc pool at first. Once that runs low, the slab heap grows with kernel
+// regions from the MemoryManager.
+
+struct FreeObject {
+    FreeObject* next;
+};
+
+struct SlabPage {
+    SlabPage* next;
+    SlabPage* prev;
+    FreeObject* freelist;
+    u16 size_class_index;
+    u16 free_count;
+    bool from_kmalloc_pool;
+};
+
+// Keeps the objects aligned to 16 bytes, or to their own size for the smaller size classes.
+static const size_t slab_page_header_size = 32;
+static_assert(sizeof(SlabPage) <= slab_page_header_size);
+
+static const size_t size_class_count = 7;
+static const size_t smallest_size_class_size = 16;
+static_assert((smallest_size_class_size << (size_class_count - 1)) == slab_alloc_max_size);
+
+static const size_t slab_expansion_page_count = 16;
+// Expanding the slab heap allocates from kmalloc itself, so leave some room in the pool for that.
+static const size_t kmalloc_pool_reserve_size = 32 * KB;
+
+// FIXME: Put a per-CPU magazine of free objects in front of each size class once there is per-CPU data.
+//        Until SMP support arrives, all allocations happen on the boot CPU with interrupts disabled anyway.
+struct SizeClass {
+    size_t object_size;
+    size_t objects_per_page;
+    // Pages with at least one free object. Allocations are served from the head.
+    SlabPage* partial_pages;
+    size_t num_pages;
+    size_t num_allocated;
+    size_t num_free;
+};
+
+// NOTE: These are not default-initialized to prevent an init-time constructor from overwriting them.
+static SizeClass s_size_classes[size_class_count];
+// Empty pages that were handed to us by the MemoryManager, ready for any size class.
+static SlabPage* s_empty_pages;
+static size_t s_expanded_page_count;
+static bool s_expanding;
+
+static const size_t kernel_page_count = (0x100000000ull - 0xc0000000) / PAGE_SIZE;
+static u8 s_slab_page_map[kernel_page_count / 8];
+
+static Bitmap slab_page_map()
+{
+    return Bitmap::wrap(s_slab_page_map, kernel_page_count);
+}
+
+static size_t kernel_page_index(const void* ptr)
+{
+    ASSERT((FlatPtr)ptr >= 0xc0000000);
+    return ((FlatPtr)ptr - 0xc0000000) / PAGE_SIZE;
+}
+
+static SlabPage& slab_page_for(const void* ptr)
+{
+    return *(SlabPage*)((FlatPtr)ptr & PAGE_MASK);
+}
+
+static size_t size_class_index_for(size_t size)
+{
+    if (size <= smallest_size_class_size)
+        return 0;
+    return (32 - __builtin_clz(size - 1)) - 4;
+}
+
+void slab_alloc_init()
+{
+    memset(s_slab_page_map, 0, sizeof(s_slab_page_map));
+    for (size_t i = 0; i < size_class_count; ++i) {
+        auto& size_class = s_size_classes[i];
+        size_class.object_size = smallest_size_class_size << i;
+        size_class.objects_per_page = (PAGE_SIZE - slab_page_header_size) / size_class.object_size;
+        size_class.partial_pages = nullptr;
+        size_class.num_pages = 0;
+        size_class.num_allocated = 0;
+        size_class.num_free = 0;
     }
+    s_empty_pages = nullptr;
+    s_expanded_page_count = 0;
+    s_expanding = false;
+}
 
-    constexpr size_t slab_size() const { return templated_slab_size; }
-
-    void* alloc()
-    {
-        InterruptDisabler disabler;
-        if (!m_freelist)
-            return kmalloc(slab_size());
-        ASSERT(m_freelist);
-        void* ptr = m_freelist;
-        m_freelist = m_freelist->next;
-        ++m_num_allocated;
-        --m_num_free;
-#ifdef SANITIZE_SLABS
-        memset(ptr, SLAB_ALLOC_SCRUB_BYTE, slab_size());
-#endif
-        return ptr;
+static void expand_from_memory_manager()
+{
+    ASSERT(!s_expanding);
+    s_expanding = true;
+    auto region = MM.allocate_kernel_region(slab_expansion_page_count * PAGE_SIZE, "Slab Heap", Region::Access::Read | Region::Access::Write);
+    s_expanding = false;
+    if (!region)
+        return;
+
+    // Slab pages are never returned to the MemoryManager, so neither is the region.
+    u8* base = region.leak_ptr()->vaddr().as_ptr();
+    for (size_t i = 0; i < slab_expansion_page_count; ++i) {
+        auto* page = (SlabPage*)(base + i * PAGE_SIZE);
+        page->from_kmalloc_pool = false;
+        page->next = s_empty_pages;
+        s_empty_pages = page;
     }
+    slab_page_map().set_range(kernel_page_index(base), slab_expansion_page_count, true);
+    s_expanded_page_count += slab_expansion_page_count;
+}
+
+static SlabPage* take_kmalloc_pool_page()
+{
+    auto* page = (SlabPage*)kmalloc_pool_allocate_page();
+    if (!page)
+        return nullptr;
+    page->from_kmalloc_pool = true;
+    slab_page_map().set(kernel_page_index(page), true);
+    return page;
+}
 
-    void dealloc(void* ptr)
-    {
-        InterruptDisabler disabler;
-        ASSERT(ptr);
-        if (ptr < m_base || ptr >= m_end) {
-            kfree(ptr);
-            return;
+static SlabPage* take_page()
+{
+    if (!s_empty_pages) {
+        bool can_expand = MemoryManager::is_initialized() && !s_expanding;
+        if (!can_expand || sum_free > kmalloc_pool_reserve_size) {
+            if (auto* page = take_kmalloc_pool_page())
+                return page;
         }
-        ((FreeSlab*)ptr)->next = m_freelist;
-#ifdef SANITIZE_SLABS
-        if (slab_size() > sizeof(FreeSlab*))
-            memset(((FreeSlab*)ptr)->padding, SLAB_DEALLOC_SCRUB_BYTE, sizeof(FreeSlab::padding));
-#endif
-        m_freelist = (FreeSlab*)ptr;
-        ++m_num_allocated;
-        --m_num_free;
+        if (can_expand)
+            expand_from_memory_manager();
     }
+    if (!s_empty_pages)
+        return take_kmalloc_pool_page();
+    auto* page = s_empty_pages;
+    s_empty_pages = page->next;
+    return page;
+}
 
-    size_t num_allocated() const { return m_num_allocated; }
-    size_t num_free() const { return m_num_free; }
+static void give_back_page(SlabPage& page)
+{
+    if (page.from_kmalloc_pool) {
+        slab_page_map().set(kernel_page_index(&page), false);
+        kmalloc_pool_deallocate_page(&page);
+        return;
+    }
+    page.next = s_empty_pages;
+    s_empty_pages = &page;
+}
 
-private:
-    struct FreeSlab {
-        FreeSlab* next { nullptr };
-        char padding[templated_slab_size - sizeof(FreeSlab*)];
-    };
+static void link_partial_page(SizeClass& size_class, SlabPage& page)
+{
+    page.prev = nullptr;
+    page.next = size_class.partial_pages;
+    if (size_class.partial_pages)
+        size_class.partial_pages->prev = &page;
+    size_class.partial_pages = &page;
+}
 
-    // NOTE: These are not default-initialized to prevent an init-time constructor from overwriting them
-    FreeSlab* m_freelist;
-    size_t m_num_allocated;
-    size_t m_num_free;
-    void* m_base;
-    void* m_end;
+static void unlink_partial_page(SizeClass& size_class, SlabPage& page)
+{
+    if (page.prev)
+        page.prev->next = page.next;
+    else
+        size_class.partial_pages = page.next;
+    if (page.next)
+        page.next->prev = page.prev;
+    page.next = nullptr;
+    page.prev = nullptr;
+}
 
-    static_assert(sizeof(FreeSlab) == templated_slab_size);
-};
+static bool add_page(size_t size_class_index)
+{
+    auto& size_class = s_size_classes[size_class_index];
+    auto* page = take_page();
+    if (!page)
+        return false;
+    page->size_class_index = size_class_index;
+    page->free_count = size_class.objects_per_page;
+    page->freelist = nullptr;
+    u8* objects = (u8*)page + slab_page_header_size;
+    for (size_t i = size_class.objects_per_page; i > 0; --i) {
+        auto* object = (FreeObject*)(objects + (i - 1) * size_class.object_size);
+        object->next = page->freelist;
+        page->freelist = object;
+    }
+    link_partial_page(size_class, *page);
+    ++size_class.num_pages;
+    size_class.num_free += size_class.objects_per_page;
+    return true;
+}
 
-static SlabAllocator<16> s_slab_allocator_16;
-static SlabAllocator<32> s_slab_allocator_32;
-static SlabAllocator<64> s_slab_allocator_64;
+void* slab_alloc(size_t size)
+{
+    if (size > slab_alloc_max_size)
+        return nullptr;
+    InterruptDisabler disabler;
+    auto size_class_index = size_class_index_for(size);
+    auto& size_class = s_size_classes[size_class_index];
+    if (!size_class.partial_pages && !add_page(size_class_index))
+        return nullptr;
 
-static_assert(sizeof(Region) <= s_slab_allocator_64.slab_size());
+    auto& page = *size_class.partial_pages;
+    auto* object = page.freelist;
+    ASSERT(object);
+    page.freelist = object->next;
+    if (!--page.free_count)
+        unlink_partial_page(size_class, page);
+    ++size_class.num_allocated;
+    --size_class.num_free;
+#ifdef SANITIZE_SLABS
+    memset(object, SLAB_ALLOC_SCRUB_BYTE, size_class.object_size);
+#endif
+    return object;
+}
 
-template<typename Callback>
-void for_each_allocator(Callback callback)
+void slab_dealloc(void* ptr)
 {
-    callback(s_slab_allocator_16);
-    callback(s_slab_allocator_32);
-    callback(s_slab_allocator_64);
+    InterruptDisabler disabler;
+    ASSERT(is_slab_allocated(ptr));
+    auto& page = slab_page_for(ptr);
+    auto& size_class = s_size_classes[page.size_class_index];
+    ASSERT((((FlatPtr)ptr & ~PAGE_MASK) - slab_page_header_size) % size_class.object_size == 0);
+#ifdef SANITIZE_SLABS
+    memset(ptr, SLAB_DEALLOC_SCRUB_BYTE, size_class.object_size);
+#endif
+    auto* object = (FreeObject*)ptr;
+    object->next = page.freelist;
+    page.freelist = object;
+    if (page.free_count++ == 0)
+        link_partial_page(size_class, page);
+    --size_class.num_allocated;
+    ++size_class.num_free;
+
+    // Hang on to one page's worth of free objects, give the rest back once a page is completely free.
+    if (page.free_count == size_class.objects_per_page && size_class.num_free >= 2 * size_class.objects_per_page) {
+        unlink_partial_page(size_class, page);
+        --size_class.num_pages;
+        size_class.num_free -= size_class.objects_per_page;
+        give_back_page(page);
+    }
 }
 
-void slab_alloc_init()
+bool is_slab_allocated(const void* ptr)
 {
-    s_slab_allocator_16.init(128 * KB);
-    s_slab_allocator_32.init(128 * KB);
-    s_slab_allocator_64.init(512 * KB);
+    if ((FlatPtr)ptr < 0xc0000000)
+        return false;
+    return slab_page_map().get(kernel_page_index(ptr));
 }
 
-void* slab_alloc(size_t slab_size)
+size_t slab_allocation_size(const void* ptr)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.alloc();
-    if (slab_size <= 32)
-        return s_slab_allocator_32.alloc();
-    if (slab_size <= 64)
-        return s_slab_allocator_64.alloc();
-    ASSERT_NOT_REACHED();
+    ASSERT(is_slab_allocated(ptr));
+    return s_size_classes[slab_page_for(ptr).size_class_index].object_size;
 }
 
-void slab_dealloc(void* ptr, size_t slab_size)
+void slab_alloc_stats(Function<void(const SlabStatistics&)> callback)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.dealloc(ptr);
-    if (slab_size <= 32)
-        return s_slab_allocator_32.dealloc(ptr);
-    if (slab_size <= 64)
-        return s_slab_allocator_64.dealloc(ptr);
-    ASSERT_NOT_REACHED();
+    for (auto& size_class : s_size_classes) {
+        SlabStatistics statistics;
+        {
+            InterruptDisabler disabler;
+            statistics = { size_class.object_size, size_class.num_allocated, size_class.num_free, size_class.num_pages };
+        }
+        callback(statistics);
+    }
 }
 
-void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)> callback)
+size_t slab_expanded_page_count()
 {
-    for_each_allocator([&](auto& allocator) {
-        callback(allocator.slab_size(), allocator.num_allocated(), allocator.num_free());
-    });
+    return s_expanded_page_count;
 }
 
 }
@@ -34,16 +34,22 @@ namespace Kernel {
 #define SLAB_ALLOC_SCRUB_BYTE 0xab
 #define SLAB_DEALLOC_SCRUB_BYTE 0xbc
 
-void* slab_alloc(size_t slab_size);
-void slab_dealloc(void*, size_t slab_size);
+// kmalloc() serves everything up to this size from the slab heap.
+static const size_t slab_alloc_max_size = 1024;
+
+struct SlabStatistics {
+    size_t object_size;
+    size_t num_allocated;
+    size_t num_free;
+    size_t num_pages;
+};
+
 void slab_alloc_init();
-void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)>);
-
-#define MAKE_SLAB_ALLOCATED(type)                                        \
-public:                                                                  \
-    void* operator new(size_t) { return slab_alloc(sizeof(type)); }      \
-    void operator delete(void* ptr) { slab_dealloc(ptr, sizeof(type)); } \
-                                                                         \
-private:
+void* slab_alloc(size_t);
+void slab_dealloc(void*);
+bool is_slab_allocated(const void*);
+size_t slab_allocation_size(const void*);
+void slab_alloc_stats(Function<void(const SlabStatistics&)>);
+size_t slab_expanded_page_count();
 
 }
@@ -25,8 +25,8 @@
  */
 
 /*
- * Really really *really* Q&D malloc() and free() implementations
- * just to get going. Don't ever let anyone see this shit. :^)
+ * Small allocations come from the slab heap (see SlabAllocator.cpp). Everything else is
+ * carved out of a fixed pool with a first-fit bitmap allocator.
  */
 
 #include <AK/Assertions.h>
@@ -34,6 +34,7 @@
 #include <AK/Optional.h>
 #include <AK/Types.h>
 #include <Kernel/Arch/i386/CPU.h>
+#include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/Heap/kmalloc.h>
 #include <Kernel/KSyms.h>
 #include <Kernel/Process.h>
@@ -111,6 +112,42 @@ void* kmalloc_page_aligned(size_t size)
     return ptr;
 }
 
+void* kmalloc_pool_allocate_page()
+{
+    Kernel::InterruptDisabler disabler;
+    // A page is free when all of its chunks are, and there are 8 chunks per byte of the map.
+    constexpr size_t map_bytes_per_page = PAGE_SIZE / CHUNK_SIZE / 8;
+    for (size_t page = 0; page < POOL_SIZE / PAGE_SIZE; ++page) {
+        const u8* map = &alloc_map[page * map_bytes_per_page];
+        bool is_free = true;
+        for (size_t i = 0; i < map_bytes_per_page; ++i) {
+            if (map[i]) {
+                is_free = false;
+                break;
+            }
+        }
+        if (!is_free)
+            continue;
+        Bitmap bitmap_wrapper = Bitmap::wrap(alloc_map, POOL_SIZE / CHUNK_SIZE);
+        bitmap_wrapper.set_range(page * (PAGE_SIZE / CHUNK_SIZE), PAGE_SIZE / CHUNK_SIZE, true);
+        sum_alloc += PAGE_SIZE;
+        sum_free -= PAGE_SIZE;
+        return (void*)(BASE_PHYSICAL + page * PAGE_SIZE);
+    }
+    return nullptr;
+}
+
+void kmalloc_pool_deallocate_page(void* ptr)
+{
+    Kernel::InterruptDisabler disabler;
+    ASSERT((FlatPtr)ptr >= BASE_PHYSICAL && (FlatPtr)ptr < BASE_PHYSICAL + POOL_SIZE);
+    ASSERT(((FlatPtr)ptr & PAGE_MASK) == (FlatPtr)ptr);
+    Bitmap bitmap_wrapper = Bitmap::wrap(alloc_map, POOL_SIZE / CHUNK_SIZE);
+    bitmap_wrapper.set_range(((FlatPtr)ptr - BASE_PHYSICAL) / CHUNK_SIZE, PAGE_SIZE / CHUNK_SIZE, false);
+    sum_alloc -= PAGE_SIZE;
+    sum_free += PAGE_SIZE;
+}
+
 inline void* kmalloc_allocate(size_t first_chunk, size_t chunks_needed)
 {
     auto* a = (AllocationHeader*)(BASE_PHYSICAL + (first_chunk * CHUNK_SIZE));
@@ -138,6 +175,12 @@ void* kmalloc_impl(size_t size)
         Kernel::dump_backtrace();
     }
 
+    // Small allocations are served from the slab heap, which can grow beyond the pool.
+    if (size <= Kernel::slab_alloc_max_size) {
+        if (void* ptr = Kernel::slab_alloc(size))
+            return ptr;
+    }
+
     // We need space for the AllocationHeader at the head of the block.
     size_t real_size = size + sizeof(AllocationHeader);
 
@@ -177,6 +220,11 @@ void kfree(void* ptr)
     Kernel::InterruptDisabler disabler;
     ++g_kfree_call_count;
 
+    if (Kernel::is_slab_allocated(ptr)) {
+        Kernel::slab_dealloc(ptr);
+        return;
+    }
+
     auto* a = (AllocationHeader*)((((u8*)ptr) - sizeof(AllocationHeader)));
     FlatPtr start = ((FlatPtr)a - (FlatPtr)BASE_PHYSICAL) / CHUNK_SIZE;
 
@@ -198,8 +246,13 @@ void* krealloc(void* ptr, size_t new_size)
 
     Kernel::InterruptDisabler disabler;
 
-    auto* a = (AllocationHeader*)((((u8*)ptr) - sizeof(AllocationHeader)));
-    size_t old_size = a->allocation_size_in_chunks * CHUNK_SIZE;
+    size_t old_size;
+    if (Kernel::is_slab_allocated(ptr)) {
+        old_size = Kernel::slab_allocation_size(ptr);
+    } else {
+        auto* a = (AllocationHeader*)((((u8*)ptr) - sizeof(AllocationHeader)));
+        old_size = a->allocation_size_in_chunks * CHUNK_SIZE - sizeof(AllocationHeader);
+    }
 
     if (old_size == new_size)
         return ptr;
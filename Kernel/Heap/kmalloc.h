@@ -39,6 +39,11 @@ void kmalloc_init();
 [[gnu::malloc, gnu::returns_nonnull, gnu::alloc_size(1)]] void* kmalloc_page_aligned(size_t);
 [[gnu::malloc, gnu::returns_nonnull, gnu::alloc_size(1)]] void* kmalloc_aligned(size_t, size_t alignment);
 void* krealloc(void*, size_t);
+
+// Whole pages out of the kmalloc pool, used to back the slab heap.
+void* kmalloc_pool_allocate_page();
+void kmalloc_pool_deallocate_page(void*);
+
 void kfree(void*);
 void kfree_aligned(void*);
 
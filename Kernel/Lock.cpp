@@ -24,31 +24,120 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/HashMap.h>
 #include <Kernel/KSyms.h>
 #include <Kernel/Lock.h>
+#include <Kernel/Process.h>
 #include <Kernel/Thread.h>
+#include <Kernel/Time/TimeManagement.h>
 
 namespace Kernel {
 
-void Lock::lock()
+// Contention is aggregated by lock name, so e.g. every inode lock shows up
+// as a single "Inode" entry. Only the slow path touches this.
+static HashMap<const char*, LockStatistics>* s_statistics;
+
+static u64 monotonic_usec()
+{
+    if (!TimeManagement::initialized())
+        return 0;
+    auto now = TimeManagement::the().monotonic_time();
+    return (u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bool Lock::is_shared_holder(const Thread* thread) const
+{
+    for (auto* holder : m_shared_holders) {
+        if (holder == thread)
+            return true;
+    }
+    return false;
+}
+
+bool Lock::is_exclusively_locked_by_current_thread() const
 {
+    return m_mode == Mode::Exclusive && m_holder == Thread::current;
+}
+
+void Lock::lock(Mode mode)
+{
+    ASSERT(mode != Mode::Unlocked);
     ASSERT(!Scheduler::is_active());
     if (!are_interrupts_enabled()) {
         klog() << "Interrupts disabled when trying to take Lock{" << m_name << "}";
         dump_backtrace();
         hang();
     }
+    u64 wait_started_usec = 0;
+    Thread* contended_holder = nullptr;
     for (;;) {
         bool expected = false;
-        if (m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
-            if (!m_holder || m_holder == Thread::current) {
+        if (!m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel))
+            continue;
+
+        bool acquired = false;
+        switch (m_mode) {
+        case Mode::Unlocked:
+            m_mode = mode;
+            if (mode == Mode::Exclusive)
                 m_holder = Thread::current;
+            else
+                m_shared_holders.append(Thread::current);
+            m_level = 1;
+            acquired = true;
+            break;
+        case Mode::Exclusive:
+            if (m_holder == Thread::current) {
                 ++m_level;
-                m_lock.store(false, AK::memory_order_release);
-                return;
+                acquired = true;
             }
-            Thread::current->wait_on(m_queue, &m_lock, m_holder, m_name);
+            break;
+        case Mode::Shared:
+            if (mode == Mode::Exclusive) {
+                ASSERT(!is_shared_holder(Thread::current));
+                break;
+            }
+            // Waiting writers keep new readers out, but a thread that already
+            // holds the lock shared must be let back in or it would deadlock.
+            if (!m_exclusive_waiters || is_shared_holder(Thread::current)) {
+                m_shared_holders.append(Thread::current);
+                ++m_level;
+                acquired = true;
+            }
+            break;
+        }
+
+        if (acquired) {
+            m_lock.store(false, AK::memory_order_release);
+            if (wait_started_usec)
+                record_contention(mode, monotonic_usec() - wait_started_usec, contended_holder);
+            return;
+        }
+
+        // FIXME: Spin for a while before going to sleep if the holder is running on another CPU. There's
+        //        only the boot CPU until SMP support exists, and then the holder can't be running.
+        if (!wait_started_usec) {
+            wait_started_usec = max<u64>(monotonic_usec(), 1);
+            contended_holder = m_mode == Mode::Exclusive ? m_holder : m_shared_holders.first();
+        }
+        Thread* beneficiary = m_mode == Mode::Exclusive ? m_holder : m_shared_holders.first();
+        if (mode == Mode::Exclusive)
+            ++m_exclusive_waiters;
+        else
+            ++m_shared_waiters;
+        Thread::current->wait_on(m_queue, &m_lock, beneficiary, m_name);
+
+        // Take the waiter back off the books under the lock's own spinlock.
+        // clear_waiters() may have zeroed the counts while we were asleep.
+        for (;;) {
+            expected = false;
+            if (m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel))
+                break;
         }
+        u32& waiters = mode == Mode::Exclusive ? m_exclusive_waiters : m_shared_waiters;
+        if (waiters)
+            --waiters;
+        m_lock.store(false, AK::memory_order_release);
     }
 }
 
@@ -57,15 +146,36 @@ void Lock::unlock()
     for (;;) {
         bool expected = false;
         if (m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
-            ASSERT(m_holder == Thread::current);
+            ASSERT(m_mode != Mode::Unlocked);
             ASSERT(m_level);
+            if (m_mode == Mode::Exclusive) {
+                ASSERT(m_holder == Thread::current);
+            } else {
+                bool removed = false;
+                for (size_t i = 0; i < m_shared_holders.size(); ++i) {
+                    if (m_shared_holders[i] == Thread::current) {
+                        m_shared_holders.remove(i);
+                        removed = true;
+                        break;
+                    }
+                }
+                ASSERT(removed);
+            }
             --m_level;
             if (m_level) {
                 m_lock.store(false, AK::memory_order_release);
                 return;
             }
+            m_mode = Mode::Unlocked;
             m_holder = nullptr;
-            m_queue.wake_one(&m_lock);
+            // With readers waiting, let everyone have a go; the writers among
+            // them will go back to sleep if a reader gets in first.
+            if (m_shared_waiters) {
+                m_lock.store(false, AK::memory_order_release);
+                m_queue.wake_all();
+            } else {
+                m_queue.wake_one(&m_lock);
+            }
             return;
         }
         // I don't know *who* is using "m_lock", so just yield.
@@ -76,10 +186,10 @@ void Lock::unlock()
 bool Lock::force_unlock_if_locked()
 {
     InterruptDisabler disabler;
-    if (m_holder != Thread::current)
+    if (m_mode != Mode::Exclusive || m_holder != Thread::current)
         return false;
     ASSERT(m_level == 1);
-    ASSERT(m_holder == Thread::current);
+    m_mode = Mode::Unlocked;
     m_holder = nullptr;
     --m_level;
     m_queue.wake_one();
@@ -90,6 +200,42 @@ void Lock::clear_waiters()
 {
     InterruptDisabler disabler;
     m_queue.clear();
+    m_exclusive_waiters = 0;
+    m_shared_waiters = 0;
+}
+
+void Lock::record_contention(Mode mode, u64 wait_usec, Thread* holder)
+{
+    InterruptDisabler disabler;
+    if (!s_statistics)
+        s_statistics = new HashMap<const char*, LockStatistics>;
+    if (!s_statistics->contains(m_name)) {
+        LockStatistics statistics;
+        statistics.name = m_name;
+        s_statistics->set(m_name, statistics);
+    }
+    auto& statistics = (*s_statistics->find(m_name)).value;
+    ++statistics.contended_count;
+    if (mode == Mode::Shared)
+        ++statistics.shared_contended_count;
+    statistics.total_wait_usec += wait_usec;
+    statistics.max_wait_usec = max(statistics.max_wait_usec, wait_usec);
+    if (holder && Thread::is_thread(holder)) {
+        statistics.last_holder_pid = holder->process().pid();
+        statistics.last_holder_tid = holder->tid();
+    }
+}
+
+Vector<LockStatistics> Lock::contention_statistics()
+{
+    InterruptDisabler disabler;
+    Vector<LockStatistics> statistics;
+    if (!s_statistics)
+        return statistics;
+    statistics.ensure_capacity(s_statistics->size());
+    for (auto& it : *s_statistics)
+        statistics.append(it.value);
+    return statistics;
 }
 
 }
@@ -29,49 +29,87 @@
 #include <AK/Assertions.h>
 #include <AK/Atomic.h>
 #include <AK/Types.h>
+#include <AK/Vector.h>
 #include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/Forward.h>
 #include <Kernel/WaitQueue.h>
 
 namespace Kernel {
 
+struct LockStatistics {
+    const char* name { nullptr };
+    u32 contended_count { 0 };
+    u32 shared_contended_count { 0 };
+    u64 total_wait_usec { 0 };
+    u64 max_wait_usec { 0 };
+    pid_t last_holder_pid { 0 };
+    int last_holder_tid { 0 };
+};
+
 class Lock {
 public:
+    // Exclusive holders may re-enter the lock (in either mode), shared holders
+    // may only take it shared again. Upgrading shared to exclusive would
+    // deadlock against another upgrader, so it's not allowed.
+    // Re-entry has to stay: Ext2FS helpers like allocate_blocks() and
+    // set_inode_allocation_state() take the FS lock themselves, and are called
+    // from create_inode() and friends with it already held.
+    enum class Mode {
+        Unlocked,
+        Shared,
+        Exclusive,
+    };
+
     Lock(const char* name = nullptr)
         : m_name(name)
     {
     }
     ~Lock() {}
 
-    void lock();
+    void lock(Mode = Mode::Exclusive);
     void unlock();
     bool force_unlock_if_locked();
-    bool is_locked() const { return m_holder; }
+    bool is_locked() const { return m_mode != Mode::Unlocked; }
+    bool is_exclusively_locked_by_current_thread() const;
+    Mode mode() const { return m_mode; }
     void clear_waiters();
 
     const char* name() const { return m_name; }
 
+    static Vector<LockStatistics> contention_statistics();
+
 private:
+    bool is_shared_holder(const Thread*) const;
+    void record_contention(Mode, u64 wait_usec, Thread* holder);
+
     Atomic<bool> m_lock { false };
+    Mode m_mode { Mode::Unlocked };
     u32 m_level { 0 };
     Thread* m_holder { nullptr };
+    // One entry per shared acquisition, so a thread that took the lock
+    // shared twice shows up twice.
+    Vector<Thread*, 2> m_shared_holders;
+    u32 m_exclusive_waiters { 0 };
+    u32 m_shared_waiters { 0 };
     const char* m_name { nullptr };
     WaitQueue m_queue;
 };
 
 class Locker {
 public:
-    [[gnu::always_inline]] inline explicit Locker(Lock& l)
+    [[gnu::always_inline]] inline explicit Locker(Lock& l, Lock::Mode mode = Lock::Mode::Exclusive)
         : m_lock(l)
+        , m_mode(mode)
     {
         lock();
     }
     [[gnu::always_inline]] inline ~Locker() { unlock(); }
     [[gnu::always_inline]] inline void unlock() { m_lock.unlock(); }
-    [[gnu::always_inline]] inline void lock() { m_lock.lock(); }
+    [[gnu::always_inline]] inline void lock() { m_lock.lock(m_mode); }
 
 private:
     Lock& m_lock;
+    Lock::Mode m_mode;
 };
 
 #define LOCKER(lock) Locker locker(lock)
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/NetworkOrdered.h>
+#include <AK/Types.h>
+
+namespace Kernel {
+
+// One's complement sums as used by IPv4, ICMP, UDP and TCP, RFC 1071.
+//
+// The sum is byte order independent, so the words are added up the way they sit in memory, four bytes
+// at a time into a 64-bit accumulator that only needs folding at the very end. Sums of several pieces
+// can be chained through internet_checksum_add(), as long as every piece but the last has an even size.
+
+inline u32 internet_checksum_add(u32 initial, const void* ptr, size_t size)
+{
+    auto* bytes = (const u8*)ptr;
+    u64 sum = initial;
+    while (size >= 16) {
+        u32 words[4];
+        __builtin_memcpy(words, bytes, sizeof(words));
+        sum += (u64)words[0] + words[1] + words[2] + words[3];
+        bytes += 16;
+        size -= 16;
+    }
+    while (size >= 4) {
+        u32 word;
+        __builtin_memcpy(&word, bytes, sizeof(word));
+        sum += word;
+        bytes += 4;
+        size -= 4;
+    }
+    if (size >= 2) {
+        u16 word;
+        __builtin_memcpy(&word, bytes, sizeof(word));
+        sum += word;
+        bytes += 2;
+        size -= 2;
+    }
+    // A trailing odd byte counts as if it were followed by a zero byte.
+    if (size)
+        sum += *bytes;
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    return sum;
+}
+
+inline u16 internet_checksum_fold(u32 sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+inline NetworkOrdered<u16> internet_checksum_finish(u32 sum)
+{
+    // The folded sum is already in network byte order, so undo the conversion NetworkOrdered is about to do.
+    return convert_between_host_and_network((u16)~internet_checksum_fold(sum));
+}
+
+// The folded sum without the final inversion, for checksum offloading to add the rest of the data on top of.
+inline NetworkOrdered<u16> internet_checksum_partial(u32 sum)
+{
+    return convert_between_host_and_network(internet_checksum_fold(sum));
+}
+
+inline NetworkOrdered<u16> internet_checksum(const void* ptr, size_t size)
+{
+    return internet_checksum_finish(internet_checksum_add(0, ptr, size));
+}
+
+}
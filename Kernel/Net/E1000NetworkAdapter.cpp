@@ -57,6 +57,7 @@ namespace Kernel {
 #define REG_RADV 0x282C             // RX Int. Absolute Delay Timer
 #define REG_RSRPD 0x2C00            // RX Small Packet Detect Interrupt
 #define REG_TIPG 0x0410             // Transmit Inter Packet Gap
+#define REG_RXCSUM 0x5000           // RX Checksum Control
 #define ECTRL_SLU 0x40              //set link up
 #define RCTL_EN (1 << 1)            // Receiver Enable
 #define RCTL_SBP (1 << 2)           // Store Bad Packets
@@ -79,6 +80,8 @@ namespace Kernel {
 #define RCTL_DPF (1 << 22)          // Discard Pause Frames
 #define RCTL_PMCF (1 << 23)         // Pass MAC Control Frames
 #define RCTL_SECRC (1 << 26)        // Strip Ethernet CRC
+#define RXCSUM_IPOFL (1 << 8)       // IP Checksum Offload Enable
+#define RXCSUM_TUOFL (1 << 9)       // TCP/UDP Checksum Offload Enable
 
 // Buffer Sizes
 #define RCTL_BSIZE_256 (3 << 16)
@@ -96,9 +99,16 @@ namespace Kernel {
 #define CMD_IC (1 << 2)   // Insert Checksum
 #define CMD_RS (1 << 3)   // Report Status
 #define CMD_RPS (1 << 4)  // Report Packet Sent
+#define CMD_DEXT (1 << 5) // Descriptor Extension, for context and data descriptors
 #define CMD_VLE (1 << 6)  // VLAN Packet Enable
 #define CMD_IDE (1 << 7)  // Interrupt Delay Enable
 
+// Context and data descriptors
+#define TXD_CMD_SHIFT 24
+#define TXD_DTYP_CONTEXT (0 << 20)
+#define TXD_DTYP_DATA (1 << 20)
+#define POPTS_TXSM (1 << 1) // Insert TCP/UDP checksum
+
 // TCTL Register
 
 #define TCTL_EN (1 << 1)      // Transmit Enable
@@ -113,6 +123,13 @@ namespace Kernel {
 #define TSTA_LC (1 << 2) // Late Collision
 #define LSTA_TU (1 << 3) // Transmit Underrun
 
+// RX descriptor status and errors
+
+#define RXD_STAT_DD (1 << 0)    // Descriptor Done
+#define RXD_STAT_IXSM (1 << 2)  // Ignore Checksum Indication
+#define RXD_STAT_TCPCS (1 << 5) // TCP/UDP Checksum Calculated
+#define RXD_ERR_TCPE (1 << 5)   // TCP/UDP Checksum Error
+
 // STATUS Register
 
 #define STATUS_FD 0x01
@@ -139,6 +156,8 @@ namespace Kernel {
 #define INTERRUPT_TXD_LOW (1 << 15)
 #define INTERRUPT_SRPD (1 << 16)
 
+#define INTERRUPTS_RX (INTERRUPT_RXDMT0 | INTERRUPT_RXO | INTERRUPT_RXT0)
+
 void E1000NetworkAdapter::detect(const PCI::Address& address)
 {
     if (address.is_null())
@@ -181,13 +200,14 @@ E1000NetworkAdapter::E1000NetworkAdapter(PCI::Address address, u8 irq)
     u32 flags = in32(REG_CTRL);
     out32(REG_CTRL, flags | ECTRL_SLU);
 
-    out16(REG_INTERRUPT_RATE, 6000); // Interrupt rate of 1.536 milliseconds
+    // Throttle interrupts, the interval is in units of 256 nanoseconds.
+    out32(REG_INTERRUPT_RATE, 1000000000 / (max_interrupts_per_second * 256));
 
     initialize_rx_descriptors();
     initialize_tx_descriptors();
+    set_has_checksum_offload(true);
 
-    out32(REG_INTERRUPT_MASK_SET, 0x1f6dc);
-    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RXT0);
+    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPTS_RX);
     in32(REG_INTERRUPT_CAUSE_READ);
 
     enable_irq();
@@ -199,23 +219,21 @@ E1000NetworkAdapter::~E1000NetworkAdapter()
 
 void E1000NetworkAdapter::handle_irq(const RegisterState&)
 {
-    out32(REG_INTERRUPT_MASK_CLEAR, 0xffffffff);
-
     u32 status = in32(REG_INTERRUPT_CAUSE_READ);
-    if (status & 4) {
+    if (status & INTERRUPT_LSC) {
         u32 flags = in32(REG_CTRL);
         out32(REG_CTRL, flags | ECTRL_SLU);
     }
-    if (status & 0x80) {
-        receive();
+    if (status & INTERRUPTS_RX) {
+        // Leave the RX ring to the NetworkTask until it has caught up, see NetworkAdapter::poll().
+        out32(REG_INTERRUPT_MASK_CLEAR, INTERRUPTS_RX);
+        schedule_poll();
     }
-    if (status & 0x10) {
-        // Threshold OK?
+    if (status & INTERRUPT_TXDW) {
+        // Only ever unmasked while send_raw() is waiting for room in the TX ring.
+        out32(REG_INTERRUPT_MASK_CLEAR, INTERRUPT_TXDW);
+        m_wait_queue.wake_all();
     }
-
-    m_wait_queue.wake_all();
-
-    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RXT0 | INTERRUPT_RXO);
 }
 
 void E1000NetworkAdapter::detect_eeprom()
@@ -274,11 +292,15 @@ bool E1000NetworkAdapter::link_up()
 
 void E1000NetworkAdapter::initialize_rx_descriptors()
 {
-    auto* rx_descriptors = (e1000_tx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
+    // Each RX buffer fits in a single page, so the ring doesn't need any physically contiguous memory.
+    // The pool lets the stack hold on to a few rings' worth of packets before we fall back to copying.
+    m_rx_buffer_pool = PacketBufferPool::create("E1000 RX buffer", rx_buffer_size, number_of_rx_descriptors * 4);
+    auto* rx_descriptors = (e1000_rx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
     for (int i = 0; i < number_of_rx_descriptors; ++i) {
         auto& descriptor = rx_descriptors[i];
-        m_rx_buffers_regions.append(MM.allocate_contiguous_kernel_region(PAGE_ROUND_UP(8192), "E1000 RX buffer", Region::Access::Read | Region::Access::Write));
-        descriptor.addr = m_rx_buffers_regions[i]->vmobject().physical_pages()[0]->paddr().get();
+        m_rx_buffers.append(m_rx_buffer_pool->try_take());
+        ASSERT(m_rx_buffers[i]);
+        descriptor.addr = m_rx_buffers[i]->physical_address().get();
         descriptor.status = 0;
     }
 
@@ -288,17 +310,21 @@ void E1000NetworkAdapter::initialize_rx_descriptors()
     out32(REG_RXDESCHEAD, 0);
     out32(REG_RXDESCTAIL, number_of_rx_descriptors - 1);
 
-    out32(REG_RCTRL, RCTL_EN | RCTL_SBP | RCTL_UPE | RCTL_MPE | RCTL_LBM_NONE | RTCL_RDMTS_HALF | RCTL_BAM | RCTL_SECRC | RCTL_BSIZE_8192);
+    out32(REG_RXCSUM, RXCSUM_IPOFL | RXCSUM_TUOFL);
+    out32(REG_RCTRL, RCTL_EN | RCTL_SBP | RCTL_UPE | RCTL_MPE | RCTL_LBM_NONE | RTCL_RDMTS_HALF | RCTL_BAM | RCTL_SECRC | RCTL_BSIZE_2048);
 }
 
 void E1000NetworkAdapter::initialize_tx_descriptors()
 {
+    m_tx_buffers_region = MM.allocate_contiguous_kernel_region(PAGE_ROUND_UP(number_of_tx_descriptors * tx_buffer_size), "E1000 TX buffers", Region::Access::Read | Region::Access::Write);
+    auto tx_buffers_base = m_tx_buffers_region->vmobject().physical_pages()[0]->paddr();
     auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
     for (int i = 0; i < number_of_tx_descriptors; ++i) {
         auto& descriptor = tx_descriptors[i];
-        m_tx_buffers_regions.append(MM.allocate_contiguous_kernel_region(PAGE_ROUND_UP(8192), "E1000 TX buffer", Region::Access::Read | Region::Access::Write));
-        descriptor.addr = m_tx_buffers_regions[i]->vmobject().physical_pages()[0]->paddr().get();
+        descriptor.addr = tx_buffers_base.offset(i * tx_buffer_size).get();
         descriptor.cmd = 0;
+        // Every descriptor starts out free for send_raw() to use.
+        descriptor.status = TSTA_DD;
     }
 
     out32(REG_TXDESCLO, m_tx_descriptors_region->vmobject().physical_pages()[0]->paddr().get());
@@ -382,58 +408,126 @@ u32 E1000NetworkAdapter::in32(u16 address)
 
 void E1000NetworkAdapter::send_raw(const u8* data, size_t length)
 {
-    disable_irq();
-    u32 tx_current = in32(REG_TXDESCTAIL);
-#ifdef E1000_DEBUG
-    klog() << "E1000: Sending packet (" << length << " bytes)";
-#endif
+    transmit(data, length, 0, 0);
+}
+
+void E1000NetworkAdapter::send_raw_with_checksum_offload(const u8* data, size_t length, size_t checksum_start, size_t checksum_offset)
+{
+    ASSERT(checksum_start + checksum_offset <= 0xff);
+    transmit(data, length, checksum_start, checksum_offset);
+}
+
+void E1000NetworkAdapter::transmit(const u8* data, size_t length, size_t checksum_start, size_t checksum_offset)
+{
+    ASSERT(length <= tx_buffer_size);
+    bool offload_checksum = checksum_offset != 0;
+    InterruptDisabler disabler;
     auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
-    auto& descriptor = tx_descriptors[tx_current];
-    ASSERT(length <= 8192);
-    auto* vptr = (void*)m_tx_buffers_regions[tx_current]->vaddr().as_ptr();
-    memcpy(vptr, data, length);
-    descriptor.length = length;
-    descriptor.status = 0;
-    descriptor.cmd = CMD_EOP | CMD_IFCS | CMD_RS;
-#ifdef E1000_DEBUG
-    klog() << "E1000: Using tx descriptor " << tx_current << " (head is at " << in32(REG_TXDESCHEAD) << ")";
-#endif
-    tx_current = (tx_current + 1) % number_of_tx_descriptors;
-    cli();
-    enable_irq();
-    out32(REG_TXDESCTAIL, tx_current);
+    u32 tx_current;
+    bool needs_context;
     for (;;) {
-        if (descriptor.status) {
-            sti();
+        cli();
+        tx_current = in32(REG_TXDESCTAIL);
+        // The card remembers the checksum offsets, so a context descriptor is only needed when they change.
+        needs_context = offload_checksum && (checksum_start != m_tx_checksum_start || checksum_offset != m_tx_checksum_offset);
+        // Always leave one descriptor free: with every descriptor in use the tail would equal the head,
+        // which the card takes for an empty ring. The card finishes descriptors in order, so if the one
+        // after the last we need is free, so are the ones before it.
+        u32 tx_guard = (tx_current + (needs_context ? 2 : 1)) % number_of_tx_descriptors;
+        if (tx_descriptors[tx_guard].status & TSTA_DD)
             break;
-        }
+        // The ring is full, wait for the card to finish sending the oldest frame.
+        out32(REG_INTERRUPT_MASK_SET, INTERRUPT_TXDW);
         Thread::current->wait_on(m_wait_queue);
     }
 #ifdef E1000_DEBUG
-    klog() << "E1000: Sent packet, status is now " << String::format("%b", descriptor.status) << "!";
+    klog() << "E1000: Sending packet (" << length << " bytes)";
 #endif
+
+    if (needs_context) {
+        auto& context = *(e1000_tx_context_desc*)&tx_descriptors[tx_current];
+        context.ipcss = 0;
+        context.ipcso = 0;
+        context.ipcse = 0;
+        context.tucss = checksum_start;
+        context.tucso = checksum_start + checksum_offset;
+        context.tucse = 0;
+        context.status = 0;
+        context.hdrlen = 0;
+        context.mss = 0;
+        context.cmd_and_length = TXD_DTYP_CONTEXT | ((CMD_DEXT | CMD_RS) << TXD_CMD_SHIFT);
+        m_tx_checksum_start = checksum_start;
+        m_tx_checksum_offset = checksum_offset;
+        tx_current = (tx_current + 1) % number_of_tx_descriptors;
+    }
+
+    memcpy(m_tx_buffers_region->vaddr().offset(tx_current * tx_buffer_size).as_ptr(), data, length);
+    // A context descriptor may have been written over this slot, so always put the buffer address back.
+    auto buffer_address = m_tx_buffers_region->vmobject().physical_pages()[0]->paddr().offset(tx_current * tx_buffer_size);
+    if (offload_checksum) {
+        auto& descriptor = *(e1000_tx_data_desc*)&tx_descriptors[tx_current];
+        descriptor.addr = buffer_address.get();
+        descriptor.status = 0;
+        descriptor.popts = POPTS_TXSM;
+        descriptor.special = 0;
+        descriptor.cmd_and_length = length | TXD_DTYP_DATA | ((CMD_EOP | CMD_IFCS | CMD_RS | CMD_DEXT) << TXD_CMD_SHIFT);
+    } else {
+        auto& descriptor = tx_descriptors[tx_current];
+        descriptor.addr = buffer_address.get();
+        descriptor.length = length;
+        descriptor.cso = 0;
+        descriptor.css = 0;
+        descriptor.special = 0;
+        descriptor.status = 0;
+        descriptor.cmd = CMD_EOP | CMD_IFCS | CMD_RS;
+    }
+#ifdef E1000_DEBUG
+    klog() << "E1000: Using tx descriptor " << tx_current << " (head is at " << in32(REG_TXDESCHEAD) << ")";
+#endif
+    // Don't wait for the frame to go out, the descriptor gets reused once the card sets its DD bit.
+    out32(REG_TXDESCTAIL, (tx_current + 1) % number_of_tx_descriptors);
 }
 
-void E1000NetworkAdapter::receive()
+size_t E1000NetworkAdapter::poll_receive(size_t budget)
 {
-    auto* rx_descriptors = (e1000_tx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
-    u32 rx_current;
-    for (;;) {
-        rx_current = in32(REG_RXDESCTAIL);
-        if (rx_current == in32(REG_RXDESCHEAD))
-            return;
-        rx_current = (rx_current + 1) % number_of_rx_descriptors;
-        if (!(rx_descriptors[rx_current].status & 1))
+    auto* rx_descriptors = (e1000_rx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
+    u32 rx_tail = in32(REG_RXDESCTAIL);
+    size_t received = 0;
+    while (received < budget) {
+        u32 rx_current = (rx_tail + 1) % number_of_rx_descriptors;
+        auto& descriptor = rx_descriptors[rx_current];
+        if (!(descriptor.status & RXD_STAT_DD))
             break;
-        auto* buffer = m_rx_buffers_regions[rx_current]->vaddr().as_ptr();
-        u16 length = rx_descriptors[rx_current].length;
+        auto& buffer = m_rx_buffers[rx_current];
+        u16 length = descriptor.length;
+        bool checksum_verified = !(descriptor.status & RXD_STAT_IXSM) && (descriptor.status & RXD_STAT_TCPCS) && !(descriptor.errors & RXD_ERR_TCPE);
 #ifdef E1000_DEBUG
-        klog() << "E1000: Received 1 packet @ " << buffer << " (" << length << ") bytes!";
+        klog() << "E1000: Received 1 packet @ " << buffer->data() << " (" << length << ") bytes!";
 #endif
-        did_receive(buffer, length);
-        rx_descriptors[rx_current].status = 0;
-        out32(REG_RXDESCTAIL, rx_current);
+        // Hand the filled buffer up the stack and put a fresh one in the ring.
+        // If too many packets are still in flight, copy this one out instead so the ring never runs dry.
+        if (auto replacement = m_rx_buffer_pool->try_take()) {
+            buffer->set_size(length);
+            buffer->set_checksum_verified(checksum_verified);
+            did_receive(buffer.release_nonnull());
+            buffer = move(replacement);
+            descriptor.addr = buffer->physical_address().get();
+        } else {
+            did_receive(buffer->data(), length, checksum_verified);
+        }
+        descriptor.status = 0;
+        rx_tail = rx_current;
+        ++received;
     }
+    // Give the whole batch of descriptors back to the card at once.
+    if (received)
+        out32(REG_RXDESCTAIL, rx_tail);
+    return received;
+}
+
+void E1000NetworkAdapter::enable_receive_interrupts()
+{
+    out32(REG_INTERRUPT_MASK_SET, INTERRUPTS_RX);
 }
 
 }
@@ -44,6 +44,7 @@ public:
     virtual ~E1000NetworkAdapter() override;
 
     virtual void send_raw(const u8*, size_t) override;
+    virtual void send_raw_with_checksum_offload(const u8*, size_t, size_t checksum_start, size_t checksum_offset) override;
     virtual bool link_up() override;
 
     virtual const char* purpose() const override { return class_name(); }
@@ -73,6 +74,30 @@ private:
         volatile uint16_t special { 0 };
     };
 
+    // Tells the card where the TCP/UDP checksum goes for the data descriptors that follow it.
+    struct [[gnu::packed]] e1000_tx_context_desc
+    {
+        volatile uint8_t ipcss { 0 };
+        volatile uint8_t ipcso { 0 };
+        volatile uint16_t ipcse { 0 };
+        volatile uint8_t tucss { 0 };
+        volatile uint8_t tucso { 0 };
+        volatile uint16_t tucse { 0 };
+        volatile uint32_t cmd_and_length { 0 };
+        volatile uint8_t status { 0 };
+        volatile uint8_t hdrlen { 0 };
+        volatile uint16_t mss { 0 };
+    };
+
+    struct [[gnu::packed]] e1000_tx_data_desc
+    {
+        volatile uint64_t addr { 0 };
+        volatile uint32_t cmd_and_length { 0 };
+        volatile uint8_t status { 0 };
+        volatile uint8_t popts { 0 };
+        volatile uint16_t special { 0 };
+    };
+
     void detect_eeprom();
     u32 read_eeprom(u8 address);
     void read_mac_address();
@@ -90,21 +115,30 @@ private:
     u16 in16(u16 address);
     u32 in32(u16 address);
 
-    void receive();
+    void transmit(const u8*, size_t, size_t checksum_start, size_t checksum_offset);
+
+    virtual size_t poll_receive(size_t budget) override;
+    virtual void enable_receive_interrupts() override;
 
     IOAddress m_io_base;
     VirtualAddress m_mmio_base;
     OwnPtr<Region> m_rx_descriptors_region;
     OwnPtr<Region> m_tx_descriptors_region;
-    Vector<OwnPtr<Region>> m_rx_buffers_regions;
-    Vector<OwnPtr<Region>> m_tx_buffers_regions;
+    Vector<RefPtr<PacketBuffer>> m_rx_buffers;
+    RefPtr<PacketBufferPool> m_rx_buffer_pool;
+    OwnPtr<Region> m_tx_buffers_region;
     OwnPtr<Region> m_mmio_region;
     u8 m_interrupt_line { 0 };
+    u8 m_tx_checksum_start { 0 };
+    u8 m_tx_checksum_offset { 0 };
     bool m_has_eeprom { false };
     bool m_use_mmio { false };
 
-    static const int number_of_rx_descriptors = 32;
-    static const int number_of_tx_descriptors = 8;
+    static const int number_of_rx_descriptors = 256;
+    static const size_t rx_buffer_size = 2048;
+    static const int number_of_tx_descriptors = 64;
+    static const size_t tx_buffer_size = 2048;
+    static const u32 max_interrupts_per_second = 8000;
 
     WaitQueue m_wait_queue;
 };
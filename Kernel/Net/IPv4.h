@@ -31,6 +31,7 @@
 #include <AK/NetworkOrdered.h>
 #include <AK/String.h>
 #include <AK/Types.h>
+#include <Kernel/Net/Checksum.h>
 
 namespace Kernel {
 
@@ -45,8 +46,6 @@ enum class IPv4PacketFlags : u16 {
     MoreFragments = 0x2000,
 };
 
-NetworkOrdered<u16> internet_checksum(const void*, size_t);
-
 class [[gnu::packed]] IPv4Packet
 {
 public:
@@ -126,19 +125,19 @@ private:
 static_assert(sizeof(IPv4Packet) == 20);
 const LogStream& operator<<(const LogStream& stream, const IPv4Packet& packet);
 
-inline NetworkOrdered<u16> internet_checksum(const void* ptr, size_t count)
+// Sum of the pseudo-header that the TCP and UDP checksums cover in front of the segment itself.
+inline u32 ipv4_pseudo_header_sum(const IPv4Address& source, const IPv4Address& destination, IPv4Protocol protocol, u16 length)
 {
-    u32 checksum = 0;
-    auto* w = (const u16*)ptr;
-    while (count > 1) {
-        checksum += convert_between_host_and_network(*w++);
-        if (checksum & 0x80000000)
-            checksum = (checksum & 0xffff) | (checksum >> 16);
-        count -= 2;
-    }
-    while (checksum >> 16)
-        checksum = (checksum & 0xffff) + (checksum >> 16);
-    return ~checksum & 0xffff;
+    struct [[gnu::packed]] PseudoHeader
+    {
+        IPv4Address source;
+        IPv4Address destination;
+        u8 zero;
+        u8 protocol;
+        NetworkOrdered<u16> length;
+    };
+    PseudoHeader pseudo_header { source, destination, 0, (u8)protocol, length };
+    return internet_checksum_add(0, &pseudo_header, sizeof(pseudo_header));
 }
 
 }
@@ -66,6 +66,7 @@ KResultOr<NonnullRefPtr<Socket>> IPv4Socket::create(int type, int protocol)
 
 IPv4Socket::IPv4Socket(int type, int protocol)
     : Socket(AF_INET, type, protocol)
+    , m_receive_buffer(type == SOCK_STREAM ? 256 * KB : 65536)
 {
 #ifdef IPV4_SOCKET_DEBUG
     dbg() << "IPv4Socket{" << this << "} created with type=" << type << ", protocol=" << protocol;
@@ -193,7 +194,7 @@ int IPv4Socket::allocate_local_port_if_needed()
     return port;
 }
 
-ssize_t IPv4Socket::sendto(FileDescription&, const void* data, size_t data_length, int flags, const sockaddr* addr, socklen_t addr_length)
+ssize_t IPv4Socket::sendto(FileDescription& description, const void* data, size_t data_length, int flags, const sockaddr* addr, socklen_t addr_length)
 {
     (void)flags;
     if (addr && addr_length != sizeof(sockaddr_in))
@@ -230,10 +231,16 @@ ssize_t IPv4Socket::sendto(FileDescription&, const void* data, size_t data_lengt
         return data_length;
     }
 
-    int nsent = protocol_send(data, data_length);
-    if (nsent > 0)
-        Thread::current->did_ipv4_socket_write(nsent);
-    return nsent;
+    for (;;) {
+        int nsent = protocol_send(data, data_length);
+        if (nsent > 0)
+            Thread::current->did_ipv4_socket_write(nsent);
+        if (nsent != -EAGAIN || !description.is_blocking())
+            return nsent;
+        // The protocol's send buffer is full, wait for it to drain.
+        if (Thread::current->block<Thread::WriteBlocker>(description) != Thread::BlockResult::WokeNormally)
+            return -EINTR;
+    }
 }
 
 ssize_t IPv4Socket::receive_byte_buffered(FileDescription& description, void* buffer, size_t buffer_length, int, sockaddr*, socklen_t*)
@@ -264,6 +271,7 @@ ssize_t IPv4Socket::receive_byte_buffered(FileDescription& description, void* bu
         Thread::current->did_ipv4_socket_read((size_t)nreceived);
 
     m_can_read = !m_receive_buffer.is_empty();
+    protocol_did_read();
     return nreceived;
 }
 
@@ -285,11 +293,11 @@ ssize_t IPv4Socket::receive_packet_buffered(FileDescription& description, void*
             packet = m_receive_queue.take_first();
             m_can_read = !m_receive_queue.is_empty();
 #ifdef IPV4_SOCKET_DEBUG
-            dbg() << "IPv4Socket(" << this << "): recvfrom without blocking " << packet.data.value().size() << " bytes, packets in queue: " << m_receive_queue.size_slow();
+            dbg() << "IPv4Socket(" << this << "): recvfrom without blocking " << packet.data->size() << " bytes, packets in queue: " << m_receive_queue.size_slow();
 #endif
         }
     }
-    if (!packet.data.has_value()) {
+    if (!packet.data) {
         if (protocol_is_disconnected()) {
             dbg() << "IPv4Socket{" << this << "} is protocol-disconnected, returning 0 in recvfrom!";
             return 0;
@@ -311,11 +319,11 @@ ssize_t IPv4Socket::receive_packet_buffered(FileDescription& description, void*
         packet = m_receive_queue.take_first();
         m_can_read = !m_receive_queue.is_empty();
 #ifdef IPV4_SOCKET_DEBUG
-        dbg() << "IPv4Socket(" << this << "): recvfrom with blocking " << packet.data.value().size() << " bytes, packets in queue: " << m_receive_queue.size_slow();
+        dbg() << "IPv4Socket(" << this << "): recvfrom with blocking " << packet.data->size() << " bytes, packets in queue: " << m_receive_queue.size_slow();
 #endif
     }
-    ASSERT(packet.data.has_value());
-    auto& ipv4_packet = *(const IPv4Packet*)(packet.data.value().data());
+    ASSERT(packet.data);
+    auto& ipv4_packet = *(const IPv4Packet*)(packet.data->data());
 
     if (addr) {
 #ifdef IPV4_SOCKET_DEBUG
@@ -335,7 +343,7 @@ ssize_t IPv4Socket::receive_packet_buffered(FileDescription& description, void*
         return ipv4_packet.payload_size();
     }
 
-    return protocol_receive(packet.data.value(), buffer, buffer_length, flags);
+    return protocol_receive(*packet.data, buffer, buffer_length, flags);
 }
 
 ssize_t IPv4Socket::recvfrom(FileDescription& description, void* buffer, size_t buffer_length, int flags, sockaddr* addr, socklen_t* addr_length)
@@ -358,23 +366,23 @@ ssize_t IPv4Socket::recvfrom(FileDescription& description, void* buffer, size_t
     return nreceived;
 }
 
-bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port, KBuffer&& packet)
+bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port, NonnullRefPtr<PacketBuffer> packet)
 {
     LOCKER(lock());
 
     if (is_shut_down_for_reading())
         return false;
 
-    auto packet_size = packet.size();
+    auto packet_size = packet->size();
 
     if (buffer_mode() == BufferMode::Bytes) {
+        int nreceived = protocol_receive(*packet, m_scratch_buffer.value().data(), m_scratch_buffer.value().size(), 0);
         size_t space_in_receive_buffer = m_receive_buffer.space_for_writing();
-        if (packet_size > space_in_receive_buffer) {
+        if ((size_t)nreceived > space_in_receive_buffer) {
             dbg() << "IPv4Socket(" << this << "): did_receive refusing packet since buffer is full.";
             ASSERT(m_can_read);
             return false;
         }
-        int nreceived = protocol_receive(packet, m_scratch_buffer.value().data(), m_scratch_buffer.value().size(), 0);
         m_receive_buffer.write(m_scratch_buffer.value().data(), nreceived);
         m_can_read = !m_receive_buffer.is_empty();
     } else {
@@ -393,6 +401,7 @@ bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port,
     else
         dbg() << "IPv4Socket(" << this << "): did_receive " << packet_size << " bytes, total_received=" << m_bytes_received << ", packets in queue: " << m_receive_queue.size_slow();
 #endif
+    evaluate_block_conditions();
     return true;
 }
 
@@ -573,6 +582,7 @@ void IPv4Socket::shut_down_for_reading()
 {
     Socket::shut_down_for_reading();
     m_can_read = true;
+    evaluate_block_conditions();
 }
 
 }
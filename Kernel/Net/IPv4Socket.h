@@ -33,6 +33,7 @@
 #include <Kernel/Lock.h>
 #include <Kernel/Net/IPv4.h>
 #include <Kernel/Net/IPv4SocketTuple.h>
+#include <Kernel/Net/PacketBuffer.h>
 #include <Kernel/Net/Socket.h>
 
 namespace Kernel {
@@ -65,7 +66,7 @@ public:
 
     virtual int ioctl(FileDescription&, unsigned request, unsigned arg) override;
 
-    bool did_receive(const IPv4Address& peer_address, u16 peer_port, KBuffer&&);
+    bool did_receive(const IPv4Address& peer_address, u16 peer_port, NonnullRefPtr<PacketBuffer>);
 
     const IPv4Address& local_address() const { return m_local_address; }
     u16 local_port() const { return m_local_port; }
@@ -96,17 +97,20 @@ protected:
 
     virtual KResult protocol_bind() { return KSuccess; }
     virtual KResult protocol_listen() { return KSuccess; }
-    virtual int protocol_receive(const KBuffer&, void*, size_t, int) { return -ENOTIMPL; }
+    virtual int protocol_receive(const PacketBuffer&, void*, size_t, int) { return -ENOTIMPL; }
     virtual int protocol_send(const void*, size_t) { return -ENOTIMPL; }
     virtual KResult protocol_connect(FileDescription&, ShouldBlock) { return KSuccess; }
     virtual int protocol_allocate_local_port() { return 0; }
     virtual bool protocol_is_disconnected() const { return false; }
+    virtual void protocol_did_read() { }
 
     virtual void shut_down_for_reading() override;
 
     void set_local_address(IPv4Address address) { m_local_address = address; }
     void set_peer_address(IPv4Address address) { m_peer_address = address; }
 
+    const DoubleBuffer& receive_buffer() const { return m_receive_buffer; }
+
 private:
     virtual bool is_ipv4() const override { return true; }
 
@@ -119,7 +123,7 @@ private:
     struct ReceivedPacket {
         IPv4Address peer_address;
         u16 peer_port;
-        Optional<KBuffer> data;
+        RefPtr<PacketBuffer> data;
     };
 
     SinglyLinkedList<ReceivedPacket> m_receive_queue;
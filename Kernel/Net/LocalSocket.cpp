@@ -215,6 +215,7 @@ void LocalSocket::attach(FileDescription& description)
         ASSERT(m_connect_side_fd != &description);
         m_accept_side_fd_open = true;
     }
+    evaluate_block_conditions();
 }
 
 void LocalSocket::detach(FileDescription& description)
@@ -225,6 +226,7 @@ void LocalSocket::detach(FileDescription& description)
         ASSERT(m_accept_side_fd_open);
         m_accept_side_fd_open = false;
     }
+    evaluate_block_conditions();
 }
 
 bool LocalSocket::can_read(const FileDescription& description) const
@@ -264,8 +266,10 @@ ssize_t LocalSocket::sendto(FileDescription& description, const void* data, size
     if (!has_attached_peer(description))
         return -EPIPE;
     ssize_t nwritten = send_buffer_for(description).write((const u8*)data, data_size);
-    if (nwritten > 0)
+    if (nwritten > 0) {
         Thread::current->did_unix_socket_write(nwritten);
+        evaluate_block_conditions();
+    }
     return nwritten;
 }
 
@@ -307,8 +311,10 @@ ssize_t LocalSocket::recvfrom(FileDescription& description, void* buffer, size_t
         return 0;
     ASSERT(!buffer_for_me.is_empty());
     int nread = buffer_for_me.read((u8*)buffer, buffer_size);
-    if (nread > 0)
+    if (nread > 0) {
         Thread::current->did_unix_socket_read(nread);
+        evaluate_block_conditions();
+    }
     return nread;
 }
 
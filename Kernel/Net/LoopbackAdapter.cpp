@@ -26,6 +26,8 @@
 
 #include <Kernel/Net/LoopbackAdapter.h>
 
+//#define LOOPBACK_DEBUG
+
 namespace Kernel {
 
 LoopbackAdapter& LoopbackAdapter::the()
@@ -41,6 +43,8 @@ LoopbackAdapter::LoopbackAdapter()
     set_interface_name("loop");
     set_mtu(65536);
     set_mac_address({ 19, 85, 2, 9, 0x55, 0xaa });
+    // Nothing can get corrupted on the way back to ourselves, so don't bother computing or verifying checksums.
+    set_has_checksum_offload(true);
 }
 
 LoopbackAdapter::~LoopbackAdapter()
@@ -49,8 +53,15 @@ LoopbackAdapter::~LoopbackAdapter()
 
 void LoopbackAdapter::send_raw(const u8* data, size_t size)
 {
+#ifdef LOOPBACK_DEBUG
     dbg() << "LoopbackAdapter: Sending " << size << " byte(s) to myself.";
-    did_receive(data, size);
+#endif
+    did_receive(data, size, true);
+}
+
+void LoopbackAdapter::send_raw_with_checksum_offload(const u8* data, size_t size, size_t, size_t)
+{
+    send_raw(data, size);
 }
 
 }
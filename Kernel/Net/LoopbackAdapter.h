@@ -38,6 +38,7 @@ public:
     virtual ~LoopbackAdapter() override;
 
     virtual void send_raw(const u8*, size_t) override;
+    virtual void send_raw_with_checksum_offload(const u8*, size_t, size_t, size_t) override;
     virtual const char* class_name() const override { return "LoopbackAdapter"; }
 
 private:
@@ -100,10 +100,35 @@ void NetworkAdapter::send(const MACAddress& destination, const ARPPacket& packet
     send_raw((const u8*)eth, size_in_bytes);
 }
 
-void NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Address& destination_ipv4, IPv4Protocol protocol, const u8* payload, size_t payload_size, u8 ttl)
+static size_t transport_checksum_offset(IPv4Protocol protocol)
+{
+    switch (protocol) {
+    case IPv4Protocol::TCP:
+        return 16;
+    case IPv4Protocol::UDP:
+        return 6;
+    default:
+        ASSERT_NOT_REACHED();
+    }
+}
+
+static void finish_transport_checksum(u8* segment, size_t size, size_t checksum_offset)
+{
+    // The checksum field holds the pseudo-header sum, so summing the segment as it is covers everything.
+    auto checksum = internet_checksum(segment, size);
+    memcpy(segment + checksum_offset, &checksum, sizeof(checksum));
+}
+
+void NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Address& destination_ipv4, IPv4Protocol protocol, const u8* payload, size_t payload_size, u8 ttl, bool has_partial_checksum)
 {
     size_t ipv4_packet_size = sizeof(IPv4Packet) + payload_size;
     if (ipv4_packet_size > mtu()) {
+        if (has_partial_checksum) {
+            auto completed_payload = ByteBuffer::copy(payload, payload_size);
+            finish_transport_checksum(completed_payload.data(), payload_size, transport_checksum_offset(protocol));
+            send_ipv4_fragmented(destination_mac, destination_ipv4, protocol, completed_payload.data(), payload_size, ttl);
+            return;
+        }
         send_ipv4_fragmented(destination_mac, destination_ipv4, protocol, payload, payload_size, ttl);
         return;
     }
@@ -127,6 +152,14 @@ void NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Addr
     m_packets_out++;
     m_bytes_out += ethernet_frame_size;
     memcpy(ipv4.payload(), payload, payload_size);
+    if (has_partial_checksum) {
+        size_t checksum_offset = transport_checksum_offset(protocol);
+        if (has_checksum_offload()) {
+            send_raw_with_checksum_offload((const u8*)&eth, ethernet_frame_size, sizeof(EthernetFrameHeader) + sizeof(IPv4Packet), checksum_offset);
+            return;
+        }
+        finish_transport_checksum((u8*)ipv4.payload(), payload_size, checksum_offset);
+    }
     send_raw((const u8*)&eth, ethernet_frame_size);
 }
 
@@ -168,47 +201,69 @@ void NetworkAdapter::send_ipv4_fragmented(const MACAddress& destination_mac, con
     }
 }
 
-void NetworkAdapter::did_receive(const u8* data, size_t length)
+void NetworkAdapter::did_receive(NonnullRefPtr<PacketBuffer> packet)
 {
     InterruptDisabler disabler;
     m_packets_in++;
-    m_bytes_in += length;
+    m_bytes_in += packet->size();
+
+    m_packet_queue.append(move(packet));
 
-    Optional<KBuffer> buffer;
+    if (on_receive)
+        on_receive();
+}
 
-    if (m_unused_packet_buffers.is_empty()) {
-        buffer = KBuffer::copy(data, length);
+void NetworkAdapter::did_receive(const u8* data, size_t length, bool checksum_verified)
+{
+    RefPtr<PacketBuffer> packet;
+    {
+        InterruptDisabler disabler;
+        if (!m_copied_packet_pool)
+            m_copied_packet_pool = PacketBufferPool::create("Packet buffer", PAGE_SIZE, 100);
+        if (length <= m_copied_packet_pool->buffer_size())
+            packet = m_copied_packet_pool->try_take();
+    }
+    if (packet) {
+        memcpy(packet->data(), data, length);
+        packet->set_size(length);
     } else {
-        buffer = m_unused_packet_buffers.take_first();
-        --m_unused_packet_buffers_count;
-        if (length <= buffer.value().size()) {
-            memcpy(buffer.value().data(), data, length);
-            buffer.value().set_size(length);
-        } else {
-            buffer = KBuffer::copy(data, length);
-        }
+        packet = PacketBuffer::copy(data, length);
     }
+    packet->set_checksum_verified(checksum_verified);
+    did_receive(packet.release_nonnull());
+}
 
-    m_packet_queue.append(buffer.value());
-
+void NetworkAdapter::schedule_poll()
+{
+    InterruptDisabler disabler;
+    m_poll_scheduled = true;
     if (on_receive)
         on_receive();
 }
 
-size_t NetworkAdapter::dequeue_packet(u8* buffer, size_t buffer_size)
+size_t NetworkAdapter::poll(size_t budget)
+{
+    {
+        InterruptDisabler disabler;
+        if (!m_poll_scheduled)
+            return 0;
+    }
+    size_t received = poll_receive(budget);
+    if (received < budget) {
+        // The ring is empty. Anything that arrives from here on raises the interrupt again.
+        InterruptDisabler disabler;
+        m_poll_scheduled = false;
+        enable_receive_interrupts();
+    }
+    return received;
+}
+
+RefPtr<PacketBuffer> NetworkAdapter::dequeue_packet()
 {
     InterruptDisabler disabler;
     if (m_packet_queue.is_empty())
-        return 0;
-    auto packet = m_packet_queue.take_first();
-    size_t packet_size = packet.size();
-    ASSERT(packet_size <= buffer_size);
-    memcpy(buffer, packet.data(), packet_size);
-    if (m_unused_packet_buffers_count < 100) {
-        m_unused_packet_buffers.append(packet);
-        ++m_unused_packet_buffers_count;
-    }
-    return packet_size;
+        return nullptr;
+    return m_packet_queue.take_first();
 }
 
 void NetworkAdapter::set_ipv4_address(const IPv4Address& address)
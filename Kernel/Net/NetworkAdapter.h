@@ -37,6 +37,7 @@
 #include <Kernel/Net/ARP.h>
 #include <Kernel/Net/ICMP.h>
 #include <Kernel/Net/IPv4.h>
+#include <Kernel/Net/PacketBuffer.h>
 
 namespace Kernel {
 
@@ -63,13 +64,23 @@ public:
     void set_ipv4_gateway(const IPv4Address&);
 
     void send(const MACAddress&, const ARPPacket&);
-    void send_ipv4(const MACAddress&, const IPv4Address&, IPv4Protocol, const u8* payload, size_t payload_size, u8 ttl);
+    // With has_partial_checksum, the TCP or UDP checksum field in the payload only holds the pseudo-header sum,
+    // and either the adapter or send_ipv4() fills in the rest on the way out.
+    void send_ipv4(const MACAddress&, const IPv4Address&, IPv4Protocol, const u8* payload, size_t payload_size, u8 ttl, bool has_partial_checksum = false);
     void send_ipv4_fragmented(const MACAddress&, const IPv4Address&, IPv4Protocol, const u8* payload, size_t payload_size, u8 ttl);
 
-    size_t dequeue_packet(u8* buffer, size_t buffer_size);
+    bool has_checksum_offload() const { return m_has_checksum_offload; }
+
+    RefPtr<PacketBuffer> dequeue_packet();
 
     bool has_queued_packets() const { return !m_packet_queue.is_empty(); }
 
+    // Adapters that support polling mask their receive interrupt when it fires and call schedule_poll().
+    // The NetworkTask then pulls up to `budget` frames at a time off the ring, and the interrupt
+    // is only turned back on once a poll comes up short. Returns the number of frames received.
+    size_t poll(size_t budget);
+    bool poll_scheduled() const { return m_poll_scheduled; }
+
     u32 mtu() const { return m_mtu; }
     void set_mtu(u32 mtu) { m_mtu = mtu; }
 
@@ -85,16 +96,26 @@ protected:
     void set_interface_name(const StringView& basename);
     void set_mac_address(const MACAddress& mac_address) { m_mac_address = mac_address; }
     virtual void send_raw(const u8*, size_t) = 0;
-    void did_receive(const u8*, size_t);
+    // Only called on adapters that set_has_checksum_offload(true). The last two arguments are where the TCP or UDP
+    // segment starts in the frame, and where its checksum field is relative to that.
+    virtual void send_raw_with_checksum_offload(const u8*, size_t, size_t, size_t) { ASSERT_NOT_REACHED(); }
+    void set_has_checksum_offload(bool offload) { m_has_checksum_offload = offload; }
+    void did_receive(NonnullRefPtr<PacketBuffer>);
+    void did_receive(const u8*, size_t, bool checksum_verified = false);
+
+    void schedule_poll();
+    virtual size_t poll_receive(size_t) { return 0; }
+    virtual void enable_receive_interrupts() {}
 
 private:
     MACAddress m_mac_address;
     IPv4Address m_ipv4_address;
     IPv4Address m_ipv4_netmask;
     IPv4Address m_ipv4_gateway;
-    SinglyLinkedList<KBuffer> m_packet_queue;
-    SinglyLinkedList<KBuffer> m_unused_packet_buffers;
-    size_t m_unused_packet_buffers_count { 0 };
+    SinglyLinkedList<NonnullRefPtr<PacketBuffer>> m_packet_queue;
+    RefPtr<PacketBufferPool> m_copied_packet_pool;
+    bool m_poll_scheduled { false };
+    bool m_has_checksum_offload { false };
     String m_name;
     u32 m_packets_in { 0 };
     u32 m_bytes_in { 0 };
@@ -33,6 +33,7 @@
 #include <Kernel/Net/IPv4Socket.h>
 #include <Kernel/Net/LoopbackAdapter.h>
 #include <Kernel/Net/NetworkTask.h>
+#include <Kernel/Net/PacketBuffer.h>
 #include <Kernel/Net/Routing.h>
 #include <Kernel/Net/TCP.h>
 #include <Kernel/Net/TCPSocket.h>
@@ -51,25 +52,35 @@
 
 namespace Kernel {
 
+static void handle_packet(PacketBuffer&);
 static void handle_arp(const EthernetFrameHeader&, size_t frame_size);
-static void handle_ipv4(const EthernetFrameHeader&, size_t frame_size);
-static void handle_icmp(const EthernetFrameHeader&, const IPv4Packet&);
-static void handle_udp(const IPv4Packet&);
-static void handle_tcp(const IPv4Packet&);
+static void handle_ipv4(const EthernetFrameHeader&, PacketBuffer&);
+static void handle_icmp(const EthernetFrameHeader&, const IPv4Packet&, PacketBuffer&);
+static void handle_udp(const IPv4Packet&, PacketBuffer&);
+static void handle_tcp(const IPv4Packet&, PacketBuffer&);
 
 [[noreturn]] static void NetworkTask_main();
 
+static WaitQueue* s_packet_wait_queue;
+
 void NetworkTask::spawn()
 {
     Thread* thread = nullptr;
     Process::create_kernel_process(thread, "NetworkTask", NetworkTask_main);
 }
 
+void NetworkTask::wake()
+{
+    if (s_packet_wait_queue)
+        s_packet_wait_queue->wake_all();
+}
+
 void NetworkTask_main()
 {
     WaitQueue packet_wait_queue;
+    s_packet_wait_queue = &packet_wait_queue;
     u8 octet = 15;
-    int pending_packets = 0;
+    bool has_pending_packets = false;
     NetworkAdapter::for_each([&](auto& adapter) {
         if (String(adapter.class_name()) == "LoopbackAdapter") {
             adapter.set_ipv4_address({ 127, 0, 0, 1 });
@@ -84,81 +95,102 @@ void NetworkTask_main()
         klog() << "NetworkTask: " << adapter.class_name() << " network adapter found: hw=" << adapter.mac_address().to_string().characters() << " address=" << adapter.ipv4_address().to_string().characters() << " netmask=" << adapter.ipv4_netmask().to_string().characters() << " gateway=" << adapter.ipv4_gateway().to_string().characters();
 
         adapter.on_receive = [&]() {
-            pending_packets++;
+            has_pending_packets = true;
             packet_wait_queue.wake_all();
         };
     });
 
-    auto dequeue_packet = [&pending_packets](u8* buffer, size_t buffer_size) -> size_t {
-        if (pending_packets == 0)
-            return 0;
-        size_t packet_size = 0;
-        NetworkAdapter::for_each([&](auto& adapter) {
-            if (packet_size || !adapter.has_queued_packets())
+    // Take up to poll_budget frames from each adapter per pass, so a busy adapter can't starve the others,
+    // and frames arriving back-to-back get handled without an interrupt or a wakeup each.
+    constexpr size_t poll_budget = 64;
+    auto dequeue_packets = [&](auto& batch) {
+        {
+            InterruptDisabler disabler;
+            if (!has_pending_packets)
                 return;
-            packet_size = adapter.dequeue_packet(buffer, buffer_size);
-            pending_packets--;
+            has_pending_packets = false;
+        }
+        NetworkAdapter::for_each([&](auto& adapter) {
+            adapter.poll(poll_budget);
+            for (size_t i = 0; i < poll_budget; ++i) {
+                auto packet = adapter.dequeue_packet();
+                if (!packet)
+                    break;
 #ifdef NETWORK_TASK_DEBUG
-            klog() << "NetworkTask: Dequeued packet from " << adapter.name().characters() << " (" << packet_size << " bytes)";
+                klog() << "NetworkTask: Dequeued packet from " << adapter.name().characters() << " (" << packet->size() << " bytes)";
 #endif
+                batch.append(packet.release_nonnull());
+            }
+            // Whatever is left over gets picked up on the next pass.
+            if (adapter.has_queued_packets() || adapter.poll_scheduled())
+                has_pending_packets = true;
         });
-        return packet_size;
     };
 
-    size_t buffer_size = 64 * KB;
-    auto buffer_region = MM.allocate_kernel_region(buffer_size, "Kernel Packet Buffer", Region::Access::Read | Region::Access::Write, false, true);
-    auto buffer = (u8*)buffer_region->vaddr().get();
-
     klog() << "NetworkTask: Enter main loop.";
+    Vector<NonnullRefPtr<PacketBuffer>, poll_budget> batch;
     for (;;) {
-        size_t packet_size = dequeue_packet(buffer, buffer_size);
-        if (!packet_size) {
-            Thread::current->wait_on(packet_wait_queue);
-            continue;
-        }
-        if (packet_size < sizeof(EthernetFrameHeader)) {
-            klog() << "NetworkTask: Packet is too small to be an Ethernet packet! (" << packet_size << ")";
+        TCPSocket::handle_fired_timers();
+
+        batch.clear_with_capacity();
+        dequeue_packets(batch);
+        if (batch.is_empty()) {
+            // Interrupts stay disabled until we're asleep, so neither a timer nor a packet can arrive unnoticed in between.
+            InterruptDisabler disabler;
+            if (!has_pending_packets && !TCPSocket::has_fired_timers())
+                Thread::current->wait_on(packet_wait_queue);
             continue;
         }
-        auto& eth = *(const EthernetFrameHeader*)buffer;
+        for (auto& packet : batch)
+            handle_packet(packet);
+    }
+}
+
+void handle_packet(PacketBuffer& packet)
+{
+    size_t packet_size = packet.size();
+    if (packet_size < sizeof(EthernetFrameHeader)) {
+        klog() << "NetworkTask: Packet is too small to be an Ethernet packet! (" << packet_size << ")";
+        return;
+    }
+    auto& eth = *(const EthernetFrameHeader*)packet.data();
 #ifdef ETHERNET_DEBUG
-        klog() << "NetworkTask: From " << eth.source().to_string().characters() << " to " << eth.destination().to_string().characters() << ", ether_type=" << String::format("%w", eth.ether_type()) << ", packet_length=" << packet_size;
+    klog() << "NetworkTask: From " << eth.source().to_string().characters() << " to " << eth.destination().to_string().characters() << ", ether_type=" << String::format("%w", eth.ether_type()) << ", packet_length=" << packet_size;
 #endif
 
 #ifdef ETHERNET_VERY_DEBUG
-        for (size_t i = 0; i < packet_size; i++) {
-            klog() << String::format("%b", buffer[i]);
-
-            switch (i % 16) {
-            case 7:
-                klog() << "  ";
-                break;
-            case 15:
-                klog() << "";
-                break;
-            default:
-                klog() << " ";
-                break;
-            }
-        }
-
-        klog() << "";
-#endif
+    for (size_t i = 0; i < packet_size; i++) {
+        klog() << String::format("%b", packet.data()[i]);
 
-        switch (eth.ether_type()) {
-        case EtherType::ARP:
-            handle_arp(eth, packet_size);
-            break;
-        case EtherType::IPv4:
-            handle_ipv4(eth, packet_size);
+        switch (i % 16) {
+        case 7:
+            klog() << "  ";
             break;
-        case EtherType::IPv6:
-            // ignore
+        case 15:
+            klog() << "";
             break;
         default:
-            klog() << "NetworkTask: Unknown ethernet type 0x" << String::format("%x", eth.ether_type());
+            klog() << " ";
+            break;
         }
     }
+
+    klog() << "";
+#endif
+
+    switch (eth.ether_type()) {
+    case EtherType::ARP:
+        handle_arp(eth, packet_size);
+        break;
+    case EtherType::IPv4:
+        handle_ipv4(eth, packet);
+        break;
+    case EtherType::IPv6:
+        // ignore
+        break;
+    default:
+        klog() << "NetworkTask: Unknown ethernet type 0x" << String::format("%x", eth.ether_type());
+    }
 }
 
 void handle_arp(const EthernetFrameHeader& eth, size_t frame_size)
@@ -213,8 +245,9 @@ void handle_arp(const EthernetFrameHeader& eth, size_t frame_size)
     }
 }
 
-void handle_ipv4(const EthernetFrameHeader& eth, size_t frame_size)
+void handle_ipv4(const EthernetFrameHeader& eth, PacketBuffer& packet_buffer)
 {
+    size_t frame_size = packet_buffer.size();
     constexpr size_t minimum_ipv4_frame_size = sizeof(EthernetFrameHeader) + sizeof(IPv4Packet);
     if (frame_size < minimum_ipv4_frame_size) {
         klog() << "handle_ipv4: Frame too small (" << frame_size << ", need " << minimum_ipv4_frame_size << ")";
@@ -233,24 +266,28 @@ void handle_ipv4(const EthernetFrameHeader& eth, size_t frame_size)
         return;
     }
 
+    // From here on the buffer holds just the IPv4 packet, without the Ethernet header or any trailing padding.
+    packet_buffer.pull(sizeof(EthernetFrameHeader));
+    packet_buffer.set_size(packet.length());
+
 #ifdef IPV4_DEBUG
     klog() << "handle_ipv4: source=" << packet.source().to_string().characters() << ", target=" << packet.destination().to_string().characters();
 #endif
 
     switch ((IPv4Protocol)packet.protocol()) {
     case IPv4Protocol::ICMP:
-        return handle_icmp(eth, packet);
+        return handle_icmp(eth, packet, packet_buffer);
     case IPv4Protocol::UDP:
-        return handle_udp(packet);
+        return handle_udp(packet, packet_buffer);
     case IPv4Protocol::TCP:
-        return handle_tcp(packet);
+        return handle_tcp(packet, packet_buffer);
     default:
         klog() << "handle_ipv4: Unhandled protocol " << packet.protocol();
         break;
     }
 }
 
-void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet)
+void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet, PacketBuffer& packet_buffer)
 {
     auto& icmp_header = *static_cast<const ICMPHeader*>(ipv4_packet.payload());
 #ifdef ICMP_DEBUG
@@ -263,7 +300,7 @@ void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet)
             LOCKER(socket->lock());
             if (socket->protocol() != (unsigned)IPv4Protocol::ICMP)
                 continue;
-            socket->did_receive(ipv4_packet.source(), 0, KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()));
+            socket->did_receive(ipv4_packet.source(), 0, packet_buffer);
         }
     }
 
@@ -289,7 +326,15 @@ void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet)
     }
 }
 
-void handle_udp(const IPv4Packet& ipv4_packet)
+static bool has_valid_transport_checksum(const IPv4Packet& ipv4_packet, const PacketBuffer& packet_buffer, IPv4Protocol protocol)
+{
+    if (packet_buffer.is_checksum_verified())
+        return true;
+    u32 sum = ipv4_pseudo_header_sum(ipv4_packet.source(), ipv4_packet.destination(), protocol, ipv4_packet.payload_size());
+    return internet_checksum_finish(internet_checksum_add(sum, ipv4_packet.payload(), ipv4_packet.payload_size())) == 0;
+}
+
+void handle_udp(const IPv4Packet& ipv4_packet, PacketBuffer& packet_buffer)
 {
     if (ipv4_packet.payload_size() < sizeof(UDPPacket)) {
         klog() << "handle_udp: Packet too small (" << ipv4_packet.payload_size() << ", need " << sizeof(UDPPacket) << ")";
@@ -303,6 +348,11 @@ void handle_udp(const IPv4Packet& ipv4_packet)
     }
 
     auto& udp_packet = *static_cast<const UDPPacket*>(ipv4_packet.payload());
+    // A zero checksum means the sender didn't compute one.
+    if (udp_packet.checksum() && !has_valid_transport_checksum(ipv4_packet, packet_buffer, IPv4Protocol::UDP)) {
+        klog() << "handle_udp: Dropping packet with bad checksum";
+        return;
+    }
 #ifdef UDP_DEBUG
     klog() << "handle_udp: source=" << ipv4_packet.source().to_string().characters() << ":" << udp_packet.source_port() << ", destination=" << ipv4_packet.destination().to_string().characters() << ":" << udp_packet.destination_port() << " length=" << udp_packet.length();
 #endif
@@ -315,10 +365,10 @@ void handle_udp(const IPv4Packet& ipv4_packet)
 
     ASSERT(socket->type() == SOCK_DGRAM);
     ASSERT(socket->local_port() == udp_packet.destination_port());
-    socket->did_receive(ipv4_packet.source(), udp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()));
+    socket->did_receive(ipv4_packet.source(), udp_packet.source_port(), packet_buffer);
 }
 
-void handle_tcp(const IPv4Packet& ipv4_packet)
+void handle_tcp(const IPv4Packet& ipv4_packet, PacketBuffer& packet_buffer)
 {
     if (ipv4_packet.payload_size() < sizeof(TCPPacket)) {
         klog() << "handle_tcp: IPv4 payload is too small to be a TCP packet (" << ipv4_packet.payload_size() << ", need " << sizeof(TCPPacket) << ")";
@@ -338,6 +388,11 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
         return;
     }
 
+    if (!has_valid_transport_checksum(ipv4_packet, packet_buffer, IPv4Protocol::TCP)) {
+        klog() << "handle_tcp: Dropping packet with bad checksum";
+        return;
+    }
+
     size_t payload_size = ipv4_packet.payload_size() - tcp_packet.header_size();
 
 #ifdef TCP_DEBUG
@@ -400,6 +455,7 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
 #endif
             client->set_sequence_number(1000);
             client->set_ack_number(tcp_packet.sequence_number() + payload_size + 1);
+            client->receive_syn_options(tcp_packet);
             client->send_tcp_packet(TCPFlags::SYN | TCPFlags::ACK);
             client->set_state(TCPSocket::State::SynReceived);
             return;
@@ -494,7 +550,9 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
         switch (tcp_packet.flags()) {
         case TCPFlags::ACK:
             socket->set_ack_number(tcp_packet.sequence_number() + payload_size);
-            socket->set_state(TCPSocket::State::Closed);
+            // Wait for our FIN to be acknowledged, not just the data we sent before it.
+            if (socket->all_sent_data_acknowledged())
+                socket->set_state(TCPSocket::State::Closed);
             return;
         default:
             klog() << "handle_tcp: unexpected flags in LastAck state";
@@ -506,7 +564,8 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
         switch (tcp_packet.flags()) {
         case TCPFlags::ACK:
             socket->set_ack_number(tcp_packet.sequence_number() + payload_size);
-            socket->set_state(TCPSocket::State::FinWait2);
+            if (socket->all_sent_data_acknowledged())
+                socket->set_state(TCPSocket::State::FinWait2);
             return;
         case TCPFlags::FIN:
             socket->set_ack_number(tcp_packet.sequence_number() + payload_size + 1);
@@ -537,7 +596,8 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
         switch (tcp_packet.flags()) {
         case TCPFlags::ACK:
             socket->set_ack_number(tcp_packet.sequence_number() + payload_size);
-            socket->set_state(TCPSocket::State::TimeWait);
+            if (socket->all_sent_data_acknowledged())
+                socket->set_state(TCPSocket::State::TimeWait);
             return;
         default:
             klog() << "handle_tcp: unexpected flags in Closing state";
@@ -546,27 +606,23 @@ void handle_tcp(const IPv4Packet& ipv4_packet)
             return;
         }
     case TCPSocket::State::Established:
-        if (tcp_packet.has_fin()) {
-            if (payload_size != 0)
-                socket->did_receive(ipv4_packet.source(), tcp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()));
+#ifdef TCP_DEBUG
+        klog() << "Got packet with ack_no=" << tcp_packet.ack_number() << ", seq_no=" << tcp_packet.sequence_number() << ", payload_size=" << payload_size << ", expecting seq_no=" << socket->ack_number() << ", our seq_no=" << socket->sequence_number();
+#endif
 
-            socket->set_ack_number(tcp_packet.sequence_number() + payload_size + 1);
-            socket->send_tcp_packet(TCPFlags::ACK);
-            socket->set_state(TCPSocket::State::CloseWait);
-            socket->set_connected(false);
+        if (!payload_size && !tcp_packet.has_fin())
             return;
-        }
 
-        socket->set_ack_number(tcp_packet.sequence_number() + payload_size);
-
-#ifdef TCP_DEBUG
-        klog() << "Got packet with ack_no=" << tcp_packet.ack_number() << ", seq_no=" << tcp_packet.sequence_number() << ", payload_size=" << payload_size << ", acking it with new ack_no=" << socket->ack_number() << ", seq_no=" << socket->sequence_number();
-#endif
+        // FIN segments go through the same trimming and reassembly as data. The FIN only counts once everything
+        // in front of it is here, which is either now or when a later segment fills the gap in front of it.
+        if (!socket->receive_data(packet_buffer, tcp_packet.sequence_number(), payload_size, tcp_packet.has_fin()))
+            return;
 
-        if (payload_size) {
-            if (socket->did_receive(ipv4_packet.source(), tcp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size())))
-                socket->send_tcp_packet(TCPFlags::ACK);
-        }
+        socket->set_ack_number(socket->ack_number() + 1);
+        socket->send_tcp_packet(TCPFlags::ACK);
+        socket->set_state(TCPSocket::State::CloseWait);
+        socket->set_connected(false);
+        return;
     }
 }
 
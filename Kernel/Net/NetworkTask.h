@@ -30,5 +30,8 @@ namespace Kernel {
 class NetworkTask {
 public:
     static void spawn();
+
+    // Safe to call from IRQ handlers and timer callbacks.
+    static void wake();
 };
 }
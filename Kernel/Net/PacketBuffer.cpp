@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Memory.h>
+#include <AK/StringView.h>
+#include <Kernel/Arch/i386/CPU.h>
+#include <Kernel/Net/PacketBuffer.h>
+#include <Kernel/VM/MemoryManager.h>
+
+namespace Kernel {
+
+NonnullRefPtr<PacketBuffer> PacketBuffer::create_with_size(size_t size, size_t headroom)
+{
+    auto region = MM.allocate_kernel_region(PAGE_ROUND_UP(headroom + size), "Packet buffer", Region::Access::Read | Region::Access::Write);
+    ASSERT(region);
+    return adopt(*new PacketBuffer(region.release_nonnull(), headroom, size));
+}
+
+NonnullRefPtr<PacketBuffer> PacketBuffer::copy(const void* data, size_t size, size_t headroom)
+{
+    auto buffer = create_with_size(size, headroom);
+    memcpy(buffer->data(), data, size);
+    return buffer;
+}
+
+PacketBuffer::PacketBuffer(NonnullOwnPtr<Region>&& region, size_t headroom, size_t size, PacketBufferPool* pool)
+    : m_region(move(region))
+    , m_pool(pool)
+    , m_offset(headroom)
+    , m_size(size)
+{
+    ASSERT(m_offset + m_size <= m_region->size());
+}
+
+PacketBuffer::~PacketBuffer()
+{
+    if (m_pool)
+        m_pool->recycle({}, m_region.release_nonnull());
+}
+
+PhysicalAddress PacketBuffer::physical_address() const
+{
+    auto& page = m_region->vmobject().physical_pages()[m_region->first_page_index() + m_offset / PAGE_SIZE];
+    ASSERT(page);
+    return page->paddr().offset(m_offset % PAGE_SIZE);
+}
+
+NonnullRefPtr<PacketBufferPool> PacketBufferPool::create(const char* name, size_t buffer_size, size_t max_buffer_count)
+{
+    return adopt(*new PacketBufferPool(name, buffer_size, max_buffer_count));
+}
+
+PacketBufferPool::PacketBufferPool(const char* name, size_t buffer_size, size_t max_buffer_count)
+    : m_name(name)
+    , m_buffer_size(buffer_size)
+    , m_max_buffer_count(max_buffer_count)
+{
+}
+
+RefPtr<PacketBuffer> PacketBufferPool::try_take(size_t headroom)
+{
+    ASSERT(headroom < m_buffer_size);
+    InterruptDisabler disabler;
+    if (!m_free_regions.is_empty())
+        return adopt(*new PacketBuffer(m_free_regions.take_last(), headroom, m_buffer_size - headroom, this));
+    if (m_buffer_count >= m_max_buffer_count)
+        return nullptr;
+    auto region = MM.allocate_kernel_region(PAGE_ROUND_UP(m_buffer_size), m_name, Region::Access::Read | Region::Access::Write);
+    if (!region)
+        return nullptr;
+    ++m_buffer_count;
+    return adopt(*new PacketBuffer(region.release_nonnull(), headroom, m_buffer_size - headroom, this));
+}
+
+void PacketBufferPool::recycle(Badge<PacketBuffer>, NonnullOwnPtr<Region>&& region)
+{
+    InterruptDisabler disabler;
+    m_free_regions.append(move(region));
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+// PacketBuffer: Reference-counted network packet memory.
+//
+// A PacketBuffer carries a received frame from the driver all the way up to the
+// socket receive queue without being copied. Protocol layers strip their headers
+// with pull() instead of copying the payload somewhere else, and push() gives the
+// headroom back for prepending a header in front of the data.
+//
+// Buffers taken from a PacketBufferPool hand their memory back to the pool when the
+// last reference goes away, so a driver can put it straight back into its ring.
+
+#include <AK/Badge.h>
+#include <AK/NonnullOwnPtrVector.h>
+#include <AK/RefCounted.h>
+#include <AK/RefPtr.h>
+#include <Kernel/VM/Region.h>
+#include <LibBareMetal/Memory/PhysicalAddress.h>
+
+namespace Kernel {
+
+class PacketBufferPool;
+
+class PacketBuffer : public RefCounted<PacketBuffer> {
+public:
+    static NonnullRefPtr<PacketBuffer> create_with_size(size_t size, size_t headroom = 0);
+    static NonnullRefPtr<PacketBuffer> copy(const void* data, size_t size, size_t headroom = 0);
+    ~PacketBuffer();
+
+    u8* data() { return m_region->vaddr().as_ptr() + m_offset; }
+    const u8* data() const { return m_region->vaddr().as_ptr() + m_offset; }
+    size_t size() const { return m_size; }
+    size_t headroom() const { return m_offset; }
+    size_t capacity() const { return m_region->size() - m_offset; }
+
+    void set_size(size_t size)
+    {
+        ASSERT(size <= capacity());
+        m_size = size;
+    }
+
+    // Strip a header off the front of the packet.
+    void pull(size_t length)
+    {
+        ASSERT(length <= m_size);
+        m_offset += length;
+        m_size -= length;
+    }
+
+    // Grow the packet into its headroom, returning a pointer to the new front.
+    u8* push(size_t length)
+    {
+        ASSERT(length <= m_offset);
+        m_offset -= length;
+        m_size += length;
+        return data();
+    }
+
+    // Physical address of data(). Only meaningful for buffers that fit in a single page.
+    PhysicalAddress physical_address() const;
+
+    // Set by adapters that have already checked the TCP or UDP checksum, or that never put the packet on a wire.
+    bool is_checksum_verified() const { return m_checksum_verified; }
+    void set_checksum_verified(bool verified) { m_checksum_verified = verified; }
+
+private:
+    friend class PacketBufferPool;
+    PacketBuffer(NonnullOwnPtr<Region>&&, size_t headroom, size_t size, PacketBufferPool* = nullptr);
+
+    OwnPtr<Region> m_region;
+    RefPtr<PacketBufferPool> m_pool;
+    size_t m_offset { 0 };
+    size_t m_size { 0 };
+    bool m_checksum_verified { false };
+};
+
+class PacketBufferPool : public RefCounted<PacketBufferPool> {
+public:
+    static NonnullRefPtr<PacketBufferPool> create(const char* name, size_t buffer_size, size_t max_buffer_count);
+
+    // Returns null once max_buffer_count buffers are in flight.
+    RefPtr<PacketBuffer> try_take(size_t headroom = 0);
+    void recycle(Badge<PacketBuffer>, NonnullOwnPtr<Region>&&);
+
+    size_t buffer_size() const { return m_buffer_size; }
+
+private:
+    PacketBufferPool(const char* name, size_t buffer_size, size_t max_buffer_count);
+
+    const char* m_name { nullptr };
+    size_t m_buffer_size { 0 };
+    size_t m_max_buffer_count { 0 };
+    size_t m_buffer_count { 0 };
+    NonnullOwnPtrVector<Region> m_free_regions;
+};
+
+}
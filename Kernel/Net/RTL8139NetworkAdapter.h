@@ -71,7 +71,6 @@ private:
     u16 m_rx_buffer_offset { 0 };
     Vector<OwnPtr<Region>> m_tx_buffers;
     u8 m_tx_next_buffer { 0 };
-    OwnPtr<Region> m_packet_buffer;
     bool m_link_up { false };
 };
 }
@@ -41,6 +41,17 @@ struct TCPFlags {
     };
 };
 
+struct TCPOptionKind {
+    enum : u8 {
+        End = 0,
+        NOP = 1,
+        MSS = 2,
+        WindowScale = 3,
+        SACKPermitted = 4,
+        SACK = 5,
+    };
+};
+
 class [[gnu::packed]] TCPPacket
 {
 public:
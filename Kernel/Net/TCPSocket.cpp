@@ -24,15 +24,18 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <AK/Time.h>
+#include <AK/Optional.h>
 #include <Kernel/Devices/RandomDevice.h>
 #include <Kernel/FileSystem/FileDescription.h>
 #include <Kernel/Net/NetworkAdapter.h>
+#include <Kernel/Net/NetworkTask.h>
 #include <Kernel/Net/Routing.h>
 #include <Kernel/Net/TCP.h>
 #include <Kernel/Net/TCPSocket.h>
 #include <Kernel/Process.h>
 #include <Kernel/Random.h>
+#include <Kernel/Scheduler.h>
+#include <Kernel/TimerQueue.h>
 
 //#define TCP_SOCKET_DEBUG
 
@@ -56,10 +59,25 @@ void TCPSocket::set_state(State new_state)
     if (new_state == State::Established && m_direction == Direction::Outgoing)
         m_role = Role::Connected;
 
+    if (new_state == State::Established)
+        send_outgoing_packets();
+
     if (new_state == State::Closed) {
+        {
+            LOCKER(m_not_acked_lock);
+            m_not_acked.clear();
+            m_unsent.clear();
+            m_unsent_bytes = 0;
+            m_out_of_order.clear();
+            m_should_send_fin = false;
+            cancel_timer(RetransmitTimer);
+            cancel_timer(DelayedAckTimer);
+        }
         LOCKER(closing_sockets().lock());
         closing_sockets().resource().remove(tuple());
     }
+
+    evaluate_block_conditions();
 }
 
 Lockable<HashMap<IPv4SocketTuple, RefPtr<TCPSocket>>>& TCPSocket::closing_sockets()
@@ -148,6 +166,13 @@ TCPSocket::TCPSocket(int protocol)
 
 TCPSocket::~TCPSocket()
 {
+    {
+        InterruptDisabler disabler;
+        cancel_timer(RetransmitTimer);
+        cancel_timer(DelayedAckTimer);
+        m_fired_timers = 0;
+    }
+
     LOCKER(sockets_by_tuple().lock());
     sockets_by_tuple().resource().remove(tuple());
 
@@ -161,7 +186,7 @@ NonnullRefPtr<TCPSocket> TCPSocket::create(int protocol)
     return adopt(*new TCPSocket(protocol));
 }
 
-int TCPSocket::protocol_receive(const KBuffer& packet_buffer, void* buffer, size_t buffer_size, int flags)
+int TCPSocket::protocol_receive(const PacketBuffer& packet_buffer, void* buffer, size_t buffer_size, int flags)
 {
     (void)flags;
     auto& ipv4_packet = *(const IPv4Packet*)(packet_buffer.data());
@@ -175,158 +200,733 @@ int TCPSocket::protocol_receive(const KBuffer& packet_buffer, void* buffer, size
     return payload_size;
 }
 
+static inline bool sequence_before(u32 a, u32 b)
+{
+    return (i32)(a - b) < 0;
+}
+
+static inline bool can_send_data_in_state(TCPSocket::State state)
+{
+    // Data queued before shutting down for writing still goes out ahead of our FIN.
+    return state == TCPSocket::State::Established || state == TCPSocket::State::CloseWait || state == TCPSocket::State::FinWait1 || state == TCPSocket::State::LastAck;
+}
+
+bool TCPSocket::all_sent_data_acknowledged() const
+{
+    return m_unsent.is_empty() && !m_should_send_fin && m_send_unacknowledged == m_sequence_number;
+}
+
 int TCPSocket::protocol_send(const void* data, size_t data_length)
 {
-    send_tcp_packet(TCPFlags::PUSH | TCPFlags::ACK, data, data_length);
-    return data_length;
+    LOCKER(m_not_acked_lock);
+    size_t nqueued = min(data_length, send_buffer_space());
+    if (!nqueued)
+        return -EAGAIN;
+
+    auto* bytes = (const u8*)data;
+    for (size_t offset = 0; offset < nqueued;) {
+        // Top up a partial segment first, so a burst of small writes doesn't turn into a burst of tiny packets.
+        if (!m_unsent.is_empty() && m_unsent.last().size() < m_send_mss) {
+            auto& segment = m_unsent.last();
+            size_t chunk = min(m_send_mss - segment.size(), nqueued - offset);
+            segment.append(bytes + offset, chunk);
+            offset += chunk;
+            continue;
+        }
+        size_t chunk = min((size_t)m_send_mss, nqueued - offset);
+        m_unsent.append(ByteBuffer::copy(bytes + offset, chunk));
+        offset += chunk;
+    }
+    m_unsent_bytes += nqueued;
+
+    send_outgoing_packets();
+    return nqueued;
+}
+
+bool TCPSocket::can_write(const FileDescription& description) const
+{
+    return IPv4Socket::can_write(description) && send_buffer_space() > 0;
+}
+
+size_t TCPSocket::send_buffer_space() const
+{
+    size_t used = m_unsent_bytes + (m_sequence_number - m_send_unacknowledged);
+    if (used >= send_buffer_size)
+        return 0;
+    return send_buffer_size - used;
+}
+
+size_t TCPSocket::bytes_in_flight() const
+{
+    size_t bytes = 0;
+    for (auto& packet : m_not_acked) {
+        if (!packet.lost && !packet.sacked)
+            bytes += packet.ack_number - packet.sequence_number;
+    }
+    return bytes;
+}
+
+u16 TCPSocket::local_mss()
+{
+    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
+    if (routing_decision.is_zero())
+        return default_mss;
+    return min(routing_decision.adapter->mtu(), (u32)0xffff) - sizeof(IPv4Packet) - sizeof(TCPPacket);
+}
+
+u16 TCPSocket::advertised_window(bool is_syn) const
+{
+    // The window in a SYN segment is never scaled, RFC 7323 2.2.
+    size_t window = receive_buffer().space_for_writing() >> (is_syn ? 0 : m_receive_window_scale);
+    return min(window, (size_t)0xffff);
+}
+
+static inline u32 read_u32_big_endian(const u8* data)
+{
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | data[3];
+}
+
+static inline void write_u32_big_endian(u8* data, u32 value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
 }
 
 void TCPSocket::send_tcp_packet(u16 flags, const void* payload, size_t payload_size)
 {
-    auto buffer = ByteBuffer::create_zeroed(sizeof(TCPPacket) + payload_size);
+    LOCKER(m_not_acked_lock);
+    bool is_syn = flags & TCPFlags::SYN;
+
+    // A SYN carries our MSS, and offers window scaling and SACK unless we're answering a peer that didn't offer them.
+    // Once SACK is on, ACKs tell the peer which segments we're holding on to past a gap.
+    u8 options[max_options_size];
+    size_t options_size = 0;
+    if (is_syn) {
+        bool is_answer = flags & TCPFlags::ACK;
+        u16 mss = local_mss();
+        options[options_size++] = TCPOptionKind::MSS;
+        options[options_size++] = 4;
+        options[options_size++] = mss >> 8;
+        options[options_size++] = mss & 0xff;
+        if (!is_answer || m_sack_permitted) {
+            options[options_size++] = TCPOptionKind::NOP;
+            options[options_size++] = TCPOptionKind::NOP;
+            options[options_size++] = TCPOptionKind::SACKPermitted;
+            options[options_size++] = 2;
+        }
+        if (!is_answer || m_receive_window_scale) {
+            options[options_size++] = TCPOptionKind::NOP;
+            options[options_size++] = TCPOptionKind::WindowScale;
+            options[options_size++] = 3;
+            options[options_size++] = receive_window_scale;
+        }
+    } else if ((flags & TCPFlags::ACK) && m_sack_permitted && !m_out_of_order.is_empty()) {
+        options_size = write_sack_blocks(options, max_options_size);
+    }
+    ASSERT(options_size % sizeof(u32) == 0);
+
+    auto buffer = ByteBuffer::create_zeroed(sizeof(TCPPacket) + options_size + payload_size);
     auto& tcp_packet = *(TCPPacket*)(buffer.data());
     ASSERT(local_port());
     tcp_packet.set_source_port(local_port());
     tcp_packet.set_destination_port(peer_port());
-    tcp_packet.set_window_size(1024);
+    u16 window = advertised_window(is_syn);
+    tcp_packet.set_window_size(window);
+    m_last_advertised_window = (u32)window << (is_syn ? 0 : m_receive_window_scale);
     tcp_packet.set_sequence_number(m_sequence_number);
-    tcp_packet.set_data_offset(sizeof(TCPPacket) / sizeof(u32));
+    tcp_packet.set_data_offset((sizeof(TCPPacket) + options_size) / sizeof(u32));
     tcp_packet.set_flags(flags);
 
-    if (flags & TCPFlags::ACK)
+    memcpy(buffer.data() + sizeof(TCPPacket), options, options_size);
+
+    if (flags & TCPFlags::ACK) {
         tcp_packet.set_ack_number(m_ack_number);
+        // This acknowledges everything we've received, so there's no need for a delayed ACK anymore.
+        m_segments_awaiting_ack = 0;
+        cancel_timer(DelayedAckTimer);
+    }
 
-    if (flags & TCPFlags::SYN) {
+    u32 sequence_number = m_sequence_number;
+    m_sequence_number += payload_size;
+    if (flags & (TCPFlags::SYN | TCPFlags::FIN))
         ++m_sequence_number;
-    } else {
-        m_sequence_number += payload_size;
-    }
 
     memcpy(tcp_packet.payload(), payload, payload_size);
-    tcp_packet.set_checksum(compute_tcp_checksum(local_address(), peer_address(), tcp_packet, payload_size));
+    // Only the pseudo-header goes into the checksum here, the adapter adds the segment when it goes out.
+    tcp_packet.set_checksum(internet_checksum_partial(ipv4_pseudo_header_sum(local_address(), peer_address(), IPv4Protocol::TCP, tcp_packet.header_size() + payload_size)));
 
-    if (tcp_packet.has_syn() || payload_size > 0) {
-        LOCKER(m_not_acked_lock);
-        m_not_acked.append({ m_sequence_number, move(buffer) });
-        send_outgoing_packets();
+    if (m_sequence_number != sequence_number) {
+        m_not_acked.append({ sequence_number, m_sequence_number, move(buffer) });
+        transmit(m_not_acked.last());
         return;
     }
 
     auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
-    ASSERT(!routing_decision.is_zero());
+    if (routing_decision.is_zero())
+        return;
 
     routing_decision.adapter->send_ipv4(
         routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
-        buffer.data(), buffer.size(), ttl());
+        buffer.data(), buffer.size(), ttl(), true);
 
     m_packets_out++;
     m_bytes_out += buffer.size();
 }
 
-void TCPSocket::send_outgoing_packets()
+void TCPSocket::transmit(OutgoingPacket& packet)
 {
     auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
-    ASSERT(!routing_decision.is_zero());
+    if (routing_decision.is_zero())
+        return;
+
+    if (packet.tx_counter)
+        m_retransmitted_segments++;
+    packet.tx_time = g_uptime;
+    packet.tx_counter++;
+    packet.lost = false;
 
-    auto now = kgettimeofday();
+#ifdef TCP_SOCKET_DEBUG
+    auto& tcp_packet = *(TCPPacket*)(packet.buffer.data());
+    klog() << "sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
+#endif
+    routing_decision.adapter->send_ipv4(
+        routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
+        packet.buffer.data(), packet.buffer.size(), ttl(), true);
 
+    m_packets_out++;
+    m_bytes_out += packet.buffer.size();
+
+    start_timer(RetransmitTimer);
+}
+
+void TCPSocket::send_outgoing_packets()
+{
     LOCKER(m_not_acked_lock);
+
+    // Segments written off by a retransmission timeout go out again first, as the congestion window opens back up.
     for (auto& packet : m_not_acked) {
-        timeval diff;
-        timeval_sub(packet.tx_time, now, diff);
-        if (diff.tv_sec == 0 && diff.tv_usec <= 500000)
+        if (!packet.lost || packet.sacked)
             continue;
-        packet.tx_time = now;
-        packet.tx_counter++;
+        if (bytes_in_flight() >= m_congestion_window)
+            return;
+        transmit(packet);
+    }
 
-#ifdef TCP_SOCKET_DEBUG
-        auto& tcp_packet = *(TCPPacket*)(packet.buffer.data());
-        klog() << "sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
-#endif
-        routing_decision.adapter->send_ipv4(
-            routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
-            packet.buffer.data(), packet.buffer.size(), ttl());
+    if (!can_send_data_in_state(m_state))
+        return;
+
+    size_t window = min(m_congestion_window, m_send_window);
+    while (!m_unsent.is_empty()) {
+        size_t in_flight = bytes_in_flight();
+        if (in_flight + m_unsent.first().size() > window && (in_flight || !window))
+            break;
+        auto segment = m_unsent.take_first();
+        m_unsent_bytes -= segment.size();
+        send_tcp_packet(TCPFlags::PUSH | TCPFlags::ACK, segment.data(), segment.size());
+    }
 
-        m_packets_out++;
-        m_bytes_out += packet.buffer.size();
+    if (m_unsent.is_empty()) {
+        if (m_should_send_fin) {
+            m_should_send_fin = false;
+            send_tcp_packet(TCPFlags::FIN | TCPFlags::ACK);
+        }
+        return;
     }
+
+    // The peer has closed its window on us. Let the retransmission timer probe it, so we notice when it opens again.
+    if (m_not_acked.is_empty())
+        start_timer(RetransmitTimer);
 }
 
-void TCPSocket::receive_tcp_packet(const TCPPacket& packet, u16 size)
+void TCPSocket::send_fin()
+{
+    LOCKER(m_not_acked_lock);
+    // The FIN has to come after everything that's still waiting to be sent.
+    m_should_send_fin = true;
+    send_outgoing_packets();
+}
+
+void TCPSocket::send_delayed_ack()
+{
+    // Acknowledge at least every second segment right away, and leave the rest to the delayed ACK timer, RFC 1122 4.2.3.2.
+    if (++m_segments_awaiting_ack >= 2) {
+        send_tcp_packet(TCPFlags::ACK);
+        return;
+    }
+    start_timer(DelayedAckTimer);
+}
+
+void TCPSocket::protocol_did_read()
 {
-    if (packet.has_ack()) {
-        u32 ack_number = packet.ack_number();
+    if (m_state != State::Established && m_state != State::FinWait1 && m_state != State::FinWait2)
+        return;
+    // Once reading has opened the window up by a full segment or half the buffer, tell the peer about it, RFC 1122 4.2.3.3.
+    size_t space = receive_buffer().space_for_writing();
+    size_t threshold = min((size_t)m_send_mss, space / 2);
+    if (space >= m_last_advertised_window + threshold)
+        send_tcp_packet(TCPFlags::ACK);
+}
+
+static void trim_segment_front(PacketBuffer& packet_buffer, size_t count)
+{
+    // Slide the headers forward over the bytes we already have, so that the payload starts with the first new byte.
+    auto& ipv4_packet = *(IPv4Packet*)packet_buffer.data();
+    auto& tcp_packet = *(TCPPacket*)ipv4_packet.payload();
+    size_t headers_size = sizeof(IPv4Packet) + tcp_packet.header_size();
+    u32 sequence_number = tcp_packet.sequence_number();
+    u16 length = ipv4_packet.length();
+    memmove(packet_buffer.data() + count, packet_buffer.data(), headers_size);
+    packet_buffer.pull(count);
+
+    auto& trimmed_ipv4_packet = *(IPv4Packet*)packet_buffer.data();
+    trimmed_ipv4_packet.set_length(length - count);
+    ((TCPPacket*)trimmed_ipv4_packet.payload())->set_sequence_number(sequence_number + count);
+}
+
+bool TCPSocket::receive_data(NonnullRefPtr<PacketBuffer> packet, u32 sequence_number, size_t payload_size, bool has_fin)
+{
+    // did_receive() takes the socket lock, and readers take it before m_not_acked_lock, so take them in the same order.
+    Locker socket_locker(lock());
+    LOCKER(m_not_acked_lock);
+    u32 end_sequence_number = sequence_number + payload_size;
+
+    if (!sequence_before(m_ack_number, end_sequence_number)) {
+        // We already have all of the data. A FIN right behind it is ours to take (the peer may be resending a FIN
+        // segment whose data we got out of order), anything else is a retransmission, the peer probably didn't get our ACK.
+        if (has_fin && end_sequence_number == m_ack_number) {
+            m_out_of_order.clear();
+            return true;
+        }
+        send_tcp_packet(TCPFlags::ACK);
+        return false;
+    }
+
+    if (sequence_before(m_ack_number, sequence_number)) {
+        // There's a gap in front of this segment. Hold on to it, and acknowledge what we do have right away,
+        // since duplicate ACKs are what gets the sender to retransmit the missing segment.
+        m_out_of_order_segments++;
+        m_last_out_of_order_sequence = sequence_number;
+        size_t index = 0;
+        while (index < m_out_of_order.size() && sequence_before(m_out_of_order[index].sequence_number, sequence_number))
+            ++index;
+        bool is_duplicate = index < m_out_of_order.size()
+            && m_out_of_order[index].sequence_number == sequence_number
+            && !sequence_before(m_out_of_order[index].end_sequence_number, end_sequence_number);
+        if (is_duplicate && has_fin && m_out_of_order[index].end_sequence_number == end_sequence_number)
+            m_out_of_order[index].has_fin = true;
+        if (!is_duplicate && m_out_of_order.size() < max_out_of_order_segments)
+            m_out_of_order.insert(index, { sequence_number, end_sequence_number, has_fin, move(packet) });
+        send_tcp_packet(TCPFlags::ACK);
+        return false;
+    }
+
+    if (sequence_before(sequence_number, m_ack_number))
+        trim_segment_front(*packet, m_ack_number - sequence_number);
+
+    if (!did_receive(peer_address(), peer_port(), move(packet))) {
+        // No room in the receive buffer, remind the peer of our window.
+        send_tcp_packet(TCPFlags::ACK);
+        return false;
+    }
+    m_ack_number = end_sequence_number;
+
+    if (has_fin) {
+        // Nothing comes after a FIN, so whatever is still queued is bogus.
+        m_out_of_order.clear();
+        return true;
+    }
+
+    if (m_out_of_order.is_empty()) {
+        send_delayed_ack();
+        return false;
+    }
+
+    // This may have filled a gap. Either way, the peer should hear about it right away, RFC 5681 4.2.
+    if (deliver_out_of_order_segments()) {
+        m_out_of_order.clear();
+        return true;
+    }
+    send_tcp_packet(TCPFlags::ACK);
+    return false;
+}
+
+bool TCPSocket::deliver_out_of_order_segments()
+{
+    while (!m_out_of_order.is_empty() && !sequence_before(m_ack_number, m_out_of_order.first().sequence_number)) {
+        auto segment = m_out_of_order.take_first();
+        if (!sequence_before(m_ack_number, segment.end_sequence_number)) {
+            if (segment.has_fin && segment.end_sequence_number == m_ack_number)
+                return true;
+            continue;
+        }
+        if (sequence_before(segment.sequence_number, m_ack_number))
+            trim_segment_front(*segment.packet, m_ack_number - segment.sequence_number);
+        if (!did_receive(peer_address(), peer_port(), move(segment.packet))) {
+            // The receive buffer is full, so drop the rest and let the peer retransmit it once there's room again.
+            m_out_of_order.clear();
+            return false;
+        }
+        m_ack_number = segment.end_sequence_number;
+        if (segment.has_fin)
+            return true;
+    }
+    return false;
+}
+
+size_t TCPSocket::write_sack_blocks(u8* options, size_t max_size) const
+{
+    struct Block {
+        u32 left_edge;
+        u32 right_edge;
+    };
+    Vector<Block, max_out_of_order_segments> blocks;
+    for (auto& segment : m_out_of_order) {
+        if (!blocks.is_empty() && !sequence_before(blocks.last().right_edge, segment.sequence_number)) {
+            if (sequence_before(blocks.last().right_edge, segment.end_sequence_number))
+                blocks.last().right_edge = segment.end_sequence_number;
+            continue;
+        }
+        blocks.append({ segment.sequence_number, segment.end_sequence_number });
+    }
+
+    // The first block has to be the one holding the most recently received segment, RFC 2018 4.
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        auto& block = blocks[i];
+        if (!sequence_before(m_last_out_of_order_sequence, block.left_edge) && sequence_before(m_last_out_of_order_sequence, block.right_edge)) {
+            auto recent_block = blocks.take(i);
+            blocks.prepend(recent_block);
+            break;
+        }
+    }
+
+    size_t block_count = min((size_t)blocks.size(), (max_size - 4) / 8);
+    if (!block_count)
+        return 0;
+    options[0] = TCPOptionKind::NOP;
+    options[1] = TCPOptionKind::NOP;
+    options[2] = TCPOptionKind::SACK;
+    options[3] = 2 + 8 * block_count;
+    for (size_t i = 0; i < block_count; ++i) {
+        write_u32_big_endian(options + 4 + 8 * i, blocks[i].left_edge);
+        write_u32_big_endian(options + 8 + 8 * i, blocks[i].right_edge);
+    }
+    return 4 + 8 * block_count;
+}
+
+template<typename Callback>
+static void for_each_option(const TCPPacket& packet, Callback callback)
+{
+    auto* options = (const u8*)&packet + sizeof(TCPPacket);
+    size_t options_size = packet.header_size() > sizeof(TCPPacket) ? packet.header_size() - sizeof(TCPPacket) : 0;
+    for (size_t i = 0; i < options_size;) {
+        u8 kind = options[i];
+        if (kind == TCPOptionKind::End)
+            break;
+        if (kind == TCPOptionKind::NOP) {
+            ++i;
+            continue;
+        }
+        if (i + 1 >= options_size)
+            break;
+        u8 length = options[i + 1];
+        if (length < 2 || i + length > options_size)
+            break;
+        callback(kind, options + i + 2, length - 2);
+        i += length;
+    }
+}
+
+void TCPSocket::receive_syn_options(const TCPPacket& packet)
+{
+    u32 peer_mss = default_mss;
+    bool peer_sent_window_scale = false;
+    u8 peer_window_scale = 0;
+    bool peer_sent_sack_permitted = false;
+
+    for_each_option(packet, [&](u8 kind, const u8* data, size_t length) {
+        if (kind == TCPOptionKind::MSS && length == 2) {
+            peer_mss = (data[0] << 8) | data[1];
+        } else if (kind == TCPOptionKind::WindowScale && length == 1) {
+            peer_sent_window_scale = true;
+            peer_window_scale = min(data[0], (u8)14);
+        } else if (kind == TCPOptionKind::SACKPermitted && length == 0) {
+            peer_sent_sack_permitted = true;
+        }
+    });
+
+    // We always offer window scaling and SACK, so they're on exactly when the peer's SYN offered them too.
+    m_send_window_scale = peer_sent_window_scale ? peer_window_scale : 0;
+    m_receive_window_scale = peer_sent_window_scale ? receive_window_scale : 0;
+    m_sack_permitted = peer_sent_sack_permitted;
+    m_send_mss = max(min(peer_mss, (u32)local_mss()), 64u);
+
+    // Initial window, RFC 3390.
+    m_congestion_window = min(4 * m_send_mss, max(2 * m_send_mss, 4380u));
 
 #ifdef TCP_SOCKET_DEBUG
-        dbg() << "TCPSocket: receive_tcp_packet: " << ack_number;
+    dbg() << "TCPSocket: SYN options: mss=" << m_send_mss << ", send_window_scale=" << (int)m_send_window_scale << ", receive_window_scale=" << (int)m_receive_window_scale << ", sack_permitted=" << m_sack_permitted;
 #endif
+}
 
-        int removed = 0;
-        LOCKER(m_not_acked_lock);
-        while (!m_not_acked.is_empty()) {
-            auto& packet = m_not_acked.first();
+void TCPSocket::receive_tcp_packet(const TCPPacket& packet, u16 size)
+{
+    m_packets_in++;
+    m_bytes_in += packet.header_size() + size;
+
+    if (packet.has_syn() && m_state != State::Listen)
+        receive_syn_options(packet);
+
+    if (!packet.has_ack())
+        return;
+
+    // The window in a SYN segment is never scaled.
+    u32 window = packet.window_size();
+    if (!packet.has_syn())
+        window <<= m_send_window_scale;
+
+    size_t payload_size = size - packet.header_size();
+    LOCKER(m_not_acked_lock);
+    if (m_sack_permitted && !packet.has_syn())
+        receive_sack_blocks(packet);
+    receive_ack(packet.ack_number(), window, payload_size == 0 && !packet.has_syn() && !packet.has_fin());
+}
+
+void TCPSocket::receive_sack_blocks(const TCPPacket& packet)
+{
+    for_each_option(packet, [&](u8 kind, const u8* data, size_t length) {
+        if (kind != TCPOptionKind::SACK || length % 8)
+            return;
+        for (size_t i = 0; i < length; i += 8) {
+            u32 left_edge = read_u32_big_endian(data + i);
+            u32 right_edge = read_u32_big_endian(data + i + 4);
+            if (!sequence_before(left_edge, right_edge) || sequence_before(m_sequence_number, right_edge))
+                continue;
+            for (auto& outgoing_packet : m_not_acked) {
+                if (!sequence_before(outgoing_packet.sequence_number, right_edge))
+                    break;
+                if (!sequence_before(outgoing_packet.sequence_number, left_edge) && !sequence_before(right_edge, outgoing_packet.ack_number))
+                    outgoing_packet.sacked = true;
+            }
+            if (sequence_before(m_highest_sacked, right_edge))
+                m_highest_sacked = right_edge;
+        }
+    });
+}
+
+void TCPSocket::retransmit_sack_holes()
+{
+    // Anything below the highest SACKed sequence number that the receiver hasn't SACKed is a hole, RFC 6675.
+    for (auto& packet : m_not_acked) {
+        if (!sequence_before(packet.sequence_number, m_highest_sacked))
+            break;
+        if (packet.sacked || packet.retransmitted_in_recovery)
+            continue;
+        if (bytes_in_flight() >= m_congestion_window)
+            break;
+        packet.retransmitted_in_recovery = true;
+        transmit(packet);
+    }
+}
+
+void TCPSocket::receive_ack(u32 ack_number, u32 window, bool is_duplicate_candidate)
+{
+    LOCKER(m_not_acked_lock);
 
 #ifdef TCP_SOCKET_DEBUG
-            dbg() << "TCPSocket: iterate: " << packet.ack_number;
+    dbg() << "TCPSocket: receive_ack: " << ack_number << ", window=" << window << ", cwnd=" << m_congestion_window;
 #endif
 
-            if (packet.ack_number <= ack_number) {
-                m_not_acked.take_first();
-                removed++;
-            } else {
+    // Ignore ACKs for things we haven't sent yet.
+    if (sequence_before(m_sequence_number, ack_number))
+        return;
+
+    if (sequence_before(m_send_unacknowledged, ack_number)) {
+        u32 acked = ack_number - m_send_unacknowledged;
+        m_send_unacknowledged = ack_number;
+
+        Optional<u32> rtt;
+        while (!m_not_acked.is_empty()) {
+            auto& packet = m_not_acked.first();
+            if (sequence_before(ack_number, packet.ack_number))
                 break;
+            // Karn's algorithm: a retransmitted segment can't tell us anything about the round-trip time.
+            if (packet.tx_counter == 1)
+                rtt = (g_uptime - packet.tx_time) / TimeUnit::MS;
+            m_not_acked.take_first();
+        }
+        if (rtt.has_value())
+            update_rtt(rtt.value());
+
+        cancel_timer(RetransmitTimer);
+        if (!m_not_acked.is_empty())
+            start_timer(RetransmitTimer);
+
+        if (m_in_fast_recovery) {
+            if (!sequence_before(ack_number, m_recover)) {
+                // Everything that was outstanding when we entered fast recovery has arrived.
+                m_congestion_window = m_slow_start_threshold;
+                m_in_fast_recovery = false;
+            } else if (!m_sack_permitted) {
+                // A partial ACK means the next segment was lost as well, so retransmit it right away.
+                if (!m_not_acked.is_empty())
+                    transmit(m_not_acked.first());
+                m_congestion_window -= min(m_congestion_window, acked);
+                m_congestion_window += m_send_mss;
             }
+        } else if (m_congestion_window < m_slow_start_threshold) {
+            m_congestion_window += min(acked, m_send_mss);
+        } else {
+            m_congestion_window += max(1u, m_send_mss * m_send_mss / m_congestion_window);
         }
+        // There's no point in a congestion window bigger than all the data we're willing to have in flight.
+        m_congestion_window = min(m_congestion_window, (u32)send_buffer_size);
+        m_duplicate_ack_count = 0;
+
+        // Writers may be waiting for space in the send buffer.
+        evaluate_block_conditions();
+    } else if (is_duplicate_candidate && ack_number == m_send_unacknowledged && window == m_send_window && !m_not_acked.is_empty()) {
+        m_duplicate_acks++;
+        if (++m_duplicate_ack_count == 3 && !m_in_fast_recovery && sequence_before(m_recover, ack_number)) {
+            // Fast retransmit: three duplicate ACKs mean the segment after this one was lost.
+            m_slow_start_threshold = max((m_sequence_number - m_send_unacknowledged) / 2, 2 * m_send_mss);
+            m_recover = m_sequence_number;
+            m_in_fast_recovery = true;
+            for (auto& packet : m_not_acked)
+                packet.retransmitted_in_recovery = false;
+            m_not_acked.first().retransmitted_in_recovery = true;
+            transmit(m_not_acked.first());
+            // With SACK, SACKed segments already don't count as in flight, so there's no need to inflate the window.
+            m_congestion_window = m_slow_start_threshold;
+            if (!m_sack_permitted)
+                m_congestion_window += 3 * m_send_mss;
+        } else if (m_in_fast_recovery && !m_sack_permitted) {
+            // Every further duplicate ACK means another segment has left the network.
+            m_congestion_window += m_send_mss;
+        }
+    }
 
-#ifdef TCP_SOCKET_DEBUG
-        dbg() << "TCPSocket: receive_tcp_packet acknowledged " << removed << " packets";
-#endif
+    if (m_in_fast_recovery && m_sack_permitted)
+        retransmit_sack_holes();
+
+    m_send_window = window;
+    send_outgoing_packets();
+}
+
+void TCPSocket::update_rtt(u32 rtt)
+{
+    if (!m_has_rtt_sample) {
+        m_has_rtt_sample = true;
+        m_smoothed_rtt = rtt;
+        m_rtt_variance = rtt / 2;
+    } else {
+        u32 delta = rtt > m_smoothed_rtt ? rtt - m_smoothed_rtt : m_smoothed_rtt - rtt;
+        m_rtt_variance = (3 * m_rtt_variance + delta) / 4;
+        m_smoothed_rtt = (7 * m_smoothed_rtt + rtt) / 8;
     }
+    u32 timeout = m_smoothed_rtt + max(1u, 4 * m_rtt_variance);
+    m_retransmission_timeout = max(minimum_retransmission_timeout, min(timeout, maximum_retransmission_timeout));
+}
 
-    m_packets_in++;
-    m_bytes_in += packet.header_size() + size;
+static bool s_has_fired_timers;
+
+void TCPSocket::start_timer(TimerFlags timer)
+{
+    InterruptDisabler disabler;
+    auto& timer_id = timer == RetransmitTimer ? m_retransmit_timer_id : m_delayed_ack_timer_id;
+    if (timer_id)
+        return;
+    u32 timeout = timer == RetransmitTimer ? m_retransmission_timeout : delayed_ack_timeout;
+    timer_id = TimerQueue::the().add_timer(timeout, TimeUnit::MS, [this, timer] {
+        timer_fired(timer);
+    });
 }
 
-NetworkOrdered<u16> TCPSocket::compute_tcp_checksum(const IPv4Address& source, const IPv4Address& destination, const TCPPacket& packet, u16 payload_size)
+void TCPSocket::cancel_timer(TimerFlags timer)
 {
-    struct [[gnu::packed]] PseudoHeader
-    {
-        IPv4Address source;
-        IPv4Address destination;
-        u8 zero;
-        u8 protocol;
-        NetworkOrdered<u16> payload_size;
-    };
+    InterruptDisabler disabler;
+    auto& timer_id = timer == RetransmitTimer ? m_retransmit_timer_id : m_delayed_ack_timer_id;
+    if (!timer_id)
+        return;
+    TimerQueue::the().cancel_timer(timer_id);
+    timer_id = 0;
+}
 
-    PseudoHeader pseudo_header { source, destination, 0, (u8)IPv4Protocol::TCP, sizeof(TCPPacket) + payload_size };
+void TCPSocket::timer_fired(TimerFlags timer)
+{
+    // This runs in the timer interrupt, so just make a note of it and let the NetworkTask do the work.
+    ASSERT_INTERRUPTS_DISABLED();
+    if (timer == RetransmitTimer)
+        m_retransmit_timer_id = 0;
+    else
+        m_delayed_ack_timer_id = 0;
+    m_fired_timers |= timer;
+    s_has_fired_timers = true;
+    NetworkTask::wake();
+}
 
-    u32 checksum = 0;
-    auto* w = (const NetworkOrdered<u16>*)&pseudo_header;
-    for (size_t i = 0; i < sizeof(pseudo_header) / sizeof(u16); ++i) {
-        checksum += w[i];
-        if (checksum > 0xffff)
-            checksum = (checksum >> 16) + (checksum & 0xffff);
-    }
-    w = (const NetworkOrdered<u16>*)&packet;
-    for (size_t i = 0; i < sizeof(packet) / sizeof(u16); ++i) {
-        checksum += w[i];
-        if (checksum > 0xffff)
-            checksum = (checksum >> 16) + (checksum & 0xffff);
+bool TCPSocket::has_fired_timers()
+{
+    return s_has_fired_timers;
+}
+
+void TCPSocket::handle_fired_timers()
+{
+    {
+        InterruptDisabler disabler;
+        if (!s_has_fired_timers)
+            return;
+        s_has_fired_timers = false;
     }
-    ASSERT(packet.data_offset() * 4 == sizeof(TCPPacket));
-    w = (const NetworkOrdered<u16>*)packet.payload();
-    for (size_t i = 0; i < payload_size / sizeof(u16); ++i) {
-        checksum += w[i];
-        if (checksum > 0xffff)
-            checksum = (checksum >> 16) + (checksum & 0xffff);
+
+    for_each([](TCPSocket& socket) {
+        u8 fired_timers;
+        {
+            InterruptDisabler disabler;
+            fired_timers = socket.m_fired_timers;
+            socket.m_fired_timers = 0;
+        }
+        if (fired_timers & DelayedAckTimer) {
+            if (socket.m_segments_awaiting_ack)
+                socket.send_tcp_packet(TCPFlags::ACK);
+        }
+        if (fired_timers & RetransmitTimer)
+            socket.handle_retransmit_timeout();
+    });
+}
+
+void TCPSocket::handle_retransmit_timeout()
+{
+    LOCKER(m_not_acked_lock);
+
+    if (!m_not_acked.is_empty()) {
+#ifdef TCP_SOCKET_DEBUG
+        dbg() << "TCPSocket: retransmission timeout, rto=" << m_retransmission_timeout << ", cwnd=" << m_congestion_window;
+#endif
+        // Back to slow start, RFC 5681 3.1. Everything in flight is presumed lost, and goes out again as the window grows.
+        m_slow_start_threshold = max((m_sequence_number - m_send_unacknowledged) / 2, 2 * m_send_mss);
+        m_congestion_window = m_send_mss;
+        m_in_fast_recovery = false;
+        m_duplicate_ack_count = 0;
+        m_recover = m_sequence_number;
+        m_retransmission_timeout = min(m_retransmission_timeout * 2, maximum_retransmission_timeout);
+        // The receiver is allowed to throw away data it has SACKed, so don't trust any of that anymore either, RFC 2018 section 8.
+        for (auto& packet : m_not_acked) {
+            packet.lost = true;
+            packet.sacked = false;
+        }
+        transmit(m_not_acked.first());
+        return;
     }
-    if (payload_size & 1) {
-        u16 expanded_byte = ((const u8*)packet.payload())[payload_size - 1] << 8;
-        checksum += expanded_byte;
-        if (checksum > 0xffff)
-            checksum = (checksum >> 16) + (checksum & 0xffff);
+
+    if (!m_unsent.is_empty() && can_send_data_in_state(m_state)) {
+        // Window probe: push the next segment through the closed window to get a fresh window update back.
+        m_retransmission_timeout = min(m_retransmission_timeout * 2, maximum_retransmission_timeout);
+        auto segment = m_unsent.take_first();
+        m_unsent_bytes -= segment.size();
+        send_tcp_packet(TCPFlags::PUSH | TCPFlags::ACK, segment.data(), segment.size());
     }
-    return ~(checksum & 0xffff);
 }
 
 KResult TCPSocket::protocol_bind()
@@ -362,7 +962,7 @@ KResult TCPSocket::protocol_connect(FileDescription& description, ShouldBlock sh
 
     allocate_local_port_if_needed();
 
-    m_sequence_number = get_good_random<u32>();
+    set_sequence_number(get_good_random<u32>());
     m_ack_number = 0;
 
     set_setup_state(SetupState::InProgress);
@@ -433,7 +1033,7 @@ void TCPSocket::shut_down_for_writing()
 #ifdef TCP_SOCKET_DEBUG
         dbg() << " Sending FIN/ACK from Established and moving into FinWait1";
 #endif
-        send_tcp_packet(TCPFlags::FIN | TCPFlags::ACK);
+        send_fin();
         set_state(State::FinWait1);
     } else {
         dbg() << " Shutting down TCPSocket for writing but not moving to FinWait1 since state is " << to_string(state());
@@ -447,7 +1047,7 @@ void TCPSocket::close()
 #ifdef TCP_SOCKET_DEBUG
         dbg() << " Sending FIN from CloseWait and moving into LastAck";
 #endif
-        send_tcp_packet(TCPFlags::FIN | TCPFlags::ACK);
+        send_fin();
         set_state(State::LastAck);
     }
 
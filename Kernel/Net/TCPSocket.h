@@ -141,7 +141,13 @@ public:
     void set_error(Error error) { m_error = error; }
 
     void set_ack_number(u32 n) { m_ack_number = n; }
-    void set_sequence_number(u32 n) { m_sequence_number = n; }
+    void set_sequence_number(u32 n)
+    {
+        m_sequence_number = n;
+        m_send_unacknowledged = n;
+        m_recover = n;
+        m_highest_sacked = n;
+    }
     u32 ack_number() const { return m_ack_number; }
     u32 sequence_number() const { return m_sequence_number; }
     u32 packets_in() const { return m_packets_in; }
@@ -149,9 +155,31 @@ public:
     u32 packets_out() const { return m_packets_out; }
     u32 bytes_out() const { return m_bytes_out; }
 
+    u32 congestion_window() const { return m_congestion_window; }
+    u32 slow_start_threshold() const { return m_slow_start_threshold; }
+    u32 send_window() const { return m_send_window; }
+    u32 smoothed_rtt() const { return m_smoothed_rtt; }
+    u32 retransmission_timeout() const { return m_retransmission_timeout; }
+    u32 send_mss() const { return m_send_mss; }
+    bool sack_permitted() const { return m_sack_permitted; }
+    u32 out_of_order_segments() const { return m_out_of_order_segments; }
+    u32 retransmitted_segments() const { return m_retransmitted_segments; }
+    u32 duplicate_acks() const { return m_duplicate_acks; }
+
+    bool all_sent_data_acknowledged() const;
+
     void send_tcp_packet(u16 flags, const void* = nullptr, size_t = 0);
     void send_outgoing_packets();
+    void send_delayed_ack();
     void receive_tcp_packet(const TCPPacket&, u16 size);
+    void receive_syn_options(const TCPPacket&);
+    // Returns true once a FIN is in sequence, i.e. all data up to it has been received. The caller then
+    // accounts for the FIN itself.
+    bool receive_data(NonnullRefPtr<PacketBuffer>, u32 sequence_number, size_t payload_size, bool has_fin);
+
+    // Called by the NetworkTask to run the retransmission and delayed ACK timers that fired since last time.
+    static bool has_fired_timers();
+    static void handle_fired_timers();
 
     static Lockable<HashMap<IPv4SocketTuple, TCPSocket*>>& sockets_by_tuple();
     static RefPtr<TCPSocket> from_tuple(const IPv4SocketTuple& tuple);
@@ -166,6 +194,7 @@ public:
     void release_for_accept(RefPtr<TCPSocket>);
 
     virtual void close() override;
+    virtual bool can_write(const FileDescription&) const override;
 
 protected:
     void set_direction(Direction direction) { m_direction = direction; }
@@ -174,15 +203,35 @@ private:
     explicit TCPSocket(int protocol);
     virtual const char* class_name() const override { return "TCPSocket"; }
 
-    static NetworkOrdered<u16> compute_tcp_checksum(const IPv4Address& source, const IPv4Address& destination, const TCPPacket&, u16 payload_size);
-
     virtual void shut_down_for_writing() override;
 
-    virtual int protocol_receive(const KBuffer&, void* buffer, size_t buffer_size, int flags) override;
+    void send_fin();
+    u16 local_mss();
+    u16 advertised_window(bool is_syn) const;
+    size_t send_buffer_space() const;
+    size_t bytes_in_flight() const;
+    void update_rtt(u32 rtt);
+    void receive_ack(u32 ack_number, u32 window, bool is_duplicate_candidate);
+    void receive_sack_blocks(const TCPPacket&);
+    void retransmit_sack_holes();
+    bool deliver_out_of_order_segments();
+    size_t write_sack_blocks(u8* options, size_t max_size) const;
+
+    enum TimerFlags : u8 {
+        RetransmitTimer = 1 << 0,
+        DelayedAckTimer = 1 << 1,
+    };
+    void start_timer(TimerFlags);
+    void cancel_timer(TimerFlags);
+    void timer_fired(TimerFlags);
+    void handle_retransmit_timeout();
+
+    virtual int protocol_receive(const PacketBuffer&, void* buffer, size_t buffer_size, int flags) override;
     virtual int protocol_send(const void*, size_t) override;
     virtual KResult protocol_connect(FileDescription&, ShouldBlock) override;
     virtual int protocol_allocate_local_port() override;
     virtual bool protocol_is_disconnected() const override;
+    virtual void protocol_did_read() override;
     virtual KResult protocol_bind() override;
     virtual KResult protocol_listen() override;
 
@@ -199,15 +248,83 @@ private:
     u32 m_packets_out { 0 };
     u32 m_bytes_out { 0 };
 
+    static constexpr u32 default_mss = 536;
+    static constexpr size_t max_options_size = 40;
+    static constexpr u8 receive_window_scale = 3;
+    static constexpr size_t send_buffer_size = 64 * KB;
+    static constexpr u32 initial_retransmission_timeout = 1000;
+    static constexpr u32 minimum_retransmission_timeout = 200;
+    static constexpr u32 maximum_retransmission_timeout = 60000;
+    static constexpr u32 delayed_ack_timeout = 40;
+
     struct OutgoingPacket {
+        u32 sequence_number { 0 };
         u32 ack_number { 0 };
         ByteBuffer buffer;
         int tx_counter { 0 };
-        timeval tx_time { 0, 0 };
+        u64 tx_time { 0 };
+        bool lost { false };
+        bool sacked { false };
+        bool retransmitted_in_recovery { false };
+    };
+
+    struct OutOfOrderSegment {
+        u32 sequence_number { 0 };
+        u32 end_sequence_number { 0 };
+        bool has_fin { false };
+        NonnullRefPtr<PacketBuffer> packet;
     };
 
+    void transmit(OutgoingPacket&);
+
     Lock m_not_acked_lock { "TCPSocket unacked packets" };
     SinglyLinkedList<OutgoingPacket> m_not_acked;
+
+    // Data written by the application that doesn't fit in the send window yet, cut into segments of at most send_mss() bytes.
+    SinglyLinkedList<ByteBuffer> m_unsent;
+    size_t m_unsent_bytes { 0 };
+    bool m_should_send_fin { false };
+
+    // Send sequence space, RFC 793: m_send_unacknowledged is SND.UNA, m_sequence_number is SND.NXT.
+    u32 m_send_unacknowledged { 0 };
+    u32 m_send_window { 0 };
+    u8 m_send_window_scale { 0 };
+    u8 m_receive_window_scale { 0 };
+    u32 m_send_mss { default_mss };
+    u32 m_last_advertised_window { 0 };
+
+    // Selective acknowledgments, RFC 2018.
+    bool m_sack_permitted { false };
+    u32 m_highest_sacked { 0 };
+
+    // Segments that arrived ahead of a gap, sorted by sequence number. They hold on to the received packet buffers,
+    // and get delivered to the receive buffer once the gap fills.
+    static constexpr size_t max_out_of_order_segments = 64;
+    Vector<OutOfOrderSegment> m_out_of_order;
+    u32 m_last_out_of_order_sequence { 0 };
+
+    // NewReno congestion control, RFC 5681 and RFC 6582.
+    u32 m_congestion_window { default_mss };
+    u32 m_slow_start_threshold { send_buffer_size };
+    u32 m_recover { 0 };
+    int m_duplicate_ack_count { 0 };
+    bool m_in_fast_recovery { false };
+
+    // Round-trip time estimation, RFC 6298. All times are in milliseconds.
+    bool m_has_rtt_sample { false };
+    u32 m_smoothed_rtt { 0 };
+    u32 m_rtt_variance { 0 };
+    u32 m_retransmission_timeout { initial_retransmission_timeout };
+
+    int m_segments_awaiting_ack { 0 };
+
+    u32 m_out_of_order_segments { 0 };
+    u32 m_retransmitted_segments { 0 };
+    u32 m_duplicate_acks { 0 };
+
+    u64 m_retransmit_timer_id { 0 };
+    u64 m_delayed_ack_timer_id { 0 };
+    u8 m_fired_timers { 0 };
 };
 
 }
@@ -67,6 +67,7 @@
 #include <Kernel/Thread.h>
 #include <Kernel/ThreadTracer.h>
 #include <Kernel/Time/TimeManagement.h>
+#include <Kernel/TimerQueue.h>
 #include <Kernel/VM/PageDirectory.h>
 #include <Kernel/VM/PrivateInodeVMObject.h>
 #include <Kernel/VM/PurgeableVMObject.h>
@@ -243,38 +244,61 @@ bool Process::deallocate_region(Region& region)
     InterruptDisabler disabler;
     if (m_region_lookup_cache.region == &region)
         m_region_lookup_cache.region = nullptr;
-    for (size_t i = 0; i < m_regions.size(); ++i) {
-        if (&m_regions[i] == &region) {
-            m_regions.unstable_remove(i);
+    // While a region is being split, the old region and its first part briefly share a base address.
+    for (size_t i = first_region_index_above(region.vaddr()); i > 0 && m_regions[i - 1].vaddr() == region.vaddr(); --i) {
+        if (&m_regions[i - 1] == &region) {
+            m_regions.remove(i - 1);
             return true;
         }
     }
     return false;
 }
 
+size_t Process::first_region_index_above(VirtualAddress vaddr) const
+{
+    size_t low = 0;
+    size_t high = m_regions.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (m_regions[middle].vaddr() <= vaddr)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+Region* Process::region_containing(VirtualAddress vaddr)
+{
+    size_t index = first_region_index_above(vaddr);
+    if (!index)
+        return nullptr;
+    auto& region = m_regions[index - 1];
+    if (!region.contains(vaddr))
+        return nullptr;
+    return &region;
+}
+
 Region* Process::region_from_range(const Range& range)
 {
     if (m_region_lookup_cache.range == range && m_region_lookup_cache.region)
         return m_region_lookup_cache.region;
 
     size_t size = PAGE_ROUND_UP(range.size());
-    for (auto& region : m_regions) {
-        if (region.vaddr() == range.base() && region.size() == size) {
-            m_region_lookup_cache.range = range;
-            m_region_lookup_cache.region = region.make_weak_ptr();
-            return &region;
-        }
-    }
-    return nullptr;
+    auto* region = region_containing(range.base());
+    if (!region || region->vaddr() != range.base() || region->size() != size)
+        return nullptr;
+    m_region_lookup_cache.range = range;
+    m_region_lookup_cache.region = region->make_weak_ptr();
+    return region;
 }
 
 Region* Process::region_containing(const Range& range)
 {
-    for (auto& region : m_regions) {
-        if (region.contains(range))
-            return &region;
-    }
-    return nullptr;
+    auto* region = region_containing(range.base());
+    if (!region || !region->contains(range))
+        return nullptr;
+    return region;
 }
 
 int Process::sys$set_mmap_name(const Syscall::SC_set_mmap_name_params* user_params)
@@ -961,7 +985,7 @@ int Process::do_exec(NonnullRefPtr<FileDescription> main_program_description, Ve
     Thread::current->m_signal_mask = 0;
     Thread::current->m_pending_signals = 0;
 
-    m_futex_queues.clear();
+    m_futex_waiters.clear();
 
     m_region_lookup_cache = {};
 
@@ -2109,11 +2133,21 @@ unsigned Process::sys$alarm(unsigned seconds)
     if (m_alarm_deadline && m_alarm_deadline > g_uptime) {
         previous_alarm_remaining = (m_alarm_deadline - g_uptime) / TimeManagement::the().ticks_per_second();
     }
+    InterruptDisabler disabler;
+    if (m_alarm_timer_id) {
+        TimerQueue::the().cancel_timer(m_alarm_timer_id);
+        m_alarm_timer_id = 0;
+    }
     if (!seconds) {
         m_alarm_deadline = 0;
         return previous_alarm_remaining;
     }
     m_alarm_deadline = g_uptime + seconds * TimeManagement::the().ticks_per_second();
+    m_alarm_timer_id = TimerQueue::the().add_timer_at(m_alarm_deadline, [this] {
+        m_alarm_timer_id = 0;
+        m_alarm_deadline = 0;
+        send_signal(SIGALRM, nullptr);
+    });
     return previous_alarm_remaining;
 }
 
@@ -2222,7 +2256,8 @@ int Process::sys$usleep(useconds_t usec)
     REQUIRE_PROMISE(stdio);
     if (!usec)
         return 0;
-    u64 wakeup_time = Thread::current->sleep(usec / 1000);
+    timespec duration { (time_t)(usec / 1000000), (long)(usec % 1000000) * 1000 };
+    u64 wakeup_time = Thread::current->sleep(TimeManagement::the().ticks_for_duration(duration));
     if (wakeup_time > g_uptime)
         return -EINTR;
     return 0;
@@ -3070,7 +3105,19 @@ void Process::finalize()
 
     m_regions.clear();
 
+    if (m_alarm_timer_id) {
+        InterruptDisabler disabler;
+        TimerQueue::the().cancel_timer(m_alarm_timer_id);
+        m_alarm_timer_id = 0;
+    }
+
     m_dead = true;
+
+    {
+        InterruptDisabler disabler;
+        if (auto* parent = Process::from_pid(m_ppid))
+            parent->wait_block_condition().unblock();
+    }
 }
 
 void Process::die()
@@ -3938,6 +3985,24 @@ int Process::sys$ftruncate(int fd, off_t length)
     return description->truncate(static_cast<u64>(length));
 }
 
+int Process::sys$fsync(int fd)
+{
+    REQUIRE_PROMISE(stdio);
+    auto description = file_description(fd);
+    if (!description)
+        return -EBADF;
+    return description->fsync(false);
+}
+
+int Process::sys$fdatasync(int fd)
+{
+    REQUIRE_PROMISE(stdio);
+    auto description = file_description(fd);
+    if (!description)
+        return -EBADF;
+    return description->fsync(true);
+}
+
 int Process::sys$watch_file(const char* user_path, size_t path_length)
 {
     REQUIRE_PROMISE(rpath);
@@ -4015,8 +4080,9 @@ int Process::sys$mount(const Syscall::SC_mount_params* user_params)
     auto source_fd = params.source_fd;
     auto target = validate_and_copy_string_from_user(params.target);
     auto fs_type = validate_and_copy_string_from_user(params.fs_type);
+    auto data = validate_and_copy_string_from_user(params.data);
 
-    if (target.is_null() || fs_type.is_null())
+    if (target.is_null() || fs_type.is_null() || data.is_null())
         return -EFAULT;
 
     auto description = file_description(source_fd);
@@ -4050,9 +4116,21 @@ int Process::sys$mount(const Syscall::SC_mount_params* user_params)
             return -ENODEV;
         }
 
+        size_t disk_cache_size = 0;
+        for (auto& option : data.split_view(',')) {
+            if (option.starts_with("disk_cache_size=")) {
+                bool ok;
+                disk_cache_size = option.substring_view(strlen("disk_cache_size=")).to_uint(ok);
+                if (ok && disk_cache_size)
+                    continue;
+            }
+            dbg() << "mount: invalid ext2 option '" << option << "'";
+            return -EINVAL;
+        }
+
         dbg() << "mount: attempting to mount " << description->absolute_path() << " on " << target;
 
-        fs = Ext2FS::create(*description);
+        fs = Ext2FS::create(*description, disk_cache_size);
     } else if (fs_type == "proc" || fs_type == "ProcFS") {
         fs = ProcFS::create();
     } else if (fs_type == "devpts" || fs_type == "DevPtsFS") {
@@ -4246,12 +4324,10 @@ int Process::sys$clock_gettime(clockid_t clock_id, timespec* user_ts)
 
     switch (clock_id) {
     case CLOCK_MONOTONIC:
-        ts.tv_sec = TimeManagement::the().seconds_since_boot();
-        ts.tv_nsec = TimeManagement::the().ticks_this_second() * 1000000;
+        ts = TimeManagement::the().monotonic_time();
         break;
     case CLOCK_REALTIME:
-        ts.tv_sec = TimeManagement::the().epoch_time();
-        ts.tv_nsec = TimeManagement::the().ticks_this_second() * 1000000;
+        ts = TimeManagement::the().epoch_time_with_nanoseconds();
         break;
     default:
         return -EINVAL;
@@ -4301,10 +4377,14 @@ int Process::sys$clock_nanosleep(const Syscall::SC_clock_nanosleep_params* user_
     case CLOCK_MONOTONIC: {
         u64 wakeup_time;
         if (is_absolute) {
-            u64 time_to_wake = (requested_sleep.tv_sec * 1000 + requested_sleep.tv_nsec / 1000000);
-            wakeup_time = Thread::current->sleep_until(time_to_wake);
+            timespec now = TimeManagement::the().monotonic_time();
+            if (requested_sleep.tv_sec < now.tv_sec || (requested_sleep.tv_sec == now.tv_sec && requested_sleep.tv_nsec <= now.tv_nsec))
+                return 0;
+            timespec time_to_wake;
+            timespec_sub(requested_sleep, now, time_to_wake);
+            wakeup_time = Thread::current->sleep_until(g_uptime + TimeManagement::the().ticks_for_duration(time_to_wake));
         } else {
-            u32 ticks_to_sleep = (requested_sleep.tv_sec * 1000 + requested_sleep.tv_nsec / 1000000);
+            u64 ticks_to_sleep = TimeManagement::the().ticks_for_duration(requested_sleep);
             if (!ticks_to_sleep)
                 return 0;
             wakeup_time = Thread::current->sleep(ticks_to_sleep);
@@ -4319,11 +4399,7 @@ int Process::sys$clock_nanosleep(const Syscall::SC_clock_nanosleep_params* user_
                     return -EFAULT;
                 }
 
-                timespec remaining_sleep;
-                memset(&remaining_sleep, 0, sizeof(timespec));
-                remaining_sleep.tv_sec = ticks_left / TimeManagement::the().ticks_per_second();
-                ticks_left -= remaining_sleep.tv_sec * TimeManagement::the().ticks_per_second();
-                remaining_sleep.tv_nsec = ticks_left * 1000000;
+                timespec remaining_sleep = TimeManagement::the().duration_for_ticks(ticks_left);
                 copy_to_user(params.remaining_sleep, &remaining_sleep);
             }
             return -EINTR;
@@ -4547,12 +4623,82 @@ Thread& Process::any_thread()
     return *found_thread;
 }
 
-WaitQueue& Process::futex_queue(i32* userspace_address)
+void Process::add_futex_waiter(Thread::FutexBlocker& blocker)
+{
+    InterruptDisabler disabler;
+    m_futex_waiters.ensure(blocker.address()).append(&blocker);
+}
+
+void Process::remove_futex_waiter(Thread::FutexBlocker& blocker)
+{
+    InterruptDisabler disabler;
+    auto it = m_futex_waiters.find(blocker.address());
+    if (it == m_futex_waiters.end())
+        return;
+    auto& waiters = (*it).value;
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (waiters[i] == &blocker) {
+            waiters.remove(i);
+            break;
+        }
+    }
+    if (waiters.is_empty())
+        m_futex_waiters.remove(it);
+}
+
+int Process::futex_wake(FlatPtr address, int count, u32 bitset)
+{
+    InterruptDisabler disabler;
+    auto it = m_futex_waiters.find(address);
+    if (it == m_futex_waiters.end())
+        return 0;
+    auto& waiters = (*it).value;
+    int woken = 0;
+    for (size_t i = 0; i < waiters.size() && woken < count;) {
+        auto& blocker = *waiters[i];
+        if (!(blocker.bitset() & bitset)) {
+            ++i;
+            continue;
+        }
+        waiters.remove(i);
+        blocker.wake();
+        Scheduler::evaluate_blocked_thread(blocker.thread());
+        ++woken;
+    }
+    if (waiters.is_empty())
+        m_futex_waiters.remove(it);
+    if (woken)
+        Scheduler::stop_idling();
+    return woken;
+}
+
+int Process::futex_requeue(FlatPtr address, int wake_count, FlatPtr target_address, int requeue_count, int& requeued)
 {
-    auto& queue = m_futex_queues.ensure((FlatPtr)userspace_address);
-    if (!queue)
-        queue = make<WaitQueue>();
-    return *queue;
+    InterruptDisabler disabler;
+    requeued = 0;
+    int woken = futex_wake(address, wake_count, FUTEX_BITSET_MATCH_ANY);
+    if (address == target_address || requeue_count <= 0)
+        return woken;
+    auto it = m_futex_waiters.find(address);
+    if (it == m_futex_waiters.end())
+        return woken;
+
+    // Move waiters over without waking them, so a broadcast doesn't send everyone stampeding for the mutex.
+    // They're taken off the old futex first, since adding the new one to the map may rehash it.
+    Vector<Thread::FutexBlocker*> moved_waiters;
+    auto& waiters = (*it).value;
+    while (!waiters.is_empty() && (int)moved_waiters.size() < requeue_count)
+        moved_waiters.append(waiters.take_first());
+    if (waiters.is_empty())
+        m_futex_waiters.remove(it);
+
+    auto& target_waiters = m_futex_waiters.ensure(target_address);
+    for (auto* blocker : moved_waiters) {
+        blocker->set_address(target_address);
+        target_waiters.append(blocker);
+    }
+    requeued = moved_waiters.size();
+    return woken;
 }
 
 int Process::sys$futex(const Syscall::SC_futex_params* user_params)
@@ -4566,48 +4712,84 @@ int Process::sys$futex(const Syscall::SC_futex_params* user_params)
     i32* userspace_address = params.userspace_address;
     int futex_op = params.futex_op;
     i32 value = params.val;
-    const timespec* user_timeout = params.timeout;
 
     if (!validate_read_typed(userspace_address))
         return -EFAULT;
 
-    if (user_timeout && !validate_read_typed(user_timeout))
-        return -EFAULT;
-
-    timespec timeout { 0, 0 };
-    if (user_timeout)
-        copy_from_user(&timeout, user_timeout);
-
     i32 user_value;
 
     switch (futex_op) {
     case FUTEX_WAIT:
+    case FUTEX_WAIT_BITSET: {
+        u32 bitset = futex_op == FUTEX_WAIT_BITSET ? (u32)params.val3 : FUTEX_BITSET_MATCH_ANY;
+        if (!bitset)
+            return -EINVAL;
+
+        Optional<u64> timeout_tick;
+        if (params.timeout) {
+            timespec timeout;
+            if (!validate_read_and_copy_typed(&timeout, params.timeout))
+                return -EFAULT;
+            if (timeout.tv_sec < 0 || timeout.tv_nsec < 0 || timeout.tv_nsec >= 1000000000)
+                return -EINVAL;
+            // Like on Linux, FUTEX_WAIT takes a relative timeout and FUTEX_WAIT_BITSET an absolute CLOCK_MONOTONIC one.
+            if (futex_op == FUTEX_WAIT_BITSET) {
+                auto now = TimeManagement::the().monotonic_time();
+                if (timeout.tv_sec < now.tv_sec || (timeout.tv_sec == now.tv_sec && timeout.tv_nsec <= now.tv_nsec))
+                    return -ETIMEDOUT;
+                timespec_sub(timeout, now, timeout);
+            }
+            timeout_tick = g_uptime + TimeManagement::the().ticks_for_duration(timeout);
+        }
+
         copy_from_user(&user_value, userspace_address);
         if (user_value != value)
             return -EAGAIN;
-        // FIXME: This is supposed to be interruptible by a signal, but right now WaitQueue cannot be interrupted.
-        // FIXME: Support timeout!
-        Thread::current->wait_on(futex_queue(userspace_address));
-        break;
+
+        bool woken = false;
+        auto result = Thread::current->block<Thread::FutexBlocker>((FlatPtr)userspace_address, bitset, timeout_tick, woken);
+        if (woken)
+            return 0;
+        if (result != Thread::BlockResult::WokeNormally)
+            return -EINTR;
+        return -ETIMEDOUT;
+    }
     case FUTEX_WAKE:
-        if (value == 0)
+        if (value <= 0)
             return 0;
-        if (value == 1) {
-            futex_queue(userspace_address).wake_one();
-        } else {
-            // FIXME: Wake exactly (value) waiters.
-            futex_queue(userspace_address).wake_all();
+        return futex_wake((FlatPtr)userspace_address, value, FUTEX_BITSET_MATCH_ANY);
+    case FUTEX_WAKE_BITSET:
+        if (!params.val3)
+            return -EINVAL;
+        if (value <= 0)
+            return 0;
+        return futex_wake((FlatPtr)userspace_address, value, (u32)params.val3);
+    case FUTEX_REQUEUE:
+    case FUTEX_CMP_REQUEUE: {
+        if (!validate_read_typed(params.userspace_address2))
+            return -EFAULT;
+        if (futex_op == FUTEX_CMP_REQUEUE) {
+            copy_from_user(&user_value, userspace_address);
+            if (user_value != params.val3)
+                return -EAGAIN;
         }
-        break;
+        int requeue_count = (int)min(params.val2, (u32)INT32_MAX);
+        int requeued = 0;
+        int woken = futex_requeue((FlatPtr)userspace_address, value, (FlatPtr)params.userspace_address2, requeue_count, requeued);
+        // FUTEX_REQUEUE only reports how many waiters it woke, FUTEX_CMP_REQUEUE counts the requeued ones too.
+        if (futex_op == FUTEX_REQUEUE)
+            return woken;
+        return woken + requeued;
+    }
     }
 
-    return 0;
+    return -ENOSYS;
 }
 
 int Process::sys$set_thread_boost(int tid, int amount)
 {
     REQUIRE_PROMISE(proc);
-    if (amount < 0 || amount > 20)
+    if (amount < 0 || amount > THREAD_PRIORITY_BOOST_MAX)
         return -EINVAL;
     InterruptDisabler disabler;
     auto* thread = Thread::from_tid(tid);
@@ -4624,7 +4806,7 @@ int Process::sys$set_thread_boost(int tid, int amount)
 int Process::sys$set_process_boost(pid_t pid, int amount)
 {
     REQUIRE_PROMISE(proc);
-    if (amount < 0 || amount > 20)
+    if (amount < 0 || amount > THREAD_PRIORITY_BOOST_MAX)
         return -EINVAL;
     InterruptDisabler disabler;
     auto* process = Process::from_pid(pid);
@@ -4633,6 +4815,10 @@ int Process::sys$set_process_boost(pid_t pid, int amount)
     if (!is_superuser() && process->uid() != euid())
         return -EPERM;
     process->m_priority_boost = amount;
+    process->for_each_thread([](Thread& thread) {
+        Scheduler::update_priority_for_thread(thread);
+        return IterationDecision::Continue;
+    });
     return 0;
 }
 
@@ -4740,7 +4926,7 @@ int Process::sys$pledge(const Syscall::SC_pledge_params* user_params)
 Region& Process::add_region(NonnullOwnPtr<Region> region)
 {
     auto* ptr = region.ptr();
-    m_regions.append(move(region));
+    m_regions.insert(first_region_index_above(region->vaddr()), move(region));
     return *ptr;
 }
 
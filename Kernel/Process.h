@@ -32,6 +32,7 @@
 #include <AK/NonnullOwnPtrVector.h>
 #include <AK/String.h>
 #include <AK/WeakPtr.h>
+#include <Kernel/BlockCondition.h>
 #include <Kernel/FileSystem/InodeMetadata.h>
 #include <Kernel/Forward.h>
 #include <Kernel/Lock.h>
@@ -120,6 +121,9 @@ public:
 
     bool is_dead() const { return m_dead; }
 
+    // Signalled whenever one of our children exits or stops, for the benefit of waitpid().
+    BlockCondition& wait_block_condition() { return m_wait_block_condition; }
+
     bool is_ring0() const { return m_ring == Ring0; }
     bool is_ring3() const { return m_ring == Ring3; }
 
@@ -173,6 +177,8 @@ public:
     int sys$gettid();
     int sys$donate(int tid);
     int sys$ftruncate(int fd, off_t);
+    int sys$fsync(int fd);
+    int sys$fdatasync(int fd);
     pid_t sys$setsid();
     pid_t sys$getsid(pid_t);
     int sys$setpgid(pid_t pid, pid_t pgid);
@@ -393,6 +399,9 @@ public:
 
     int icon_id() const { return m_icon_id; }
 
+    unsigned inode_faults() const { return m_inode_faults; }
+    void did_inode_fault() { ++m_inode_faults; }
+
     u32 priority_boost() const { return m_priority_boost; }
 
     Custody& root_directory();
@@ -486,7 +495,10 @@ private:
 
     Region* region_from_range(const Range&);
     Region* region_containing(const Range&);
+    Region* region_containing(VirtualAddress);
+    size_t first_region_index_above(VirtualAddress) const;
 
+    // Sorted by base address, so that lookups can binary search.
     NonnullOwnPtrVector<Region> m_regions;
     struct RegionLookupCache {
         Range range;
@@ -506,9 +518,12 @@ private:
     Lock m_big_lock { "Process" };
 
     u64 m_alarm_deadline { 0 };
+    u64 m_alarm_timer_id { 0 };
 
     int m_icon_id { -1 };
 
+    unsigned m_inode_faults { 0 };
+
     u32 m_priority_boost { 0 };
 
     u32 m_promises { 0 };
@@ -517,8 +532,14 @@ private:
     VeilState m_veil_state { VeilState::None };
     Vector<UnveiledPath> m_unveiled_paths;
 
-    WaitQueue& futex_queue(i32*);
-    HashMap<u32, OwnPtr<WaitQueue>> m_futex_queues;
+    void add_futex_waiter(Thread::FutexBlocker&);
+    void remove_futex_waiter(Thread::FutexBlocker&);
+    int futex_wake(FlatPtr address, int count, u32 bitset);
+    int futex_requeue(FlatPtr address, int wake_count, FlatPtr target_address, int requeue_count, int& requeued);
+    // Waiters on each futex, in the order they started waiting.
+    HashMap<FlatPtr, Vector<Thread::FutexBlocker*>> m_futex_waiters;
+
+    BlockCondition m_wait_block_condition;
 
     OwnPtr<PerformanceEventBuffer> m_perf_event_buffer;
 
@@ -656,7 +677,7 @@ inline const LogStream& operator<<(const LogStream& stream, const Process& proce
 
 inline u32 Thread::effective_priority() const
 {
-    return m_priority + m_process.priority_boost() + m_priority_boost + m_extra_priority;
+    return m_priority + m_process.priority_boost() + m_priority_boost;
 }
 
 #define REQUIRE_NO_PROMISES                      \
@@ -24,8 +24,8 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <AK/QuickSort.h>
 #include <AK/TemporaryChange.h>
+#include <AK/Time.h>
 #include <Kernel/FileSystem/FileDescription.h>
 #include <Kernel/Net/Socket.h>
 #include <Kernel/Process.h>
@@ -53,10 +53,95 @@ void Scheduler::update_state_for_thread(Thread& thread)
     ASSERT_INTERRUPTS_DISABLED();
     auto& list = g_scheduler_data->thread_list_for_state(thread.state());
 
-    if (list.contains(thread))
+    if (!list.contains(thread))
+        list.append(thread);
+
+    // Threads that just blocked get looked at once more on the next pass, in case what they're waiting for
+    // happened before they went to sleep. After that, we only keep polling the ones that have to be.
+    auto& polled_threads = g_scheduler_data->m_polled_threads;
+    switch (thread.state()) {
+    case Thread::Blocked:
+    case Thread::Skip1SchedulerPass:
+    case Thread::Skip0SchedulerPasses:
+        if (!polled_threads.contains(thread))
+            polled_threads.append(thread);
+        break;
+    default:
+        if (polled_threads.contains(thread))
+            polled_threads.remove(thread);
+        break;
+    }
+
+    // Only threads that are waiting for the CPU live in a run queue, not the one currently running.
+    if (thread.state() == Thread::Runnable) {
+        if (!thread.m_run_queue)
+            g_scheduler_data->m_active_run_queue->enqueue(thread);
+    } else if (thread.m_run_queue) {
+        thread.m_run_queue->dequeue(thread);
+    }
+}
+
+void Scheduler::update_priority_for_thread(Thread& thread)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    auto* run_queue = thread.m_run_queue;
+    if (!run_queue)
         return;
+    run_queue->dequeue(thread);
+    run_queue->enqueue(thread);
+}
+
+static u32 level_for(const Thread& thread)
+{
+    return min(thread.effective_priority(), RunQueue::level_count - 1);
+}
+
+void RunQueue::enqueue(Thread& thread)
+{
+    ASSERT(!thread.m_run_queue);
+    u32 level = level_for(thread);
+    m_levels[level].append(thread);
+    m_non_empty_levels[level / 32] |= 1u << (level % 32);
+    thread.m_run_queue = this;
+    thread.m_run_queue_level = level;
+    ++m_thread_count;
+}
+
+void RunQueue::dequeue(Thread& thread)
+{
+    ASSERT(thread.m_run_queue == this);
+    u32 level = thread.m_run_queue_level;
+    m_levels[level].remove(thread);
+    if (m_levels[level].is_empty())
+        m_non_empty_levels[level / 32] &= ~(1u << (level % 32));
+    thread.m_run_queue = nullptr;
+    --m_thread_count;
+}
+
+static bool is_schedulable(Thread& thread)
+{
+    if (thread.process().is_being_inspected())
+        return false;
+    if (thread.process().exec_tid() && thread.process().exec_tid() != thread.tid())
+        return false;
+    return true;
+}
 
-    list.append(thread);
+Thread* RunQueue::highest_priority_thread()
+{
+    for (int word = bitmap_word_count - 1; word >= 0; --word) {
+        u32 levels = m_non_empty_levels[word];
+        while (levels) {
+            u32 bit = 31 - __builtin_clz(levels);
+            // Usually the first thread in the list will do; we only have to look further while a process is being inspected or exec'd.
+            for (auto& thread : m_levels[word * 32 + bit]) {
+                if (is_schedulable(thread))
+                    return &thread;
+            }
+            levels &= ~(1u << bit);
+        }
+    }
+    return nullptr;
 }
 
 static u32 time_slice_for(const Thread& thread)
@@ -64,12 +149,14 @@ static u32 time_slice_for(const Thread& thread)
     // One time slice unit == 1ms
     if (&thread == g_colonel)
         return 1;
-    return 10;
+    // Everyone gets one turn per round of the run queues, so give higher priority threads a longer one.
+    return max(10 * thread.effective_priority() / THREAD_PRIORITY_NORMAL, 2u);
 }
 
 timeval Scheduler::time_since_boot()
 {
-    return { TimeManagement::the().seconds_since_boot(), (suseconds_t)TimeManagement::the().ticks_this_second() * 1000 };
+    auto now = TimeManagement::the().monotonic_time();
+    return { now.tv_sec, (suseconds_t)(now.tv_nsec / 1000) };
 }
 
 Thread* g_finalizer;
@@ -105,9 +192,33 @@ bool Thread::JoinBlocker::should_unblock(Thread& joiner, time_t, long)
     return !joiner.m_joinee;
 }
 
+// Turns a deadline given as time since boot into the tick at which we'll have reached it.
+static u64 tick_for_time_since_boot(const timeval& deadline)
+{
+    auto now = Scheduler::time_since_boot();
+    if (deadline.tv_sec < now.tv_sec || (deadline.tv_sec == now.tv_sec && deadline.tv_usec <= now.tv_usec))
+        return g_uptime;
+    timeval remaining;
+    timeval_sub(deadline, now, remaining);
+    u64 ticks_per_second = TimeManagement::the().ticks_per_second();
+    u64 remaining_ticks = remaining.tv_sec * ticks_per_second + ((u64)remaining.tv_usec * ticks_per_second + 999999) / 1000000;
+    return g_uptime + remaining_ticks;
+}
+
 Thread::FileDescriptionBlocker::FileDescriptionBlocker(const FileDescription& description)
     : m_blocked_description(description)
 {
+    description.file().block_condition().add_blocked_thread(*Thread::current);
+}
+
+Thread::FileDescriptionBlocker::~FileDescriptionBlocker()
+{
+    m_blocked_description->file().block_condition().remove_blocked_thread(*Thread::current);
+}
+
+bool Thread::FileDescriptionBlocker::should_poll() const
+{
+    return m_blocked_description->file().should_poll_for_readiness();
 }
 
 const FileDescription& Thread::FileDescriptionBlocker::blocked_description() const
@@ -153,6 +264,13 @@ Thread::WriteBlocker::WriteBlocker(const FileDescription& description)
     }
 }
 
+Optional<u64> Thread::WriteBlocker::timeout_tick() const
+{
+    if (!m_deadline.has_value())
+        return {};
+    return tick_for_time_since_boot(m_deadline.value());
+}
+
 bool Thread::WriteBlocker::should_unblock(Thread&, time_t now_sec, long now_usec)
 {
     if (m_deadline.has_value()) {
@@ -178,6 +296,13 @@ Thread::ReadBlocker::ReadBlocker(const FileDescription& description)
     }
 }
 
+Optional<u64> Thread::ReadBlocker::timeout_tick() const
+{
+    if (!m_deadline.has_value())
+        return {};
+    return tick_for_time_since_boot(m_deadline.value());
+}
+
 bool Thread::ReadBlocker::should_unblock(Thread&, time_t now_sec, long now_usec)
 {
     if (m_deadline.has_value()) {
@@ -216,6 +341,46 @@ Thread::SelectBlocker::SelectBlocker(const timeval& tv, bool select_has_timeout,
     , m_select_write_fds(write_fds)
     , m_select_exceptional_fds(except_fds)
 {
+    register_with_files(read_fds);
+    register_with_files(write_fds);
+    register_with_files(except_fds);
+}
+
+Thread::SelectBlocker::~SelectBlocker()
+{
+    for (auto& file : m_files)
+        file->block_condition().remove_blocked_thread(*Thread::current);
+}
+
+void Thread::SelectBlocker::register_with_files(const FDVector& fds)
+{
+    auto& process = Thread::current->process();
+    for (int fd : fds) {
+        if (!process.m_fds[fd])
+            continue;
+        auto& file = process.m_fds[fd].description->file();
+        // The same file may well show up more than once, e.g. when selecting for both reading and writing.
+        bool already_registered = false;
+        for (auto& registered_file : m_files) {
+            if (registered_file.ptr() == &file) {
+                already_registered = true;
+                break;
+            }
+        }
+        if (already_registered)
+            continue;
+        file.block_condition().add_blocked_thread(*Thread::current);
+        if (file.should_poll_for_readiness())
+            m_should_poll = true;
+        m_files.append(file);
+    }
+}
+
+Optional<u64> Thread::SelectBlocker::timeout_tick() const
+{
+    if (!m_select_has_timeout)
+        return {};
+    return tick_for_time_since_boot(m_select_timeout);
 }
 
 bool Thread::SelectBlocker::should_unblock(Thread& thread, time_t now_sec, long now_usec)
@@ -246,6 +411,37 @@ Thread::WaitBlocker::WaitBlocker(int wait_options, pid_t& waitee_pid)
     : m_wait_options(wait_options)
     , m_waitee_pid(waitee_pid)
 {
+    Thread::current->process().wait_block_condition().add_blocked_thread(*Thread::current);
+}
+
+Thread::WaitBlocker::~WaitBlocker()
+{
+    Thread::current->process().wait_block_condition().remove_blocked_thread(*Thread::current);
+}
+
+Thread::FutexBlocker::FutexBlocker(FlatPtr address, u32 bitset, Optional<u64> timeout_tick, bool& woken)
+    : m_thread(*Thread::current)
+    , m_address(address)
+    , m_bitset(bitset)
+    , m_timeout_tick(timeout_tick)
+    , m_woken(woken)
+{
+    m_woken = false;
+    m_thread.process().add_futex_waiter(*this);
+}
+
+Thread::FutexBlocker::~FutexBlocker()
+{
+    // Waking or requeueing takes care of the bookkeeping, so this only matters for timeouts and signals.
+    if (!m_woken)
+        m_thread.process().remove_futex_waiter(*this);
+}
+
+bool Thread::FutexBlocker::should_unblock(Thread&, time_t, long)
+{
+    if (m_woken)
+        return true;
+    return m_timeout_tick.has_value() && m_timeout_tick.value() <= g_uptime;
 }
 
 bool Thread::WaitBlocker::should_unblock(Thread& thread, time_t, long)
@@ -292,6 +488,16 @@ bool Thread::SemiPermanentBlocker::should_unblock(Thread&, time_t, long)
     return false;
 }
 
+bool Scheduler::evaluate_blocked_thread(Thread& thread)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    if (!thread.is_blocked())
+        return false;
+    auto now = time_since_boot();
+    thread.consider_unblock(now.tv_sec, now.tv_usec);
+    return !thread.is_blocked();
+}
+
 // Called by the scheduler on threads that are blocked for some reason.
 // Make a decision as to whether to unblock them or not.
 void Thread::consider_unblock(time_t now_sec, long now_usec)
@@ -340,11 +546,16 @@ bool Scheduler::pick_next()
     auto now_sec = now.tv_sec;
     auto now_usec = now.tv_usec;
 
-    // Check and unblock threads whose wait conditions have been met.
-    Scheduler::for_each_nonrunnable([&](Thread& thread) {
+    // Check and unblock threads whose wait conditions have been met. Most blocked threads are woken up
+    // by whatever they're waiting for, so we only have to look at the ones that asked to be polled.
+    auto& polled_threads = g_scheduler_data->m_polled_threads;
+    for (auto it = polled_threads.begin(); it != polled_threads.end();) {
+        auto& thread = *it;
+        ++it;
         thread.consider_unblock(now_sec, now_usec);
-        return IterationDecision::Continue;
-    });
+        if (thread.is_blocked() && !thread.m_blocker->should_poll())
+            polled_threads.remove(thread);
+    }
 
     Process::for_each([&](Process& process) {
         if (process.is_dead()) {
@@ -356,10 +567,6 @@ bool Scheduler::pick_next()
             }
             return IterationDecision::Continue;
         }
-        if (process.m_alarm_deadline && g_uptime > process.m_alarm_deadline) {
-            process.m_alarm_deadline = 0;
-            process.send_signal(SIGALRM, nullptr);
-        }
         return IterationDecision::Continue;
     });
 
@@ -405,32 +612,23 @@ bool Scheduler::pick_next()
     });
 #endif
 
-    Vector<Thread*, 128> sorted_runnables;
-    for_each_runnable([&sorted_runnables](auto& thread) {
-        sorted_runnables.append(&thread);
-        return IterationDecision::Continue;
-    });
-    quick_sort(sorted_runnables, [](auto& a, auto& b) { return a->effective_priority() >= b->effective_priority(); });
-
-    Thread* thread_to_schedule = nullptr;
-
-    for (auto* thread : sorted_runnables) {
-        if (thread->process().is_being_inspected())
-            continue;
-
-        if (thread->process().exec_tid() && thread->process().exec_tid() != thread->tid())
-            continue;
-
-        ASSERT(thread->state() == Thread::Runnable || thread->state() == Thread::Running);
-
-        if (!thread_to_schedule) {
-            thread->m_extra_priority = 0;
-            thread_to_schedule = thread;
-        } else {
-            thread->m_extra_priority++;
+    // The current thread has to compete for the CPU like everyone else. If it used up its whole
+    // time slice, it waits until all other runnable threads have had their turn.
+    if (Thread::current->state() == Thread::Running) {
+        Thread::current->set_state(Thread::Runnable);
+        if (!Thread::current->ticks_left() && Thread::current->m_run_queue) {
+            Thread::current->m_run_queue->dequeue(*Thread::current);
+            g_scheduler_data->m_expired_run_queue->enqueue(*Thread::current);
         }
     }
 
+    auto* thread_to_schedule = g_scheduler_data->m_active_run_queue->highest_priority_thread();
+    if (!thread_to_schedule) {
+        // Everyone in the active queue has had their turn, so start a new round.
+        swap(g_scheduler_data->m_active_run_queue, g_scheduler_data->m_expired_run_queue);
+        thread_to_schedule = g_scheduler_data->m_active_run_queue->highest_priority_thread();
+    }
+
     if (!thread_to_schedule)
         thread_to_schedule = g_colonel;
 
@@ -492,8 +690,10 @@ bool Scheduler::context_switch(Thread& thread)
     thread.set_ticks_left(time_slice_for(thread));
     thread.did_schedule();
 
-    if (Thread::current == &thread)
+    if (Thread::current == &thread) {
+        thread.set_state(Thread::Running);
         return false;
+    }
 
     if (Thread::current) {
         // If the last process hasn't blocked (still marked as running),
@@ -589,16 +789,17 @@ void Scheduler::initialize()
     load_task_register(s_redirection.selector);
 }
 
-void Scheduler::timer_tick(const RegisterState& regs)
+void Scheduler::timer_tick(const RegisterState& regs, u64 elapsed_ticks)
 {
     if (!Thread::current)
         return;
 
-    ++g_uptime;
+    g_uptime += elapsed_ticks;
 
+    auto now = TimeManagement::the().epoch_time_with_nanoseconds();
     timeval tv;
-    tv.tv_sec = TimeManagement::the().epoch_time();
-    tv.tv_usec = TimeManagement::the().ticks_this_second() * 1000;
+    tv.tv_sec = now.tv_sec;
+    tv.tv_usec = now.tv_nsec / 1000;
     Process::update_info_page_timestamp(tv);
 
     if (Process::current->is_profiling()) {
@@ -666,10 +867,30 @@ void Scheduler::stop_idling()
     s_should_stop_idling = true;
 }
 
+// How long we let the tick stop for at most, even if no timer is due before then.
+static constexpr u64 max_ticks_without_tick = 256;
+
+static bool should_stop_tick()
+{
+    // Threads that have to be polled need the scheduler to keep running.
+    return !s_should_stop_idling && TimeManagement::the().can_stop_tick() && g_scheduler_data->m_polled_threads.is_empty();
+}
+
 void Scheduler::idle_loop()
 {
     for (;;) {
-        asm("hlt");
+        cli();
+        bool tick_stopped = should_stop_tick() && TimeManagement::the().stop_tick_until(TimerQueue::the().next_timer_due(g_uptime + max_ticks_without_tick));
+        // sti only takes effect after the next instruction, so no interrupt can sneak in before we halt.
+        asm volatile("sti\n"
+                     "hlt");
+        if (tick_stopped) {
+            // Whatever woke us up (like a signal) may need a scheduler pass, so restart the tick and take one now.
+            TimeManagement::the().restart_tick();
+            s_should_stop_idling = false;
+            yield();
+            continue;
+        }
         if (s_should_stop_idling) {
             s_should_stop_idling = false;
             yield();
@@ -35,6 +35,7 @@
 namespace Kernel {
 
 class Process;
+class RunQueue;
 class Thread;
 class WaitQueue;
 struct RegisterState;
@@ -50,7 +51,7 @@ extern SchedulerData* g_scheduler_data;
 class Scheduler {
 public:
     static void initialize();
-    static void timer_tick(const RegisterState&);
+    static void timer_tick(const RegisterState&, u64 elapsed_ticks = 1);
     static bool pick_next();
     static timeval time_since_boot();
     static void pick_next_and_switch_now();
@@ -73,6 +74,8 @@ public:
 
     static void init_thread(Thread& thread);
     static void update_state_for_thread(Thread& thread);
+    static void update_priority_for_thread(Thread& thread);
+    static bool evaluate_blocked_thread(Thread& thread);
 
 private:
     static void prepare_for_iret_to_new_process();
@@ -182,7 +182,9 @@ namespace Kernel {
     __ENUMERATE_SYSCALL(perf_event)           \
     __ENUMERATE_SYSCALL(shutdown)             \
     __ENUMERATE_SYSCALL(get_stack_bounds)     \
-    __ENUMERATE_SYSCALL(ptrace)
+    __ENUMERATE_SYSCALL(ptrace)               \
+    __ENUMERATE_SYSCALL(fsync)                \
+    __ENUMERATE_SYSCALL(fdatasync)
 
 namespace Syscall {
 
@@ -321,7 +323,12 @@ struct SC_futex_params {
     i32* userspace_address;
     int futex_op;
     i32 val;
-    const timespec* timeout;
+    union {
+        const timespec* timeout;
+        u32 val2;
+    };
+    i32* userspace_address2;
+    i32 val3;
 };
 
 struct SC_setkeymap_params {
@@ -399,6 +406,7 @@ struct SC_mount_params {
     StringArgument target;
     StringArgument fs_type;
     int flags;
+    StringArgument data;
 };
 
 struct SC_pledge_params {
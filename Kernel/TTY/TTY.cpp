@@ -162,6 +162,7 @@ void TTY::emit(u8 ch)
             //We use '\0' to delimit the end
             //of a line.
             m_input_buffer.enqueue('\0');
+            evaluate_block_conditions();
             return;
         }
         if (is_kill(ch)) {
@@ -182,6 +183,7 @@ void TTY::emit(u8 ch)
     }
     m_input_buffer.enqueue(ch);
     echo(ch);
+    evaluate_block_conditions();
 }
 
 bool TTY::can_do_backspace() const
@@ -277,6 +279,8 @@ void TTY::set_termios(const termios& t)
           << ", INLCR=" << ((m_termios.c_iflag & INLCR) != 0)
           << ", IGNCR=" << ((m_termios.c_iflag & IGNCR) != 0);
 #endif
+    // Switching in or out of canonical mode changes what counts as readable.
+    evaluate_block_conditions();
 }
 
 int TTY::ioctl(FileDescription&, unsigned request, unsigned arg)
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Kernel/Devices/MemoryPressureDevice.h>
+#include <Kernel/Process.h>
+#include <Kernel/Tasks/PageReclaimTask.h>
+#include <Kernel/Time/TimeManagement.h>
+#include <Kernel/VM/MemoryManager.h>
+
+namespace Kernel {
+
+void PageReclaimTask::spawn()
+{
+    Thread* page_reclaim_thread = nullptr;
+    Process::create_kernel_process(page_reclaim_thread, "PageReclaimTask", [] {
+        for (;;) {
+            MM.wait_until_memory_pressure_needs_attention();
+            int reclaimed_page_count = MM.reclaim_user_physical_pages();
+            if (MM.update_reported_memory_pressure())
+                MemoryPressureDevice::the().notify_observers();
+            // Everything that could be reclaimed is gone, so leave it to userspace for a while.
+            if (!reclaimed_page_count && MM.memory_pressure() != MemoryManager::MemoryPressure::None)
+                Thread::current->sleep(TimeManagement::the().ticks_per_second());
+        }
+    });
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Vector.h>
+#include <Kernel/Process.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
+#include <Kernel/VM/InodeVMObject.h>
+#include <Kernel/WaitQueue.h>
+
+namespace Kernel {
+
+struct ReadaheadRequest {
+    RefPtr<InodeVMObject> vmobject;
+    size_t first_page_index { 0 };
+    size_t page_count { 0 };
+};
+
+static const size_t max_pending_readahead_requests = 16;
+
+static Vector<ReadaheadRequest, max_pending_readahead_requests>* s_pending_requests;
+static WaitQueue* s_wait_queue;
+
+void ReadaheadTask::spawn()
+{
+    s_pending_requests = new Vector<ReadaheadRequest, max_pending_readahead_requests>;
+    s_wait_queue = new WaitQueue;
+
+    Thread* readahead_thread = nullptr;
+    Process::create_kernel_process(readahead_thread, "ReadaheadTask", [] {
+        for (;;) {
+            ReadaheadRequest request;
+            {
+                // Check and go to sleep with interrupts disabled, so a wakeup can't slip in between.
+                InterruptDisabler disabler;
+                if (s_pending_requests->is_empty()) {
+                    Thread::current->wait_on(*s_wait_queue);
+                    continue;
+                }
+                request = s_pending_requests->take_first();
+            }
+            request.vmobject->read_ahead({}, request.first_page_index, request.page_count);
+        }
+    });
+}
+
+void ReadaheadTask::queue(InodeVMObject& vmobject, size_t first_page_index, size_t page_count)
+{
+    InterruptDisabler disabler;
+    if (!s_pending_requests || s_pending_requests->size() >= max_pending_readahead_requests)
+        return;
+    s_pending_requests->append({ vmobject, first_page_index, page_count });
+    s_wait_queue->wake_one();
+}
+
+}
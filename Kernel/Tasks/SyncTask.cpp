@@ -36,7 +36,7 @@ void SyncTask::spawn()
     Thread* syncd_thread = nullptr;
     Process::create_kernel_process(syncd_thread, "SyncTask", [] {
         for (;;) {
-            VFS::the().sync();
+            VFS::the().write_back();
             Thread::current->sleep(1 * TimeManagement::the().ticks_per_second());
         }
     });
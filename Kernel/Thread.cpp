@@ -34,6 +34,7 @@
 #include <Kernel/Scheduler.h>
 #include <Kernel/Thread.h>
 #include <Kernel/ThreadTracer.h>
+#include <Kernel/TimerQueue.h>
 #include <Kernel/VM/MemoryManager.h>
 #include <Kernel/VM/PageDirectory.h>
 #include <Kernel/VM/ProcessPagingScope.h>
@@ -161,6 +162,20 @@ Thread::~Thread()
     m_process.m_thread_count--;
 }
 
+void Thread::set_priority(u32 priority)
+{
+    InterruptDisabler disabler;
+    m_priority = priority;
+    Scheduler::update_priority_for_thread(*this);
+}
+
+void Thread::set_priority_boost(u32 boost)
+{
+    InterruptDisabler disabler;
+    m_priority_boost = boost;
+    Scheduler::update_priority_for_thread(*this);
+}
+
 void Thread::unblock()
 {
     if (current == this) {
@@ -304,6 +319,7 @@ void Thread::finalize()
         static_cast<JoinBlocker*>(m_joiner->m_blocker)->set_joinee_exit_value(m_exit_value);
         static_cast<JoinBlocker*>(m_joiner->m_blocker)->set_interrupted_by_death();
         m_joiner->m_joinee = nullptr;
+        Scheduler::evaluate_blocked_thread(*m_joiner);
         // NOTE: We clear the joiner pointer here as well, to be tidy.
         m_joiner = nullptr;
     }
@@ -757,17 +773,58 @@ void Thread::set_state(State new_state)
         ASSERT(m_blocker != nullptr);
     }
 
+    if (m_state == Blocked)
+        cancel_blocker_timer();
+
     m_state = new_state;
     if (m_process.pid() != 0) {
         Scheduler::update_state_for_thread(*this);
     }
 
+    if (new_state == Blocked) {
+        // Blockers with a timeout get a timer to wake them up, instead of being polled until they time out.
+        auto timeout_tick = m_blocker->timeout_tick();
+        if (timeout_tick.has_value())
+            arm_blocker_timer(timeout_tick.value());
+    }
+
+    if (new_state == Stopped) {
+        // Let our parent know, in case it's waiting for us to stop.
+        if (auto* parent = Process::from_pid(m_process.ppid()))
+            parent->wait_block_condition().unblock();
+    }
+
     if (new_state == Dying) {
         g_finalizer_has_work = true;
         g_finalizer_wait_queue->wake_all();
     }
 }
 
+void Thread::arm_blocker_timer(u64 tick)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(!m_blocker_timer_id);
+    m_blocker_timer_id = TimerQueue::the().add_timer_at(tick, [this] {
+        m_blocker_timer_id = 0;
+        if (Scheduler::evaluate_blocked_thread(*this)) {
+            Scheduler::stop_idling();
+            return;
+        }
+        // Timeouts given as a time of day may round to a tick that's a little early, so keep trying.
+        if (is_blocked() && m_blocker->timeout_tick().has_value())
+            arm_blocker_timer(g_uptime + 1);
+    });
+}
+
+void Thread::cancel_blocker_timer()
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    if (!m_blocker_timer_id)
+        return;
+    TimerQueue::the().cancel_timer(m_blocker_timer_id);
+    m_blocker_timer_id = 0;
+}
+
 String Thread::backtrace(ProcessInspectionHandle&) const
 {
     return backtrace_impl();
@@ -61,6 +61,7 @@ struct ThreadSpecificData {
 #define THREAD_PRIORITY_NORMAL 30
 #define THREAD_PRIORITY_HIGH 50
 #define THREAD_PRIORITY_MAX 99
+#define THREAD_PRIORITY_BOOST_MAX 20
 
 class Thread {
     friend class Process;
@@ -82,10 +83,10 @@ public:
     int tid() const { return m_tid; }
     int pid() const;
 
-    void set_priority(u32 p) { m_priority = p; }
+    void set_priority(u32);
     u32 priority() const { return m_priority; }
 
-    void set_priority_boost(u32 boost) { m_priority_boost = boost; }
+    void set_priority_boost(u32);
     u32 priority_boost() const { return m_priority_boost; }
 
     u32 effective_priority() const;
@@ -123,6 +124,10 @@ public:
         virtual bool should_unblock(Thread&, time_t now_s, long us) = 0;
         virtual const char* state_string() const = 0;
         virtual bool is_reason_signal() const { return false; }
+        // Blockers are normally re-evaluated when whatever they are waiting for tells them to (see BlockCondition),
+        // or when their timeout expires. Blockers that can't be told have to be polled on every scheduler pass.
+        virtual bool should_poll() const { return false; }
+        virtual Optional<u64> timeout_tick() const { return {}; }
         void set_interrupted_by_death() { m_was_interrupted_by_death = true; }
         bool was_interrupted_by_death() const { return m_was_interrupted_by_death; }
         void set_interrupted_by_signal() { m_was_interrupted_while_blocked = true; }
@@ -148,7 +153,9 @@ public:
 
     class FileDescriptionBlocker : public Blocker {
     public:
+        virtual ~FileDescriptionBlocker() override;
         const FileDescription& blocked_description() const;
+        virtual bool should_poll() const override;
 
     protected:
         explicit FileDescriptionBlocker(const FileDescription&);
@@ -176,6 +183,7 @@ public:
         explicit WriteBlocker(const FileDescription&);
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return "Writing"; }
+        virtual Optional<u64> timeout_tick() const override;
 
     private:
         Optional<timeval> m_deadline;
@@ -186,6 +194,7 @@ public:
         explicit ReadBlocker(const FileDescription&);
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return "Reading"; }
+        virtual Optional<u64> timeout_tick() const override;
 
     private:
         Optional<timeval> m_deadline;
@@ -196,6 +205,7 @@ public:
         ConditionBlocker(const char* state_string, Function<bool()>&& condition);
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return m_state_string; }
+        virtual bool should_poll() const override { return true; }
 
     private:
         Function<bool()> m_block_until_condition;
@@ -207,6 +217,7 @@ public:
         explicit SleepBlocker(u64 wakeup_time);
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return "Sleeping"; }
+        virtual Optional<u64> timeout_tick() const override { return m_wakeup_time; }
 
     private:
         u64 m_wakeup_time { 0 };
@@ -216,10 +227,17 @@ public:
     public:
         typedef Vector<int, FD_SETSIZE> FDVector;
         SelectBlocker(const timeval& tv, bool select_has_timeout, const FDVector& read_fds, const FDVector& write_fds, const FDVector& except_fds);
+        virtual ~SelectBlocker() override;
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return "Selecting"; }
+        virtual bool should_poll() const override { return m_should_poll; }
+        virtual Optional<u64> timeout_tick() const override;
 
     private:
+        void register_with_files(const FDVector&);
+
+        Vector<NonnullRefPtr<File>> m_files;
+        bool m_should_poll { false };
         timeval m_select_timeout;
         bool m_select_has_timeout { false };
         const FDVector& m_select_read_fds;
@@ -230,6 +248,7 @@ public:
     class WaitBlocker final : public Blocker {
     public:
         WaitBlocker(int wait_options, pid_t& waitee_pid);
+        virtual ~WaitBlocker() override;
         virtual bool should_unblock(Thread&, time_t, long) override;
         virtual const char* state_string() const override { return "Waiting"; }
 
@@ -238,6 +257,28 @@ public:
         pid_t& m_waitee_pid;
     };
 
+    class FutexBlocker final : public Blocker {
+    public:
+        FutexBlocker(FlatPtr address, u32 bitset, Optional<u64> timeout_tick, bool& woken);
+        virtual ~FutexBlocker() override;
+        virtual bool should_unblock(Thread&, time_t, long) override;
+        virtual const char* state_string() const override { return "Futex"; }
+        virtual Optional<u64> timeout_tick() const override { return m_timeout_tick; }
+
+        Thread& thread() { return m_thread; }
+        FlatPtr address() const { return m_address; }
+        void set_address(FlatPtr address) { m_address = address; }
+        u32 bitset() const { return m_bitset; }
+        void wake() { m_woken = true; }
+
+    private:
+        Thread& m_thread;
+        FlatPtr m_address { 0 };
+        u32 m_bitset { 0 };
+        Optional<u64> m_timeout_tick;
+        bool& m_woken;
+    };
+
     class SemiPermanentBlocker final : public Blocker {
     public:
         enum class Reason {
@@ -441,15 +482,20 @@ public:
 
 private:
     IntrusiveListNode m_runnable_list_node;
+    IntrusiveListNode m_run_queue_node;
+    IntrusiveListNode m_polled_list_node;
     IntrusiveListNode m_wait_queue_node;
 
 private:
     friend class SchedulerData;
+    friend class RunQueue;
     friend class WaitQueue;
     bool unlock_process_if_locked();
     void relock_process();
     String backtrace_impl() const;
     void reset_fpu_state();
+    void arm_blocker_timer(u64 tick);
+    void cancel_blocker_timer();
 
     Process& m_process;
     int m_tid { -1 };
@@ -466,6 +512,7 @@ private:
     VirtualAddress m_thread_specific_data;
     SignalActionData m_signal_action_data[32];
     Blocker* m_blocker { nullptr };
+    u64 m_blocker_timer_id { 0 };
 
     bool m_is_joinable { true };
     Thread* m_joiner { nullptr };
@@ -490,9 +537,11 @@ private:
     State m_state { Invalid };
     String m_name;
     u32 m_priority { THREAD_PRIORITY_NORMAL };
-    u32 m_extra_priority { 0 };
     u32 m_priority_boost { 0 };
 
+    RunQueue* m_run_queue { nullptr };
+    u32 m_run_queue_level { 0 };
+
     u8 m_stop_signal { 0 };
     State m_stop_state { Invalid };
 
@@ -543,12 +592,44 @@ inline IterationDecision Thread::for_each_in_state(State state, Callback callbac
 
 const LogStream& operator<<(const LogStream&, const Thread&);
 
+// Runnable threads, with one FIFO list per effective priority and a bitmap of the
+// non-empty ones, so finding the highest priority thread doesn't depend on how many there are.
+class RunQueue {
+public:
+    static constexpr u32 level_count = THREAD_PRIORITY_MAX + 2 * THREAD_PRIORITY_BOOST_MAX + 1;
+
+    void enqueue(Thread&);
+    void dequeue(Thread&);
+    Thread* highest_priority_thread();
+
+    bool is_empty() const { return !m_thread_count; }
+    size_t thread_count() const { return m_thread_count; }
+
+private:
+    static constexpr u32 bitmap_word_count = (level_count + 31) / 32;
+
+    IntrusiveList<Thread, &Thread::m_run_queue_node> m_levels[level_count];
+    u32 m_non_empty_levels[bitmap_word_count] {};
+    size_t m_thread_count { 0 };
+};
+
 struct SchedulerData {
     typedef IntrusiveList<Thread, &Thread::m_runnable_list_node> ThreadList;
 
     ThreadList m_runnable_threads;
     ThreadList m_nonrunnable_threads;
 
+    // Threads that have to be looked at on the next scheduler pass: ones that just blocked,
+    // ones skipping scheduler passes, and ones whose blocker has to be polled.
+    IntrusiveList<Thread, &Thread::m_polled_list_node> m_polled_threads;
+
+    // Threads that have used up their time slice move to the expired queue, and the two queues
+    // trade places once the active one runs dry. This way every runnable thread gets a turn,
+    // no matter how many higher priority threads there are.
+    RunQueue m_run_queues[2];
+    RunQueue* m_active_run_queue { &m_run_queues[0] };
+    RunQueue* m_expired_run_queue { &m_run_queues[1] };
+
     ThreadList& thread_list_for_state(Thread::State state)
     {
         if (Thread::is_runnable_state(state))
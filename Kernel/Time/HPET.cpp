@@ -243,7 +243,16 @@ void HPET::enable(const HPETComparator& comparator)
 u64 HPET::main_counter_value() const
 {
     auto* registers_block = (const volatile HPETRegistersBlock*)m_hpet_mmio_region->vaddr().offset(m_physical_acpi_hpet_registers.offset_in_page()).as_ptr();
-    return registers_block->main_counter_value.reg;
+    auto* counter_halves = (const volatile u32*)&registers_block->main_counter_value.reg;
+    // We can only read the counter 32 bits at a time while it keeps running,
+    // so make sure the low half didn't wrap into the high half in between.
+    u32 high;
+    u32 low;
+    do {
+        high = counter_halves[1];
+        low = counter_halves[0];
+    } while (high != counter_halves[1]);
+    return ((u64)high << 32) | low;
 }
 u64 HPET::frequency() const
 {
@@ -317,7 +326,7 @@ u64 HPET::calculate_ticks_in_nanoseconds() const
 HPET::HPET(PhysicalAddress acpi_hpet)
     : m_physical_acpi_hpet_table(acpi_hpet)
     , m_physical_acpi_hpet_registers(find_acpi_hept_registers_block())
-    , m_hpet_mmio_region(MM.allocate_kernel_region(m_physical_acpi_hpet_registers.page_base(), PAGE_SIZE, "HPET MMIO", Region::Access::Read | Region::Access::Write))
+    , m_hpet_mmio_region(MM.allocate_kernel_region(m_physical_acpi_hpet_registers.page_base(), PAGE_SIZE, "HPET MMIO", Region::Access::Read | Region::Access::Write, false, false))
 {
     auto region = MM.allocate_kernel_region(m_physical_acpi_hpet_table.page_base(), (PAGE_SIZE * 2), "HPET Initialization", Region::Access::Read);
     auto* sdt = (volatile ACPI::Structures::HPET*)region->vaddr().offset(m_physical_acpi_hpet_table.offset_in_page()).as_ptr();
@@ -336,6 +345,9 @@ HPET::HPET(PhysicalAddress acpi_hpet)
 
     global_disable();
 
+    counter_is_64_bit_capable = registers_block->raw_capabilites.reg & (u32)HPETFlags::Attributes::Counter64BitCapable;
+    legacy_replacement_route_capable = registers_block->raw_capabilites.reg & (u32)HPETFlags::Attributes::LegacyReplacementRouteCapable;
+
     m_frequency = NANOSECOND_PERIOD_TO_HERTZ(calculate_ticks_in_nanoseconds());
     klog() << "HPET: frequency " << m_frequency << " Hz (" << MEGAHERTZ_TO_HERTZ(m_frequency) << " MHz)";
     ASSERT(capabilities_register->main_counter_tick_period <= ABSOLUTE_MAXIMUM_COUNTER_TICK_PERIOD);
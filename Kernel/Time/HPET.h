@@ -46,6 +46,7 @@ public:
 
     u64 main_counter_value() const;
     u64 frequency() const;
+    bool is_64_bit_capable() const { return counter_is_64_bit_capable; }
 
     const FixedArray<RefPtr<HPETComparator>>& comparators() const;
     void disable(const HPETComparator&);
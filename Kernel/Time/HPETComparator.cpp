@@ -66,10 +66,16 @@ void HPETComparator::handle_irq(const RegisterState& regs)
 }
 
 void HPETComparator::set_new_countdown()
+{
+    set_next_countdown(1);
+}
+
+void HPETComparator::set_next_countdown(size_t periods)
 {
     ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(!is_periodic());
     ASSERT(m_frequency <= HPET::the().frequency());
-    HPET::the().set_non_periodic_comparator_value(*this, HPET::the().frequency() / m_frequency);
+    HPET::the().set_non_periodic_comparator_value(*this, (HPET::the().frequency() / m_frequency) * periods);
 }
 
 size_t HPETComparator::ticks_per_second() const
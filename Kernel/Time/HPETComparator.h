@@ -55,6 +55,9 @@ public:
     virtual bool is_capable_of_frequency(size_t frequency) const override;
     virtual size_t calculate_nearest_possible_frequency(size_t frequency) const override;
 
+    // Only for one-shot comparators: make the next interrupt come the given number of periods from now.
+    void set_next_countdown(size_t periods);
+
 private:
     void set_new_countdown();
     virtual void handle_irq(const RegisterState&) override;
@@ -54,12 +54,77 @@ bool TimeManagement::is_system_timer(const HardwareTimer& timer) const
 void TimeManagement::set_epoch_time(time_t value)
 {
     InterruptDisabler disabler;
-    m_epoch_time = value;
+    m_epoch_time = value - monotonic_time().tv_sec;
 }
 
 time_t TimeManagement::epoch_time() const
 {
-    return m_epoch_time;
+    return m_epoch_time + monotonic_time().tv_sec;
+}
+
+timespec TimeManagement::monotonic_time() const
+{
+    timespec ts;
+    if (m_has_hpet_clock) {
+        u64 counter = HPET::the().main_counter_value();
+        u64 frequency = HPET::the().frequency();
+        ts.tv_sec = counter / frequency;
+        ts.tv_nsec = ((counter % frequency) * 1000000000) / frequency;
+        return ts;
+    }
+    InterruptDisabler disabler;
+    ts.tv_sec = m_seconds_since_boot;
+    ts.tv_nsec = ((u64)m_ticks_this_second * 1000000000) / m_time_keeper_timer->ticks_per_second();
+    return ts;
+}
+
+timespec TimeManagement::epoch_time_with_nanoseconds() const
+{
+    auto ts = monotonic_time();
+    ts.tv_sec += m_epoch_time;
+    return ts;
+}
+
+u64 TimeManagement::ticks_for_duration(const timespec& duration) const
+{
+    if (duration.tv_sec < 0)
+        return 0;
+    u64 ticks_per_second = this->ticks_per_second();
+    return (u64)duration.tv_sec * ticks_per_second + ((u64)duration.tv_nsec * ticks_per_second + 999999999) / 1000000000;
+}
+
+timespec TimeManagement::duration_for_ticks(u64 ticks) const
+{
+    u64 ticks_per_second = this->ticks_per_second();
+    timespec ts;
+    ts.tv_sec = ticks / ticks_per_second;
+    ts.tv_nsec = ((ticks % ticks_per_second) * 1000000000) / ticks_per_second;
+    return ts;
+}
+
+bool TimeManagement::stop_tick_until(u64 tick)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    if (!m_can_stop_tick || tick <= g_uptime + 1)
+        return false;
+    // Line the interrupt up with where the tick would have been, so we don't drift.
+    u64 deadline_counter = m_last_tick_counter + (tick - g_uptime) * m_counter_ticks_per_tick;
+    u64 counter = HPET::the().main_counter_value();
+    if (deadline_counter <= counter + m_counter_ticks_per_tick)
+        return false;
+    static_cast<HPETComparator&>(*m_system_timer).set_next_countdown((deadline_counter - counter) / m_counter_ticks_per_tick);
+    m_tick_stopped = true;
+    return true;
+}
+
+void TimeManagement::restart_tick()
+{
+    InterruptDisabler disabler;
+    if (!m_tick_stopped)
+        return;
+    m_tick_stopped = false;
+    // Any ticks we missed get accounted for by the next timer interrupt.
+    static_cast<HPETComparator&>(*m_system_timer).set_next_countdown(1);
 }
 
 void TimeManagement::initialize()
@@ -72,18 +137,13 @@ void TimeManagement::initialize()
 }
 time_t TimeManagement::seconds_since_boot() const
 {
-    return m_seconds_since_boot;
+    return monotonic_time().tv_sec;
 }
 time_t TimeManagement::ticks_per_second() const
 {
     return m_system_timer->ticks_per_second();
 }
 
-time_t TimeManagement::ticks_this_second() const
-{
-    return m_ticks_this_second;
-}
-
 time_t TimeManagement::boot_time() const
 {
     return RTC::boot_time();
@@ -203,12 +263,32 @@ bool TimeManagement::probe_and_set_non_legacy_hardware_timers()
         }
     }
 
+    // With a 64-bit main counter we can read the time straight from the HPET, and the system timer
+    // can run in one-shot mode so that we don't have to take timer interrupts while idle.
+    m_has_hpet_clock = HPET::the().is_64_bit_capable();
+    bool should_stop_tick_when_idle = m_has_hpet_clock && kernel_command_line().lookup("tickless").value_or("on") != "off";
+    if (should_stop_tick_when_idle && m_system_timer->is_periodic())
+        m_system_timer->set_non_periodic();
+
     m_system_timer->change_function([](const RegisterState& regs) { update_scheduler_ticks(regs); });
     dbg() << "Reset timers";
     m_system_timer->try_to_set_frequency(m_system_timer->calculate_nearest_possible_frequency(1024));
     m_time_keeper_timer->change_function([](const RegisterState& regs) { update_time(regs); });
     m_time_keeper_timer->try_to_set_frequency(OPTIMAL_TICKS_PER_SECOND_RATE);
 
+    if (m_has_hpet_clock) {
+        // The main counter keeps time for us, there's no need for another stream of interrupts.
+        m_time_keeper_timer->disable_irq();
+    }
+
+    if (should_stop_tick_when_idle && !m_system_timer->is_periodic()) {
+        InterruptDisabler disabler;
+        m_counter_ticks_per_tick = HPET::the().frequency() / m_system_timer->ticks_per_second();
+        m_last_tick_counter = HPET::the().main_counter_value();
+        m_can_stop_tick = true;
+        klog() << "Time: Using the HPET main counter as clock source, tickless idle enabled";
+    }
+
     return true;
 }
 
@@ -247,7 +327,6 @@ void TimeManagement::increment_time_since_boot(const RegisterState&)
     if (++m_ticks_this_second >= m_time_keeper_timer->ticks_per_second()) {
         // FIXME: Synchronize with other clock somehow to prevent drifting apart.
         ++m_seconds_since_boot;
-        ++m_epoch_time;
         m_ticks_this_second = 0;
     }
 }
@@ -259,6 +338,19 @@ void TimeManagement::update_scheduler_ticks(const RegisterState& regs)
 
 void TimeManagement::update_ticks(const RegisterState& regs)
 {
-    Scheduler::timer_tick(regs);
+    u64 elapsed_ticks = 1;
+    if (m_can_stop_tick) {
+        // The tick may have been stopped for a while, and one-shot interrupts always arrive a little late,
+        // so count how many ticks have really gone by.
+        u64 counter = HPET::the().main_counter_value();
+        u64 counted_ticks = (counter - m_last_tick_counter) / m_counter_ticks_per_tick;
+        if (counted_ticks) {
+            elapsed_ticks = counted_ticks;
+            m_last_tick_counter += counted_ticks * m_counter_ticks_per_tick;
+        } else {
+            m_last_tick_counter = counter;
+        }
+    }
+    Scheduler::timer_tick(regs, elapsed_ticks);
 }
 }
@@ -48,9 +48,19 @@ public:
     void set_epoch_time(time_t);
     time_t seconds_since_boot() const;
     time_t ticks_per_second() const;
-    time_t ticks_this_second() const;
     time_t boot_time() const;
 
+    timespec monotonic_time() const;
+    timespec epoch_time_with_nanoseconds() const;
+
+    // Converts a duration into system timer ticks, rounding up so that we never wake anyone up early.
+    u64 ticks_for_duration(const timespec&) const;
+    timespec duration_for_ticks(u64 ticks) const;
+
+    bool can_stop_tick() const { return m_can_stop_tick; }
+    bool stop_tick_until(u64 tick);
+    void restart_tick();
+
     bool is_system_timer(const HardwareTimer&) const;
 
     static void update_time(const RegisterState&);
@@ -72,7 +82,17 @@ private:
 
     u32 m_ticks_this_second { 0 };
     u32 m_seconds_since_boot { 0 };
+    // The wall clock time at boot. The current time is this plus the monotonic time.
     time_t m_epoch_time { 0 };
+
+    // With a 64-bit HPET main counter, we read the time from it instead of counting timer interrupts.
+    // If the system timer is a one-shot HPET comparator too, the tick can be stopped while idle,
+    // and we catch up on the ticks that went by from the main counter.
+    bool m_has_hpet_clock { false };
+    bool m_can_stop_tick { false };
+    bool m_tick_stopped { false };
+    u64 m_counter_ticks_per_tick { 0 };
+    u64 m_last_tick_counter { 0 };
     RefPtr<HardwareTimer> m_system_timer;
     RefPtr<HardwareTimer> m_time_keeper_timer;
     Function<void(RegisterState&)> m_scheduler_ticking { update_time };
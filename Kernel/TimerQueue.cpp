@@ -41,21 +41,21 @@ TimerQueue& TimerQueue::the()
     return *s_the;
 }
 
-u64 TimerQueue::add_timer(NonnullOwnPtr<Timer>&& timer)
+TimerQueue::TimerQueue()
+    : m_last_fired_tick(g_uptime)
 {
-    ASSERT(timer->expires > g_uptime);
-
-    timer->id = ++m_timer_id_count;
-
-    auto following_timer = m_timer_queue.find([&timer](auto& other) { return other->expires > timer->expires; });
-    if (following_timer.is_end())
-        m_timer_queue.append(move(timer));
-    else
-        m_timer_queue.insert_before(following_timer, move(timer));
+}
 
-    update_next_timer_due();
+u64 TimerQueue::add_timer(NonnullOwnPtr<Timer>&& timer_ptr)
+{
+    ASSERT(timer_ptr->expires > g_uptime);
+    InterruptDisabler disabler;
 
-    return m_timer_id_count;
+    auto* timer = timer_ptr.leak_ptr();
+    timer->id = ++m_timer_id_count;
+    slot_for(timer->expires).append(*timer);
+    m_timers_by_id.set(timer->id, timer);
+    return timer->id;
 }
 
 u64 TimerQueue::add_timer(u64 duration, TimeUnit unit, Function<void()>&& callback)
@@ -66,37 +66,72 @@ u64 TimerQueue::add_timer(u64 duration, TimeUnit unit, Function<void()>&& callba
     return add_timer(move(timer));
 }
 
+u64 TimerQueue::add_timer_at(u64 expires, Function<void()>&& callback)
+{
+    NonnullOwnPtr timer = make<Timer>();
+    // The earliest we can fire a timer is on the next tick.
+    timer->expires = max(expires, g_uptime + 1);
+    timer->callback = move(callback);
+    return add_timer(move(timer));
+}
+
 bool TimerQueue::cancel_timer(u64 id)
 {
-    auto it = m_timer_queue.find([id](auto& timer) { return timer->id == id; });
-    if (it.is_end())
+    InterruptDisabler disabler;
+    auto it = m_timers_by_id.find(id);
+    if (it == m_timers_by_id.end())
         return false;
-    m_timer_queue.remove(it);
-    update_next_timer_due();
+    auto* timer = (*it).value;
+    m_timers_by_id.remove(it);
+    timer->list_node.remove();
+    delete timer;
     return true;
 }
 
+u64 TimerQueue::next_timer_due(u64 limit)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    if (m_timers_by_id.is_empty())
+        return limit;
+    // Only look one turn of the wheel ahead, anything later than that shows up in the same slots again.
+    u64 last_tick_to_check = min(limit, m_last_fired_tick + wheel_slot_count);
+    for (u64 tick = m_last_fired_tick + 1; tick <= last_tick_to_check; ++tick) {
+        for (auto& timer : slot_for(tick)) {
+            if (timer.expires <= tick)
+                return tick;
+        }
+    }
+    return limit;
+}
+
 void TimerQueue::fire()
 {
-    if (m_timer_queue.is_empty())
+    ASSERT_INTERRUPTS_DISABLED();
+    // Normally this runs once per tick, but catch up on any ticks we may have missed.
+    while (m_last_fired_tick < g_uptime)
+        fire_slot(++m_last_fired_tick);
+}
+
+void TimerQueue::fire_slot(u64 tick)
+{
+    auto& slot = slot_for(tick);
+    if (slot.is_empty())
         return;
 
-    ASSERT(m_next_timer_due == m_timer_queue.first()->expires);
+    // Take the expired timers out first, since their callbacks may add or cancel other timers.
+    TimerList expired_timers;
+    for (auto it = slot.begin(); it != slot.end();) {
+        auto& timer = *it;
+        ++it;
+        if (timer.expires <= tick)
+            expired_timers.append(timer);
+    }
 
-    while (!m_timer_queue.is_empty() && g_uptime > m_timer_queue.first()->expires) {
-        auto timer = m_timer_queue.take_first();
+    while (auto* timer = expired_timers.take_first()) {
+        m_timers_by_id.remove(timer->id);
         timer->callback();
+        delete timer;
     }
-
-    update_next_timer_due();
-}
-
-void TimerQueue::update_next_timer_due()
-{
-    if (m_timer_queue.is_empty())
-        m_next_timer_due = 0;
-    else
-        m_next_timer_due = m_timer_queue.first()->expires;
 }
 
 }
@@ -27,9 +27,10 @@
 #pragma once
 
 #include <AK/Function.h>
+#include <AK/HashMap.h>
+#include <AK/IntrusiveList.h>
 #include <AK/NonnullOwnPtr.h>
 #include <AK/OwnPtr.h>
-#include <AK/SinglyLinkedList.h>
 #include <Kernel/Time/TimeManagement.h>
 
 namespace Kernel {
@@ -38,6 +39,7 @@ struct Timer {
     u64 id;
     u64 expires;
     Function<void()> callback;
+    IntrusiveListNode list_node;
     bool operator<(const Timer& rhs) const
     {
         return expires < rhs.expires;
@@ -64,15 +66,31 @@ public:
 
     u64 add_timer(NonnullOwnPtr<Timer>&&);
     u64 add_timer(u64 duration, TimeUnit, Function<void()>&& callback);
+    u64 add_timer_at(u64 expires, Function<void()>&& callback);
     bool cancel_timer(u64 id);
     void fire();
 
+    // Returns the tick at which the next timer is due, or the given limit if nothing is due before it.
+    u64 next_timer_due(u64 limit);
+
+    size_t timer_count() const { return m_timers_by_id.size(); }
+
 private:
-    void update_next_timer_due();
+    TimerQueue();
+
+    typedef IntrusiveList<Timer, &Timer::list_node> TimerList;
+
+    // Timers are hashed into a wheel of slots by the tick they expire on, so adding and cancelling
+    // a timer is O(1), and every tick we only have to look at the timers in a single slot.
+    // Timers that are more than a full turn of the wheel away just stay in their slot for another turn.
+    static constexpr size_t wheel_slot_count = 256;
+    TimerList& slot_for(u64 tick) { return m_wheel[tick % wheel_slot_count]; }
+    void fire_slot(u64 tick);
 
-    u64 m_next_timer_due { 0 };
     u64 m_timer_id_count { 0 };
-    SinglyLinkedList<NonnullOwnPtr<Timer>> m_timer_queue;
+    u64 m_last_fired_tick { 0 };
+    TimerList m_wheel[wheel_slot_count];
+    HashMap<u64, Timer*> m_timers_by_id;
 };
 
 }
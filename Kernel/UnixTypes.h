@@ -77,6 +77,12 @@
 
 #define FUTEX_WAIT 1
 #define FUTEX_WAKE 2
+#define FUTEX_REQUEUE 3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
 
 /* c_cc characters */
 #define VINTR 0
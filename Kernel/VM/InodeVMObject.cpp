@@ -24,17 +24,25 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/ByteBuffer.h>
 #include <Kernel/FileSystem/Inode.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
 #include <Kernel/VM/InodeVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
 #include <Kernel/VM/Region.h>
+#include <LibBareMetal/StdLib.h>
 
 namespace Kernel {
 
+static const size_t max_page_in_page_count = 16;
+static const size_t min_readahead_page_count = 4;
+static const size_t max_readahead_page_count = 16;
+
 InodeVMObject::InodeVMObject(Inode& inode, size_t size)
     : VMObject(size)
     , m_inode(inode)
     , m_dirty_pages(page_count(), false)
+    , m_inactive_pages(page_count(), false)
 {
 }
 
@@ -42,6 +50,7 @@ InodeVMObject::InodeVMObject(const InodeVMObject& other)
     : VMObject(other)
     , m_inode(other.m_inode)
     , m_dirty_pages(page_count(), false)
+    , m_inactive_pages(page_count(), false)
 {
     for (size_t i = 0; i < page_count(); ++i)
         m_dirty_pages.set(i, other.m_dirty_pages.get(i));
@@ -78,12 +87,29 @@ void InodeVMObject::inode_size_changed(Badge<Inode>, size_t old_size, size_t new
 
     InterruptDisabler disabler;
 
+    auto old_page_count = page_count();
     auto new_page_count = PAGE_ROUND_UP(new_size) / PAGE_SIZE;
+
+    if (new_size < old_size && new_size % PAGE_SIZE && new_page_count <= old_page_count) {
+        // The tail of the new last page is past EOF now, and must read back as zeroes if the file grows again.
+        if (auto& last_page = m_physical_pages[new_page_count - 1]) {
+            auto* ptr = MM.quickmap_page(*last_page);
+            memset(ptr + new_size % PAGE_SIZE, 0, PAGE_SIZE - new_size % PAGE_SIZE);
+            MM.unquickmap_page();
+        }
+    }
+
+    // Shrinking drops the pages past EOF, and the remap below unmaps them from every region.
     m_physical_pages.resize(new_page_count);
 
-    m_dirty_pages.grow(new_page_count, false);
+    if (new_page_count > old_page_count) {
+        m_dirty_pages.grow(new_page_count, false);
+        m_inactive_pages.grow(new_page_count, false);
+    } else if (new_page_count < old_page_count) {
+        m_dirty_pages.shrink(new_page_count);
+        m_inactive_pages.shrink(new_page_count);
+    }
 
-    // FIXME: Consolidate with inode_contents_changed() so we only do a single walk.
     for_each_region([](auto& region) {
         region.remap();
     });
@@ -91,53 +117,210 @@ void InodeVMObject::inode_size_changed(Badge<Inode>, size_t old_size, size_t new
 
 void InodeVMObject::inode_contents_changed(Badge<Inode>, off_t offset, ssize_t size, const u8* data)
 {
-    (void)size;
-    (void)data;
-    InterruptDisabler disabler;
     ASSERT(offset >= 0);
+    ASSERT(size >= 0);
 
-    // FIXME: Only invalidate the parts that actually changed.
-    for (auto& physical_page : m_physical_pages)
-        physical_page = nullptr;
-
-#if 0
+    // Bring the resident pages in the written range up to date instead of dropping them,
+    // so the next read() or fault doesn't have to page them back in. The data may be in the
+    // writer's userspace buffer, which can fault, so bounce each chunk through the stack
+    // before touching the quickmap, like read_bytes() does.
+    u8 page_buffer[PAGE_SIZE];
+    size_t end_offset = (size_t)offset + (size_t)size;
+    {
+        // The inode has the new data already, but a page_in() that's still reading may have gotten the old
+        // data and would install it after we're done here. Have it read those pages again.
+        InterruptDisabler disabler;
+        if ((size_t)offset / PAGE_SIZE < m_page_in_end_page_index && PAGE_ROUND_UP(end_offset) / PAGE_SIZE > m_page_in_first_page_index)
+            m_page_in_was_overwritten = true;
+    }
     size_t current_offset = offset;
-    size_t remaining_bytes = size;
-    const u8* data_ptr = data;
+    while (current_offset < end_offset) {
+        size_t page_index = current_offset / PAGE_SIZE;
+        size_t offset_in_page = current_offset % PAGE_SIZE;
+        size_t bytes_to_copy = min(PAGE_SIZE - offset_in_page, end_offset - current_offset);
+        {
+            InterruptDisabler disabler;
+            if (page_index >= page_count())
+                break;
+            if (m_physical_pages[page_index].is_null()) {
+                current_offset += bytes_to_copy;
+                continue;
+            }
+        }
+        memcpy(page_buffer, data + (current_offset - offset), bytes_to_copy);
+        {
+            // The page may have been reclaimed while we were copying, then there's nothing to update.
+            InterruptDisabler disabler;
+            if (page_index >= page_count())
+                break;
+            if (auto& physical_page = m_physical_pages[page_index]) {
+                auto* ptr = MM.quickmap_page(*physical_page);
+                memcpy(ptr + offset_in_page, page_buffer, bytes_to_copy);
+                MM.unquickmap_page();
+            }
+        }
+        current_offset += bytes_to_copy;
+    }
+}
 
-    auto to_page_index = [] (size_t offset) -> size_t {
-        return offset / PAGE_SIZE;
-    };
+bool InodeVMObject::page_in(size_t first_page_index, size_t page_count)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(m_paging_lock.is_locked());
 
-    if (current_offset & PAGE_MASK) {
-        size_t page_index = to_page_index(current_offset);
-        size_t bytes_to_copy = min(size, PAGE_SIZE - (current_offset & PAGE_MASK));
-        if (m_physical_pages[page_index]) {
-            auto* ptr = MM.quickmap_page(*m_physical_pages[page_index]);
-            memcpy(ptr, data_ptr, bytes_to_copy);
-            MM.unquickmap_page();
+    size_t size = page_count * PAGE_SIZE;
+#ifdef MM_DEBUG
+    dbg() << "InodeVMObject: page_in ready to read " << page_count << " pages from inode";
+#endif
+    m_page_in_first_page_index = first_page_index;
+    m_page_in_end_page_index = first_page_index + page_count;
+    sti();
+    auto buffer = ByteBuffer::create_uninitialized(size);
+    cli();
+    do {
+        m_page_in_was_overwritten = false;
+        sti();
+        auto nread = m_inode->read_bytes(first_page_index * PAGE_SIZE, size, buffer.data(), nullptr);
+        if (nread < 0) {
+            klog() << "InodeVMObject: page_in had error (" << nread << ") while reading!";
+            cli();
+            m_page_in_first_page_index = 0;
+            m_page_in_end_page_index = 0;
+            return false;
         }
-        current_offset += bytes_to_copy;
-        data += bytes_to_copy;
-        remaining_bytes -= bytes_to_copy;
+        if ((size_t)nread < size) {
+            // If we read less than we asked for, zero out the rest to avoid leaking uninitialized data.
+            memset(buffer.data() + nread, 0, size - nread);
+        }
+        cli();
+    } while (m_page_in_was_overwritten);
+    m_page_in_first_page_index = 0;
+    m_page_in_end_page_index = 0;
+
+    // The inode may have shrunk while we were reading.
+    size_t end_page_index = min(first_page_index + page_count, this->page_count());
+    for (size_t i = first_page_index; i < end_page_index; ++i) {
+        auto& physical_page = m_physical_pages[i];
+        if (!physical_page.is_null())
+            continue;
+        physical_page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+        if (physical_page.is_null())
+            continue;
+        u8* dest_ptr = MM.quickmap_page(*physical_page);
+        memcpy(dest_ptr, buffer.data() + (i - first_page_index) * PAGE_SIZE, PAGE_SIZE);
+        MM.unquickmap_page();
     }
+    return true;
+}
+
+ssize_t InodeVMObject::read_bytes(off_t offset, ssize_t count, u8* buffer)
+{
+    ASSERT(offset >= 0);
+    ASSERT(count >= 0);
+    LOCKER(m_paging_lock);
+
+    off_t size = m_inode->size();
+    if (offset >= size)
+        return 0;
+    size_t end_offset = min((size_t)offset + (size_t)count, (size_t)size);
 
-    for (size_t page_index = to_page_index(current_offset); page_index < m_physical_pages.size(); ++page_index) {
-        size_t bytes_to_copy = PAGE_SIZE - (current_offset & PAGE_MASK);
-        if (m_physical_pages[page_index]) {
+    // Pages are copied out through the quickmap, which can't stay in use while we touch the
+    // caller's buffer (that might fault), so bounce each chunk through the stack.
+    u8 page_buffer[PAGE_SIZE];
+    size_t current_offset = offset;
+    while (current_offset < end_offset) {
+        size_t page_index = current_offset / PAGE_SIZE;
+        size_t offset_in_page = current_offset % PAGE_SIZE;
+        size_t bytes_to_copy = min(PAGE_SIZE - offset_in_page, end_offset - current_offset);
+        {
+            InterruptDisabler disabler;
+            if (page_index >= page_count())
+                break;
+            if (m_physical_pages[page_index].is_null()) {
+                // Page in the run of missing pages covered by this read with a single request.
+                size_t end_page_index = min(PAGE_ROUND_UP(end_offset) / PAGE_SIZE, page_index + max_page_in_page_count);
+                end_page_index = min(end_page_index, page_count());
+                size_t run_end = page_index + 1;
+                while (run_end < end_page_index && m_physical_pages[run_end].is_null())
+                    ++run_end;
+                if (!page_in(page_index, run_end - page_index))
+                    return current_offset > (size_t)offset ? (ssize_t)(current_offset - offset) : -EIO;
+                if (page_index >= page_count())
+                    break;
+                if (m_physical_pages[page_index].is_null())
+                    return current_offset > (size_t)offset ? (ssize_t)(current_offset - offset) : -ENOMEM;
+            }
             auto* ptr = MM.quickmap_page(*m_physical_pages[page_index]);
-            memcpy(ptr, data_ptr, bytes_to_copy);
+            memcpy(page_buffer, ptr + offset_in_page, bytes_to_copy);
             MM.unquickmap_page();
         }
+        memcpy(buffer + (current_offset - offset), page_buffer, bytes_to_copy);
         current_offset += bytes_to_copy;
-        data += bytes_to_copy;
     }
-#endif
+    if (current_offset > (size_t)offset) {
+        size_t first_page_index = offset / PAGE_SIZE;
+        size_t end_page_index = PAGE_ROUND_UP(current_offset) / PAGE_SIZE;
+        {
+            // read() doesn't go through a mapping, so there's no accessed bit for the reclaimer to find.
+            InterruptDisabler disabler;
+            for (size_t i = first_page_index; i < min(end_page_index, m_inactive_pages.size()); ++i)
+                m_inactive_pages.set(i, false);
+        }
+        did_access_pages(first_page_index, end_page_index);
+    }
+    return (ssize_t)(current_offset - offset);
+}
 
-    // FIXME: Consolidate with inode_size_changed() so we only do a single walk.
-    for_each_region([](auto& region) {
-        region.remap();
-    });
+void InodeVMObject::did_access_pages(size_t first_page_index, size_t end_page_index)
+{
+    InterruptDisabler disabler;
+    auto& state = m_readahead_state;
+
+    // An access that picks up where the previous one left off (or in the page it ended in) is
+    // sequential and doubles the readahead window, anything else resets it.
+    if (first_page_index == state.next_page_index || first_page_index + 1 == state.next_page_index) {
+        state.window_page_count = state.window_page_count ? min(state.window_page_count * 2, max_readahead_page_count) : min_readahead_page_count;
+    } else {
+        state.window_page_count = 0;
+        state.readahead_end = 0;
+    }
+    state.next_page_index = end_page_index;
+
+    if (!state.window_page_count)
+        return;
+    size_t readahead_start = max(end_page_index, state.readahead_end);
+    size_t readahead_end = min(end_page_index + state.window_page_count, page_count());
+    if (readahead_start >= readahead_end)
+        return;
+    ReadaheadTask::queue(*this, readahead_start, readahead_end - readahead_start);
+    state.readahead_end = readahead_end;
+}
+
+void InodeVMObject::read_ahead(Badge<ReadaheadTask>, size_t first_page_index, size_t page_count)
+{
+    // Readahead pages would only push out pages someone actually needs.
+    if (MM.memory_pressure() != MemoryManager::MemoryPressure::None)
+        return;
+
+    LOCKER(m_paging_lock);
+    InterruptDisabler disabler;
+    size_t end_page_index = first_page_index + page_count;
+    size_t page_index = first_page_index;
+    while (page_index < min(end_page_index, this->page_count())) {
+        if (!m_physical_pages[page_index].is_null()) {
+            ++page_index;
+            continue;
+        }
+        size_t run_end = page_index + 1;
+        while (run_end < min(end_page_index, this->page_count()) && m_physical_pages[run_end].is_null())
+            ++run_end;
+#ifdef MM_DEBUG
+        dbg() << "InodeVMObject: Reading ahead pages " << page_index << "-" << (run_end - 1) << " of inode " << m_inode->identifier();
+#endif
+        if (!page_in(page_index, run_end - page_index))
+            return;
+        page_index = run_end;
+    }
 }
 
 int InodeVMObject::release_all_clean_pages()
@@ -150,6 +333,13 @@ int InodeVMObject::release_all_clean_pages_impl()
 {
     int count = 0;
     InterruptDisabler disabler;
+    // Pick up writes through current mappings first, they're not in m_dirty_pages yet.
+    for_each_region([&](auto& region) {
+        for (size_t i = 0; i < region.page_count(); ++i) {
+            if (region.is_page_dirty(i) && region.first_page_index() + i < page_count())
+                m_dirty_pages.set(region.first_page_index() + i, true);
+        }
+    });
     for (size_t i = 0; i < page_count(); ++i) {
         if (!m_dirty_pages.get(i) && m_physical_pages[i]) {
             m_physical_pages[i] = nullptr;
@@ -162,6 +352,65 @@ int InodeVMObject::release_all_clean_pages_impl()
     return count;
 }
 
+int InodeVMObject::reclaim_inactive_clean_pages(Badge<MemoryManager>, int max_page_count)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    // Someone is paging this object in right now, leave it alone.
+    if (m_paging_lock.is_locked())
+        return 0;
+
+    // Writes through mappings that are gone were recorded in m_dirty_pages when they were unmapped,
+    // the ones through current mappings show up as dirty PTEs below.
+    Vector<Region*, 4> regions;
+    for_each_region([&](auto& region) {
+        regions.append(&region);
+    });
+
+    int count = 0;
+    for (size_t i = 0; i < page_count() && count < max_page_count; ++i) {
+        auto& physical_page = m_physical_pages[i];
+        if (!physical_page || m_dirty_pages.get(i))
+            continue;
+        // Dropping our reference wouldn't free a page that's shared with a clone of this object.
+        if (physical_page->ref_count() != 1)
+            continue;
+
+        bool accessed = false;
+        bool dirty = false;
+        for (auto* region : regions) {
+            if (i < region->first_page_index() || i > region->last_page_index())
+                continue;
+            size_t page_index_in_region = i - region->first_page_index();
+            if (region->is_page_dirty(page_index_in_region))
+                dirty = true;
+            if (region->test_and_clear_page_accessed(page_index_in_region))
+                accessed = true;
+        }
+
+        if (dirty) {
+            m_dirty_pages.set(i, true);
+            continue;
+        }
+        if (accessed) {
+            m_inactive_pages.set(i, false);
+            continue;
+        }
+        if (!m_inactive_pages.get(i)) {
+            m_inactive_pages.set(i, true);
+            continue;
+        }
+
+        for (auto* region : regions) {
+            if (i >= region->first_page_index() && i <= region->last_page_index())
+                region->unmap_page(i - region->first_page_index());
+        }
+        physical_page = nullptr;
+        m_inactive_pages.set(i, false);
+        ++count;
+    }
+    return count;
+}
+
 u32 InodeVMObject::writable_mappings() const
 {
     u32 count = 0;
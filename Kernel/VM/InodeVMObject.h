@@ -32,6 +32,8 @@
 
 namespace Kernel {
 
+class ReadaheadTask;
+
 class InodeVMObject : public VMObject {
 public:
     virtual ~InodeVMObject() override;
@@ -42,11 +44,39 @@ public:
     void inode_contents_changed(Badge<Inode>, off_t, ssize_t, const u8*);
     void inode_size_changed(Badge<Inode>, size_t old_size, size_t new_size);
 
+    // Copies file contents out of the resident pages, paging in the missing ones first. This lets read()
+    // share its cache with mmap() without mapping the object into kernel address space.
+    ssize_t read_bytes(off_t offset, ssize_t count, u8* buffer);
+
+    // Reads the non-resident pages in [first_page_index, first_page_index + page_count) from the inode in
+    // a single request. Called with the paging lock held and interrupts disabled; interrupts are enabled
+    // while reading. Pages that couldn't be allocated stay non-resident, so callers should check.
+    // If the inode is written to while we're reading, the pages are read again.
+    bool page_in(size_t first_page_index, size_t page_count);
+
+    // Called on every read() and fault with the pages it touched. Sequential accesses grow a readahead
+    // window, and the pages in it are paged in by the ReadaheadTask in the background.
+    void did_access_pages(size_t first_page_index, size_t end_page_index);
+    void read_ahead(Badge<ReadaheadTask>, size_t first_page_index, size_t page_count);
+
     size_t amount_dirty() const;
     size_t amount_clean() const;
 
     int release_all_clean_pages();
 
+    // Second-chance reclaim of clean pages: a page that wasn't accessed through any mapping since the
+    // previous scan is inactive and gets dropped (it's read back in on the next fault), the others are
+    // demoted to inactive.
+    int reclaim_inactive_clean_pages(Badge<MemoryManager>, int max_page_count);
+
+    // Regions hand over the PTE dirty bits of the pages they unmap, so a write through a mapping that's
+    // gone (or was made read-only) still keeps the page from being reclaimed.
+    void set_page_dirty(Badge<Region>, size_t page_index)
+    {
+        if (page_index < m_dirty_pages.size())
+            m_dirty_pages.set(page_index, true);
+    }
+
     u32 writable_mappings() const;
     u32 executable_mappings() const;
 
@@ -62,8 +92,22 @@ protected:
 
     int release_all_clean_pages_impl();
 
+    struct ReadaheadState {
+        size_t next_page_index { 0 };
+        size_t readahead_end { 0 };
+        size_t window_page_count { 0 };
+    };
+
     NonnullRefPtr<Inode> m_inode;
+    ReadaheadState m_readahead_state;
+
+    // The pages the (single, since it's serialized by the paging lock) page_in() in progress is reading.
+    size_t m_page_in_first_page_index { 0 };
+    size_t m_page_in_end_page_index { 0 };
+    bool m_page_in_was_overwritten { false };
+
     Bitmap m_dirty_pages;
+    Bitmap m_inactive_pages;
 };
 
 }
@@ -34,6 +34,7 @@
 #include <Kernel/Multiboot.h>
 #include <Kernel/VM/AnonymousVMObject.h>
 #include <Kernel/VM/ContiguousVMObject.h>
+#include <Kernel/VM/InodeVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
 #include <Kernel/VM/PageDirectory.h>
 #include <Kernel/VM/PhysicalRegion.h>
@@ -52,6 +53,10 @@ namespace Kernel {
 
 static MemoryManager* s_the;
 
+// How many pre-zeroed pages PageZeroingTask tries to keep around, and when to wake it up to top them up.
+static const size_t zeroed_page_pool_size = 256;
+static const size_t zeroed_page_pool_low_water_mark = zeroed_page_pool_size / 2;
+
 MemoryManager& MM
 {
     return *s_the;
@@ -66,6 +71,7 @@ MemoryManager::MemoryManager()
     protect_kernel_image();
 
     m_shared_zero_page = allocate_user_physical_page();
+    m_zeroed_user_pages.ensure_capacity(zeroed_page_pool_size);
 }
 
 MemoryManager::~MemoryManager()
@@ -230,6 +236,11 @@ PageTableEntry& MemoryManager::ensure_pte(PageDirectory& page_directory, Virtual
     return quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()))[page_table_index];
 }
 
+bool MemoryManager::is_initialized()
+{
+    return s_the != nullptr;
+}
+
 void MemoryManager::initialize()
 {
     s_the = new MemoryManager;
@@ -239,20 +250,33 @@ Region* MemoryManager::kernel_region_from_vaddr(VirtualAddress vaddr)
 {
     if (vaddr.get() < 0xc0000000)
         return nullptr;
-    for (auto& region : MM.m_kernel_regions) {
-        if (region.contains(vaddr))
-            return &region;
+    size_t index = MM.first_kernel_region_index_above(vaddr);
+    if (!index)
+        return nullptr;
+    auto* region = MM.m_kernel_regions[index - 1];
+    if (!region->contains(vaddr))
+        return nullptr;
+    return region;
+}
+
+size_t MemoryManager::first_kernel_region_index_above(VirtualAddress vaddr) const
+{
+    size_t low = 0;
+    size_t high = m_kernel_regions.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (m_kernel_regions[middle]->vaddr() <= vaddr)
+            low = middle + 1;
+        else
+            high = middle;
     }
-    return nullptr;
+    return low;
 }
 
 Region* MemoryManager::user_region_from_vaddr(Process& process, VirtualAddress vaddr)
 {
-    // FIXME: Use a binary search tree (maybe red/black?) or some other more appropriate data structure!
-    for (auto& region : process.m_regions) {
-        if (region.contains(vaddr))
-            return &region;
-    }
+    if (auto* region = process.region_containing(vaddr))
+        return region;
 #ifdef MM_DEBUG
     dbg() << process << " Couldn't find user region for " << vaddr;
 #endif
@@ -382,6 +406,10 @@ void MemoryManager::deallocate_user_physical_page(PhysicalPage&& page)
         region.return_page(move(page));
         --m_user_physical_pages_used;
 
+        // Let PageReclaimTask tell everyone that the pressure is off.
+        if (m_reported_memory_pressure != MemoryPressure::None && free_user_physical_pages() >= high_water_mark())
+            m_memory_pressure_wait_queue.wake_one();
+
         return;
     }
 
@@ -403,26 +431,40 @@ RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page()
 RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill should_zero_fill)
 {
     InterruptDisabler disabler;
-    RefPtr<PhysicalPage> page = find_free_user_physical_page();
+    RefPtr<PhysicalPage> page;
+    if (should_zero_fill == ShouldZeroFill::Yes && !m_zeroed_user_pages.is_empty()) {
+        page = m_zeroed_user_pages.take_last();
+        should_zero_fill = ShouldZeroFill::No;
+    } else {
+        page = find_free_user_physical_page();
+    }
+
+    // The zeroed pages are still free memory, so use them before resorting to purging.
+    if (!page && !m_zeroed_user_pages.is_empty())
+        page = m_zeroed_user_pages.take_last();
+
+    if (m_zeroed_user_pages.size() < zeroed_page_pool_low_water_mark)
+        m_zeroed_page_pool_wait_queue.wake_one();
 
     if (!page) {
         if (m_user_physical_regions.is_empty()) {
             klog() << "MM: no user physical regions available (?)";
         }
 
-        for_each_vmobject([&](auto& vmobject) {
-            if (vmobject.is_purgeable()) {
-                auto& purgeable_vmobject = static_cast<PurgeableVMObject&>(vmobject);
-                int purged_page_count = purgeable_vmobject.purge_with_interrupts_disabled({});
-                if (purged_page_count) {
-                    klog() << "MM: Purge saved the day! Purged " << purged_page_count << " pages from PurgeableVMObject{" << &purgeable_vmobject << "}";
-                    page = find_free_user_physical_page();
-                    ASSERT(page);
-                    return IterationDecision::Break;
-                }
+        int purged_page_count = purge_volatile_vmobjects(1);
+        if (purged_page_count) {
+            klog() << "MM: Purge saved the day! Purged " << purged_page_count << " pages";
+            page = find_free_user_physical_page();
+            ASSERT(page);
+        }
+
+        // The first scan may only find recently used pages and demote them, so give it a second chance.
+        for (int pass = 0; !page && pass < 2; ++pass) {
+            if (reclaim_clean_inode_pages(1)) {
+                page = find_free_user_physical_page();
+                ASSERT(page);
             }
-            return IterationDecision::Continue;
-        });
+        }
 
         if (!page) {
             klog() << "MM: no user physical pages available";
@@ -442,6 +484,10 @@ RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill s
     }
 
     ++m_user_physical_pages_used;
+
+    if (free_user_physical_pages() < low_water_mark())
+        m_memory_pressure_wait_queue.wake_one();
+
     return page;
 }
 
@@ -472,8 +518,8 @@ Vector<RefPtr<PhysicalPage>> MemoryManager::allocate_contiguous_supervisor_physi
 
     for (auto& region : m_super_physical_regions) {
         physical_pages = region.take_contiguous_free_pages((count), true);
-        if (physical_pages.is_empty())
-            continue;
+        if (!physical_pages.is_empty())
+            break;
     }
 
     if (physical_pages.is_empty()) {
@@ -499,8 +545,8 @@ RefPtr<PhysicalPage> MemoryManager::allocate_supervisor_physical_page()
 
     for (auto& region : m_super_physical_regions) {
         page = region.take_free_page(true);
-        if (page.is_null())
-            continue;
+        if (!page.is_null())
+            break;
     }
 
     if (!page) {
@@ -522,6 +568,125 @@ RefPtr<PhysicalPage> MemoryManager::allocate_supervisor_physical_page()
     return page;
 }
 
+void MemoryManager::refill_zeroed_page_pool()
+{
+    for (;;) {
+        // Interrupts are only disabled for one page at a time, so anyone that needs the CPU can get it in between.
+        InterruptDisabler disabler;
+        if (m_zeroed_user_pages.size() >= zeroed_page_pool_size)
+            return;
+        // Don't hoard the last free pages, the rest of the system needs them more.
+        if (m_user_physical_pages - m_user_physical_pages_used - m_zeroed_user_pages.size() < zeroed_page_pool_size * 2)
+            return;
+        auto page = find_free_user_physical_page();
+        if (!page)
+            return;
+        auto* ptr = quickmap_page(*page);
+        fast_u32_fill((u32*)ptr, 0, PAGE_SIZE / sizeof(u32));
+        unquickmap_page();
+        m_zeroed_user_pages.append(page.release_nonnull());
+    }
+}
+
+void MemoryManager::wait_until_zeroed_page_pool_runs_low()
+{
+    // Check and go to sleep with interrupts disabled, so a wakeup can't slip in between.
+    InterruptDisabler disabler;
+    if (m_zeroed_user_pages.size() < zeroed_page_pool_low_water_mark)
+        return;
+    Thread::current->wait_on(m_zeroed_page_pool_wait_queue);
+}
+
+MemoryManager::MemoryPressure MemoryManager::memory_pressure() const
+{
+    auto free_pages = free_user_physical_pages();
+    if (free_pages < critical_water_mark())
+        return MemoryPressure::Critical;
+    if (free_pages < low_water_mark())
+        return MemoryPressure::Low;
+    return MemoryPressure::None;
+}
+
+void MemoryManager::wait_until_memory_pressure_needs_attention()
+{
+    // Check and go to sleep with interrupts disabled, so a wakeup can't slip in between.
+    InterruptDisabler disabler;
+    if (free_user_physical_pages() < low_water_mark())
+        return;
+    if (m_reported_memory_pressure != MemoryPressure::None && free_user_physical_pages() >= high_water_mark())
+        return;
+    Thread::current->wait_on(m_memory_pressure_wait_queue);
+}
+
+int MemoryManager::purge_volatile_vmobjects(int page_count)
+{
+    InterruptDisabler disabler;
+    int purged_page_count = 0;
+    for_each_vmobject([&](auto& vmobject) {
+        if (!vmobject.is_purgeable())
+            return IterationDecision::Continue;
+        purged_page_count += static_cast<PurgeableVMObject&>(vmobject).purge_with_interrupts_disabled({});
+        if (purged_page_count >= page_count)
+            return IterationDecision::Break;
+        return IterationDecision::Continue;
+    });
+    return purged_page_count;
+}
+
+int MemoryManager::reclaim_clean_inode_pages(int page_count)
+{
+    int reclaimed_page_count = 0;
+    size_t remaining_vmobjects;
+    {
+        InterruptDisabler disabler;
+        remaining_vmobjects = m_vmobjects.size_slow();
+    }
+    for (; remaining_vmobjects && reclaimed_page_count < page_count; --remaining_vmobjects) {
+        // Interrupts are only disabled for one VMObject at a time, the list may change in between.
+        InterruptDisabler disabler;
+        auto* vmobject = m_vmobjects.remove_head();
+        if (!vmobject)
+            break;
+        // Move scanned objects to the back, so the next scan continues where this one left off.
+        m_vmobjects.append(vmobject);
+        if (vmobject->is_inode())
+            reclaimed_page_count += static_cast<InodeVMObject&>(*vmobject).reclaim_inactive_clean_pages({}, page_count - reclaimed_page_count);
+    }
+    return reclaimed_page_count;
+}
+
+int MemoryManager::reclaim_user_physical_pages()
+{
+    auto free_pages = free_user_physical_pages();
+    if (free_pages >= high_water_mark())
+        return 0;
+    int page_count = high_water_mark() - free_pages;
+
+    // Volatile memory goes first, its owners have promised that they can recreate it.
+    int reclaimed_page_count = purge_volatile_vmobjects(page_count);
+    if (reclaimed_page_count < page_count)
+        reclaimed_page_count += reclaim_clean_inode_pages(page_count - reclaimed_page_count);
+#ifdef MM_DEBUG
+    dbg() << "MM: Reclaimed " << reclaimed_page_count << " of " << page_count << " wanted pages";
+#endif
+    return reclaimed_page_count;
+}
+
+bool MemoryManager::update_reported_memory_pressure()
+{
+    InterruptDisabler disabler;
+    auto pressure = memory_pressure();
+    // Don't flip back and forth around the low water mark, only call it over once we're above the high one.
+    if (pressure == MemoryPressure::None && m_reported_memory_pressure != MemoryPressure::None && free_user_physical_pages() < high_water_mark())
+        pressure = MemoryPressure::Low;
+    if (pressure == m_reported_memory_pressure)
+        return false;
+    m_reported_memory_pressure = pressure;
+    ++m_memory_pressure_event_count;
+    klog() << "MM: Memory pressure is now " << (pressure == MemoryPressure::None ? "none" : pressure == MemoryPressure::Low ? "low" : "critical") << ", " << free_user_physical_pages() << " pages free";
+    return true;
+}
+
 void MemoryManager::enter_process_paging_scope(Process& process)
 {
     ASSERT(Thread::current);
@@ -699,7 +864,7 @@ void MemoryManager::register_region(Region& region)
 {
     InterruptDisabler disabler;
     if (region.vaddr().get() >= 0xc0000000)
-        m_kernel_regions.append(&region);
+        m_kernel_regions.insert(first_kernel_region_index_above(region.vaddr()), &region);
     else
         m_user_regions.append(&region);
 }
@@ -707,9 +872,14 @@ void MemoryManager::register_region(Region& region)
 void MemoryManager::unregister_region(Region& region)
 {
     InterruptDisabler disabler;
-    if (region.vaddr().get() >= 0xc0000000)
-        m_kernel_regions.remove(&region);
-    else
+    if (region.vaddr().get() >= 0xc0000000) {
+        for (size_t i = first_kernel_region_index_above(region.vaddr()); i > 0 && m_kernel_regions[i - 1]->vaddr() == region.vaddr(); --i) {
+            if (m_kernel_regions[i - 1] == &region) {
+                m_kernel_regions.remove(i - 1);
+                break;
+            }
+        }
+    } else
         m_user_regions.remove(&region);
 }
 
@@ -717,7 +887,8 @@ void MemoryManager::dump_kernel_regions()
 {
     klog() << "Kernel regions:";
     klog() << "BEGIN       END         SIZE        ACCESS  NAME";
-    for (auto& region : MM.m_kernel_regions) {
+    for (auto* region_ptr : MM.m_kernel_regions) {
+        auto& region = *region_ptr;
         klog() << String::format("%08x", region.vaddr().get()) << " -- " << String::format("%08x", region.vaddr().offset(region.size() - 1).get()) << "    " << String::format("%08x", region.size()) << "    " << (region.is_readable() ? 'R' : ' ') << (region.is_writable() ? 'W' : ' ') << (region.is_executable() ? 'X' : ' ') << (region.is_shared() ? 'S' : ' ') << (region.is_stack() ? 'T' : ' ') << (region.vmobject().is_purgeable() ? 'P' : ' ') << "    " << region.name().characters();
     }
 }
@@ -34,6 +34,7 @@
 #include <Kernel/VM/PhysicalPage.h>
 #include <Kernel/VM/Region.h>
 #include <Kernel/VM/VMObject.h>
+#include <Kernel/WaitQueue.h>
 
 namespace Kernel {
 
@@ -68,6 +69,7 @@ class SynthFSInode;
 
 class MemoryManager {
     AK_MAKE_ETERNAL
+    friend class InodeVMObject;
     friend class PageDirectory;
     friend class PhysicalPage;
     friend class PhysicalRegion;
@@ -78,6 +80,7 @@ class MemoryManager {
 
 public:
     static MemoryManager& the();
+    static bool is_initialized();
 
     static void initialize();
 
@@ -115,6 +118,27 @@ public:
     unsigned user_physical_pages_used() const { return m_user_physical_pages_used; }
     unsigned super_physical_pages() const { return m_super_physical_pages; }
     unsigned super_physical_pages_used() const { return m_super_physical_pages_used; }
+    unsigned zeroed_user_physical_pages() const { return m_zeroed_user_pages.size(); }
+
+    // Used by PageZeroingTask to keep a stock of zeroed pages for zero-fill faults.
+    void refill_zeroed_page_pool();
+    void wait_until_zeroed_page_pool_runs_low();
+
+    enum class MemoryPressure {
+        None,
+        Low,
+        Critical,
+    };
+
+    unsigned free_user_physical_pages() const { return m_user_physical_pages - m_user_physical_pages_used; }
+    MemoryPressure memory_pressure() const;
+    MemoryPressure reported_memory_pressure() const { return m_reported_memory_pressure; }
+    u32 memory_pressure_event_count() const { return m_memory_pressure_event_count; }
+
+    // Used by PageReclaimTask to free up memory before we actually run out.
+    void wait_until_memory_pressure_needs_attention();
+    int reclaim_user_physical_pages();
+    bool update_reported_memory_pressure();
 
     template<typename Callback>
     static void for_each_vmobject(Callback callback)
@@ -157,10 +181,17 @@ private:
 
     static Region* user_region_from_vaddr(Process&, VirtualAddress);
     static Region* kernel_region_from_vaddr(VirtualAddress);
+    size_t first_kernel_region_index_above(VirtualAddress) const;
 
     static Region* region_from_vaddr(VirtualAddress);
 
     RefPtr<PhysicalPage> find_free_user_physical_page();
+    int purge_volatile_vmobjects(int page_count);
+    int reclaim_clean_inode_pages(int page_count);
+
+    unsigned critical_water_mark() const { return m_user_physical_pages / 64; }
+    unsigned low_water_mark() const { return m_user_physical_pages / 16; }
+    unsigned high_water_mark() const { return m_user_physical_pages / 8; }
     u8* quickmap_page(PhysicalPage&);
     void unquickmap_page();
 
@@ -170,6 +201,7 @@ private:
     PageDirectory& kernel_page_directory() { return *m_kernel_page_directory; }
 
     const PageTableEntry* pte(const PageDirectory&, VirtualAddress);
+    PageTableEntry* pte(PageDirectory& page_directory, VirtualAddress vaddr) { return const_cast<PageTableEntry*>(pte(const_cast<const PageDirectory&>(page_directory), vaddr)); }
     PageTableEntry& ensure_pte(PageDirectory&, VirtualAddress);
 
     RefPtr<PageDirectory> m_kernel_page_directory;
@@ -177,6 +209,15 @@ private:
 
     RefPtr<PhysicalPage> m_shared_zero_page;
 
+    // FIXME: Give each CPU a small cache of free and zeroed pages in front of these, so allocations on different
+    //        CPUs don't all serialize here. That requires per-CPU data, which we'll only have with SMP support.
+    NonnullRefPtrVector<PhysicalPage> m_zeroed_user_pages;
+    WaitQueue m_zeroed_page_pool_wait_queue;
+
+    WaitQueue m_memory_pressure_wait_queue;
+    MemoryPressure m_reported_memory_pressure { MemoryPressure::None };
+    u32 m_memory_pressure_event_count { 1 };
+
     unsigned m_user_physical_pages { 0 };
     unsigned m_user_physical_pages_used { 0 };
     unsigned m_super_physical_pages { 0 };
@@ -186,7 +227,8 @@ private:
     NonnullRefPtrVector<PhysicalRegion> m_super_physical_regions;
 
     InlineLinkedList<Region> m_user_regions;
-    InlineLinkedList<Region> m_kernel_regions;
+    // Sorted by base address, so that lookups can binary search.
+    Vector<Region*> m_kernel_regions;
 
     InlineLinkedList<VMObject> m_vmobjects;
 
@@ -202,9 +244,9 @@ void VMObject::for_each_region(Callback callback)
         if (&region.vmobject() == this)
             callback(region);
     }
-    for (auto& region : MM.m_kernel_regions) {
-        if (&region.vmobject() == this)
-            callback(region);
+    for (auto* region : MM.m_kernel_regions) {
+        if (&region->vmobject() == this)
+            callback(*region);
     }
 }
 
@@ -28,7 +28,6 @@
 
 #include <AK/NonnullRefPtr.h>
 #include <Kernel/Assertions.h>
-#include <Kernel/Heap/SlabAllocator.h>
 #include <LibBareMetal/Memory/PhysicalAddress.h>
 
 namespace Kernel {
@@ -38,7 +37,6 @@ class PhysicalPage {
     friend class PageDirectory;
     friend class VMObject;
 
-    MAKE_SLAB_ALLOCATED(PhysicalPage)
 public:
     PhysicalAddress paddr() const { return m_paddr; }
 
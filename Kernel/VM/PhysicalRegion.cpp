@@ -92,21 +92,31 @@ unsigned PhysicalRegion::find_contiguous_free_pages(size_t count)
 Optional<unsigned> PhysicalRegion::find_and_allocate_contiguous_range(size_t count)
 {
     ASSERT(count != 0);
-    size_t found_pages_count = 0;
-    auto first_index = m_bitmap.find_longest_range_of_unset_bits(count, found_pages_count);
+    if (count == 1)
+        return find_and_allocate_one_page();
+
+    auto first_index = m_bitmap.find_first_fit(count);
     if (!first_index.has_value())
         return {};
 
     auto page = first_index.value();
-    if (count == found_pages_count) {
-        for (unsigned page_index = page; page_index < (page + count); page_index++) {
-            m_bitmap.set(page_index, true);
-        }
-        m_used += count;
-        m_last = page + count;
-        return page;
-    }
-    return {};
+    m_bitmap.set_range(page, count, true);
+    m_used += count;
+    return page;
+}
+
+Optional<unsigned> PhysicalRegion::find_and_allocate_one_page()
+{
+    // m_last is never above the lowest free page, so there's no point in looking at anything below it.
+    size_t page = m_last;
+    auto found = m_bitmap.find_next_range_of_unset_bits(page, 1, 1);
+    if (!found.has_value())
+        return {};
+
+    m_bitmap.set(page, true);
+    ++m_used;
+    m_last = page + 1;
+    return page;
 }
 
 RefPtr<PhysicalPage> PhysicalRegion::take_free_page(bool supervisor)
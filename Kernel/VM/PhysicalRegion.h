@@ -59,6 +59,7 @@ public:
 private:
     unsigned find_contiguous_free_pages(size_t count);
     Optional<unsigned> find_and_allocate_contiguous_range(size_t count);
+    Optional<unsigned> find_and_allocate_one_page();
 
     PhysicalRegion(PhysicalAddress lower, PhysicalAddress upper);
 
@@ -140,10 +140,21 @@ Range RangeAllocator::allocate_specific(VirtualAddress base, size_t size)
         return {};
 
     Range allocated_range(base, size);
-    for (size_t i = 0; i < m_available_ranges.size(); ++i) {
+
+    // The available ranges are sorted and don't overlap, so the only candidate is the last one starting at or below base.
+    size_t low = 0;
+    size_t high = m_available_ranges.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (m_available_ranges[middle].base() <= base)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low > 0 && m_available_ranges[low - 1].contains(base, size)) {
+        size_t i = low - 1;
         auto& available_range = m_available_ranges[i];
-        if (!available_range.contains(base, size))
-            continue;
         if (available_range == allocated_range) {
             m_available_ranges.remove(i);
             return allocated_range;
@@ -40,6 +40,8 @@
 
 namespace Kernel {
 
+static const size_t fault_around_page_count = 16;
+
 Region::Region(const Range& range, NonnullRefPtr<VMObject> vmobject, size_t offset_in_vmobject, const String& name, u8 access, bool cacheable)
     : m_range(range)
     , m_offset_in_vmobject(offset_in_vmobject)
@@ -214,9 +216,15 @@ void Region::map_individual_page_impl(size_t page_index)
 {
     auto page_vaddr = vaddr().offset(page_index * PAGE_SIZE);
     auto& pte = MM.ensure_pte(*m_page_directory, page_vaddr);
+    // The VMObject may have shrunk underneath us (e.g. a mapped inode being truncated.)
+    if (first_page_index() + page_index >= vmobject().page_count()) {
+        pte.clear();
+        MM.flush_tlb(page_vaddr);
+        return;
+    }
     auto& physical_page = vmobject().physical_pages()[first_page_index() + page_index];
     if (!physical_page || (!is_readable() && !is_writable())) {
-        pte.clear();
+        clear_pte(page_index, pte);
     } else {
         pte.set_cache_disabled(!m_cacheable);
         pte.set_physical_page_base(physical_page->paddr().get());
@@ -235,6 +243,15 @@ void Region::map_individual_page_impl(size_t page_index)
     MM.flush_tlb(page_vaddr);
 }
 
+void Region::clear_pte(size_t page_index, PageTableEntry& pte)
+{
+    // The D bit is the only record of a write through this mapping, so hand it to the VMObject before it's
+    // gone. Otherwise reclaim would take the page for clean and read it back from the inode later.
+    if (pte.is_present() && pte.is_dirty() && vmobject().is_inode())
+        static_cast<InodeVMObject&>(vmobject()).set_page_dirty({}, first_page_index() + page_index);
+    pte.clear();
+}
+
 void Region::remap_page(size_t page_index)
 {
     ASSERT(m_page_directory);
@@ -243,6 +260,43 @@ void Region::remap_page(size_t page_index)
     map_individual_page_impl(page_index);
 }
 
+void Region::unmap_page(size_t page_index)
+{
+    if (!m_page_directory)
+        return;
+    InterruptDisabler disabler;
+    auto page_vaddr = vaddr().offset(page_index * PAGE_SIZE);
+    // Don't use ensure_pte() here, we may be freeing memory because there is none left for a page table.
+    auto* pte = MM.pte(*m_page_directory, page_vaddr);
+    if (!pte)
+        return;
+    clear_pte(page_index, *pte);
+    MM.flush_tlb(page_vaddr);
+}
+
+bool Region::test_and_clear_page_accessed(size_t page_index)
+{
+    if (!m_page_directory)
+        return false;
+    InterruptDisabler disabler;
+    auto page_vaddr = vaddr().offset(page_index * PAGE_SIZE);
+    auto* pte = MM.pte(*m_page_directory, page_vaddr);
+    if (!pte || !pte->is_present() || !pte->is_accessed())
+        return false;
+    pte->set_accessed(false);
+    MM.flush_tlb(page_vaddr);
+    return true;
+}
+
+bool Region::is_page_dirty(size_t page_index) const
+{
+    if (!m_page_directory)
+        return false;
+    InterruptDisabler disabler;
+    auto* pte = MM.pte(*m_page_directory, vaddr().offset(page_index * PAGE_SIZE));
+    return pte && pte->is_present() && pte->is_dirty();
+}
+
 void Region::unmap(ShouldDeallocateVirtualMemoryRange deallocate_range)
 {
     InterruptDisabler disabler;
@@ -250,7 +304,7 @@ void Region::unmap(ShouldDeallocateVirtualMemoryRange deallocate_range)
     for (size_t i = 0; i < page_count(); ++i) {
         auto vaddr = this->vaddr().offset(i * PAGE_SIZE);
         auto& pte = MM.ensure_pte(*m_page_directory, vaddr);
-        pte.clear();
+        clear_pte(i, pte);
         MM.flush_tlb(vaddr);
 #ifdef MM_DEBUG
         auto& physical_page = vmobject().physical_pages()[first_page_index() + i];
@@ -416,13 +470,38 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
     cli();
 
     auto& inode_vmobject = static_cast<InodeVMObject&>(vmobject());
-    auto& vmobject_physical_page_entry = inode_vmobject.physical_pages()[first_page_index() + page_index_in_region];
+    auto& physical_pages = inode_vmobject.physical_pages();
 
 #ifdef PAGE_FAULT_DEBUG
     dbg() << "Inode fault in " << name() << " page index: " << page_index_in_region;
 #endif
 
-    if (!vmobject_physical_page_entry.is_null()) {
+    // Fault-around: look at an aligned window of neighboring pages, map the ones
+    // that are already resident, and page in the ones that aren't together with
+    // the faulting page.
+    if (first_page_index() + page_index_in_region >= inode_vmobject.page_count()) {
+        dbg() << "MM: handle_inode_fault at page " << page_index_in_region << " beyond the end of the inode";
+        return PageFaultResponse::ShouldCrash;
+    }
+    size_t window_start = page_index_in_region & ~(fault_around_page_count - 1);
+    size_t window_end = min(window_start + fault_around_page_count, page_count());
+    window_end = min(window_end, inode_vmobject.page_count() - first_page_index());
+
+    auto is_resident = [&](size_t page_index) {
+        return !physical_pages[first_page_index() + page_index].is_null();
+    };
+
+    for (size_t i = window_start; i < window_end; ++i) {
+        if (i == page_index_in_region || !is_resident(i))
+            continue;
+        auto& pte = MM.ensure_pte(*m_page_directory, vaddr().offset(i * PAGE_SIZE));
+        if (!pte.is_present())
+            map_individual_page_impl(i);
+    }
+
+    inode_vmobject.did_access_pages(first_page_index() + window_start, first_page_index() + window_end);
+
+    if (is_resident(page_index_in_region)) {
 #ifdef PAGE_FAULT_DEBUG
         dbg() << ("MM: page_in_from_inode() but page already present. Fine with me!");
 #endif
@@ -430,36 +509,37 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
         return PageFaultResponse::Continue;
     }
 
-    if (Thread::current)
+    if (Thread::current) {
         Thread::current->did_inode_fault();
+        Thread::current->process().did_inode_fault();
+    }
 
-#ifdef MM_DEBUG
-    dbg() << "MM: page_in_from_inode ready to read from inode";
-#endif
-    sti();
-    u8 page_buffer[PAGE_SIZE];
-    auto& inode = inode_vmobject.inode();
-    auto nread = inode.read_bytes((first_page_index() + page_index_in_region) * PAGE_SIZE, PAGE_SIZE, page_buffer, nullptr);
-    if (nread < 0) {
-        klog() << "MM: handle_inode_fault had error (" << nread << ") while reading!";
+    // Page in the run of non-resident pages around the faulting page with a single read.
+    size_t cluster_start = page_index_in_region;
+    while (cluster_start > window_start && !is_resident(cluster_start - 1))
+        --cluster_start;
+    size_t cluster_end = page_index_in_region + 1;
+    while (cluster_end < window_end && !is_resident(cluster_end))
+        ++cluster_end;
+    if (!inode_vmobject.page_in(first_page_index() + cluster_start, cluster_end - cluster_start))
+        return PageFaultResponse::ShouldCrash;
+
+    // The inode may have shrunk while we were reading.
+    if (first_page_index() + page_index_in_region >= inode_vmobject.page_count()) {
+        dbg() << "MM: handle_inode_fault at page " << page_index_in_region << " beyond the end of the inode";
         return PageFaultResponse::ShouldCrash;
     }
-    if (nread < PAGE_SIZE) {
-        // If we read less than a page, zero out the rest to avoid leaking uninitialized data.
-        memset(page_buffer + nread, 0, PAGE_SIZE - nread);
-    }
-    cli();
-    vmobject_physical_page_entry = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
-    if (vmobject_physical_page_entry.is_null()) {
+    if (!is_resident(page_index_in_region)) {
         klog() << "MM: handle_inode_fault was unable to allocate a physical page";
         return PageFaultResponse::ShouldCrash;
     }
+    cluster_end = min(cluster_end, inode_vmobject.page_count() - first_page_index());
 
-    u8* dest_ptr = MM.quickmap_page(*vmobject_physical_page_entry);
-    memcpy(dest_ptr, page_buffer, PAGE_SIZE);
-    MM.unquickmap_page();
+    for (size_t i = cluster_start; i < cluster_end; ++i) {
+        if (is_resident(i))
+            remap_page(i);
+    }
 
-    remap_page(page_index_in_region);
     return PageFaultResponse::Continue;
 }
 
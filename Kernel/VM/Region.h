@@ -27,14 +27,15 @@
 #pragma once
 
 #include <AK/InlineLinkedList.h>
+#include <AK/OwnPtr.h>
 #include <AK/String.h>
 #include <AK/Weakable.h>
-#include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/VM/RangeAllocator.h>
 
 namespace Kernel {
 
 class Inode;
+class PageTableEntry;
 class VMObject;
 
 enum class PageFaultResponse {
@@ -47,7 +48,6 @@ class Region final
     , public Weakable<Region> {
     friend class MemoryManager;
 
-    MAKE_SLAB_ALLOCATED(Region)
 public:
     enum Access {
         Read = 1,
@@ -152,6 +152,11 @@ public:
 
     void remap();
     void remap_page(size_t index);
+    void unmap_page(size_t index);
+
+    // The CPU sets the accessed and dirty bits in a page's table entry whenever it's used through this region.
+    bool test_and_clear_page_accessed(size_t index);
+    bool is_page_dirty(size_t index) const;
 
     // For InlineLinkedListNode
     Region* m_next { nullptr };
@@ -176,6 +181,7 @@ private:
     PageFaultResponse handle_zero_fault(size_t page_index);
 
     void map_individual_page_impl(size_t page_index);
+    void clear_pte(size_t page_index, PageTableEntry&);
 
     RefPtr<PageDirectory> m_page_directory;
     Range m_range;
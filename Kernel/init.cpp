@@ -40,6 +40,7 @@
 #include <Kernel/Devices/KeyboardDevice.h>
 #include <Kernel/Devices/MBRPartitionTable.h>
 #include <Kernel/Devices/MBVGADevice.h>
+#include <Kernel/Devices/MemoryPressureDevice.h>
 #include <Kernel/Devices/NullDevice.h>
 #include <Kernel/Devices/PATAChannel.h>
 #include <Kernel/Devices/PATADiskDevice.h>
@@ -69,6 +70,9 @@
 #include <Kernel/TTY/PTYMultiplexer.h>
 #include <Kernel/TTY/VirtualConsole.h>
 #include <Kernel/Tasks/FinalizerTask.h>
+#include <Kernel/Tasks/PageReclaimTask.h>
+#include <Kernel/Tasks/PageZeroingTask.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
 #include <Kernel/Tasks/SyncTask.h>
 #include <Kernel/Time/TimeManagement.h>
 #include <Kernel/VM/MemoryManager.h>
@@ -134,6 +138,7 @@ extern "C" [[noreturn]] void init()
     TimeManagement::initialize();
 
     new NullDevice;
+    new MemoryPressureDevice;
     if (!get_serial_debug())
         new SerialDevice(SERIAL_COM1_ADDR, 64);
     new SerialDevice(SERIAL_COM2_ADDR, 65);
@@ -163,6 +168,9 @@ void init_stage2()
 {
     SyncTask::spawn();
     FinalizerTask::spawn();
+    PageZeroingTask::spawn();
+    PageReclaimTask::spawn();
+    ReadaheadTask::spawn();
 
     PCI::initialize();
 
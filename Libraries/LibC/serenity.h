@@ -55,8 +55,15 @@ int set_process_boost(pid_t, int amount);
 
 #define FUTEX_WAIT 1
 #define FUTEX_WAKE 2
+#define FUTEX_REQUEUE 3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
 
-int futex(int32_t* userspace_address, int futex_op, int32_t value, const struct timespec* timeout);
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+// For FUTEX_REQUEUE and FUTEX_CMP_REQUEUE, the maximum number of waiters to requeue is passed in place of the timeout.
+int futex(int32_t* userspace_address, int futex_op, int32_t value, const struct timespec* timeout, int32_t* userspace_address2, int32_t value3);
 
 #define PURGE_ALL_VOLATILE 0x1
 #define PURGE_ALL_CLEAN_INODE 0x2
@@ -90,7 +90,7 @@ typedef struct __pthread_mutexattr_t {
 
 typedef struct __pthread_cond_t {
     int32_t value;
-    uint32_t previous;
+    pthread_mutex_t* mutex;
     int clockid; // clockid_t
 } pthread_cond_t;
 
@@ -565,9 +565,14 @@ void sysbeep()
 
 int fsync(int fd)
 {
-    UNUSED_PARAM(fd);
-    dbgprintf("FIXME: Implement fsync()\n");
-    return 0;
+    int rc = syscall(SC_fsync, fd);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int fdatasync(int fd)
+{
+    int rc = syscall(SC_fdatasync, fd);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
 }
 
 int halt()
@@ -582,7 +587,7 @@ int reboot()
     __RETURN_WITH_ERRNO(rc, rc, -1);
 }
 
-int mount(int source_fd, const char* target, const char* fs_type, int flags)
+int mount(int source_fd, const char* target, const char* fs_type, int flags, const char* data)
 {
     if (!target || !fs_type) {
         errno = EFAULT;
@@ -593,7 +598,8 @@ int mount(int source_fd, const char* target, const char* fs_type, int flags)
         source_fd,
         { target, strlen(target) },
         { fs_type, strlen(fs_type) },
-        flags
+        flags,
+        { data, data ? strlen(data) : 0 }
     };
     int rc = syscall(SC_mount, &params);
     __RETURN_WITH_ERRNO(rc, rc, -1);
@@ -57,6 +57,7 @@ extern char** environ;
 int get_process_name(char* buffer, int buffer_size);
 void dump_backtrace();
 int fsync(int fd);
+int fdatasync(int fd);
 void sysbeep();
 int gettid();
 int donate(int tid);
@@ -129,7 +130,7 @@ int fchown(int fd, uid_t, gid_t);
 int ftruncate(int fd, off_t length);
 int halt();
 int reboot();
-int mount(int source_fd, const char* target, const char* fs_type, int flags);
+int mount(int source_fd, const char* target, const char* fs_type, int flags, const char* data);
 int umount(const char* mountpoint);
 int pledge(const char* promises, const char* execpromises);
 int unveil(const char* path, const char* permissions);
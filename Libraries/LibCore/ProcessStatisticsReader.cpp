@@ -184,6 +184,7 @@ HashMap<pid_t, Core::ProcessStatistics> ProcessStatisticsReader::get_all()
         process.amount_purgeable_volatile = process_object.get("amount_purgeable_volatile").to_u32();
         process.amount_purgeable_nonvolatile = process_object.get("amount_purgeable_nonvolatile").to_u32();
         process.icon_id = process_object.get("icon_id").to_int();
+        process.inode_faults = process_object.get("inode_faults").to_u32();
 
         auto& thread_array = process_object.get_ptr("threads")->as_array();
         process.threads.ensure_capacity(thread_array.size());
@@ -75,6 +75,7 @@ struct ProcessStatistics {
     size_t amount_purgeable_volatile;
     size_t amount_purgeable_nonvolatile;
     int icon_id;
+    unsigned inode_faults;
 
     Vector<Core::ThreadStatistics> threads;
 
@@ -27,7 +27,9 @@
 #include <AK/Assertions.h>
 #include <AK/Atomic.h>
 #include <AK/StdLibExtras.h>
+#include <AK/Time.h>
 #include <Kernel/Syscall.h>
+#include <errno.h>
 #include <limits.h>
 #include <pthread.h>
 #include <serenity.h>
@@ -139,31 +141,46 @@ int pthread_mutex_destroy(pthread_mutex_t*)
     return 0;
 }
 
+// The mutex lock word is 0 when unlocked, 1 when locked, and 2 when locked with
+// (possibly) someone sleeping on it, so an uncontended unlock doesn't need a syscall.
+enum MutexState : u32 {
+    Unlocked = 0,
+    Locked = 1,
+    LockedWithWaiters = 2,
+};
+
+static void mutex_lock_contended(pthread_mutex_t* mutex)
+{
+    auto& atomic = reinterpret_cast<Atomic<u32>&>(mutex->lock);
+    while (atomic.exchange(LockedWithWaiters, AK::memory_order_acquire) != Unlocked)
+        futex(reinterpret_cast<int32_t*>(&mutex->lock), FUTEX_WAIT, LockedWithWaiters, nullptr, nullptr, 0);
+    mutex->owner = pthread_self();
+    mutex->level = 0;
+}
+
 int pthread_mutex_lock(pthread_mutex_t* mutex)
 {
     auto& atomic = reinterpret_cast<Atomic<u32>&>(mutex->lock);
     pthread_t this_thread = pthread_self();
-    for (;;) {
-        u32 expected = false;
-        if (!atomic.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
-            if (mutex->type == PTHREAD_MUTEX_RECURSIVE && mutex->owner == this_thread) {
-                mutex->level++;
-                return 0;
-            }
-            sched_yield();
-            continue;
+    u32 expected = Unlocked;
+    if (!atomic.compare_exchange_strong(expected, Locked, AK::memory_order_acq_rel)) {
+        if (mutex->type == PTHREAD_MUTEX_RECURSIVE && mutex->owner == this_thread) {
+            mutex->level++;
+            return 0;
         }
-        mutex->owner = this_thread;
-        mutex->level = 0;
+        mutex_lock_contended(mutex);
         return 0;
     }
+    mutex->owner = this_thread;
+    mutex->level = 0;
+    return 0;
 }
 
 int pthread_mutex_trylock(pthread_mutex_t* mutex)
 {
     auto& atomic = reinterpret_cast<Atomic<u32>&>(mutex->lock);
-    u32 expected = false;
-    if (!atomic.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
+    u32 expected = Unlocked;
+    if (!atomic.compare_exchange_strong(expected, Locked, AK::memory_order_acq_rel)) {
         if (mutex->type == PTHREAD_MUTEX_RECURSIVE && mutex->owner == pthread_self()) {
             mutex->level++;
             return 0;
@@ -182,7 +199,9 @@ int pthread_mutex_unlock(pthread_mutex_t* mutex)
         return 0;
     }
     mutex->owner = 0;
-    mutex->lock = 0;
+    auto& atomic = reinterpret_cast<Atomic<u32>&>(mutex->lock);
+    if (atomic.exchange(Unlocked, AK::memory_order_release) == LockedWithWaiters)
+        futex(reinterpret_cast<int32_t*>(&mutex->lock), FUTEX_WAKE, 1, nullptr, nullptr, 0);
     return 0;
 }
 
@@ -447,7 +466,7 @@ int pthread_setschedparam(pthread_t thread, int policy, const struct sched_param
 int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr)
 {
     cond->value = 0;
-    cond->previous = 0;
+    cond->mutex = nullptr;
     cond->clockid = attr ? attr->clockid : CLOCK_MONOTONIC;
     return 0;
 }
@@ -459,13 +478,7 @@ int pthread_cond_destroy(pthread_cond_t*)
 
 int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
 {
-    i32 value = cond->value;
-    cond->previous = value;
-    pthread_mutex_unlock(mutex);
-    int rc = futex(&cond->value, FUTEX_WAIT, value, nullptr);
-    ASSERT(rc == 0);
-    pthread_mutex_lock(mutex);
-    return 0;
+    return pthread_cond_timedwait(cond, mutex, nullptr);
 }
 
 int pthread_condattr_init(pthread_condattr_t* attr)
@@ -487,27 +500,63 @@ int pthread_condattr_setclock(pthread_condattr_t* attr, clockid_t clock)
 
 int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime)
 {
-    // FIXME: Implement timeout.
-    (void)abstime;
-    pthread_cond_wait(cond, mutex);
-    return 0;
+    // cond->value is bumped by every signal, so a signal that comes in after we
+    // let go of the mutex but before we're asleep makes the futex wait return right away.
+    auto& value = reinterpret_cast<Atomic<i32>&>(cond->value);
+    i32 seen_value = value.load(AK::memory_order_acquire);
+    cond->mutex = mutex;
+    pthread_mutex_unlock(mutex);
+
+    int rc;
+    if (!abstime || cond->clockid == CLOCK_MONOTONIC) {
+        rc = futex(&cond->value, FUTEX_WAIT_BITSET, seen_value, abstime, nullptr, FUTEX_BITSET_MATCH_ANY);
+    } else {
+        // FUTEX_WAIT_BITSET only knows about CLOCK_MONOTONIC, so other clocks get a relative timeout.
+        timespec now;
+        clock_gettime(cond->clockid, &now);
+        timespec relative_timeout;
+        timespec_sub(*abstime, now, relative_timeout);
+        if (relative_timeout.tv_sec < 0) {
+            rc = -1;
+            errno = ETIMEDOUT;
+        } else {
+            rc = futex(&cond->value, FUTEX_WAIT, seen_value, &relative_timeout, nullptr, 0);
+        }
+    }
+    bool timed_out = rc < 0 && errno == ETIMEDOUT;
+
+    // A broadcast may have moved us over to the mutex's futex, in which case there may be others
+    // asleep on it, so we have to take it in the contended state to make sure they get woken up.
+    if (mutex->type == PTHREAD_MUTEX_RECURSIVE)
+        pthread_mutex_lock(mutex);
+    else
+        mutex_lock_contended(mutex);
+    return timed_out ? ETIMEDOUT : 0;
 }
 
 int pthread_cond_signal(pthread_cond_t* cond)
 {
-    u32 value = cond->previous + 1;
-    cond->value = value;
-    int rc = futex(&cond->value, FUTEX_WAKE, 1, nullptr);
-    ASSERT(rc == 0);
+    auto& value = reinterpret_cast<Atomic<i32>&>(cond->value);
+    value.fetch_add(1, AK::memory_order_release);
+    futex(&cond->value, FUTEX_WAKE, 1, nullptr, nullptr, 0);
     return 0;
 }
 
 int pthread_cond_broadcast(pthread_cond_t* cond)
 {
-    u32 value = cond->previous + 1;
-    cond->value = value;
-    int rc = futex(&cond->value, FUTEX_WAKE, INT32_MAX, nullptr);
-    ASSERT(rc == 0);
+    auto& value = reinterpret_cast<Atomic<i32>&>(cond->value);
+    i32 new_value = value.fetch_add(1, AK::memory_order_release) + 1;
+
+    // Only one waiter could get the mutex anyway, so wake that one and move the rest
+    // straight onto the mutex, where they'll be woken one by one as it's unlocked.
+    auto* mutex = cond->mutex;
+    if (mutex && mutex->type != PTHREAD_MUTEX_RECURSIVE) {
+        auto* requeue_count = reinterpret_cast<const struct timespec*>((uintptr_t)INT32_MAX);
+        if (futex(&cond->value, FUTEX_CMP_REQUEUE, 1, requeue_count, reinterpret_cast<int32_t*>(&mutex->lock), new_value) >= 0)
+            return 0;
+        // Someone signalled in the meantime; fall back to waking everybody.
+    }
+    futex(&cond->value, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
     return 0;
 }
 
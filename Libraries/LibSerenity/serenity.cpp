@@ -79,9 +79,15 @@ int set_process_boost(int tid, int amount)
     __RETURN_WITH_ERRNO(rc, rc, -1);
 }
 
-int futex(int32_t* userspace_address, int futex_op, int32_t value, const struct timespec* timeout)
-{
-    Syscall::SC_futex_params params { userspace_address, futex_op, value, timeout };
+int futex(int32_t* userspace_address, int futex_op, int32_t value, const struct timespec* timeout, int32_t* userspace_address2, int32_t value3)
+{
+    Syscall::SC_futex_params params;
+    params.userspace_address = userspace_address;
+    params.futex_op = futex_op;
+    params.val = value;
+    params.timeout = timeout;
+    params.userspace_address2 = userspace_address2;
+    params.val3 = value3;
     int rc = syscall(SC_futex, &params);
     __RETURN_WITH_ERRNO(rc, rc, -1);
 }
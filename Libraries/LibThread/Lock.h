@@ -29,6 +29,7 @@
 #include <AK/Assertions.h>
 #include <AK/Types.h>
 #include <AK/Atomic.h>
+#include <serenity.h>
 #include <unistd.h>
 
 namespace LibThread {
@@ -42,9 +43,10 @@ public:
     void unlock();
 
 private:
-    AK::Atomic<bool> m_lock { false };
+    // 0 when unlocked, 1 when locked, 2 when locked with (possibly) someone sleeping on it.
+    AK::Atomic<u32> m_lock { 0 };
     u32 m_level { 0 };
-    int m_holder { -1 };
+    AK::Atomic<int> m_holder { -1 };
 };
 
 #ifdef __serenity__
@@ -67,39 +69,32 @@ private:
 [[gnu::always_inline]] inline void Lock::lock()
 {
     int tid = gettid();
-    for (;;) {
-        bool expected = false;
-        if (m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
-            if (m_holder == -1 || m_holder == tid) {
-                m_holder = tid;
-                ++m_level;
-                m_lock.store(false, AK::memory_order_release);
-                return;
-            }
-            m_lock.store(false, AK::memory_order_release);
+    if (m_holder.load(AK::memory_order_relaxed) == tid) {
+        ++m_level;
+        return;
+    }
+    u32 expected = 0;
+    if (!m_lock.compare_exchange_strong(expected, 1, AK::memory_order_acq_rel)) {
+        if (expected != 2)
+            expected = m_lock.exchange(2, AK::memory_order_acquire);
+        while (expected != 0) {
+            futex(reinterpret_cast<int32_t*>(&m_lock), FUTEX_WAIT, 2, nullptr, nullptr, 0);
+            expected = m_lock.exchange(2, AK::memory_order_acquire);
         }
-        donate(m_holder);
     }
+    m_holder.store(tid, AK::memory_order_relaxed);
+    m_level = 1;
 }
 
 inline void Lock::unlock()
 {
-    for (;;) {
-        bool expected = false;
-        if (m_lock.compare_exchange_strong(expected, true, AK::memory_order_acq_rel)) {
-            ASSERT(m_holder == gettid());
-            ASSERT(m_level);
-            --m_level;
-            if (m_level) {
-                m_lock.store(false, AK::memory_order_release);
-                return;
-            }
-            m_holder = -1;
-            m_lock.store(false, AK::memory_order_release);
-            return;
-        }
-        donate(m_holder);
-    }
+    ASSERT(m_holder.load(AK::memory_order_relaxed) == gettid());
+    ASSERT(m_level);
+    if (--m_level)
+        return;
+    m_holder.store(-1, AK::memory_order_relaxed);
+    if (m_lock.exchange(0, AK::memory_order_release) == 2)
+        futex(reinterpret_cast<int32_t*>(&m_lock), FUTEX_WAKE, 1, nullptr, nullptr, 0);
 }
 
 #define LOCKER(lock) LibThread::Locker locker(lock)
@@ -28,6 +28,7 @@
 #include <AK/JsonObject.h>
 #include <AK/JsonValue.h>
 #include <AK/Optional.h>
+#include <AK/StringBuilder.h>
 #include <LibCore/ArgsParser.h>
 #include <LibCore/File.h>
 #include <fcntl.h>
@@ -35,9 +36,11 @@
 #include <string.h>
 #include <unistd.h>
 
-int parse_options(const StringView& options)
+// Options with a value (e.g. disk_cache_size=N) are file system specific, and passed on to the kernel in data.
+int parse_options(const StringView& options, String& data)
 {
     int flags = 0;
+    StringBuilder data_builder;
     Vector<StringView> parts = options.split_view(',');
     for (auto& part : parts) {
         if (part == "defaults")
@@ -50,9 +53,14 @@ int parse_options(const StringView& options)
             flags |= MS_NOSUID;
         else if (part == "bind")
             flags |= MS_BIND;
-        else
+        else if (String(part).contains("=")) {
+            if (!data_builder.is_empty())
+                data_builder.append(',');
+            data_builder.append(part);
+        } else
             fprintf(stderr, "Ignoring invalid option: %s\n", String(part).characters());
     }
+    data = data_builder.to_string();
     return flags;
 }
 
@@ -111,7 +119,8 @@ bool mount_all()
 
         const char* mountpoint = parts[1].characters();
         const char* fstype = parts[2].characters();
-        int flags = parts.size() >= 4 ? parse_options(parts[3]) : 0;
+        String data;
+        int flags = parts.size() >= 4 ? parse_options(parts[3], data) : 0;
 
         if (strcmp(mountpoint, "/") == 0) {
             dbg() << "Skipping mounting root";
@@ -124,7 +133,7 @@ bool mount_all()
 
         dbg() << "Mounting " << filename << "(" << fstype << ")"
               << " on " << mountpoint;
-        int rc = mount(fd, mountpoint, fstype, flags);
+        int rc = mount(fd, mountpoint, fstype, flags, data.characters());
         if (rc != 0) {
             fprintf(stderr, "Failed to mount %s (FD: %d) (%s) on %s: %s\n", filename, fd, fstype, mountpoint, strerror(errno));
             all_ok = false;
@@ -203,11 +212,12 @@ int main(int argc, char** argv)
     if (source && mountpoint) {
         if (!fs_type)
             fs_type = "ext2";
-        int flags = options ? parse_options(options) : 0;
+        String data;
+        int flags = options ? parse_options(options, data) : 0;
 
         int fd = get_source_fd(source);
 
-        if (mount(fd, mountpoint, fs_type, flags) < 0) {
+        if (mount(fd, mountpoint, fs_type, flags, data.characters()) < 0) {
             perror("mount");
             return 1;
         }
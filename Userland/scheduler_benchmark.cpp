@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018-2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Vector.h>
+#include <LibCore/ArgsParser.h>
+#include <LibCore/ElapsedTimer.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Measures how quickly the scheduler can switch between a number of threads that do nothing but yield,
+// and how evenly the CPU is shared between them.
+
+struct YieldingThread {
+    pthread_t thread_id;
+    volatile u64 yield_count { 0 };
+};
+
+static volatile bool s_should_stop;
+
+static void* yield_loop(void* context)
+{
+    auto& thread = *reinterpret_cast<YieldingThread*>(context);
+    while (!s_should_stop) {
+        sched_yield();
+        ++thread.yield_count;
+    }
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    int thread_count = 8;
+    int seconds = 5;
+
+    Core::ArgsParser args_parser;
+    args_parser.add_option(thread_count, "Number of yielding threads", "threads", 't', "count");
+    args_parser.add_option(seconds, "How long to run for", "seconds", 's', "seconds");
+    args_parser.parse(argc, argv);
+
+    if (thread_count <= 0 || seconds <= 0) {
+        fprintf(stderr, "scheduler_benchmark: Thread count and duration must be positive\n");
+        return 1;
+    }
+
+    Vector<YieldingThread> threads;
+    threads.resize(thread_count);
+
+    printf("Running: threads=%d seconds=%d\n", thread_count, seconds);
+    Core::ElapsedTimer timer;
+    timer.start();
+
+    for (auto& thread : threads) {
+        if (pthread_create(&thread.thread_id, nullptr, yield_loop, &thread) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    sleep(seconds);
+    s_should_stop = true;
+
+    for (auto& thread : threads)
+        pthread_join(thread.thread_id, nullptr);
+
+    int elapsed_ms = timer.elapsed();
+
+    u64 total_yields = 0;
+    u64 min_yields = threads[0].yield_count;
+    u64 max_yields = threads[0].yield_count;
+    for (auto& thread : threads) {
+        u64 yield_count = thread.yield_count;
+        total_yields += yield_count;
+        min_yields = min(min_yields, yield_count);
+        max_yields = max(max_yields, yield_count);
+    }
+
+    printf("Finished: time=%dms yields=%llu yields_per_second=%llu\n", elapsed_ms, total_yields, elapsed_ms ? total_yields * 1000 / elapsed_ms : total_yields);
+    printf("Per thread: min=%llu max=%llu\n", min_yields, max_yields);
+    return 0;
+}
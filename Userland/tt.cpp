@@ -29,6 +29,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static int mutex_test();
@@ -36,6 +37,7 @@ static int detached_test();
 static int priority_test();
 static int stack_size_test();
 static int set_stack_test();
+static int condvar_test();
 
 int main(int argc, char** argv)
 {
@@ -49,6 +51,8 @@ int main(int argc, char** argv)
         return stack_size_test();
     if (argc == 2 && *argv[1] == 'x')
         return set_stack_test();
+    if (argc == 2 && *argv[1] == 'c')
+        return condvar_test();
 
     printf("Hello from the first thread!\n");
     pthread_t thread_id;
@@ -348,3 +352,65 @@ int set_stack_test()
 
     return 0;
 }
+
+static pthread_mutex_t condvar_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condvar = PTHREAD_COND_INITIALIZER;
+static int condvar_waiting_threads;
+static bool condvar_go;
+
+int condvar_test()
+{
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += 100000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&condvar_mutex);
+    int rc = pthread_cond_timedwait(&condvar, &condvar_mutex, &deadline);
+    pthread_mutex_unlock(&condvar_mutex);
+    if (rc != ETIMEDOUT) {
+        printf("Expected pthread_cond_timedwait to time out, got %d\n", rc);
+        return 1;
+    }
+    printf("pthread_cond_timedwait timed out as expected\n");
+
+    const int thread_count = 4;
+    pthread_t thread_ids[thread_count];
+    for (int i = 0; i < thread_count; ++i) {
+        rc = pthread_create(
+            &thread_ids[i], nullptr, [](void*) -> void* {
+                pthread_mutex_lock(&condvar_mutex);
+                ++condvar_waiting_threads;
+                while (!condvar_go)
+                    pthread_cond_wait(&condvar, &condvar_mutex);
+                --condvar_waiting_threads;
+                pthread_mutex_unlock(&condvar_mutex);
+                return nullptr;
+            },
+            nullptr);
+        if (rc != 0) {
+            printf("pthread_create: %s\n", strerror(rc));
+            return 2;
+        }
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&condvar_mutex);
+        bool all_waiting = condvar_waiting_threads == thread_count;
+        if (all_waiting) {
+            condvar_go = true;
+            pthread_cond_broadcast(&condvar);
+        }
+        pthread_mutex_unlock(&condvar_mutex);
+        if (all_waiting)
+            break;
+        usleep(10000);
+    }
+
+    for (int i = 0; i < thread_count; ++i)
+        pthread_join(thread_ids[i], nullptr);
+    printf("All %d threads woke up from the broadcast\n", thread_count);
+    return 0;
+}